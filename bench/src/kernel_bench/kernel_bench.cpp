@@ -0,0 +1,2310 @@
+#include "kernel_bench.hpp"
+#include "../../../libs/util/stopwatch.hpp"
+#include "../../../libs/stb_libs/qsprintf.hpp"
+#include "../../../libs/thread_pool/thread_pool.hpp"
+#include "../../../libs/video/motion.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#ifdef BENCH_SWSCALE
+extern "C"
+{
+#include <libswscale/swscale.h>
+}
+#endif
+
+
+/* data */
+
+namespace kernel_bench
+{
+    namespace img = image;
+
+
+    constexpr u32 WIDTH_4K = 3840;
+    constexpr u32 HEIGHT_4K = 2160;
+
+    constexpr u32 WIDTH_1080P = 1920;
+    constexpr u32 HEIGHT_1080P = 1080;
+
+    constexpr u32 WIDTH_720P = 1280;
+    constexpr u32 HEIGHT_720P = 720;
+
+    constexpr u32 DISPLAY_WIDTH = 640;
+    constexpr u32 DISPLAY_HEIGHT = 360;
+
+    constexpr u32 PROCESS_WIDTH = DISPLAY_WIDTH / 2;
+    constexpr u32 PROCESS_HEIGHT = DISPLAY_HEIGHT / 2;
+
+    constexpr u32 SPAN_BYTES_MAX = 32 * 1024 * 1024;
+
+
+    class BenchData
+    {
+    public:
+        img::Buffer32 buffer32;
+        img::Buffer8 buffer8;
+        img::Buffer64 buffer64;
+    };
+
+
+    static void destroy(BenchData& data)
+    {
+        mb::destroy_buffer(data.buffer32);
+        mb::destroy_buffer(data.buffer8);
+        mb::destroy_buffer(data.buffer64);
+    }
+
+
+    static bool create(BenchData& data)
+    {
+        u32 n_pixels32 = 2 * WIDTH_4K * HEIGHT_4K;
+        u32 n_bytes8 = 2 * SPAN_BYTES_MAX;
+        u32 n_words64 = 2 * img::bit_mask_row_words(WIDTH_4K) * HEIGHT_4K;
+
+        data.buffer32 = img::create_buffer32(n_pixels32, "bench 32");
+        if (!data.buffer32.ok)
+        {
+            return false;
+        }
+
+        data.buffer8 = img::create_buffer8(n_bytes8, "bench 8");
+        if (!data.buffer8.ok)
+        {
+            destroy(data);
+            return false;
+        }
+
+        data.buffer64 = img::create_buffer64(n_words64, "bench 64");
+        if (!data.buffer64.ok)
+        {
+            destroy(data);
+            return false;
+        }
+
+        return true;
+    }
+
+
+    static void reset(BenchData& data)
+    {
+        mb::reset_buffer(data.buffer32);
+        mb::reset_buffer(data.buffer8);
+        mb::reset_buffer(data.buffer64);
+    }
+
+
+    // keeps results of kernels that only return a value
+    static volatile u32 result_sink = 0;
+
+
+    static void fill_random(u8* dst, u64 len, u32 seed)
+    {
+        // xorshift32
+        u32 x = seed ? seed : 0x9E3779B9;
+
+        for (u64 i = 0; i < len; i++)
+        {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            dst[i] = (u8)x;
+        }
+    }
+
+
+    template <typename T>
+    static void fill_random(MatrixView2D<T> const& view, u32 seed)
+    {
+        fill_random((u8*)view.matrix_data_, (u64)view.width * view.height * sizeof(T), seed);
+    }
+
+
+    static void fill_mask(img::GrayView const& view, u32 density_pct, u32 seed)
+    {
+        fill_random(view, seed);
+
+        auto s = img::to_span(view);
+        auto limit = (u8)(255 * density_pct / 100);
+
+        for (u32 i = 0; i < s.length; i++)
+        {
+            s.data[i] = s.data[i] < limit ? 255 : 0;
+        }
+    }
+}
+
+
+/* motion */
+
+namespace kernel_bench
+{
+    // GradientMotion::update as separate full frame passes
+    class MotionPasses
+    {
+    public:
+        img::GrayView gray;
+        img::GrayView edges;
+        img::GrayView motion;
+
+        motion::GrayMotion mot;
+
+        img::AreaPlan plan;
+    };
+
+
+    static bool create(MotionPasses& mp, BenchData& data, u32 window)
+    {
+        mp.gray = img::make_view(PROCESS_WIDTH, PROCESS_HEIGHT, data.buffer8);
+        mp.edges = img::make_view(PROCESS_WIDTH, PROCESS_HEIGHT, data.buffer8);
+        mp.motion = img::make_view(PROCESS_WIDTH, PROCESS_HEIGHT, data.buffer8);
+
+        img::fill(mp.edges, 0);
+
+        return motion::create(mp.mot, PROCESS_WIDTH / 2, PROCESS_HEIGHT / 2, window);
+    }
+
+
+    static void destroy(MotionPasses& mp)
+    {
+        motion::destroy(mp.mot);
+        img::destroy_area_plan(mp.plan);
+    }
+
+
+    static void update(MotionPasses& mp, img::GrayView const& src, Rect2Du32 proc_scan_rect)
+    {
+        if (src.width % mp.gray.width || src.height % mp.gray.height)
+        {
+            img::resize_area(mp.plan, src, mp.gray);
+        }
+        else if (src.width == mp.gray.width)
+        {
+            span::copy(img::to_span(src), img::to_span(mp.gray));
+        }
+        else
+        {
+            img::scale_down(src, mp.gray);
+        }
+
+        img::gradients(mp.gray, mp.edges);
+        motion::update(mp.mot, mp.edges, proc_scan_rect, mp.motion);
+    }
+
+
+    // moving bright block on noise
+    static void fill_motion_frame(img::GrayView const& src, u32 frame)
+    {
+        fill_random(src, frame + 1);
+
+        auto r = img::make_rect(src.width / 8 + frame * src.width / 64, src.height / 4, src.width / 8, src.height / 4);
+        img::fill(img::sub_view(src, r), 255);
+    }
+}
+
+
+/* measure */
+
+namespace kernel_bench
+{
+    static bool is_selected(BenchOptions const& options, cstr name)
+    {
+        return !options.filter || std::strstr(name, options.filter);
+    }
+
+
+    template <class FN>
+    static BenchResult measure(BenchOptions const& options, cstr name, u64 n_pixels, u64 n_bytes, FN const& func)
+    {
+        static f64 samples[MAX_REPEATS] = { 0 };
+
+        auto repeats = options.repeats;
+        repeats = repeats < 1 ? 1 : (repeats > MAX_REPEATS ? MAX_REPEATS : repeats);
+
+        for (u32 i = 0; i < options.warmup; i++)
+        {
+            func();
+        }
+
+        Stopwatch sw;
+        for (u32 i = 0; i < repeats; i++)
+        {
+            sw.start();
+            func();
+            sw.stop();
+            samples[i] = sw.get_time_nano();
+        }
+
+        std::sort(samples, samples + repeats);
+
+        f64 total = 0.0;
+        for (u32 i = 0; i < repeats; i++)
+        {
+            total += samples[i];
+        }
+
+        BenchResult res{};
+        res.name = name;
+        res.n_pixels = n_pixels;
+        res.n_bytes = n_bytes;
+        res.repeats = repeats;
+        res.min_ns = samples[0];
+        res.max_ns = samples[repeats - 1];
+        res.mean_ns = total / repeats;
+        res.median_ns = (repeats % 2) ? samples[repeats / 2] : 0.5 * (samples[repeats / 2 - 1] + samples[repeats / 2]);
+
+        f64 var = 0.0;
+        for (u32 i = 0; i < repeats; i++)
+        {
+            auto d = samples[i] - res.mean_ns;
+            var += d * d;
+        }
+
+        res.stddev_ns = std::sqrt(var / repeats);
+
+        return res;
+    }
+
+
+    template <class FN>
+    static void run_bench(BenchOptions const& options, cstr name, u64 n_pixels, u64 n_bytes, FN const& func)
+    {
+        if (!is_selected(options, name))
+        {
+            return;
+        }
+
+        print_result(measure(options, name, n_pixels, n_bytes, func));
+    }
+
+
+    void print_header()
+    {
+        std::printf("%-40s %10s %10s %10s %10s %8s %9s %8s\n",
+            "kernel", "pixels", "min ms", "median ms", "max ms", "stdev %", "ns/pixel", "GB/s");
+    }
+
+
+    void print_result(BenchResult const& r)
+    {
+        constexpr f64 i_ms = 1.0 / 1'000'000.0;
+
+        auto stddev_pct = r.mean_ns > 0.0 ? 100.0 * r.stddev_ns / r.mean_ns : 0.0;
+        auto ns_px = r.n_pixels ? r.median_ns / r.n_pixels : 0.0;
+        auto gb_s = r.median_ns > 0.0 ? r.n_bytes / r.median_ns : 0.0; // bytes/ns == GB/s
+
+        std::printf("%-40s %10llu %10.3f %10.3f %10.3f %8.1f %9.3f %8.2f\n",
+            r.name, (unsigned long long)r.n_pixels,
+            r.min_ns * i_ms, r.median_ns * i_ms, r.max_ns * i_ms,
+            stddev_pct, ns_px, gb_s);
+    }
+}
+
+
+/* image kernels */
+
+namespace kernel_bench
+{
+    static void bench_scale_down(BenchData& data, BenchOptions const& options)
+    {
+        constexpr u32 scales[] = { 2, 3, 4, 6, 8 };
+
+        char name[64] = { 0 };
+
+        for (auto s : scales)
+        {
+            reset(data);
+
+            auto src = img::make_view(WIDTH_4K, HEIGHT_4K, data.buffer32);
+            auto dst = img::make_view(WIDTH_4K / s, HEIGHT_4K / s, data.buffer32);
+            fill_random(src, s);
+
+            u64 n_src = (u64)src.width * src.height;
+            u64 n_dst = (u64)dst.width * dst.height;
+
+            stb::qsnprintf(name, 64, "scale_down rgba 4K /%u", s);
+            run_bench(options, name, n_src, 4 * (n_src + n_dst), [&](){ img::scale_down(src, dst); });
+        }
+
+        for (auto s : scales)
+        {
+            reset(data);
+
+            auto src = img::make_view(WIDTH_4K, HEIGHT_4K, data.buffer8);
+            auto dst = img::make_view(WIDTH_4K / s, HEIGHT_4K / s, data.buffer8);
+            fill_random(src, s);
+
+            u64 n_src = (u64)src.width * src.height;
+            u64 n_dst = (u64)dst.width * dst.height;
+
+            stb::qsnprintf(name, 64, "scale_down gray 4K /%u", s);
+            run_bench(options, name, n_src, n_src + n_dst, [&](){ img::scale_down(src, dst); });
+        }
+    }
+
+
+    static void bench_scale_up(BenchData& data, BenchOptions const& options)
+    {
+        constexpr u32 scales[] = { 2, 3, 4, 6, 8 };
+
+        char name[64] = { 0 };
+
+        for (auto s : scales)
+        {
+            reset(data);
+
+            auto src = img::make_view(WIDTH_4K / s, HEIGHT_4K / s, data.buffer32);
+            auto dst = img::make_view(WIDTH_4K, HEIGHT_4K, data.buffer32);
+            fill_random(src, s);
+
+            u64 n_src = (u64)src.width * src.height;
+            u64 n_dst = (u64)dst.width * dst.height;
+
+            stb::qsnprintf(name, 64, "scale_up rgba x%u 4K", s);
+            run_bench(options, name, n_dst, 4 * (n_src + n_dst), [&](){ img::scale_up(src, dst); });
+        }
+
+        for (auto s : scales)
+        {
+            reset(data);
+
+            auto src = img::make_view(WIDTH_4K / s, HEIGHT_4K / s, data.buffer8);
+            auto dst = img::make_view(WIDTH_4K, HEIGHT_4K, data.buffer8);
+            fill_random(src, s);
+
+            u64 n_src = (u64)src.width * src.height;
+            u64 n_dst = (u64)dst.width * dst.height;
+
+            stb::qsnprintf(name, 64, "scale_up gray x%u 4K", s);
+            run_bench(options, name, n_dst, n_src + n_dst, [&](){ img::scale_up(src, dst); });
+        }
+    }
+
+
+    static void bench_resize(BenchData& data, BenchOptions const& options)
+    {
+        {
+            reset(data);
+
+            auto src = img::make_view(WIDTH_4K, HEIGHT_4K, data.buffer32);
+            auto dst = img::make_view(DISPLAY_WIDTH, DISPLAY_HEIGHT, data.buffer32);
+            fill_random(src, 1);
+
+            u64 n_src = (u64)src.width * src.height;
+            u64 n_dst = (u64)dst.width * dst.height;
+
+            run_bench(options, "resize rgba 4K -> 360p", n_src, 4 * (n_src + n_dst), [&](){ img::resize(src, dst); });
+
+            img::ResizePlan plan{};
+            run_bench(options, "resize plan rgba 4K -> 360p", n_src, 4 * (n_src + n_dst), [&](){ img::resize(plan, src, dst); });
+            img::destroy_resize_plan(plan);
+        }
+        {
+            // preview path: out image to letterboxed display sub view
+            reset(data);
+
+            auto src = img::make_view(WIDTH_720P, HEIGHT_720P, data.buffer32);
+            auto display = img::make_view(DISPLAY_WIDTH, DISPLAY_HEIGHT, data.buffer32);
+            auto dst = img::sub_view(display, img::make_rect(0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT));
+            fill_random(src, 2);
+
+            u64 n_src = (u64)src.width * src.height;
+            u64 n_dst = (u64)dst.width * dst.height;
+
+            run_bench(options, "resize rgba 720p -> 360p sub view", n_src, 4 * (n_src + n_dst), [&](){ img::resize(src, dst); });
+
+            img::ResizePlan plan{};
+            run_bench(options, "resize plan rgba 720p -> 360p sub view", n_src, 4 * (n_src + n_dst), [&](){ img::resize(plan, src, dst); });
+            img::destroy_resize_plan(plan);
+        }
+        {
+            reset(data);
+
+            auto src = img::make_view(WIDTH_4K, HEIGHT_4K, data.buffer8);
+            auto dst = img::make_view(PROCESS_WIDTH, PROCESS_HEIGHT, data.buffer8);
+            fill_random(src, 3);
+
+            u64 n_src = (u64)src.width * src.height;
+            u64 n_dst = (u64)dst.width * dst.height;
+
+            run_bench(options, "resize gray 4K -> 180p", n_src, n_src + n_dst, [&](){ img::resize(src, dst); });
+
+            img::ResizePlan plan{};
+            run_bench(options, "resize plan gray 4K -> 180p", n_src, n_src + n_dst, [&](){ img::resize(plan, src, dst); });
+            img::destroy_resize_plan(plan);
+
+            img::AreaPlan area{};
+            run_bench(options, "resize area gray 4K -> 180p", n_src, n_src + n_dst, [&](){ img::resize_area(area, src, dst); });
+            img::destroy_area_plan(area);
+
+            run_bench(options, "scale_down gray 4K -> 180p", n_src, n_src + n_dst, [&](){ img::scale_down(src, dst); });
+        }
+        {
+            reset(data);
+
+            // 2.7K action camera frames, a ratio of 8.45
+            auto src = img::make_view(2704, 1520, data.buffer8);
+            auto dst = img::make_view(PROCESS_WIDTH, PROCESS_HEIGHT, data.buffer8);
+            fill_random(src, 4);
+
+            u64 n_src = (u64)src.width * src.height;
+            u64 n_dst = (u64)dst.width * dst.height;
+
+            img::ResizePlan plan{};
+            run_bench(options, "resize plan gray 2.7K -> 180p", n_src, n_src + n_dst, [&](){ img::resize(plan, src, dst); });
+            img::destroy_resize_plan(plan);
+
+            img::AreaPlan area{};
+            run_bench(options, "resize area gray 2.7K -> 180p", n_src, n_src + n_dst, [&](){ img::resize_area(area, src, dst); });
+            img::destroy_area_plan(area);
+        }
+        {
+            reset(data);
+
+            auto src = img::make_view(WIDTH_4K, HEIGHT_4K, data.buffer32);
+            auto dst = img::make_view(DISPLAY_WIDTH, DISPLAY_HEIGHT, data.buffer32);
+            fill_random(src, 5);
+
+            u64 n_src = (u64)src.width * src.height;
+            u64 n_dst = (u64)dst.width * dst.height;
+
+            img::AreaPlan area{};
+            run_bench(options, "resize area rgba 4K -> 360p", n_src, 4 * (n_src + n_dst), [&](){ img::resize_area(area, src, dst); });
+            img::destroy_area_plan(area);
+
+            run_bench(options, "scale_down rgba 4K -> 360p", n_src, 4 * (n_src + n_dst), [&](){ img::scale_down(src, dst); });
+        }
+    }
+
+
+    // motion and vfx views from one frame, each from the full frame or both from the pyramid
+    static void bench_pyramid(BenchData& data, BenchOptions const& options)
+    {
+        constexpr u32 widths[] = { WIDTH_1080P, 2704, WIDTH_4K };
+        constexpr u32 heights[] = { HEIGHT_1080P, 1520, HEIGHT_4K };
+        constexpr cstr labels[] = { "1080p", "2.7K", "4K" };
+
+        char name[64] = { 0 };
+
+        for (u32 i = 0; i < 3; i++)
+        {
+            reset(data);
+
+            auto frame = img::make_view(widths[i], heights[i], data.buffer8);
+            auto proc = img::make_view(PROCESS_WIDTH, PROCESS_HEIGHT, data.buffer8);
+            auto vfx = img::make_view(DISPLAY_WIDTH, DISPLAY_HEIGHT, data.buffer32);
+            fill_random(frame, i + 1);
+
+            u64 n = (u64)frame.width * frame.height;
+
+            img::AreaPlan proc_plan{};
+            img::AreaPlan vfx_plan{};
+            auto vfx_gray = img::make_view(DISPLAY_WIDTH, DISPLAY_HEIGHT, data.buffer8);
+
+            auto const separate = [&]()
+            {
+                if (frame.width % PROCESS_WIDTH)
+                {
+                    img::resize_area(proc_plan, frame, proc);
+                    img::resize_area(vfx_plan, frame, vfx_gray);
+                    img::map(vfx_gray, vfx);
+                }
+                else
+                {
+                    img::scale_down(frame, proc);
+                    img::map_scale_down(frame, vfx);
+                }
+            };
+
+            stb::qsnprintf(name, 64, "pyramid off, proc + vfx %s", labels[i]);
+            run_bench(options, name, n, n, separate);
+
+            img::ImagePyramid pyr{};
+            if (img::create_pyramid(pyr, frame, DISPLAY_WIDTH, DISPLAY_HEIGHT, 3))
+            {
+                auto const shared = [&]()
+                {
+                    img::reset_pyramid(pyr);
+                    result_sink = img::pyramid_level(pyr, 2).width;
+                    img::map(img::pyramid_level(pyr, 1), vfx);
+                };
+
+                stb::qsnprintf(name, 64, "pyramid on, proc + vfx %s", labels[i]);
+                run_bench(options, name, n, n, shared);
+            }
+
+            img::destroy_pyramid(pyr);
+            img::destroy_area_plan(proc_plan);
+            img::destroy_area_plan(vfx_plan);
+        }
+    }
+
+
+    static void bench_gradients(BenchData& data, BenchOptions const& options)
+    {
+        constexpr u32 widths[] = { PROCESS_WIDTH, DISPLAY_WIDTH, WIDTH_1080P };
+        constexpr u32 heights[] = { PROCESS_HEIGHT, DISPLAY_HEIGHT, HEIGHT_1080P };
+
+        char name[64] = { 0 };
+
+        for (u32 i = 0; i < 3; i++)
+        {
+            reset(data);
+
+            auto src = img::make_view(widths[i], heights[i], data.buffer8);
+            auto dst = img::make_view(widths[i], heights[i], data.buffer8);
+            fill_random(src, i + 1);
+
+            u64 n = (u64)src.width * src.height;
+
+            stb::qsnprintf(name, 64, "gradients %ux%u", widths[i], heights[i]);
+            run_bench(options, name, n, 2 * n, [&](){ img::gradients(src, dst); });
+        }
+    }
+
+
+    static void bench_centroid(BenchData& data, BenchOptions const& options)
+    {
+        constexpr u32 widths[] = { PROCESS_WIDTH / 2, DISPLAY_WIDTH, WIDTH_1080P };
+        constexpr u32 heights[] = { PROCESS_HEIGHT / 2, DISPLAY_HEIGHT, HEIGHT_1080P };
+
+        char name[64] = { 0 };
+
+        for (u32 i = 0; i < 3; i++)
+        {
+            reset(data);
+
+            auto src = img::make_view(widths[i], heights[i], data.buffer8);
+            fill_mask(src, 10, i + 1);
+
+            auto mask = img::make_bit_mask(widths[i], heights[i], data.buffer64);
+            img::to_bit_mask(src, mask);
+
+            u64 n = (u64)src.width * src.height;
+            u64 n_bits = (u64)mask.row_words * mask.height * sizeof(u64);
+
+            Point2Du32 pt = { src.width / 2, src.height / 2 };
+
+            stb::qsnprintf(name, 64, "centroid %ux%u", widths[i], heights[i]);
+            run_bench(options, name, n, n, [&](){ result_sink = img::centroid(src, pt, 0.98f).x; });
+
+            stb::qsnprintf(name, 64, "centroid bits %ux%u", widths[i], heights[i]);
+            run_bench(options, name, n, n_bits, [&](){ result_sink = img::centroid(mask, pt, 0.98f).x; });
+
+            auto r = img::make_rect(widths[i] / 4, heights[i] / 4, widths[i] / 2, heights[i] / 2);
+            auto sub = img::sub_view(src, r);
+            auto sub_mask = img::sub_view(mask, r);
+            n = (u64)sub.width * sub.height;
+
+            stb::qsnprintf(name, 64, "centroid sub view %ux%u", sub.width, sub.height);
+            run_bench(options, name, n, n, [&](){ result_sink = img::centroid(sub, pt, 0.98f).x; });
+
+            stb::qsnprintf(name, 64, "centroid bits sub view %ux%u", sub.width, sub.height);
+            run_bench(options, name, n, n / 8, [&](){ result_sink = img::centroid(sub_mask, pt, 0.98f).x; });
+        }
+    }
+
+
+    static void bench_morphology(BenchData& data, BenchOptions const& options)
+    {
+        constexpr u32 widths[] = { PROCESS_WIDTH / 2, PROCESS_WIDTH, WIDTH_1080P };
+        constexpr u32 heights[] = { PROCESS_HEIGHT / 2, PROCESS_HEIGHT, HEIGHT_1080P };
+
+        char name[64] = { 0 };
+
+        for (u32 i = 0; i < 3; i++)
+        {
+            reset(data);
+
+            auto gray = img::make_view(widths[i], heights[i], data.buffer8);
+            auto src = img::make_bit_mask(widths[i], heights[i], data.buffer64);
+            auto tmp = img::make_bit_mask(widths[i], heights[i], data.buffer64);
+            auto dst = img::make_bit_mask(widths[i], heights[i], data.buffer64);
+
+            fill_mask(gray, 10, i + 1);
+            img::to_bit_mask(gray, src);
+
+            u64 n = (u64)gray.width * gray.height;
+            u64 n_bytes = (u64)src.row_words * src.height * sizeof(u64);
+
+            for (u32 r : { 1, 3 })
+            {
+                stb::qsnprintf(name, 64, "erode r%u %ux%u", r, widths[i], heights[i]);
+                run_bench(options, name, n, 2 * n_bytes, [&](){ img::erode(src, dst, r); });
+
+                stb::qsnprintf(name, 64, "opening r%u %ux%u", r, widths[i], heights[i]);
+                run_bench(options, name, n, 4 * n_bytes, [&](){ img::opening(src, tmp, dst, r); });
+            }
+        }
+    }
+
+
+    static void bench_transform(BenchData& data, BenchOptions const& options)
+    {
+        reset(data);
+
+        auto gray = img::make_view(PROCESS_WIDTH, PROCESS_HEIGHT, data.buffer8);
+        auto motion = img::make_view(PROCESS_WIDTH, PROCESS_HEIGHT, data.buffer8);
+        auto dst = img::make_view(DISPLAY_WIDTH, DISPLAY_HEIGHT, data.buffer32);
+        fill_random(gray, 1);
+        fill_mask(motion, 10, 2);
+
+        u64 n_src = (u64)gray.width * gray.height;
+        u64 n_dst = (u64)dst.width * dst.height;
+
+        constexpr auto blue = img::to_pixel(0, 0, 255);
+
+        auto const gm = [](u8 g){ return img::to_pixel(g); };
+        auto const dm = [&](u8 d, u8 m){ return m ? blue : img::to_pixel(d); };
+
+        // the same lambdas called through std::function
+        fn<img::Pixel(u8)> const gm_fn = gm;
+        fn<img::Pixel(u8, u8)> const dm_fn = dm;
+
+        run_bench(options, "transform_scale_up gray 180p x2 fn", n_dst, n_src + 4 * n_dst,
+            [&](){ img::transform_scale_up(gray, dst, gm_fn); });
+
+        run_bench(options, "transform_scale_up gray 180p x2", n_dst, n_src + 4 * n_dst,
+            [&](){ img::transform_scale_up(gray, dst, gm); });
+
+        run_bench(options, "transform_scale_up gray+motion 180p x2 fn", n_dst, 2 * n_src + 4 * n_dst,
+            [&](){ img::transform_scale_up(gray, motion, dst, dm_fn); });
+
+        run_bench(options, "transform_scale_up gray+motion 180p x2", n_dst, 2 * n_src + 4 * n_dst,
+            [&](){ img::transform_scale_up(gray, motion, dst, dm); });
+    }
+
+
+    static void bench_map(BenchData& data, BenchOptions const& options)
+    {
+        {
+            reset(data);
+
+            auto src = img::make_view(WIDTH_4K, HEIGHT_4K, data.buffer8);
+            auto dst = img::make_view(DISPLAY_WIDTH, DISPLAY_HEIGHT, data.buffer32);
+            fill_random(src, 1);
+
+            u64 n_src = (u64)src.width * src.height;
+            u64 n_dst = (u64)dst.width * dst.height;
+
+            run_bench(options, "map_scale_down gray 4K /6", n_src, n_src + 4 * n_dst, [&](){ img::map_scale_down(src, dst); });
+        }
+        {
+            reset(data);
+
+            auto src = img::make_view(WIDTH_1080P, HEIGHT_1080P, data.buffer8);
+            auto dst = img::make_view(DISPLAY_WIDTH, DISPLAY_HEIGHT, data.buffer32);
+            fill_random(src, 2);
+
+            u64 n_src = (u64)src.width * src.height;
+            u64 n_dst = (u64)dst.width * dst.height;
+
+            run_bench(options, "map_scale_down gray 1080p /3", n_src, n_src + 4 * n_dst, [&](){ img::map_scale_down(src, dst); });
+        }
+    }
+
+
+    static void bench_copy(BenchData& data, BenchOptions const& options)
+    {
+        constexpr u32 widths[] = { WIDTH_720P, WIDTH_1080P };
+        constexpr u32 heights[] = { HEIGHT_720P, HEIGHT_1080P };
+
+        char name[64] = { 0 };
+
+        for (u32 i = 0; i < 2; i++)
+        {
+            reset(data);
+
+            auto src = img::make_view(WIDTH_4K, HEIGHT_4K, data.buffer32);
+            auto dst = img::make_view(widths[i], heights[i], data.buffer32);
+            fill_random(src, i + 1);
+
+            auto crop = img::sub_view(src, img::make_rect(WIDTH_4K / 3, HEIGHT_4K / 5, widths[i], heights[i]));
+
+            u64 n = (u64)dst.width * dst.height;
+
+            stb::qsnprintf(name, 64, "copy sub view 4K -> %ux%u", widths[i], heights[i]);
+            run_bench(options, name, n, 2 * 4 * n, [&](){ img::copy(crop, dst); });
+        }
+    }
+
+    // a 4K frame as decoded to rgba for the preview and vfx sizes
+    static void bench_map_yuv(BenchData& data, BenchOptions const& options)
+    {
+        constexpr auto space = img::YUVSpace::BT709_Limited;
+        constexpr u32 scales[] = { 2, 4, 6 };
+
+        char name[64] = { 0 };
+
+        reset(data);
+
+        auto i420 = img::make_i420(WIDTH_4K, HEIGHT_4K, data.buffer8);
+        auto nv12 = img::make_nv12(WIDTH_4K, HEIGHT_4K, data.buffer8);
+        auto rgba = img::make_view(WIDTH_4K, HEIGHT_4K, data.buffer32);
+        fill_random(i420.y.matrix_data_, img::yuv420_bytes(WIDTH_4K, HEIGHT_4K), 1);
+        fill_random(nv12.y.matrix_data_, img::yuv420_bytes(WIDTH_4K, HEIGHT_4K), 2);
+
+        u64 n = (u64)WIDTH_4K * HEIGHT_4K;
+        u64 n_yuv = img::yuv420_bytes(WIDTH_4K, HEIGHT_4K);
+
+        run_bench(options, "map i420 -> rgba 4K", n, n_yuv + 4 * n, [&](){ img::map(i420, rgba, space); });
+        run_bench(options, "map nv12 -> rgba 4K", n, n_yuv + 4 * n, [&](){ img::map(nv12, rgba, space); });
+
+        auto range = img::make_rect(WIDTH_4K / 3, HEIGHT_4K / 5, WIDTH_720P, HEIGHT_720P);
+        auto crop = img::make_view(WIDTH_720P, HEIGHT_720P, data.buffer32);
+
+        u64 n_crop = (u64)WIDTH_720P * HEIGHT_720P;
+
+        run_bench(options, "map nv12 range 4K -> 1280x720", n_crop, n_crop * 3 / 2 + 4 * n_crop,
+            [&](){ img::map(nv12, range, crop, space); });
+
+        for (auto sc : scales)
+        {
+            auto dst = img::make_view(WIDTH_4K / sc, HEIGHT_4K / sc, data.buffer32);
+
+            stb::qsnprintf(name, 64, "map_scale_down nv12 4K /%u", sc);
+            run_bench(options, name, n, n_yuv + 4 * n / (sc * sc), [&](){ img::map_scale_down(nv12, dst, space); });
+        }
+    }
+
+
+#ifdef BENCH_SWSCALE
+
+    // the same work with sws_scale, planes offset to the range as for a decoder crop
+    static void bench_sws(BenchOptions const& options, cstr name, img::NV12View const& src, Rect2Du32 const& range, img::ImageView const& dst, int flags)
+    {
+        auto w = (int)(range.x_end - range.x_begin);
+        auto h = (int)(range.y_end - range.y_begin);
+
+        auto sws = sws_getContext(w, h, AV_PIX_FMT_NV12, (int)dst.width, (int)dst.height, AV_PIX_FMT_RGBA, flags, 0, 0, 0);
+        if (!sws)
+        {
+            return;
+        }
+
+        // bt.709 limited range in, full range out
+        auto coeffs = sws_getCoefficients(SWS_CS_ITU709);
+        sws_setColorspaceDetails(sws, coeffs, 0, coeffs, 1, 0, 1 << 16, 1 << 16);
+
+        u8 const* src_data[] = { img::xy_at(src.y, range.x_begin, range.y_begin), (u8*)img::xy_at(src.uv, range.x_begin / 2, range.y_begin / 2) };
+        int src_stride[] = { (int)src.y.matrix_width, (int)(2 * src.uv.matrix_width) };
+        u8* dst_data[] = { (u8*)dst.matrix_data_ };
+        int dst_stride[] = { (int)(4 * dst.width) };
+
+        u64 n = (u64)w * h;
+        u64 n_dst = (u64)dst.width * dst.height;
+
+        run_bench(options, name, n, n * 3 / 2 + 4 * n_dst, [&](){ sws_scale(sws, src_data, src_stride, 0, h, dst_data, dst_stride); });
+
+        sws_freeContext(sws);
+    }
+
+
+    static void bench_map_yuv_sws(BenchData& data, BenchOptions const& options)
+    {
+        reset(data);
+
+        auto nv12 = img::make_nv12(WIDTH_4K, HEIGHT_4K, data.buffer8);
+        auto rgba = img::make_view(WIDTH_4K, HEIGHT_4K, data.buffer32);
+        fill_random(nv12.y.matrix_data_, img::yuv420_bytes(WIDTH_4K, HEIGHT_4K), 2);
+
+        auto full = img::make_rect(WIDTH_4K, HEIGHT_4K);
+        auto range = img::make_rect(WIDTH_4K / 3 & ~1u, HEIGHT_4K / 5 & ~1u, WIDTH_720P, HEIGHT_720P);
+        auto crop = img::make_view(WIDTH_720P, HEIGHT_720P, data.buffer32);
+        auto half = img::make_view(WIDTH_4K / 2, HEIGHT_4K / 2, data.buffer32);
+        auto quarter = img::make_view(WIDTH_4K / 4, HEIGHT_4K / 4, data.buffer32);
+
+        bench_sws(options, "sws_scale nv12 -> rgba 4K", nv12, full, rgba, SWS_POINT);
+        bench_sws(options, "sws_scale nv12 range 4K -> 1280x720", nv12, range, crop, SWS_POINT);
+        bench_sws(options, "sws_scale nv12 4K /2 area", nv12, full, half, SWS_AREA);
+        bench_sws(options, "sws_scale nv12 4K /4 area", nv12, full, quarter, SWS_AREA);
+    }
+
+#endif
+
+
+    static void bench_yuv(BenchData& data, BenchOptions const& options)
+    {
+        constexpr auto space = img::YUVSpace::BT709_Limited;
+
+        {
+            reset(data);
+
+            auto i420 = img::make_i420(WIDTH_1080P, HEIGHT_1080P, data.buffer8);
+            auto nv12 = img::make_nv12(WIDTH_1080P, HEIGHT_1080P, data.buffer8);
+            auto rgba = img::make_view(WIDTH_1080P, HEIGHT_1080P, data.buffer32);
+            fill_random(i420.y.matrix_data_, img::yuv420_bytes(WIDTH_1080P, HEIGHT_1080P), 1);
+            fill_random(nv12.y.matrix_data_, img::yuv420_bytes(WIDTH_1080P, HEIGHT_1080P), 2);
+
+            u64 n = (u64)rgba.width * rgba.height;
+            u64 n_yuv = img::yuv420_bytes(rgba.width, rgba.height);
+
+            run_bench(options, "map rgba -> nv12 1080p", n, n_yuv + 4 * n, [&](){ img::map(rgba, nv12, space); });
+        }
+        {
+            reset(data);
+
+            auto src = img::make_nv12(WIDTH_4K, HEIGHT_4K, data.buffer8);
+            auto dst = img::make_nv12(WIDTH_4K / 2, HEIGHT_4K / 2, data.buffer8);
+            fill_random(src.y.matrix_data_, img::yuv420_bytes(WIDTH_4K, HEIGHT_4K), 3);
+
+            u64 n_src = (u64)src.width * src.height;
+            u64 n_bytes = img::yuv420_bytes(src.width, src.height) + img::yuv420_bytes(dst.width, dst.height);
+
+            run_bench(options, "scale_down nv12 4K /2", n_src, n_bytes, [&](){ img::scale_down(src, dst); });
+
+            auto crop = img::sub_view(src, img::make_rect(WIDTH_4K / 3 & ~1u, HEIGHT_4K / 5 & ~1u, WIDTH_1080P, HEIGHT_1080P));
+            auto crop_dst = img::make_nv12(WIDTH_1080P, HEIGHT_1080P, data.buffer8);
+
+            u64 n = (u64)WIDTH_1080P * HEIGHT_1080P;
+
+            run_bench(options, "copy sub view nv12 4K -> 1920x1080", n, 2 * img::yuv420_bytes(WIDTH_1080P, HEIGHT_1080P),
+                [&](){ img::copy(crop, crop_dst); });
+        }
+    }
+}
+
+
+/* span kernels */
+
+namespace kernel_bench
+{
+    static void bench_span(BenchData& data, BenchOptions const& options)
+    {
+        constexpr u32 sizes[] = { 4 * 1024, 256 * 1024, 4 * 1024 * 1024, SPAN_BYTES_MAX };
+
+        char name[64] = { 0 };
+
+        for (auto n : sizes)
+        {
+            reset(data);
+
+            auto src = span::push_span(data.buffer8, n);
+            auto dst = span::push_span(data.buffer8, n);
+            fill_random(src.data, n, n);
+
+            stb::qsnprintf(name, 64, "span::copy_u8 %u KiB", n / 1024);
+            run_bench(options, name, n, 2 * (u64)n, [&](){ span::copy_u8(src.data, dst.data, n); });
+        }
+
+        for (auto n : sizes)
+        {
+            reset(data);
+
+            auto dst = span::push_span(data.buffer8, n);
+            auto len = n / 4;
+
+            stb::qsnprintf(name, 64, "span::fill_u32 %u KiB", n / 1024);
+            run_bench(options, name, len, n, [&](){ span::fill_u32((u32*)dst.data, 0xFF00FF00, len); });
+        }
+    }
+}
+
+
+namespace kernel_bench
+{
+    static void bench_motion(BenchData& data, BenchOptions const& options)
+    {
+        constexpr u32 widths[] = { WIDTH_1080P, 2704, WIDTH_4K };
+        constexpr u32 heights[] = { HEIGHT_1080P, 1520, HEIGHT_4K };
+        constexpr cstr labels[] = { "1080p", "2.7K", "4K" };
+
+        char name[64] = { 0 };
+
+        for (u32 i = 0; i < 3; i++)
+        {
+            reset(data);
+
+            auto src = img::make_view(widths[i], heights[i], data.buffer8);
+            fill_motion_frame(src, i);
+
+            auto proc_rect = img::make_rect(PROCESS_WIDTH, PROCESS_HEIGHT);
+            auto src_rect = img::make_rect(widths[i], heights[i]);
+
+            u64 n = (u64)src.width * src.height;
+
+            MotionPasses mp{};
+            motion::GradientMotion gm{};
+            if (!create(mp, data, 8) || !motion::create(gm, PROCESS_WIDTH, PROCESS_HEIGHT))
+            {
+                destroy(mp);
+                motion::destroy(gm);
+                continue;
+            }
+
+            stb::qsnprintf(name, 64, "motion separate passes %s", labels[i]);
+            run_bench(options, name, n, n, [&](){ update(mp, src, proc_rect); });
+
+            stb::qsnprintf(name, 64, "motion fused %s", labels[i]);
+            run_bench(options, name, n, n, [&](){ motion::update(gm, src, src_rect); });
+
+            gm.write_proc_views = true;
+
+            stb::qsnprintf(name, 64, "motion fused + views %s", labels[i]);
+            run_bench(options, name, n, n, [&](){ motion::update(gm, src, src_rect); });
+
+            destroy(mp);
+            motion::destroy(gm);
+        }
+    }
+
+
+    // history update, threshold and centroid per window at a full frame
+    static void bench_motion_window(BenchData& data, BenchOptions const& options)
+    {
+        char name[64] = { 0 };
+
+        reset(data);
+
+        auto src = img::make_view(WIDTH_1080P, HEIGHT_1080P, data.buffer8);
+        fill_motion_frame(src, 0);
+
+        u64 n = (u64)src.width * src.height;
+
+        for (u32 window : { 4, 8, 16, 32 })
+        {
+            motion::GrayMotion mot{};
+            if (!motion::create(mot, src.width, src.height, window))
+            {
+                motion::destroy(mot);
+                continue;
+            }
+
+            stb::qsnprintf(name, 64, "motion window %u 1080p", window);
+            run_bench(options, name, n, 4 * n, [&](){ motion::update(mot, src); });
+
+            motion::destroy(mot);
+        }
+    }
+}
+
+
+/* verify */
+
+namespace kernel_bench
+{
+    template <typename T>
+    static bool equal(MatrixView2D<T> const& a, MatrixView2D<T> const& b)
+    {
+        auto n_bytes = (u64)a.width * a.height * sizeof(T);
+        return std::memcmp(a.matrix_data_, b.matrix_data_, n_bytes) == 0;
+    }
+
+
+    // runs fn with the scalar kernels into ref and with level into dst
+    template <typename T, class FN>
+    static bool verify_level(cpu::SIMD level, MatrixView2D<T> const& ref, MatrixView2D<T> const& dst, FN const& fn)
+    {
+        img::set_simd(cpu::SIMD::None);
+        fn(ref);
+
+        img::set_simd(level);
+        fn(dst);
+
+        return equal(ref, dst);
+    }
+
+
+    // simd kernels must match the scalar output exactly
+    static bool verify_simd(BenchData& data, cpu::SIMD level)
+    {
+        // odd sizes for the vector tails, wide enough for several row chunks
+        constexpr u32 dst_w = 701;
+        constexpr u32 dst_h = 9;
+        constexpr u32 SCALE_MAX = 16;
+
+        char name[64] = { 0 };
+
+        u32 n_fail = 0;
+
+        auto const check = [&](bool ok, cstr kernel, u32 s)
+        {
+            if (!ok)
+            {
+                stb::qsnprintf(name, 64, "%s %u", kernel, s);
+                std::printf("verify %s: %s does not match scalar\n", cpu::to_cstr(level), name);
+                n_fail++;
+            }
+        };
+
+        for (u32 s = 2; s <= SCALE_MAX; s++)
+        {
+            reset(data);
+
+            auto big = img::make_view(dst_w * s, dst_h * s, data.buffer32);
+            auto small = img::make_view(dst_w, dst_h, data.buffer32);
+            auto ref = img::make_view(dst_w * s, dst_h * s, data.buffer32);
+            auto down_dst = img::make_view(dst_w, dst_h, data.buffer32);
+            auto down_ref = img::make_view(dst_w, dst_h, data.buffer32);
+            fill_random(big, s);
+            fill_random(small, s + 100);
+
+            auto down = [&](img::ImageView const& dst){ img::scale_down(big, dst); };
+            auto up = [&](img::ImageView const& dst){ img::scale_up(small, dst); };
+
+            check(verify_level(level, down_ref, down_dst, down), "scale_down rgba", s);
+            check(verify_level(level, ref, big, up), "scale_up rgba", s);
+        }
+
+        for (u32 s = 2; s <= SCALE_MAX; s++)
+        {
+            reset(data);
+
+            auto big = img::make_view(dst_w * s, dst_h * s, data.buffer8);
+            auto small = img::make_view(dst_w, dst_h, data.buffer8);
+            auto ref = img::make_view(dst_w * s, dst_h * s, data.buffer8);
+            auto down_dst = img::make_view(dst_w, dst_h, data.buffer8);
+            auto down_ref = img::make_view(dst_w, dst_h, data.buffer8);
+            fill_random(big, s);
+            fill_random(small, s + 100);
+
+            auto down = [&](img::GrayView const& dst){ img::scale_down(big, dst); };
+            auto up = [&](img::GrayView const& dst){ img::scale_up(small, dst); };
+
+            check(verify_level(level, down_ref, down_dst, down), "scale_down gray", s);
+            check(verify_level(level, ref, big, up), "scale_up gray", s);
+        }
+
+        for (u32 s = 2; s <= 8; s++)
+        {
+            reset(data);
+
+            auto src = img::make_view(dst_w * s, dst_h * s, data.buffer8);
+            auto dst = img::make_view(dst_w, dst_h, data.buffer32);
+            auto ref = img::make_view(dst_w, dst_h, data.buffer32);
+            fill_random(src, s);
+
+            auto map = [&](img::ImageView const& d){ img::map_scale_down(src, d); };
+
+            check(verify_level(level, ref, dst, map), "map_scale_down", s);
+        }
+
+        // ratios that are not integers
+        for (u32 s = 1; s <= SCALE_MAX; s += 5)
+        {
+            reset(data);
+
+            img::AreaPlan plan{};
+
+            auto src = img::make_view(dst_w * s + 37, dst_h * s + 5, data.buffer32);
+            auto dst = img::make_view(dst_w, dst_h, data.buffer32);
+            auto ref = img::make_view(dst_w, dst_h, data.buffer32);
+            fill_random(src, s);
+
+            auto area = [&](img::ImageView const& d){ img::resize_area(plan, src, d); };
+
+            check(verify_level(level, ref, dst, area), "resize_area rgba", s);
+
+            auto gray = img::make_view(dst_w * s + 37, dst_h * s + 5, data.buffer8);
+            auto gray_dst = img::make_view(dst_w, dst_h, data.buffer8);
+            auto gray_ref = img::make_view(dst_w, dst_h, data.buffer8);
+            fill_random(gray, s);
+
+            auto gray_area = [&](img::GrayView const& d){ img::resize_area(plan, gray, d); };
+
+            check(verify_level(level, gray_ref, gray_dst, gray_area), "resize_area gray", s);
+
+            img::destroy_area_plan(plan);
+        }
+
+        // yuv to rgba, ranges that begin on odd pixels and even scales
+        for (u32 s = 2; s <= SCALE_MAX; s += 2)
+        {
+            reset(data);
+
+            auto i420 = img::make_i420(dst_w * s + 1, dst_h * s + 1, data.buffer8);
+            auto nv12 = img::make_nv12(dst_w * s + 1, dst_h * s + 1, data.buffer8);
+            auto dst = img::make_view(dst_w, dst_h, data.buffer32);
+            auto ref = img::make_view(dst_w, dst_h, data.buffer32);
+            fill_random(i420.y.matrix_data_, img::yuv420_bytes(i420.width, i420.height), s);
+            fill_random(nv12.y.matrix_data_, img::yuv420_bytes(nv12.width, nv12.height), s + 100);
+
+            auto space = (img::YUVSpace)(s / 2 % 4);
+            auto range = img::make_rect(s - 1, s + 1, dst_w, dst_h);
+            auto box = img::make_rect(0, 0, dst_w * s, dst_h * s);
+
+            auto i420_map = [&](img::ImageView const& d){ img::map(i420, range, d, space); };
+            auto nv12_map = [&](img::ImageView const& d){ img::map(nv12, range, d, space); };
+            auto i420_down = [&](img::ImageView const& d){ img::map_scale_down(i420, box, d, space); };
+            auto nv12_down = [&](img::ImageView const& d){ img::map_scale_down(nv12, box, d, space); };
+
+            check(verify_level(level, ref, dst, i420_map), "map i420", s);
+            check(verify_level(level, ref, dst, nv12_map), "map nv12", s);
+            check(verify_level(level, ref, dst, i420_down), "map_scale_down i420", s);
+            check(verify_level(level, ref, dst, nv12_down), "map_scale_down nv12", s);
+        }
+
+        img::set_simd(cpu::simd_level());
+
+        std::printf("verify %s: %s\n", cpu::to_cstr(level), n_fail ? "FAIL" : "ok");
+
+        return n_fail == 0;
+    }
+}
+
+
+namespace kernel_bench
+{
+    // direct 25 tap f32 stencil
+    static u8 gradient_5x5(img::GrayView const& src, u32 x, u32 y)
+    {
+        static constexpr f32 kx[5][5] =
+        {
+            {   0.0f,   0.0f, 0.0f,  0.0f,  0.0f },
+            { -0.08f, -0.12f, 0.0f, 0.12f, 0.08f },
+            { -0.24f, -0.36f, 0.0f, 0.36f, 0.24f },
+            { -0.08f, -0.12f, 0.0f, 0.12f, 0.08f },
+            {   0.0f,   0.0f, 0.0f,  0.0f,  0.0f },
+        };
+
+        f32 gx = 0.0f;
+        f32 gy = 0.0f;
+
+        for (u32 v = 0; v < 5; v++)
+        {
+            for (u32 u = 0; u < 5; u++)
+            {
+                f32 p = img::row_begin(src, y + v - 2)[x + u - 2];
+                gx += p * kx[v][u];
+                gy += p * kx[u][v];
+            }
+        }
+
+        auto g = std::sqrt(gx * gx + gy * gy);
+        return (u8)(g < 255.0f ? g : 255.0f);
+    }
+
+
+    // separable fixed point result within 1 of the direct stencil
+    static bool verify_gradients(BenchData& data)
+    {
+        constexpr u32 w = 333;
+        constexpr u32 h = 47;
+
+        reset(data);
+
+        auto src = img::make_view(w, h, data.buffer8);
+        auto dst = img::make_view(w, h, data.buffer8);
+        fill_random(src, 7);
+
+        // flat areas, edges and noise
+        for (u32 y = 0; y < h; y++)
+        {
+            auto row = img::row_begin(src, y);
+            for (u32 x = 0; x < w / 3; x++)
+            {
+                row[x] = x < w / 6 ? 0 : 255;
+            }
+        }
+
+        img::gradients(src, dst);
+
+        u32 n_fail = 0;
+
+        for (u32 y = 2; y < h - 2; y++)
+        {
+            auto row = img::row_begin(dst, y);
+            for (u32 x = 2; x < w - 2; x++)
+            {
+                auto a = (i32)row[x];
+                auto b = (i32)gradient_5x5(src, x, y);
+                if (a - b > 1 || b - a > 1)
+                {
+                    n_fail++;
+                }
+            }
+        }
+
+        std::printf("verify gradients: %s\n", n_fail ? "FAIL" : "ok");
+
+        return n_fail == 0;
+    }
+
+
+    // the bit mask centroid must match the gray centroid with every kernel
+    static bool verify_centroid(BenchData& data)
+    {
+        constexpr u32 widths[] = { 160, 333, 1920 };
+        constexpr u32 heights[] = { 90, 47, 31 };
+        constexpr u32 densities[] = { 0, 1, 10, 50, 100 };
+
+        u32 n_fail = 0;
+
+        auto simd = cpu::simd_level();
+
+        for (u32 i = 0; i < 3; i++)
+        {
+            for (auto density : densities)
+            {
+                reset(data);
+
+                auto src = img::make_view(widths[i], heights[i], data.buffer8);
+                auto mask = img::make_bit_mask(widths[i], heights[i], data.buffer64);
+                fill_mask(src, density, i + density + 1);
+                img::to_bit_mask(src, mask);
+
+                // odd offsets for words split across the sub view
+                auto r = img::make_rect(widths[i] / 5 + 3, heights[i] / 4, widths[i] / 2 + 1, heights[i] / 2);
+
+                Point2Du32 pt = { 7, 5 };
+
+                for (u32 level = 0; level <= (u32)simd; level++)
+                {
+                    img::set_simd((cpu::SIMD)level);
+
+                    for (auto s : { 0.5f, 0.98f, 1.0f })
+                    {
+                        auto a = img::centroid(src, pt, s);
+                        auto b = img::centroid(mask, pt, s);
+                        n_fail += a.x != b.x || a.y != b.y;
+
+                        a = img::centroid(img::sub_view(src, r), pt, s);
+                        b = img::centroid(img::sub_view(mask, r), pt, s);
+                        n_fail += a.x != b.x || a.y != b.y;
+                    }
+                }
+
+                img::set_simd(simd);
+            }
+        }
+
+        std::printf("verify centroid: %s\n", n_fail ? "FAIL" : "ok");
+
+        return n_fail == 0;
+    }
+
+
+    // a plan gives the same result as a one off resize, also after the sizes change
+    static bool verify_resize_plan(BenchData& data)
+    {
+        reset(data);
+
+        u32 n_fail = 0;
+
+        img::ResizePlan plan{};
+
+        auto src = img::make_view(WIDTH_1080P, HEIGHT_1080P, data.buffer32);
+        auto ref = img::make_view(DISPLAY_WIDTH, DISPLAY_HEIGHT, data.buffer32);
+        auto dst = img::make_view(DISPLAY_WIDTH, DISPLAY_HEIGHT, data.buffer32);
+        fill_random(src, 4);
+
+        for (u32 i = 0; i < 3; i++)
+        {
+            auto r = img::make_rect(i * 100, i * 50, WIDTH_720P, HEIGHT_720P);
+            auto dst_r = img::make_rect(i * 20, 0, DISPLAY_WIDTH - i * 40, DISPLAY_HEIGHT - i * 20);
+
+            auto ref_sub = img::sub_view(ref, dst_r);
+            auto dst_sub = img::sub_view(dst, dst_r);
+
+            img::resize(img::sub_view(src, r), ref_sub);
+            img::resize(plan, img::sub_view(src, r), dst_sub);
+
+            n_fail += !equal(ref, dst);
+        }
+
+        img::destroy_resize_plan(plan);
+
+        auto gray = img::make_view(WIDTH_720P, HEIGHT_720P, data.buffer8);
+        auto gray_ref = img::make_view(PROCESS_WIDTH, PROCESS_HEIGHT, data.buffer8);
+        auto gray_dst = img::make_view(PROCESS_WIDTH, PROCESS_HEIGHT, data.buffer8);
+        fill_random(gray, 5);
+
+        img::resize(gray, gray_ref);
+        img::resize(plan, gray, gray_dst);
+        n_fail += !equal(gray_ref, gray_dst);
+
+        img::destroy_resize_plan(plan);
+
+        std::printf("verify resize plan: %s\n", n_fail ? "FAIL" : "ok");
+
+        return n_fail == 0;
+    }
+
+
+    // share of src pixel j in dst pixel i, in src pixels
+    static f64 area_overlap(u32 n_src, u32 n_dst, u32 i, u32 j)
+    {
+        f64 ratio = (f64)n_src / n_dst;
+
+        f64 lo = std::max(i * ratio, (f64)j);
+        f64 hi = std::min((i + 1) * ratio, (f64)(j + 1));
+
+        return hi > lo ? hi - lo : 0.0;
+    }
+
+
+    // each channel against the exact area average in f64, at most 1 off from rounding the weights
+    static u32 verify_area_pixels(u8 const* src, u32 src_w, u32 src_h, u8 const* dst, u32 dst_w, u32 dst_h, u32 ch)
+    {
+        f64 rx = (f64)src_w / dst_w;
+        f64 ry = (f64)src_h / dst_h;
+
+        u32 n_fail = 0;
+
+        for (u32 y = 0; y < dst_h; y++)
+        {
+            auto v_begin = (u32)(y * ry);
+            auto v_end = std::min((u32)std::ceil((y + 1) * ry), src_h);
+
+            for (u32 x = 0; x < dst_w; x++)
+            {
+                auto u_begin = (u32)(x * rx);
+                auto u_end = std::min((u32)std::ceil((x + 1) * rx), src_w);
+
+                for (u32 c = 0; c < ch; c++)
+                {
+                    f64 total = 0.0;
+                    for (u32 v = v_begin; v < v_end; v++)
+                    {
+                        auto wy = area_overlap(src_h, dst_h, y, v);
+                        for (u32 u = u_begin; u < u_end; u++)
+                        {
+                            total += wy * area_overlap(src_w, dst_w, x, u) * src[((u64)v * src_w + u) * ch + c];
+                        }
+                    }
+
+                    auto expected = total / (rx * ry);
+                    auto actual = dst[((u64)y * dst_w + x) * ch + c];
+
+                    n_fail += std::abs(actual - expected) > 1.0;
+                }
+            }
+        }
+
+        return n_fail;
+    }
+
+
+    // any ratio down and up, flat stays flat, tiles of rows match the full resize
+    static bool verify_resize_area(BenchData& data)
+    {
+        constexpr u32 src_w[] = { 2704, WIDTH_1080P, 1001, 97 };
+        constexpr u32 src_h[] = { 1520, HEIGHT_1080P, 699, 61 };
+        constexpr u32 dst_w[] = { PROCESS_WIDTH, PROCESS_WIDTH, 333, PROCESS_WIDTH };
+        constexpr u32 dst_h[] = { PROCESS_HEIGHT, PROCESS_HEIGHT, 211, PROCESS_HEIGHT };
+
+        u32 n_fail = 0;
+
+        img::AreaPlan plan{};
+
+        for (u32 i = 0; i < 4; i++)
+        {
+            reset(data);
+
+            auto src = img::make_view(src_w[i], src_h[i], data.buffer8);
+            auto dst = img::make_view(dst_w[i], dst_h[i], data.buffer8);
+            auto tiles = img::make_view(dst_w[i], dst_h[i], data.buffer8);
+            fill_random(src, i + 1);
+
+            img::resize_area(plan, src, dst);
+            n_fail += verify_area_pixels(src.matrix_data_, src.width, src.height, dst.matrix_data_, dst.width, dst.height, 1);
+
+            for (u32 y = 0; y < tiles.height; y += 7)
+            {
+                auto tile = tiles;
+                tile.matrix_data_ += (u64)y * tiles.width;
+                tile.height = std::min(7u, tiles.height - y);
+
+                img::resize_area_rows(plan, src, tile, y);
+            }
+
+            n_fail += !equal(dst, tiles);
+
+            img::fill(src, 200);
+            img::resize_area(plan, src, dst);
+
+            auto d = img::to_span(dst);
+            for (u32 p = 0; p < d.length; p++)
+            {
+                n_fail += d.data[p] != 200;
+            }
+
+            auto rgba = img::make_view(src_w[i], src_h[i], data.buffer32);
+            auto rgba_dst = img::make_view(dst_w[i], dst_h[i], data.buffer32);
+            fill_random(rgba, i + 10);
+
+            img::resize_area(plan, rgba, rgba_dst);
+            n_fail += verify_area_pixels((u8*)rgba.matrix_data_, rgba.width, rgba.height, (u8*)rgba_dst.matrix_data_, rgba_dst.width, rgba_dst.height, 4);
+        }
+
+        img::destroy_area_plan(plan);
+
+        std::printf("verify resize area: %s\n", n_fail ? "FAIL" : "ok");
+
+        return n_fail == 0;
+    }
+
+
+    // lazy levels match building every level in order, a reset frame is read again
+    static bool verify_pyramid(BenchData& data)
+    {
+        constexpr u32 widths[] = { WIDTH_1080P, 2704 };
+        constexpr u32 heights[] = { HEIGHT_1080P, 1520 };
+
+        u32 n_fail = 0;
+
+        for (u32 i = 0; i < 2; i++)
+        {
+            reset(data);
+
+            auto frame = img::make_view(widths[i], heights[i], data.buffer8);
+            auto l1 = img::make_view(DISPLAY_WIDTH, DISPLAY_HEIGHT, data.buffer8);
+            auto l2 = img::make_view(DISPLAY_WIDTH / 2, DISPLAY_HEIGHT / 2, data.buffer8);
+            auto l3 = img::make_view(DISPLAY_WIDTH / 4, DISPLAY_HEIGHT / 4, data.buffer8);
+
+            img::AreaPlan plan{};
+            img::ImagePyramid pyr{};
+
+            if (!img::create_pyramid(pyr, frame, DISPLAY_WIDTH, DISPLAY_HEIGHT, 4))
+            {
+                n_fail++;
+                continue;
+            }
+
+            for (u32 f = 0; f < 2; f++)
+            {
+                fill_random(frame, 10 * i + f + 1);
+
+                if (frame.width % DISPLAY_WIDTH)
+                {
+                    img::resize_area(plan, frame, l1);
+                }
+                else
+                {
+                    img::scale_down(frame, l1);
+                }
+
+                img::scale_down(l1, l2);
+                img::scale_down(l2, l3);
+
+                img::reset_pyramid(pyr);
+
+                // deepest first
+                n_fail += !equal(img::pyramid_level(pyr, 3), l3);
+                n_fail += !equal(img::pyramid_level(pyr, 1), l1);
+                n_fail += !equal(img::pyramid_level(pyr, 2), l2);
+                n_fail += img::pyramid_level(pyr, 0).matrix_data_ != frame.matrix_data_;
+            }
+
+            img::destroy_pyramid(pyr);
+            img::destroy_area_plan(plan);
+        }
+
+        std::printf("verify pyramid: %s\n", n_fail ? "FAIL" : "ok");
+
+        return n_fail == 0;
+    }
+
+
+    class YUVRef
+    {
+    public:
+        f64 kr;
+        f64 kb;
+        f64 kg;
+        f64 y_scale;
+        f64 c_scale;
+        f64 y_offset;
+    };
+
+
+    static YUVRef yuv_ref(img::YUVSpace space)
+    {
+        auto s = (u32)space;
+        auto full = s & 1;
+
+        YUVRef ref{};
+        ref.kr = s < 2 ? 0.299 : 0.2126;
+        ref.kb = s < 2 ? 0.114 : 0.0722;
+        ref.kg = 1.0 - ref.kr - ref.kb;
+        ref.y_scale = full ? 1.0 : 219.0 / 255.0;
+        ref.c_scale = full ? 1.0 : 224.0 / 255.0;
+        ref.y_offset = full ? 0.0 : 16.0;
+
+        return ref;
+    }
+
+
+    static u32 off_by_more_than_1(u8 actual, f64 expected)
+    {
+        expected = std::clamp(expected, 0.0, 255.0);
+        return std::abs(actual - expected) > 1.0;
+    }
+
+
+    // planes pushed to one buffer are contiguous
+    static img::GrayView plane_view(img::GraySubView const& plane)
+    {
+        img::GrayView view{};
+        view.matrix_data_ = plane.matrix_data_;
+        view.width = plane.width;
+        view.height = plane.height;
+
+        return view;
+    }
+
+
+    // each space against the f64 formulas in both directions
+    static u32 verify_yuv_spaces(BenchData& data)
+    {
+        constexpr u32 width = 257;
+        constexpr u32 height = 129;
+
+        u32 n_fail = 0;
+
+        for (u32 s = 0; s < 4; s++)
+        {
+            reset(data);
+
+            auto space = (img::YUVSpace)s;
+            auto ref = yuv_ref(space);
+
+            auto rgba = img::make_view(width, height, data.buffer32);
+            auto yuv = img::make_i444(width, height, data.buffer8);
+            fill_random(rgba, s + 1);
+
+            img::map(rgba, yuv, space);
+
+            for (u32 y = 0; y < height; y++)
+            {
+                for (u32 x = 0; x < width; x++)
+                {
+                    auto p = img::xy_at(rgba, x, y);
+                    f64 l = ref.kr * p->red + ref.kg * p->green + ref.kb * p->blue;
+
+                    n_fail += off_by_more_than_1(*img::xy_at(yuv.y, x, y), ref.y_offset + ref.y_scale * l);
+                    n_fail += off_by_more_than_1(*img::xy_at(yuv.u, x, y), 128.0 + ref.c_scale * (p->blue - l) / (2.0 * (1.0 - ref.kb)));
+                    n_fail += off_by_more_than_1(*img::xy_at(yuv.v, x, y), 128.0 + ref.c_scale * (p->red - l) / (2.0 * (1.0 - ref.kr)));
+                }
+            }
+
+            fill_random(yuv.y.matrix_data_, img::yuv444_bytes(width, height), s + 10);
+
+            img::map(yuv, rgba, space);
+
+            for (u32 y = 0; y < height; y++)
+            {
+                for (u32 x = 0; x < width; x++)
+                {
+                    auto p = img::xy_at(rgba, x, y);
+                    f64 l = (*img::xy_at(yuv.y, x, y) - ref.y_offset) / ref.y_scale;
+                    f64 pb = (*img::xy_at(yuv.u, x, y) - 128.0) / ref.c_scale;
+                    f64 pr = (*img::xy_at(yuv.v, x, y) - 128.0) / ref.c_scale;
+
+                    f64 r = l + 2.0 * (1.0 - ref.kr) * pr;
+                    f64 b = l + 2.0 * (1.0 - ref.kb) * pb;
+                    f64 g = (l - ref.kr * r - ref.kb * b) / ref.kg;
+
+                    n_fail += off_by_more_than_1(p->red, r);
+                    n_fail += off_by_more_than_1(p->green, g);
+                    n_fail += off_by_more_than_1(p->blue, b);
+                }
+            }
+        }
+
+        return n_fail;
+    }
+
+
+    // I420 and NV12 hold the same samples, crops and scaled frames match the full frame
+    // scale 0 skips scale_down
+    static u32 verify_yuv_420(BenchData& data, u32 width, u32 height, u32 scale)
+    {
+        constexpr auto space = img::YUVSpace::BT709_Limited;
+
+        u32 n_fail = 0;
+
+        reset(data);
+
+        auto rgba = img::make_view(width, height, data.buffer32);
+        auto a = img::make_view(width, height, data.buffer32);
+        auto b = img::make_view(width, height, data.buffer32);
+        auto i420 = img::make_i420(width, height, data.buffer8);
+        auto nv12 = img::make_nv12(width, height, data.buffer8);
+        fill_random(rgba, width);
+
+        img::map(rgba, i420, space);
+        img::map(rgba, nv12, space);
+
+        n_fail += !equal(plane_view(i420.y), plane_view(nv12.y));
+
+        for (u32 cy = 0; cy < nv12.uv.height; cy++)
+        {
+            for (u32 cx = 0; cx < nv12.uv.width; cx++)
+            {
+                auto uv = *img::xy_at(nv12.uv, cx, cy);
+                n_fail += uv.u != *img::xy_at(i420.u, cx, cy);
+                n_fail += uv.v != *img::xy_at(i420.v, cx, cy);
+            }
+        }
+
+        img::map(i420, a, space);
+        img::map(nv12, b, space);
+        n_fail += !equal(a, b);
+
+        // crop on even x and y, odd width
+        auto crop_w = width / 2 + 1;
+        auto crop_h = height / 2 + 1;
+        auto rect = img::make_rect(width / 4 & ~1u, height / 4 & ~1u, crop_w, crop_h);
+
+        auto crop_i420 = img::make_i420(crop_w, crop_h, data.buffer8);
+        auto crop_nv12 = img::make_nv12(crop_w, crop_h, data.buffer8);
+        auto crop_rgba = img::make_view(crop_w, crop_h, data.buffer32);
+
+        img::copy(img::sub_view(i420, rect), crop_i420);
+        img::copy(img::sub_view(nv12, rect), crop_nv12);
+
+        auto a_crop = img::sub_view(a, rect);
+
+        img::map(crop_i420, crop_rgba, space);
+        for (u32 y = 0; y < crop_h; y++)
+        {
+            n_fail += std::memcmp(img::row_begin(a_crop, y), img::row_begin(crop_rgba, y), crop_w * sizeof(img::Pixel)) != 0;
+        }
+
+        img::map(crop_nv12, crop_rgba, space);
+        for (u32 y = 0; y < crop_h; y++)
+        {
+            n_fail += std::memcmp(img::row_begin(a_crop, y), img::row_begin(crop_rgba, y), crop_w * sizeof(img::Pixel)) != 0;
+        }
+
+        // each plane as gray, interleaved chroma with simd and scalar sums
+        if (scale > 1)
+        {
+            auto dst_w = width / scale;
+            auto dst_h = height / scale;
+
+            auto small_i420 = img::make_i420(dst_w, dst_h, data.buffer8);
+            auto small_nv12 = img::make_nv12(dst_w, dst_h, data.buffer8);
+            auto small_gray = img::make_view(dst_w, dst_h, data.buffer8);
+            auto small_u = img::make_view(small_i420.u.width, small_i420.u.height, data.buffer8);
+            auto small_a = img::make_view(dst_w, dst_h, data.buffer32);
+            auto small_b = img::make_view(dst_w, dst_h, data.buffer32);
+
+            img::scale_down(i420, small_i420);
+
+            img::scale_down(plane_view(i420.y), small_gray);
+            n_fail += !equal(small_gray, plane_view(small_i420.y));
+
+            img::scale_down(plane_view(i420.u), small_u);
+            n_fail += !equal(small_u, plane_view(small_i420.u));
+
+            img::map(small_i420, small_a, space);
+
+            auto simd = img::get_simd();
+            for (auto level : { simd, cpu::SIMD::None })
+            {
+                img::set_simd(level);
+                img::fill(small_nv12, img::YUVu8{ 0, 0, 0 });
+                img::scale_down(nv12, small_nv12);
+                img::map(small_nv12, small_b, space);
+                n_fail += !equal(small_a, small_b);
+            }
+
+            img::set_simd(simd);
+        }
+
+        // border on the chroma grid, no mixed pixels
+        auto back = img::YUVu8{ 40, 100, 160 };
+        auto color = img::YUVu8{ 200, 60, 220 };
+        auto back_p = img::to_pixel(back, space);
+        auto color_p = img::to_pixel(color, space);
+
+        // 101, 51 to 401, 252 moves out to 100, 50 to 402, 252, thick 4
+        img::fill(i420, back);
+        img::draw_rect(i420, img::make_rect(101, 51, 300, 201), color, 3);
+        img::map(i420, a, space);
+
+        for (u32 y = 0; y < height; y++)
+        {
+            for (u32 x = 0; x < width; x++)
+            {
+                auto in = x >= 100 && x < 402 && y >= 50 && y < 252;
+                auto inner = x >= 104 && x < 398 && y >= 54 && y < 248;
+                auto expected = in && !inner ? color_p : back_p;
+
+                n_fail += img::as_u32(*img::xy_at(a, x, y)) != img::as_u32(expected);
+            }
+        }
+
+        return n_fail;
+    }
+
+
+    static img::GrayView copy_plane(img::GraySubView const& src, BenchData& data)
+    {
+        auto dst = img::make_view(src.width, src.height, data.buffer8);
+        for (u32 y = 0; y < src.height; y++)
+        {
+            std::memcpy(img::row_begin(dst, y), img::row_begin(src, y), src.width);
+        }
+
+        return dst;
+    }
+
+
+    // ranges match crops of the whole frame,
+    // map_scale_down matches each plane scaled down and mapped as 4:4:4
+    static u32 verify_yuv_map(BenchData& data, u32 scale)
+    {
+        constexpr auto space = img::YUVSpace::BT601_Limited;
+        constexpr u32 width = 1282;
+        constexpr u32 height = 722;
+        constexpr u32 dst_w = 320;
+        constexpr u32 dst_h = 176;
+
+        u32 n_fail = 0;
+
+        reset(data);
+
+        auto rgba = img::make_view(width, height, data.buffer32);
+        auto full = img::make_view(width, height, data.buffer32);
+        auto i420 = img::make_i420(width, height, data.buffer8);
+        auto nv12 = img::make_nv12(width, height, data.buffer8);
+        fill_random(rgba, scale);
+
+        img::map(rgba, i420, space);
+        img::map(rgba, nv12, space);
+        img::map(i420, full, space);
+
+        auto const equal_rows = [&](img::SubView const& a, img::ImageView const& b)
+        {
+            for (u32 y = 0; y < b.height; y++)
+            {
+                n_fail += std::memcmp(img::row_begin(a, y), img::row_begin(b, y), b.width * sizeof(img::Pixel)) != 0;
+            }
+        };
+
+        auto odd = img::make_rect(3, 5, width / 2 + 1, height / 2 + 1);
+        auto part = img::make_view(width / 2 + 1, height / 2 + 1, data.buffer32);
+
+        img::map(i420, odd, part, space);
+        equal_rows(img::sub_view(full, odd), part);
+
+        img::map(nv12, odd, part, space);
+        equal_rows(img::sub_view(full, odd), part);
+
+        auto range = img::make_rect(2, 2, dst_w * scale, dst_h * scale);
+        auto c_range = img::make_rect(1, 1, dst_w * scale / 2, dst_h * scale / 2);
+
+        auto y_ref = img::make_view(dst_w, dst_h, data.buffer8);
+        img::scale_down(copy_plane(img::sub_view(i420.y, range), data), y_ref);
+
+        auto u_ref = copy_plane(img::sub_view(i420.u, c_range), data);
+        auto v_ref = copy_plane(img::sub_view(i420.v, c_range), data);
+        if (scale > 2)
+        {
+            auto u = img::make_view(dst_w, dst_h, data.buffer8);
+            auto v = img::make_view(dst_w, dst_h, data.buffer8);
+            img::scale_down(u_ref, u);
+            img::scale_down(v_ref, v);
+            u_ref = u;
+            v_ref = v;
+        }
+
+        u8* planes[] = { y_ref.matrix_data_, u_ref.matrix_data_, v_ref.matrix_data_ };
+        i32 strides[] = { (i32)dst_w, (i32)dst_w, (i32)dst_w };
+
+        auto ref = img::make_view(dst_w, dst_h, data.buffer32);
+        auto dst = img::make_view(dst_w, dst_h, data.buffer32);
+        img::map(img::make_i444(dst_w, dst_h, planes, strides), ref, space);
+
+        img::map_scale_down(i420, range, dst, space);
+        n_fail += !equal(ref, dst);
+
+        img::map_scale_down(nv12, range, dst, space);
+        n_fail += !equal(ref, dst);
+
+        return n_fail;
+    }
+
+
+    // function objects and fn give the same pixels
+    static bool verify_transform(BenchData& data)
+    {
+        constexpr auto blue = img::to_pixel(0, 0, 255);
+
+        u32 n_fail = 0;
+
+        reset(data);
+
+        auto gray = img::make_view(PROCESS_WIDTH, PROCESS_HEIGHT, data.buffer8);
+        auto motion = img::make_view(PROCESS_WIDTH, PROCESS_HEIGHT, data.buffer8);
+        auto a = img::make_view(DISPLAY_WIDTH * 2, DISPLAY_HEIGHT * 2, data.buffer32);
+        auto b = img::make_view(DISPLAY_WIDTH * 2, DISPLAY_HEIGHT * 2, data.buffer32);
+        fill_random(gray, 1);
+        fill_mask(motion, 10, 2);
+
+        auto const gm = [](u8 g){ return img::to_pixel(g, 255 - g, g / 2); };
+        auto const dm = [&](u8 d, u8 m){ return m ? blue : img::to_pixel(d); };
+        auto const inv = [](img::Pixel p){ return img::to_pixel(255 - p.red, 255 - p.green, 255 - p.blue); };
+
+        for (u32 scale : { 2, 4 })
+        {
+            auto da = a;
+            auto db = b;
+            da.width = db.width = DISPLAY_WIDTH * scale / 2;
+            da.height = db.height = DISPLAY_HEIGHT * scale / 2;
+
+            img::transform_scale_up(gray, da, gm);
+            img::transform_scale_up(gray, db, fn<img::Pixel(u8)>(gm));
+            n_fail += !equal(da, db);
+
+            img::transform_scale_up(gray, motion, da, dm);
+            img::transform_scale_up(gray, motion, db, fn<img::Pixel(u8, u8)>(dm));
+            n_fail += !equal(da, db);
+
+            img::transform(da, db, inv);
+            img::transform(db, da, fn<img::Pixel(img::Pixel)>(inv));
+            img::transform_scale_up(gray, motion, db, dm);
+            n_fail += !equal(da, db);
+        }
+
+        std::printf("verify transform: %s\n", n_fail ? "FAIL" : "ok");
+
+        return n_fail == 0;
+    }
+
+
+    static bool verify_yuv(BenchData& data)
+    {
+        u32 n_fail = 0;
+
+        n_fail += verify_yuv_spaces(data);
+        n_fail += verify_yuv_420(data, WIDTH_1080P, HEIGHT_1080P, 3);
+        n_fail += verify_yuv_420(data, 641, 361, 0);
+        n_fail += verify_yuv_map(data, 2);
+        n_fail += verify_yuv_map(data, 4);
+
+        std::printf("verify yuv: %s\n", n_fail ? "FAIL" : "ok");
+
+        return n_fail == 0;
+    }
+
+
+    // each pixel against its square in the gray mask
+    static bool verify_morph_pixels(img::GrayView const& src, img::BitMaskView const& dst, u32 r, bool erode)
+    {
+        u32 n_fail = 0;
+
+        for (u32 y = 0; y < src.height; y++)
+        {
+            for (u32 x = 0; x < src.width; x++)
+            {
+                auto y_begin = y > r ? y - r : 0;
+                auto y_end = std::min(y + r + 1, src.height);
+                auto x_begin = x > r ? x - r : 0;
+                auto x_end = std::min(x + r + 1, src.width);
+
+                u32 n_set = 0;
+                for (u32 v = y_begin; v < y_end; v++)
+                {
+                    for (u32 u = x_begin; u < x_end; u++)
+                    {
+                        n_set += img::row_begin(src, v)[u] ? 1 : 0;
+                    }
+                }
+
+                auto n = (y_end - y_begin) * (x_end - x_begin);
+                bool expected = erode ? n_set == n : n_set > 0;
+                bool bit = (img::row_begin(dst, y)[x / 64] >> (x % 64)) & 1;
+
+                n_fail += expected != bit;
+            }
+
+            // nothing past the width
+            auto tail = src.width % 64;
+            if (tail)
+            {
+                n_fail += (img::row_begin(dst, y)[dst.row_words - 1] >> tail) != 0;
+            }
+        }
+
+        return n_fail == 0;
+    }
+
+
+    static bool verify_morphology(BenchData& data)
+    {
+        constexpr u32 widths[] = { 160, 333, 64 };
+        constexpr u32 heights[] = { 90, 47, 5 };
+
+        u32 n_fail = 0;
+
+        for (u32 i = 0; i < 3; i++)
+        {
+            for (u32 density : { 5, 50, 95 })
+            {
+                reset(data);
+
+                auto gray = img::make_view(widths[i], heights[i], data.buffer8);
+                auto src = img::make_bit_mask(widths[i], heights[i], data.buffer64);
+                auto tmp = img::make_bit_mask(widths[i], heights[i], data.buffer64);
+                auto dst = img::make_bit_mask(widths[i], heights[i], data.buffer64);
+
+                fill_mask(gray, density, i + density);
+                img::to_bit_mask(gray, src);
+
+                for (u32 r = 0; r <= 3; r++)
+                {
+                    img::erode(src, dst, r);
+                    n_fail += !verify_morph_pixels(gray, dst, r, true);
+
+                    img::dilate(src, dst, r);
+                    n_fail += !verify_morph_pixels(gray, dst, r, false);
+
+                    // opening is the dilation of the erosion
+                    img::opening(src, tmp, dst, r);
+                    auto eroded = img::make_view(widths[i], heights[i], data.buffer8);
+                    img::map(tmp, eroded);
+                    n_fail += !verify_morph_pixels(eroded, dst, r, false);
+
+                    img::closing(src, tmp, dst, r);
+                    auto dilated = img::make_view(widths[i], heights[i], data.buffer8);
+                    img::map(tmp, dilated);
+                    n_fail += !verify_morph_pixels(dilated, dst, r, true);
+                }
+            }
+        }
+
+        std::printf("verify morphology: %s\n", n_fail ? "FAIL" : "ok");
+
+        return n_fail == 0;
+    }
+}
+
+
+namespace kernel_bench
+{
+    // fn with every image on the calling thread into ref and split across the pool into dst
+    template <typename T, class FN>
+    static bool verify_rows(MatrixView2D<T> const& ref, MatrixView2D<T> const& dst, FN const& fn)
+    {
+        auto partition = thread_pool::row_partition();
+
+        auto serial = partition;
+        serial.serial_pixels = (u32)-1;
+
+        thread_pool::set_row_partition(serial);
+        fn(ref);
+
+        thread_pool::set_row_partition(partition);
+        fn(dst);
+
+        return equal(ref, dst);
+    }
+
+
+    // parallel results must match the serial results exactly
+    static bool verify_parallel(BenchData& data)
+    {
+        u32 n_fail = 0;
+
+        auto const check = [&](bool ok, cstr kernel)
+        {
+            if (!ok)
+            {
+                std::printf("verify threads: %s does not match serial\n", kernel);
+                n_fail++;
+            }
+        };
+
+        {
+            reset(data);
+
+            auto src = img::make_view(WIDTH_4K, HEIGHT_4K, data.buffer32);
+            auto ref = img::make_view(DISPLAY_WIDTH, DISPLAY_HEIGHT, data.buffer32);
+            auto dst = img::make_view(DISPLAY_WIDTH, DISPLAY_HEIGHT, data.buffer32);
+            fill_random(src, 1);
+
+            check(verify_rows(ref, dst, [&](auto const& d){ img::scale_down(src, d); }), "scale_down rgba");
+            check(verify_rows(ref, dst, [&](auto const& d){ img::resize(src, d); }), "resize rgba");
+
+            auto big_ref = img::make_view(WIDTH_1080P, HEIGHT_1080P, data.buffer32);
+            auto big_dst = img::make_view(WIDTH_1080P, HEIGHT_1080P, data.buffer32);
+            check(verify_rows(big_ref, big_dst, [&](auto const& d){ img::scale_up(dst, d); }), "scale_up rgba");
+
+            auto crop = img::sub_view(src, img::make_rect(WIDTH_4K / 4, HEIGHT_4K / 4, WIDTH_1080P, HEIGHT_1080P));
+            auto& crop_ref = big_ref;
+            auto& crop_dst = big_dst;
+            check(verify_rows(crop_ref, crop_dst, [&](auto const& d){ img::copy(crop, d); }), "copy sub view");
+        }
+        {
+            reset(data);
+
+            auto src = img::make_view(WIDTH_4K, HEIGHT_4K, data.buffer8);
+            auto ref = img::make_view(DISPLAY_WIDTH, DISPLAY_HEIGHT, data.buffer8);
+            auto dst = img::make_view(DISPLAY_WIDTH, DISPLAY_HEIGHT, data.buffer8);
+            auto map_ref = img::make_view(DISPLAY_WIDTH, DISPLAY_HEIGHT, data.buffer32);
+            auto map_dst = img::make_view(DISPLAY_WIDTH, DISPLAY_HEIGHT, data.buffer32);
+            fill_random(src, 2);
+
+            check(verify_rows(ref, dst, [&](auto const& d){ img::scale_down(src, d); }), "scale_down gray");
+            check(verify_rows(map_ref, map_dst, [&](auto const& d){ img::map_scale_down(src, d); }), "map_scale_down");
+
+            auto grad_src = img::make_view(WIDTH_1080P, HEIGHT_1080P, data.buffer8);
+            auto grad_ref = img::make_view(WIDTH_1080P, HEIGHT_1080P, data.buffer8);
+            auto grad_dst = img::make_view(WIDTH_1080P, HEIGHT_1080P, data.buffer8);
+            fill_random(grad_src, 3);
+            img::fill(grad_ref, 0);
+            img::fill(grad_dst, 0);
+
+            check(verify_rows(grad_ref, grad_dst, [&](auto const& d){ img::gradients(grad_src, d); }), "gradients");
+        }
+
+        std::printf("verify threads: %s\n", n_fail ? "FAIL" : "ok");
+
+        return n_fail == 0;
+    }
+}
+
+
+namespace kernel_bench
+{
+    // the fused update must match the separate passes exactly
+    static bool verify_motion(BenchData& data, u32 src_w, u32 src_h, u32 window)
+    {
+        constexpr u32 n_frames = 12;
+
+        reset(data);
+
+        auto src = img::make_view(src_w, src_h, data.buffer8);
+
+        MotionPasses mp{};
+        motion::GradientMotion gm{};
+
+        bool ok = create(mp, data, window) && motion::create(gm, PROCESS_WIDTH, PROCESS_HEIGHT, window);
+
+        auto src_rect = img::make_rect(src_w / 8, src_h / 8, src_w / 2, src_h / 2);
+
+        auto proc_rect = src_rect;
+        proc_rect.x_begin = (u32)((u64)proc_rect.x_begin * PROCESS_WIDTH / src_w);
+        proc_rect.x_end = (u32)((u64)proc_rect.x_end * PROCESS_WIDTH / src_w);
+        proc_rect.y_begin = (u32)((u64)proc_rect.y_begin * PROCESS_HEIGHT / src_h);
+        proc_rect.y_end = (u32)((u64)proc_rect.y_end * PROCESS_HEIGHT / src_h);
+
+        for (u32 i = 0; ok && i < n_frames; i++)
+        {
+            fill_motion_frame(src, i);
+
+            // views are written every other frame
+            gm.write_proc_views = i % 2;
+
+            // mask filter for the second half
+            auto radius = i < n_frames / 2 ? 0 : 1;
+            mp.mot.open_radius = gm.edge_motion.open_radius = radius;
+            mp.mot.close_radius = gm.edge_motion.close_radius = radius;
+
+            update(mp, src, proc_rect);
+            motion::update(gm, src, src_rect);
+
+            auto& a = mp.mot;
+            auto& b = gm.edge_motion;
+
+            auto n_words = (u64)a.mask.row_words * a.mask.height;
+
+            ok &= equal(a.values, b.values);
+            ok &= std::memcmp(a.mask.matrix_data_, b.mask.matrix_data_, n_words * sizeof(u64)) == 0;
+            ok &= equal(a.totals, b.totals);
+            ok &= a.location.x == b.location.x && a.location.y == b.location.y;
+
+            if (gm.write_proc_views)
+            {
+                ok &= equal(a.out, b.out);
+                ok &= equal(mp.gray, gm.proc_gray_view);
+                ok &= equal(mp.edges, gm.proc_edges_view);
+                ok &= equal(mp.motion, gm.proc_motion_view);
+            }
+        }
+
+        destroy(mp);
+        motion::destroy(gm);
+
+        std::printf("verify motion %ux%u window %u: %s\n", src_w, src_h, window, ok ? "ok" : "FAIL");
+
+        return ok;
+    }
+
+
+    // the integer history must give the same mask as averaging in f32
+    static bool verify_motion_window(BenchData& data, u32 window)
+    {
+        // odd width for a partial mask word
+        constexpr u32 width = 131;
+        constexpr u32 height = 37;
+        constexpr u32 n = width * height;
+
+        constexpr f32 sensitivities[] = { 0.9f, 0.5f, 0.97f, 1.0f, 0.0f };
+
+        reset(data);
+
+        auto src = img::make_view(width, height, data.buffer8);
+
+        // f32 history, as the update did before the integer version
+        auto ref_list = (f32*)mb::push_elements(data.buffer32, n * window);
+        auto ref_totals = (f32*)mb::push_elements(data.buffer32, n);
+        std::fill(ref_list, ref_list + n * window, 0.0f);
+        std::fill(ref_totals, ref_totals + n, 0.0f);
+
+        motion::GrayMotion mot{};
+        bool ok = motion::create(mot, width, height, window);
+
+        u32 ref_index = 0;
+
+        for (u32 frame = 0; ok && frame < 3 * window + 5; frame++)
+        {
+            // small noise around a level with a moving block, so only some pixels are motion
+            fill_random(src, frame + 1);
+            for (u32 i = 0; i < n; i++)
+            {
+                src.matrix_data_[i] = 100 + (src.matrix_data_[i] & 15);
+            }
+
+            img::fill(img::sub_view(src, img::make_rect(frame * 3 % width, 5, 20, 10)), 255);
+
+            mot.motion_sensitivity = sensitivities[frame % 5];
+            auto thresh = motion::motion_threshold(mot.motion_sensitivity);
+
+            motion::update(mot, src);
+
+            auto f = ref_list + (u64)ref_index * n;
+
+            for (u32 y = 0; y < height; y++)
+            {
+                auto mask = img::row_begin(mot.mask, y);
+
+                for (u32 x = 0; x < width; x++)
+                {
+                    auto i = y * width + x;
+                    f32 v = src.matrix_data_[i];
+
+                    bool expected = std::abs(ref_totals[i] / window - v) >= thresh;
+                    bool bit = (mask[x / 64] >> (x % 64)) & 1;
+
+                    ok &= bit == expected;
+
+                    ref_totals[i] += v - f[i];
+                    f[i] = v;
+
+                    ok &= (f32)mot.totals.matrix_data_[i] == ref_totals[i];
+                }
+            }
+
+            ref_index = (ref_index + 1) % window;
+        }
+
+        motion::destroy(mot);
+
+        std::printf("verify motion window %u: %s\n", window, ok ? "ok" : "FAIL");
+
+        return ok;
+    }
+}
+
+
+/* api */
+
+namespace kernel_bench
+{
+    bool run(BenchOptions const& options)
+    {
+        BenchData data{};
+
+        if (!create(data))
+        {
+            return false;
+        }
+
+        std::printf("warmup: %u, repeats: %u\n\n", options.warmup, options.repeats);
+
+        auto simd = cpu::simd_level();
+
+        bool ok = true;
+        for (u32 i = 1; i <= (u32)simd; i++)
+        {
+            ok &= verify_simd(data, (cpu::SIMD)i);
+        }
+
+        ok &= verify_gradients(data);
+        ok &= verify_centroid(data);
+        ok &= verify_morphology(data);
+
+        if (options.threads != 1)
+        {
+            thread_pool::init(options.threads);
+            std::printf("threads: %u\n", thread_pool::n_workers() + 1);
+
+            ok &= verify_parallel(data);
+        }
+
+        ok &= verify_resize_plan(data);
+        ok &= verify_resize_area(data);
+        ok &= verify_pyramid(data);
+        ok &= verify_yuv(data);
+        ok &= verify_transform(data);
+        ok &= verify_motion(data, WIDTH_1080P, HEIGHT_1080P, 8);
+        ok &= verify_motion(data, 2704, 1520, 16);
+
+        // a pyramid level at the process size
+        ok &= verify_motion(data, PROCESS_WIDTH, PROCESS_HEIGHT, 4);
+        ok &= verify_motion(data, PROCESS_WIDTH, PROCESS_HEIGHT, 32);
+
+        for (u32 window : { 4, 8, 16, 32 })
+        {
+            ok &= verify_motion_window(data, window);
+        }
+
+        if (!ok)
+        {
+            thread_pool::shutdown();
+            destroy(data);
+            return false;
+        }
+
+        std::printf("\n");
+
+        print_header();
+
+        // each supported level, scalar first
+        for (u32 i = 0; i <= (u32)simd; i++)
+        {
+            auto level = (cpu::SIMD)i;
+            img::set_simd(level);
+
+            std::printf("-- %s --\n", cpu::to_cstr(level));
+
+            bench_scale_down(data, options);
+            bench_scale_up(data, options);
+            bench_map(data, options);
+            bench_map_yuv(data, options);
+        }
+
+        img::set_simd(simd);
+
+        std::printf("--\n");
+
+        bench_resize(data, options);
+        bench_pyramid(data, options);
+        bench_gradients(data, options);
+        bench_centroid(data, options);
+        bench_morphology(data, options);
+        bench_transform(data, options);
+        bench_copy(data, options);
+        bench_yuv(data, options);
+
+#ifdef BENCH_SWSCALE
+        bench_map_yuv_sws(data, options);
+#endif
+        bench_span(data, options);
+        bench_motion(data, options);
+        bench_motion_window(data, options);
+
+        thread_pool::shutdown();
+        destroy(data);
+
+        return true;
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "../../../libs/image/image.hpp"
+
+
+namespace kernel_bench
+{
+    constexpr u32 MAX_REPEATS = 1000;
+
+
+    class BenchOptions
+    {
+    public:
+        u32 warmup = 3;
+        u32 repeats = 25;
+
+        // only run benchmarks whose name contains this text
+        cstr filter = 0;
+
+        // 1 runs on the calling thread, 0 for one per hardware thread
+        u32 threads = 1;
+    };
+
+
+    class BenchResult
+    {
+    public:
+        cstr name = 0;
+
+        u64 n_pixels = 0;
+        u64 n_bytes = 0;
+
+        u32 repeats = 0;
+
+        f64 min_ns = 0.0;
+        f64 median_ns = 0.0;
+        f64 mean_ns = 0.0;
+        f64 max_ns = 0.0;
+        f64 stddev_ns = 0.0;
+    };
+
+
+    void print_header();
+
+    void print_result(BenchResult const& result);
+
+    bool run(BenchOptions const& options);
+}
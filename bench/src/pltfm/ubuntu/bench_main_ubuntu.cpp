@@ -0,0 +1,67 @@
+#include "../../kernel_bench/kernel_bench.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace kb = kernel_bench;
+
+
+static void print_usage(cstr exe)
+{
+    std::printf("usage: %s [-w warmup] [-r repeats] [-f filter] [-t threads]\n", exe);
+}
+
+
+static bool parse_args(int argc, char* argv[], kb::BenchOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        auto arg = argv[i];
+        auto has_value = i + 1 < argc;
+
+        if (!std::strcmp(arg, "-w") && has_value)
+        {
+            options.warmup = (u32)std::atoi(argv[++i]);
+        }
+        else if (!std::strcmp(arg, "-r") && has_value)
+        {
+            options.repeats = (u32)std::atoi(argv[++i]);
+        }
+        else if (!std::strcmp(arg, "-f") && has_value)
+        {
+            options.filter = argv[++i];
+        }
+        else if (!std::strcmp(arg, "-t") && has_value)
+        {
+            options.threads = (u32)std::atoi(argv[++i]);
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+int main(int argc, char* argv[])
+{
+    kb::BenchOptions options{};
+
+    if (!parse_args(argc, argv, options))
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (!kb::run(options))
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+#include "main_o.cpp"
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "../../../../libs/alloc_type/alloc_type.cpp"
+#include "../../../../libs/image/image.cpp"
+#include "../../../../libs/span/span.cpp"
+#include "../../../../libs/thread_pool/thread_pool.cpp"
+#include "../../../../libs/video/motion.cpp"
+#include "../../kernel_bench/kernel_bench.cpp"
+#include "../../../../libs/stb_libs/stb_libs.cpp"
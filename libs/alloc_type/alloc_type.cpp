@@ -7,6 +7,9 @@
 #include <cassert>
 #include <vector>
 #include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
 
 template <typename T>
 using List = std::vector<T>;
@@ -22,6 +25,149 @@ using List = std::vector<T>;
 #endif
 
 
+/* tag stats */
+
+namespace tag_stats
+{
+    constexpr auto NO_TAG = "no tag";
+
+
+    class LiveAllocation
+    {
+    public:
+        u64 n_bytes = 0;
+        u32 tag_id = 0;
+    };
+
+
+    class TagTable
+    {
+    public:
+        std::mutex mutex;
+
+        mem::MemoryStats stats;
+
+        // every tagged allocation until it is freed, grows with the number of allocations
+        std::unordered_map<void*, LiveAllocation> live;
+    };
+
+
+    TagTable table;
+
+
+    static u32 find_tag_id(cstr tag)
+    {
+        auto& stats = table.stats;
+
+        tag = tag ? tag : NO_TAG;
+
+        u32 i = 0;
+        for (; i < stats.n_tags; i++)
+        {
+            if (stats.tags[i].tag == tag || std::strcmp(stats.tags[i].tag, tag) == 0)
+            {
+                return i;
+            }
+        }
+
+        if (i < mem::MAX_TAG_STATS)
+        {
+            stats.tags[i].tag = tag;
+            stats.n_tags++;
+            return i;
+        }
+
+        // table full, count with the last tag
+        stats.complete = false;
+        return mem::MAX_TAG_STATS - 1;
+    }
+
+
+    static void add_allocation(void* ptr, u64 n_bytes, cstr tag)
+    {
+        if (!ptr)
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(table.mutex);
+
+        auto [it, added] = table.live.try_emplace(ptr);
+        if (!added)
+        {
+            // already counted
+            return;
+        }
+
+        auto tag_id = find_tag_id(tag);
+
+        auto& live = it->second;
+        live.n_bytes = n_bytes;
+        live.tag_id = tag_id;
+
+        auto& stats = table.stats;
+        auto& ts = stats.tags[tag_id];
+
+        ts.n_allocations++;
+        ts.bytes_current += n_bytes;
+        ts.bytes_peak = ts.bytes_current > ts.bytes_peak ? ts.bytes_current : ts.bytes_peak;
+
+        stats.bytes_current += n_bytes;
+        stats.bytes_peak = stats.bytes_current > stats.bytes_peak ? stats.bytes_current : stats.bytes_peak;
+    }
+
+
+    static void remove_allocation(void* ptr)
+    {
+        if (!ptr)
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(table.mutex);
+
+        auto it = table.live.find(ptr);
+        if (it == table.live.end())
+        {
+            return;
+        }
+
+        auto& live = it->second;
+
+        table.stats.tags[live.tag_id].bytes_current -= live.n_bytes;
+        table.stats.bytes_current -= live.n_bytes;
+
+        table.live.erase(it);
+    }
+}
+
+
+namespace mem
+{
+    MemoryStats query_memory_stats()
+    {
+        std::lock_guard<std::mutex> lock(tag_stats::table.mutex);
+
+        return tag_stats::table.stats;
+    }
+
+
+    void reset_memory_peaks()
+    {
+        std::lock_guard<std::mutex> lock(tag_stats::table.mutex);
+
+        auto& stats = tag_stats::table.stats;
+
+        stats.bytes_peak = stats.bytes_current;
+
+        for (u32 i = 0; i < stats.n_tags; i++)
+        {
+            stats.tags[i].bytes_peak = stats.tags[i].bytes_current;
+        }
+    }
+}
+
+
 #ifndef ALLOC_COUNT
 
 namespace mem
@@ -45,10 +191,8 @@ namespace mem
     }
 
     
-    void* malloc_memory(u32 n_elements, u32 element_size, cstr tag)
+    static void* malloc_any(u32 n_elements, u32 element_size)
     {
-        alloc_type_log("malloc_memory(%u, %u, %s)\n", n_elements, element_size, tag);
-
 #if defined _WIN32
 
         return std::malloc(n_elements * element_size);
@@ -72,10 +216,24 @@ namespace mem
 #endif
     }
 
+    
+    void* malloc_memory(u32 n_elements, u32 element_size, cstr tag)
+    {
+        alloc_type_log("malloc_memory(%u, %u, %s)\n", n_elements, element_size, tag);
+
+        auto data = malloc_any(n_elements, element_size);
+
+        tag_stats::add_allocation(data, (u64)n_elements * element_size, tag);
+
+        return data;
+    }
+
 
     void free_memory(void* ptr, u32 element_size)
     {
         alloc_type_log("free_memory(%p, %u)\n", ptr, element_size);
+
+        tag_stats::remove_allocation(ptr);
         std::free(ptr);
     }
 
@@ -83,6 +241,8 @@ namespace mem
     void tag_memory(void* ptr, u32 n_elements, u32 element_size, cstr tag)
     {
         alloc_type_log("tag_memory(%p, %u, %u, %s)\n", ptr, n_elements, element_size, tag);
+
+        tag_stats::add_allocation(ptr, (u64)n_elements * element_size, tag);
     }
 
 
@@ -95,6 +255,8 @@ namespace mem
     void untag_memory(void* ptr, u32 element_size)
     {
         alloc_type_log("untag_memory(%p, %u)\n", ptr, element_size);
+
+        tag_stats::remove_allocation(ptr);
     }
 }
 
@@ -231,6 +393,8 @@ namespace counts
 
         log_alloc(ac, "malloc", i);
 
+        tag_stats::add_allocation(data, n_bytes, ac.tags[i]);
+
         return data;
     }
 
@@ -253,6 +417,7 @@ namespace counts
 
         log_alloc(ac, "free", i);
 
+        tag_stats::remove_allocation(ac.keys[i]);
         std::free(ac.keys[i]);
 
         ac.n_allocations--;
@@ -306,6 +471,8 @@ namespace counts
 
         log_alloc(ac, "tagged", i);
 
+        tag_stats::add_allocation(ptr, n_bytes, tag);
+
         update_element_counts(ac, i);
     }
 
@@ -331,6 +498,8 @@ namespace counts
         ac.keys[i] = 0;                
 
         log_alloc(ac, "untagged", i);
+
+        tag_stats::remove_allocation(ptr);
         ac.tags[i] = 0;
         ac.byte_counts[i] = 0;
 
@@ -71,6 +71,47 @@ namespace mem
     }
 }
 
+
+/* runtime stats by tag */
+
+namespace mem
+{
+    constexpr u32 MAX_TAG_STATS = 64;
+
+
+    class TagStats
+    {
+    public:
+        cstr tag = 0;
+
+        u64 bytes_current = 0;
+        u64 bytes_peak = 0;
+
+        u32 n_allocations = 0;
+    };
+
+
+    class MemoryStats
+    {
+    public:
+        u64 bytes_current = 0;
+        u64 bytes_peak = 0;
+
+        // false when more than MAX_TAG_STATS tags were used, the rest are counted with the last tag
+        bool complete = true;
+
+        u32 n_tags = 0;
+        TagStats tags[MAX_TAG_STATS];
+    };
+
+
+    MemoryStats query_memory_stats();
+
+    // peaks restart from the current bytes, e.g. at the start of a run
+    void reset_memory_peaks();
+}
+
+
 #ifdef ALLOC_COUNT
 
 namespace mem
@@ -2,9 +2,20 @@
 
 #include "image.hpp"
 #include "../util/numeric.hpp"
+#include "../util/trace.hpp"
+#include "../thread_pool/thread_pool.hpp"
 
 #include "../stb_libs/stb_image_options.hpp"
 
+#include <cstring>
+#include <utility>
+#include <atomic>
+#include <bit>
+
+#ifdef CPU_X64
+#include <immintrin.h>
+#endif
+
 namespace num = numeric;
 
 
@@ -138,6 +149,53 @@ namespace image
 }
 
 
+/* parallel rows */
+
+namespace image
+{
+    template <typename T>
+    static MatrixView2D<T> row_range(MatrixView2D<T> const& view, u32 y_begin, u32 y_end)
+    {
+        MatrixView2D<T> range{};
+        range.matrix_data_ = row_begin(view, y_begin);
+        range.width = view.width;
+        range.height = y_end - y_begin;
+
+        return range;
+    }
+
+
+    template <typename T>
+    static MatrixSubView2D<T> row_range(MatrixSubView2D<T> const& view, u32 y_begin, u32 y_end)
+    {
+        auto range = view;
+        range.y_begin += y_begin;
+        range.height = y_end - y_begin;
+
+        return range;
+    }
+
+
+    // func(src_rows, dst_rows) on the thread pool
+    // a step is src_rows rows of src and dst_rows rows of dst
+    template <class SRC, class DST, class FN>
+    static void parallel_rows(SRC const& src, DST const& dst, u32 src_rows, u32 dst_rows, FN const& func)
+    {
+        auto n_steps = dst.height / dst_rows;
+
+        auto src_pixels = src.width * src_rows;
+        auto dst_pixels = dst.width * dst_rows;
+
+        auto const step_rows = [&](u32 begin, u32 end)
+        {
+            func(row_range(src, begin * src_rows, end * src_rows), row_range(dst, begin * dst_rows, end * dst_rows));
+        };
+
+        thread_pool::parallel_for_rows(n_steps, num::max(src_pixels, dst_pixels), step_rows);
+    }
+}
+
+
 /* copy */
 
 namespace image
@@ -161,45 +219,53 @@ namespace image
 
     void copy(ImageView const& src, ImageView const& dst)
     {
+        TRACE_ZONE("img::copy");
+
         assert(src.matrix_data_);
         assert(dst.matrix_data_);
         assert(dst.width == src.width);
         assert(dst.height == src.height);
 
-        copy_view(src, dst);
+        parallel_rows(src, dst, 1, 1, [](auto const& s, auto const& d){ copy_view(s, d); });
     }    
 
 
     void copy(ImageView const& src, SubView const& dst)
     {
+        TRACE_ZONE("img::copy");
+
         assert(src.matrix_data_);
         assert(dst.matrix_data_);
         assert(dst.width == src.width);
         assert(dst.height == src.height);
 
-        copy_sub_view(src, dst);
+        parallel_rows(src, dst, 1, 1, [](auto const& s, auto const& d){ copy_sub_view(s, d); });
     }
 
 
     void copy(SubView const& src, ImageView const& dst)
     {
+        TRACE_ZONE("img::copy");
+
         assert(src.matrix_data_);
         assert(dst.matrix_data_);
         assert(dst.width == src.width);
         assert(dst.height == src.height);
 
-        copy_sub_view(src, dst);
+        parallel_rows(src, dst, 1, 1, [](auto const& s, auto const& d){ copy_sub_view(s, d); });
     }
 
 
     void copy(SubView const& src, SubView const& dst)
     {
+        TRACE_ZONE("img::copy");
+
         assert(src.matrix_data_);
         assert(dst.matrix_data_);
         assert(dst.width == src.width);
         assert(dst.height == src.height);
 
-        copy_sub_view(src, dst);
+        parallel_rows(src, dst, 1, 1, [](auto const& s, auto const& d){ copy_sub_view(s, d); });
     }
 }
 
@@ -208,1063 +274,4335 @@ namespace image
 
 namespace image
 {
-    template <class SRC, class DST, class FN, typename DT>
-    static void transform_scale_up_matrix_t(DT tval, SRC const& src, DST const& dst, u32 scale, FN const& func)
+    void transform(ImageView const& src, ImageView const& dst, fn<Pixel(Pixel)> const& func)
     {
-        constexpr u32 SCALE_MAX = 8;
+        TRACE_ZONE("img::transform");
 
-        assert(scale <= SCALE_MAX);
-        
-        DT p = tval;
+        assert(src.matrix_data_);
+        assert(src.width);
+        assert(src.height);
+        assert(dst.matrix_data_);
+        assert(dst.width);
+        assert(dst.height);
+        assert(src.width == dst.width);
+        assert(src.height == dst.height);
 
-        DT* rd[SCALE_MAX] = { 0 };
+        internal::transform(src, dst, func);
+    }
 
-        for (u32 ys = 0; ys < src.height; ys++)
-        {
-            auto yd = scale * ys;
-            auto rs = row_begin(src, ys);
 
-            for (u32 i = 0; i < scale; i++)
+    void transform_scale_up(GrayView const& src, ImageView const& dst, fn<Pixel(u8)> const& func)
+    {
+        TRACE_ZONE("img::transform_scale_up");
+
+        auto scale = dst.width / src.width;
+
+        assert(src.matrix_data_);
+        assert(dst.matrix_data_);
+        assert(dst.width == src.width * scale);
+        assert(dst.height == src.height * scale);
+        assert(scale > 1);
+
+        internal::transform_scale_up(src, dst, scale, func);
+    }
+
+
+    void transform_scale_up(GrayView const& src1, GrayView const& src2, ImageView const& dst, fn<Pixel(u8, u8)> const& func)
+    {
+        TRACE_ZONE("img::transform_scale_up");
+
+        auto scale = dst.width / src1.width;
+
+        assert(src1.matrix_data_);
+        assert(src2.matrix_data_);
+        assert(dst.matrix_data_);
+        assert(src1.width == src2.width);
+        assert(src1.height == src2.height);
+        assert(dst.width == src1.width * scale);
+        assert(dst.height == src1.height * scale);
+        assert(scale > 1);
+
+        internal::transform_scale_up(src1, src2, dst, scale, func);
+    }
+}
+
+
+/* simd */
+
+namespace image
+{
+namespace simd
+{
+    // u16 sums hold up to 16 x 16 x 255
+    constexpr u32 SCALE_MAX = 16;
+
+    // row sums per chunk, 8 KB on the stack
+    constexpr u32 VSUM_LEN = 4096;
+
+    // dst[i] = rows[0][i] + ... + rows[n_rows - 1][i]
+    using vsum_fn = void (*)(u8* const* rows, u32 n_rows, u16* dst, u32 len);
+
+    // each of n src elements written twice or four times
+    using dup_fn = void (*)(void const* src, void* dst, u32 n);
+
+    // number of set bits and the sum of their x, for width bits of a row from bit x_begin
+    using bit_sums_fn = void (*)(u64 const* row, u32 x_begin, u32 width, u64& count, u64& x_sum);
+
+    // weighted row sums per chunk of resize_area, 8 KB on the stack
+    constexpr u32 AREA_LEN = 2048;
+
+    // dst[i] = weights[0] * row 0[i] + ... + weights[n_rows - 1] * row n_rows - 1[i], row v at src + v * stride
+    using vwsum_fn = void (*)(u8 const* src, u64 stride, u16 const* weights, u32 n_rows, u32* dst, u32 len);
+
+    // yuv to rgb in 13 bit fixed point, so pairs of i16 products can be summed with madd
+    constexpr i32 YUV_RGB_BITS = 13;
+
+    class YUVRGB
+    {
+    public:
+        i16 y_offset;
+        i16 y_mul;
+        i16 r_v;
+        i16 g_u;
+        i16 g_v;
+        i16 b_u;
+    };
+
+    // one row, each pixel with its own u and v
+    using yuv_rgba_fn = void (*)(u8 const* y, u8 const* u, u8 const* v, Pixel* dst, u32 len, YUVRGB const& c);
+
+
+    class Kernels
+    {
+    public:
+        cpu::SIMD level = cpu::SIMD::None;
+
+        vsum_fn vsum_rows = 0;
+
+        dup_fn dup2_u8 = 0;
+        dup_fn dup4_u8 = 0;
+        dup_fn dup2_u32 = 0;
+
+        bit_sums_fn bit_sums = 0;
+
+        vwsum_fn vwsum_rows = 0;
+
+        yuv_rgba_fn yuv_rgba = 0;
+    };
+
+
+    static void vsum_rows_tail(u8* const* rows, u32 n_rows, u16* dst, u32 begin, u32 len)
+    {
+        for (u32 i = begin; i < len; i++)
+        {
+            u32 sum = 0;
+            for (u32 v = 0; v < n_rows; v++)
             {
-                rd[i] = row_begin(dst, yd + i);
+                sum += rows[v][i];
             }
 
-            for (u32 xs = 0; xs < src.width; xs++)
-            {                
-                p = func(rs[xs]);
+            dst[i] = (u16)sum;
+        }
+    }
 
-                for (u32 v = 0; v < scale; v++)
-                {
-                    for (u32 u = 0; u < scale; u++)
-                    {
-                        rd[v][u] = p;
-                    }
 
-                    rd[v] += scale;
-                }
+    template <typename T, u32 N>
+    static void dup_tail(T const* src, T* dst, u32 begin, u32 n)
+    {
+        for (u32 i = begin; i < n; i++)
+        {
+            for (u32 u = 0; u < N; u++)
+            {
+                dst[N * i + u] = src[i];
             }
         }
-    }    
-    
-    
-    template <class SRC, class DST, class FN>
-    static void transform_scale_up_matrix_s(SRC const& src, DST const& dst, u32 scale, FN const& func)
+    }
+
+
+    // S > 0 for a compile time scale
+
+    // for a power of 2 scale, i_scale is exact and the float ops are a shift
+    template <u32 S>
+    constexpr u32 pow2_shift()
     {
-        for (u32 ys = 0; ys < src.height; ys++)
+        switch (S)
         {
-            auto yd = scale * ys;
-            auto rs = row_begin(src, ys);
+        case 2: return 2;
+        case 4: return 4;
+        case 8: return 6;
+        default: return 0;
+        }
+    }
 
-            for (u32 xs = 0; xs < src.width; xs++)
-            {
-                auto xd = scale * xs;
-                
-                auto p = func(rs[xs]);
 
-                for (u32 v = 0; v < scale; v++)
-                {
-                    auto rd = row_begin(dst, yd + v) + xd;
-                    for (u32 u = 0; u < scale; u++)
-                    {                        
-                        rd[u] = p;
-                    }
-                }
+    template <u32 S, typename T>
+    static void expand_row(T const* src, T* dst, u32 n, u32 scale)
+    {
+        auto const s = S ? S : scale;
+
+        for (u32 i = 0; i < n; i++)
+        {
+            auto p = src[i];
+            for (u32 u = 0; u < s; u++)
+            {
+                dst[u] = p;
             }
+
+            dst += s;
         }
     }
 
 
-    template <class SRC1, class SRC2, class DST, class FN, typename DT>
-    static void transform_scale_up_matrix_t(DT tval, SRC1 const& src1, SRC2 const& src2, DST const& dst, u32 scale, FN const& func)
+    template <u32 S, typename T, class FN>
+    static void hsum_gray(u16 const* sums, T* dst, u32 n, u32 scale, f32 i_scale, FN const& to_dst)
     {
-        constexpr u32 SCALE_MAX = 8;
-
-        assert(scale <= SCALE_MAX);
-        
-        DT p = tval;
+        auto const s = S ? S : scale;
 
-        DT* rd[SCALE_MAX] = { 0 };
+        f32 gray = 0.0f;
 
-        for (u32 ys = 0; ys < src1.height; ys++)
+        for (u32 i = 0; i < n; i++)
         {
-            auto yd = scale * ys;
-            auto rs1 = row_begin(src1, ys);
-            auto rs2 = row_begin(src2, ys);
-
-            for (u32 i = 0; i < scale; i++)
+            u32 total = 0;
+            for (u32 u = 0; u < s; u++)
             {
-                rd[i] = row_begin(dst, yd + i);
+                total += sums[u];
             }
 
-            for (u32 xs = 0; xs < src1.width; xs++)
-            {                
-                p = func(rs1[xs], rs2[xs]);
+            sums += s;
 
-                for (u32 v = 0; v < scale; v++)
-                {
-                    for (u32 u = 0; u < scale; u++)
-                    {
-                        rd[v][u] = p;
-                    }
+            if constexpr (pow2_shift<S>() > 0)
+            {
+                dst[i] = to_dst((u8)(total >> pow2_shift<S>()));
+            }
+            else
+            {
+                // same float ops as the scalar kernels
+                gray = (f32)total;
+                gray *= i_scale;
 
-                    rd[v] += scale;
-                }
+                dst[i] = to_dst((u8)gray);
             }
         }
     }
 
 
-    template <class SRC1, class SRC2, class DST, class FN>
-    static void transform_scale_up_matrix_s(SRC1 const& src1, SRC2 const& src2, DST const& dst, u32 scale, FN const& func)
+    template <u32 S>
+    static void hsum_rgba(u16 const* sums, Pixel* dst, u32 n, u32 scale, f32 i_scale)
     {
-        for (u32 ys = 0; ys < src1.height; ys++)
-        {
-            auto yd = scale * ys;
-            auto rs1 = row_begin(src1, ys);
-            auto rs2 = row_begin(src2, ys);
+        constexpr u32 CH = 4;
+
+        auto const s = S ? S : scale;
+
+        f32 red = 0.0f;
+        f32 green = 0.0f;
+        f32 blue = 0.0f;
 
-            for (u32 xs = 0; xs < src1.width; xs++)
+        for (u32 i = 0; i < n; i++)
+        {
+            // the 4 channel sums of a pixel added as one u64, no carries between them
+            u64 total = 0;
+            for (u32 u = 0; u < s; u++)
             {
-                auto xd = scale * xs;
-                
-                auto p = func(rs1[xs], rs2[xs]);
+                u64 p = 0;
+                std::memcpy(&p, sums + CH * u, sizeof(p));
+                total += p;
+            }
 
-                for (u32 v = 0; v < scale; v++)
-                {
-                    auto rd = row_begin(dst, yd + v) + xd;
-                    for (u32 u = 0; u < scale; u++)
-                    {                        
-                        rd[u] = p;
-                    }
-                }
+            sums += CH * s;
+
+            auto r = (u32)(total & 0xFFFF);
+            auto g = (u32)((total >> 16) & 0xFFFF);
+            auto b = (u32)((total >> 32) & 0xFFFF);
+
+            if constexpr (pow2_shift<S>() > 0)
+            {
+                constexpr auto k = pow2_shift<S>();
+                dst[i] = to_pixel((u8)(r >> k), (u8)(g >> k), (u8)(b >> k));
+                continue;
             }
+
+            red   = (f32)r * i_scale;
+            green = (f32)g * i_scale;
+            blue  = (f32)b * i_scale;
+
+            dst[i] = to_pixel((u8)red, (u8)green, (u8)blue);
         }
     }
 
 
-    template <class SRC, class DST, class FN>
-    static void transform_scale_up_matrix(SRC const& src, DST const& dst, u32 scale, FN const& func)
-    {        
+    template <typename T>
+    static void expand_row(T const* src, T* dst, u32 n, u32 scale)
+    {
         switch (scale)
         {
-        case 2:
-        case 3:
-        case 4:
-        case 5:
-        case 6:
-        case 7:
-        case 8:
-        {
-            auto tval = row_begin(dst, 0)[0];
-            transform_scale_up_matrix_t(tval, src, dst, scale, func);
+        case 2: expand_row<2>(src, dst, n, scale); break;
+        case 3: expand_row<3>(src, dst, n, scale); break;
+        case 4: expand_row<4>(src, dst, n, scale); break;
+        case 6: expand_row<6>(src, dst, n, scale); break;
+        case 8: expand_row<8>(src, dst, n, scale); break;
+        default: expand_row<0>(src, dst, n, scale); break;
         }
-            break;
+    }
 
-        default:
-            transform_scale_up_matrix_s(src, dst, scale, func);
-            break;
+
+    template <typename T, class FN>
+    static void hsum_gray(u16 const* sums, T* dst, u32 n, u32 scale, f32 i_scale, FN const& to_dst)
+    {
+        switch (scale)
+        {
+        case 2: hsum_gray<2>(sums, dst, n, scale, i_scale, to_dst); break;
+        case 3: hsum_gray<3>(sums, dst, n, scale, i_scale, to_dst); break;
+        case 4: hsum_gray<4>(sums, dst, n, scale, i_scale, to_dst); break;
+        case 6: hsum_gray<6>(sums, dst, n, scale, i_scale, to_dst); break;
+        case 8: hsum_gray<8>(sums, dst, n, scale, i_scale, to_dst); break;
+        default: hsum_gray<0>(sums, dst, n, scale, i_scale, to_dst); break;
         }
     }
 
 
-    template <class SRC1, class SRC2, class DST, class FN>
-    static void transform_scale_up_matrix(SRC1 const& src1, SRC2 const& src2, DST const& dst, u32 scale, FN const& func)
+    static void hsum_rgba(u16 const* sums, Pixel* dst, u32 n, u32 scale, f32 i_scale)
     {
         switch (scale)
         {
-        case 2:
-        case 3:
-        case 4:
-        case 5:
-        case 6:
-        case 7:
-        case 8:
+        case 2: hsum_rgba<2>(sums, dst, n, scale, i_scale); break;
+        case 3: hsum_rgba<3>(sums, dst, n, scale, i_scale); break;
+        case 4: hsum_rgba<4>(sums, dst, n, scale, i_scale); break;
+        case 6: hsum_rgba<6>(sums, dst, n, scale, i_scale); break;
+        case 8: hsum_rgba<8>(sums, dst, n, scale, i_scale); break;
+        default: hsum_rgba<0>(sums, dst, n, scale, i_scale); break;
+        }
+    }
+
+
+    // 64 bits of a row from bit x, n_bits <= 64 are kept
+    static inline u64 row_bits(u64 const* row, u32 x, u32 n_bits)
+    {
+        auto word = row + x / 64;
+        auto shift = x % 64;
+
+        auto bits = word[0] >> shift;
+        if (shift && shift + n_bits > 64)
         {
-            auto tval = row_begin(dst, 0)[0];
-            transform_scale_up_matrix_t(tval, src1, src2, dst, scale, func);
+            bits |= word[1] << (64 - shift);
         }
-            break;
 
-        default:
-            transform_scale_up_matrix_s(src1, src2, dst, scale, func);
-            break;
+        if (n_bits < 64)
+        {
+            bits &= ((u64)1 << n_bits) - 1;
         }
+
+        return bits;
     }
 
 
-    void transform(ImageView const& src, ImageView const& dst, fn<Pixel(Pixel)> const& func)
+    // Bit i of a word adds i to the x sum.
+    // Bit plane k holds the bits whose index has bit k set, so the sum of the indices
+    // is the sum of popcount(plane k) << k.
+    static inline void bit_sums_t(u64 const* row, u32 x_begin, u32 width, u64& count, u64& x_sum)
     {
-        assert(src.matrix_data_);
-        assert(src.width);
-        assert(src.height);
-        assert(dst.matrix_data_);
-        assert(dst.width);
-        assert(dst.height);
-        assert(src.width == dst.width);
-        assert(src.height == dst.height);
+        constexpr u64 planes[6] = {
+            0xAAAAAAAAAAAAAAAA,
+            0xCCCCCCCCCCCCCCCC,
+            0xF0F0F0F0F0F0F0F0,
+            0xFF00FF00FF00FF00,
+            0xFFFF0000FFFF0000,
+            0xFFFFFFFF00000000
+        };
 
-        span::transform(to_span(src), to_span(dst), func);
-    }
+        u64 n = 0;
+        u64 sum = 0;
 
+        for (u32 x = 0; x < width; x += 64)
+        {
+            auto len = width - x;
+            auto bits = row_bits(row, x_begin + x, len < 64 ? len : 64);
+            if (!bits)
+            {
+                continue;
+            }
 
-    void transform_scale_up(GrayView const& src, ImageView const& dst, fn<Pixel(u8)> const& func)
-    {
-        auto scale = dst.width / src.width;
+            u64 c = std::popcount(bits);
 
-        assert(src.matrix_data_);
-        assert(dst.matrix_data_);
-        assert(dst.width == src.width * scale);
-        assert(dst.height == src.height * scale);
-        assert(scale > 1);
+            n += c;
+            sum += c * x;
+
+            for (u32 k = 0; k < 6; k++)
+            {
+                sum += (u64)std::popcount(bits & planes[k]) << k;
+            }
+        }
 
-        transform_scale_up_matrix(src, dst, scale, func);
+        count = n;
+        x_sum = sum;
     }
 
 
-    void transform_scale_up(GrayView const& src1, GrayView const& src2, ImageView const& dst, fn<Pixel(u8, u8)> const& func)
+    static void bit_sums_scalar(u64 const* row, u32 x_begin, u32 width, u64& count, u64& x_sum)
     {
-        auto scale = dst.width / src1.width;
+        bit_sums_t(row, x_begin, width, count, x_sum);
+    }
 
-        assert(src1.matrix_data_);
-        assert(src2.matrix_data_);
-        assert(dst.matrix_data_);
-        assert(src1.width == src2.width);
-        assert(src1.height == src2.height);
-        assert(dst.width == src1.width * scale);
-        assert(dst.height == src1.height * scale);
-        assert(scale > 1);
 
-        transform_scale_up_matrix(src1, src2, dst, scale, func);
+    static void vwsum_rows_tail(u8 const* src, u64 stride, u16 const* weights, u32 n_rows, u32* dst, u32 begin, u32 len)
+    {
+        for (u32 i = begin; i < len; i++)
+        {
+            dst[i] = 0;
+        }
+
+        for (u32 v = 0; v < n_rows; v++)
+        {
+            auto row = src + v * stride;
+            u32 w = weights[v];
+
+            for (u32 i = begin; i < len; i++)
+            {
+                dst[i] += w * row[i];
+            }
+        }
     }
-}
 
 
-/* resize */
+    static void vwsum_rows_scalar(u8 const* src, u64 stride, u16 const* weights, u32 n_rows, u32* dst, u32 len)
+    {
+        vwsum_rows_tail(src, stride, weights, n_rows, dst, 0, len);
+    }
 
-namespace image
-{
-    template <class SRC, class DST>
-    void scale_down_rgba_t(SRC const& src, DST const& dst, u32 scale)
-    {     
-        constexpr u32 SCALE_MAX = 8;
 
-        assert(scale <= SCALE_MAX);
+    static inline u8 clamp_u8(i32 value)
+    {
+        return (u8)(value < 0 ? 0 : (value > 255 ? 255 : value));
+    }
 
-        const f32 i_scale = 1.0f / (scale * scale);
 
-        Pixel* rd = 0;
+    static inline Pixel yuv_rgba_pixel(i32 y, i32 u, i32 v, YUVRGB const& c)
+    {
+        constexpr i32 round = 1 << (YUV_RGB_BITS - 1);
 
-        Pixel* rs[SCALE_MAX] = { 0 };
+        auto yy = (y - c.y_offset) * c.y_mul + round;
+        u -= 128;
+        v -= 128;
 
-        Pixel ps;
+        auto r = clamp_u8((yy + c.r_v * v) >> YUV_RGB_BITS);
+        auto g = clamp_u8((yy - c.g_u * u - c.g_v * v) >> YUV_RGB_BITS);
+        auto b = clamp_u8((yy + c.b_u * u) >> YUV_RGB_BITS);
 
-        f32 red = 0.0f;
-        f32 green = 0.0f;
-        f32 blue = 0.0f;
+        return to_pixel(r, g, b);
+    }
 
-        for (u32 yd = 0; yd < dst.height; yd++)
+
+    static void yuv_rgba_tail(u8 const* y, u8 const* u, u8 const* v, Pixel* dst, u32 begin, u32 len, YUVRGB const& c)
+    {
+        for (u32 i = begin; i < len; i++)
         {
-            auto ys = scale * yd;
+            dst[i] = yuv_rgba_pixel(y[i], u[i], v[i], c);
+        }
+    }
 
-            rd = row_begin(dst, yd);
-            for (u32 i = 0; i < scale; i++)
+
+    static void yuv_rgba_scalar(u8 const* y, u8 const* u, u8 const* v, Pixel* dst, u32 len, YUVRGB const& c)
+    {
+        yuv_rgba_tail(y, u, v, dst, 0, len, c);
+    }
+
+
+    // lo and hi as the i16 pair of an i32 for madd
+    static inline i32 i16_pair(i32 lo, i32 hi)
+    {
+        return (i32)((u32)(u16)lo | ((u32)(u16)hi << 16));
+    }
+}
+}
+
+
+#ifdef CPU_X64
+
+/* simd sse4.1 */
+
+namespace image
+{
+namespace simd
+{
+    CPU_TARGET("sse4.1")
+    static void vsum_rows_sse41(u8* const* rows, u32 n_rows, u16* dst, u32 len)
+    {
+        constexpr u32 N = 16;
+
+        auto zero = _mm_setzero_si128();
+
+        u32 i = 0;
+        for (; i + N <= len; i += N)
+        {
+            auto lo = _mm_setzero_si128();
+            auto hi = _mm_setzero_si128();
+
+            for (u32 v = 0; v < n_rows; v++)
             {
-                rs[i] = row_begin(src, ys + i);
+                auto x = _mm_loadu_si128((__m128i const*)(rows[v] + i));
+                lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(x, zero));
+                hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(x, zero));
             }
 
-            for (u32 xd = 0; xd < dst.width; xd++)
-            {
-                red   = 0.0f;
-                green = 0.0f;
-                blue  = 0.0f;
+            _mm_storeu_si128((__m128i*)(dst + i), lo);
+            _mm_storeu_si128((__m128i*)(dst + i + N / 2), hi);
+        }
 
-                for (u32 v = 0; v < scale; v++)
-                {
-                    for (u32 u = 0; u < scale; u++)
-                    {
-                        ps = rs[v][u];
-                        red   += ps.red;
-                        green += ps.green;
-                        blue  += ps.blue;
-                    }
+        vsum_rows_tail(rows, n_rows, dst, i, len);
+    }
 
-                    rs[v] += scale;
-                }
 
-                red   *= i_scale;
-                green *= i_scale;
-                blue  *= i_scale;
+    // rows are taken in pairs, madd multiplies the interleaved pixels by both weights and adds
 
-                rd[xd] = to_pixel((u8)red, (u8)green, (u8)blue);
+    static inline u32 weight_pair(u16 const* weights, u32 v, u32 n_rows)
+    {
+        return v + 1 < n_rows ? weights[v] | ((u32)weights[v + 1] << 16) : weights[v];
+    }
+
+
+    CPU_TARGET("sse4.1")
+    static void vwsum_rows_sse41(u8 const* src, u64 stride, u16 const* weights, u32 n_rows, u32* dst, u32 len)
+    {
+        constexpr u32 N = 8;
+
+        u32 i = 0;
+        for (; i + N <= len; i += N)
+        {
+            auto lo = _mm_setzero_si128();
+            auto hi = _mm_setzero_si128();
+
+            for (u32 v = 0; v < n_rows; v += 2)
+            {
+                auto a = _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i const*)(src + v * stride + i)));
+                auto b = v + 1 < n_rows 
+                    ? _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i const*)(src + (v + 1) * stride + i)))
+                    : _mm_setzero_si128();
+
+                auto w = _mm_set1_epi32((i32)weight_pair(weights, v, n_rows));
+
+                lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+                hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
             }
+
+            _mm_storeu_si128((__m128i*)(dst + i), lo);
+            _mm_storeu_si128((__m128i*)(dst + i + N / 2), hi);
         }
+
+        vwsum_rows_tail(src, stride, weights, n_rows, dst, i, len);
     }
-    
-    
-    template <class SRC, class DST>
-    static void scale_down_rgba_s(SRC const& src, DST const& dst, u32 scale)
-    {
-        f32 const i_scale = 1.0f / (scale * scale);
 
-        Pixel* rd = 0;
-        Pixel* rs = 0;
 
-        Pixel ps;
+    CPU_TARGET("sse4.1")
+    static void dup2_u8_sse41(void const* src_v, void* dst_v, u32 n)
+    {
+        constexpr u32 N = 16;
 
-        f32 red = 0.0f;
-        f32 green = 0.0f;
-        f32 blue = 0.0f;
+        auto src = (u8 const*)src_v;
+        auto dst = (u8*)dst_v;
 
-        for (u32 yd = 0; yd < dst.height; yd++)
+        u32 i = 0;
+        for (; i + N <= n; i += N)
         {
-            auto ys = scale * yd;
-
-            rd = row_begin(dst, yd);
+            auto x = _mm_loadu_si128((__m128i const*)(src + i));
+            _mm_storeu_si128((__m128i*)(dst + 2 * i), _mm_unpacklo_epi8(x, x));
+            _mm_storeu_si128((__m128i*)(dst + 2 * i + N), _mm_unpackhi_epi8(x, x));
+        }
 
-            for (u32 xd = 0; xd < dst.width; xd++)
-            {
-                auto xs = scale * xd;
+        dup_tail<u8, 2>(src, dst, i, n);
+    }
 
-                red   = 0.0f;
-                green = 0.0f;
-                blue  = 0.0f;
 
-                for (u32 v = 0; v < scale; v++)
-                {
-                    rs = row_begin(src, ys + v) + xs;
-                    for (u32 u = 0; u < scale; u++)
-                    {
-                        auto s = rs[u];
-                        red   += s.red;
-                        green += s.green;
-                        blue  += s.blue;
-                    }
-                }
+    CPU_TARGET("sse4.1")
+    static void dup4_u8_sse41(void const* src_v, void* dst_v, u32 n)
+    {
+        constexpr u32 N = 16;
 
-                red   *= i_scale;
-                green *= i_scale;
-                blue  *= i_scale;
+        auto src = (u8 const*)src_v;
+        auto dst = (u8*)dst_v;
 
-                rd[xd] = to_pixel((u8)red, (u8)green, (u8)blue);
-            }
+        u32 i = 0;
+        for (; i + N <= n; i += N)
+        {
+            auto x = _mm_loadu_si128((__m128i const*)(src + i));
+            auto lo = _mm_unpacklo_epi8(x, x);
+            auto hi = _mm_unpackhi_epi8(x, x);
+
+            auto d = (__m128i*)(dst + 4 * i);
+            _mm_storeu_si128(d + 0, _mm_unpacklo_epi16(lo, lo));
+            _mm_storeu_si128(d + 1, _mm_unpackhi_epi16(lo, lo));
+            _mm_storeu_si128(d + 2, _mm_unpacklo_epi16(hi, hi));
+            _mm_storeu_si128(d + 3, _mm_unpackhi_epi16(hi, hi));
         }
+
+        dup_tail<u8, 4>(src, dst, i, n);
     }
 
 
-    template <class SRC, class DST>
-    static void scale_down_gray_t(SRC const& src, DST const& dst, u32 scale)
+    CPU_TARGET("sse4.1")
+    static void dup2_u32_sse41(void const* src_v, void* dst_v, u32 n)
     {
-        constexpr u32 SCALE_MAX = 8;
+        constexpr u32 N = 4;
 
-        assert(scale <= SCALE_MAX);
+        auto src = (u32 const*)src_v;
+        auto dst = (u32*)dst_v;
 
-        const f32 i_scale = 1.0f / (scale * scale);
+        u32 i = 0;
+        for (; i + N <= n; i += N)
+        {
+            auto x = _mm_loadu_si128((__m128i const*)(src + i));
+            _mm_storeu_si128((__m128i*)(dst + 2 * i), _mm_unpacklo_epi32(x, x));
+            _mm_storeu_si128((__m128i*)(dst + 2 * i + N), _mm_unpackhi_epi32(x, x));
+        }
 
-        u8* rd = 0;
+        dup_tail<u32, 2>(src, dst, i, n);
+    }
+}
+}
 
-        u8* rs[SCALE_MAX] = { 0 };
 
-        f32 gray = 0.0f;
+/* simd avx2 */
 
-        for (u32 yd = 0; yd < dst.height; yd++)
+namespace image
+{
+namespace simd
+{
+    // every avx2 cpu has popcnt
+    CPU_TARGET("popcnt")
+    static void bit_sums_popcnt(u64 const* row, u32 x_begin, u32 width, u64& count, u64& x_sum)
+    {
+        bit_sums_t(row, x_begin, width, count, x_sum);
+    }
+
+
+    CPU_TARGET("avx2")
+    static void vsum_rows_avx2(u8* const* rows, u32 n_rows, u16* dst, u32 len)
+    {
+        constexpr u32 N = 32;
+
+        u32 i = 0;
+        for (; i + N <= len; i += N)
         {
-            auto ys = scale * yd;
+            auto lo = _mm256_setzero_si256();
+            auto hi = _mm256_setzero_si256();
 
-            rd = row_begin(dst, yd);
-            for (u32 i = 0; i < scale; i++)
+            for (u32 v = 0; v < n_rows; v++)
             {
-                rs[i] = row_begin(src, ys + i);
+                auto x = _mm256_loadu_si256((__m256i const*)(rows[v] + i));
+                lo = _mm256_add_epi16(lo, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(x)));
+                hi = _mm256_add_epi16(hi, _mm256_cvtepu8_epi16(_mm256_extracti128_si256(x, 1)));
             }
 
-            for (u32 xd = 0; xd < dst.width; xd++)
-            {
-                gray = 0.0f;
+            _mm256_storeu_si256((__m256i*)(dst + i), lo);
+            _mm256_storeu_si256((__m256i*)(dst + i + N / 2), hi);
+        }
 
-                for (u32 v = 0; v < scale; v++)
-                {
-                    for (u32 u = 0; u < scale; u++)
-                    {
-                        gray += rs[v][u];
-                    }
+        vsum_rows_tail(rows, n_rows, dst, i, len);
+    }
 
-                    rs[v] += scale;
-                }
 
-                gray *= i_scale;
+    CPU_TARGET("avx2")
+    static void vwsum_rows_avx2(u8 const* src, u64 stride, u16 const* weights, u32 n_rows, u32* dst, u32 len)
+    {
+        constexpr u32 N = 16;
 
-                rd[xd] = (u8)gray;
+        u32 i = 0;
+        for (; i + N <= len; i += N)
+        {
+            auto lo = _mm256_setzero_si256();
+            auto hi = _mm256_setzero_si256();
+
+            for (u32 v = 0; v < n_rows; v += 2)
+            {
+                auto a = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i const*)(src + v * stride + i)));
+                auto b = v + 1 < n_rows 
+                    ? _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i const*)(src + (v + 1) * stride + i)))
+                    : _mm256_setzero_si256();
+
+                auto w = _mm256_set1_epi32((i32)weight_pair(weights, v, n_rows));
+
+                lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w));
+                hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w));
             }
-        }
-    }
 
+            // unpack works per 128 bit lane, lo has pixels 0-3 and 8-11, hi has 4-7 and 12-15
+            _mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute2x128_si256(lo, hi, 0x20));
+            _mm256_storeu_si256((__m256i*)(dst + i + N / 2), _mm256_permute2x128_si256(lo, hi, 0x31));
+        }
 
-    template <class SRC, class DST>
-    static void scale_down_gray_s(SRC const& src, DST const& dst, u32 scale)
-    {        
-        f32 const i_scale = 1.0f / (scale * scale);
+        vwsum_rows_tail(src, stride, weights, n_rows, dst, i, len);
+    }
 
-        f32 gray = 0.0f;
 
-        for (u32 yd = 0; yd < dst.height; yd++)
+    // r = y_mul * y + r_v * v, b = y_mul * y + b_u * u, g = y_mul * y - g_u * u - g_v * v
+    // each a madd of interleaved i16 pairs, the saturating packs clamp to u8
+    CPU_TARGET("avx2")
+    static void yuv_rgba_avx2(u8 const* y, u8 const* u, u8 const* v, Pixel* dst, u32 len, YUVRGB const& c)
+    {
+        constexpr u32 N = 16;
+        constexpr i32 round = 1 << (YUV_RGB_BITS - 1);
+
+        auto const y_offset = _mm256_set1_epi16(c.y_offset);
+        auto const c128 = _mm256_set1_epi16(128);
+        auto const ones = _mm256_set1_epi16(1);
+        auto const alpha = _mm256_set1_epi16(255);
+        auto const rnd = _mm256_set1_epi32(round);
+
+        auto const c_yv_r = _mm256_set1_epi32(i16_pair(c.y_mul, c.r_v));
+        auto const c_yu_b = _mm256_set1_epi32(i16_pair(c.y_mul, c.b_u));
+        auto const c_yu_g = _mm256_set1_epi32(i16_pair(c.y_mul, -c.g_u));
+        auto const c_v1_g = _mm256_set1_epi32(i16_pair(-c.g_v, round));
+
+        u32 i = 0;
+        for (; i + N <= len; i += N)
         {
-            auto ys = scale * yd;
+            auto y16 = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i const*)(y + i))), y_offset);
+            auto u16 = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i const*)(u + i))), c128);
+            auto v16 = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i const*)(v + i))), c128);
+
+            // per 128 bit lane, lo has pixels 0-3 and 8-11, hi has 4-7 and 12-15
+            auto yu_lo = _mm256_unpacklo_epi16(y16, u16);
+            auto yu_hi = _mm256_unpackhi_epi16(y16, u16);
+            auto yv_lo = _mm256_unpacklo_epi16(y16, v16);
+            auto yv_hi = _mm256_unpackhi_epi16(y16, v16);
+            auto v1_lo = _mm256_unpacklo_epi16(v16, ones);
+            auto v1_hi = _mm256_unpackhi_epi16(v16, ones);
+
+            auto r_lo = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(yv_lo, c_yv_r), rnd), YUV_RGB_BITS);
+            auto r_hi = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(yv_hi, c_yv_r), rnd), YUV_RGB_BITS);
+            auto b_lo = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(yu_lo, c_yu_b), rnd), YUV_RGB_BITS);
+            auto b_hi = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(yu_hi, c_yu_b), rnd), YUV_RGB_BITS);
+            auto g_lo = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(yu_lo, c_yu_g), _mm256_madd_epi16(v1_lo, c_v1_g)), YUV_RGB_BITS);
+            auto g_hi = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(yu_hi, c_yu_g), _mm256_madd_epi16(v1_hi, c_v1_g)), YUV_RGB_BITS);
+
+            // pixels 0-7 and 8-15 per lane
+            auto r = _mm256_packs_epi32(r_lo, r_hi);
+            auto g = _mm256_packs_epi32(g_lo, g_hi);
+            auto b = _mm256_packs_epi32(b_lo, b_hi);
+
+            // 8 red then 8 green per lane, interleaved to red green pairs
+            auto rg = _mm256_packus_epi16(r, g);
+            auto ba = _mm256_packus_epi16(b, alpha);
+            rg = _mm256_unpacklo_epi8(rg, _mm256_srli_si256(rg, 8));
+            ba = _mm256_unpacklo_epi8(ba, _mm256_srli_si256(ba, 8));
+
+            auto lo = _mm256_unpacklo_epi16(rg, ba);
+            auto hi = _mm256_unpackhi_epi16(rg, ba);
+
+            _mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute2x128_si256(lo, hi, 0x20));
+            _mm256_storeu_si256((__m256i*)(dst + i + N / 2), _mm256_permute2x128_si256(lo, hi, 0x31));
+        }
 
-            auto rd = row_begin(dst, yd);
+        yuv_rgba_tail(y, u, v, dst, i, len, c);
+    }
 
-            for (u32 xd = 0; xd < dst.width; xd++)
-            {
-                auto xs = scale * xd;
 
-                gray = 0.0f;
+    // zero extend, then copy each value into the upper bytes
 
-                for (u32 v = 0; v < scale; v++)
-                {
-                    auto rs = row_begin(src, ys + v) + xs;
-                    for (u32 u = 0; u < scale; u++)
-                    {
-                        gray += rs[u];
-                    }
-                }
+    CPU_TARGET("avx2")
+    static void dup2_u8_avx2(void const* src_v, void* dst_v, u32 n)
+    {
+        constexpr u32 N = 16;
 
-                gray *= i_scale;
+        auto src = (u8 const*)src_v;
+        auto dst = (u8*)dst_v;
 
-                rd[xd] = (u8)gray;
-            }
+        u32 i = 0;
+        for (; i + N <= n; i += N)
+        {
+            auto x = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i const*)(src + i)));
+            x = _mm256_or_si256(x, _mm256_slli_epi16(x, 8));
+            _mm256_storeu_si256((__m256i*)(dst + 2 * i), x);
         }
+
+        dup_tail<u8, 2>(src, dst, i, n);
     }
 
 
-    template <class SRC, class DST>
-    static void scale_down_rgba(SRC const& src, DST const& dst, u32 scale)
-    {       
-        switch (scale)
+    CPU_TARGET("avx2")
+    static void dup4_u8_avx2(void const* src_v, void* dst_v, u32 n)
+    {
+        constexpr u32 N = 8;
+
+        auto src = (u8 const*)src_v;
+        auto dst = (u8*)dst_v;
+
+        u32 i = 0;
+        for (; i + N <= n; i += N)
         {
-        case 2:
-        case 3:
-        case 4:
-        case 5:
-        case 6:
-        case 7:
-        case 8:
-            scale_down_rgba_t(src, dst, scale);
-            break;
+            auto x = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i const*)(src + i)));
+            x = _mm256_or_si256(x, _mm256_slli_epi32(x, 8));
+            x = _mm256_or_si256(x, _mm256_slli_epi32(x, 16));
+            _mm256_storeu_si256((__m256i*)(dst + 4 * i), x);
+        }
 
-        default:
-            scale_down_rgba_s(src, dst, scale);
-            break;
-        }        
+        dup_tail<u8, 4>(src, dst, i, n);
     }
 
 
-    template <class SRC, class DST>
-    static void scale_down_gray(SRC const& src, DST const& dst, u32 scale)
-    {       
-        switch (scale)
-        {
-        case 2:
-        case 3:
-        case 4:
-        case 5:
-        case 6:
-        case 7:
-        case 8:
-            scale_down_gray_t(src, dst, scale);
-            break;
+    CPU_TARGET("avx2")
+    static void dup2_u32_avx2(void const* src_v, void* dst_v, u32 n)
+    {
+        constexpr u32 N = 4;
 
-        default:
-            scale_down_gray_s(src, dst, scale);
-            break;
+        auto src = (u32 const*)src_v;
+        auto dst = (u32*)dst_v;
+
+        u32 i = 0;
+        for (; i + N <= n; i += N)
+        {
+            auto x = _mm256_cvtepu32_epi64(_mm_loadu_si128((__m128i const*)(src + i)));
+            x = _mm256_or_si256(x, _mm256_slli_epi64(x, 32));
+            _mm256_storeu_si256((__m256i*)(dst + 2 * i), x);
         }
+
+        dup_tail<u32, 2>(src, dst, i, n);
     }
-    
+}
+}
 
-    template <class SRC, class DST, class T>
-    void scale_up_matrix_t(T tval, SRC const& src, DST const& dst, u32 scale)
-    {   
-        constexpr u32 SCALE_MAX = 8;
-        
-        T ps = tval;
 
-        T* rd[scale] = { 0 };
-        
-        for (u32 ys = 0; ys < src.height; ys++)
+/* simd avx512 */
+
+namespace image
+{
+namespace simd
+{
+    CPU_TARGET("avx512f,avx512bw")
+    static void vsum_rows_avx512(u8* const* rows, u32 n_rows, u16* dst, u32 len)
+    {
+        constexpr u32 N = 64;
+
+        u32 i = 0;
+        for (; i + N <= len; i += N)
         {
-            auto yd = scale * ys;
-            auto rs = row_begin(src, ys);
+            auto lo = _mm512_setzero_si512();
+            auto hi = _mm512_setzero_si512();
 
-            for (u32 i = 0; i < scale; i++)
+            for (u32 v = 0; v < n_rows; v++)
             {
-                rd[i] = row_begin(dst, yd + i);
+                auto x = _mm512_loadu_si512((void const*)(rows[v] + i));
+                lo = _mm512_add_epi16(lo, _mm512_cvtepu8_epi16(_mm512_castsi512_si256(x)));
+                hi = _mm512_add_epi16(hi, _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(x, 1)));
             }
 
-            for (u32 xs = 0; xs < src.width; xs++)
-            {
-                ps = rs[xs];
-
-                for (u32 v = 0; v < scale; v++)
-                {
-                    for (u32 u = 0; u < scale; u++)
-                    {
-                        rd[v][u] = ps;
-                    }
-
-                    rd[v] += scale;
-                }
-            }
+            _mm512_storeu_si512((void*)(dst + i), lo);
+            _mm512_storeu_si512((void*)(dst + i + N / 2), hi);
         }
+
+        vsum_rows_tail(rows, n_rows, dst, i, len);
     }
 
 
-    template <class SRC, class DST>
-    void scale_up_matrix_s(SRC const& src, DST const& dst, u32 scale)
-    {        
-        for (u32 ys = 0; ys < src.height; ys++)
+    CPU_TARGET("avx512f,avx512bw")
+    static void vwsum_rows_avx512(u8 const* src, u64 stride, u16 const* weights, u32 n_rows, u32* dst, u32 len)
+    {
+        constexpr u32 N = 32;
+
+        // 64 bit halves of the 128 bit lanes back in pixel order
+        auto const idx_lo = _mm512_setr_epi64(0, 1, 8, 9, 2, 3, 10, 11);
+        auto const idx_hi = _mm512_setr_epi64(4, 5, 12, 13, 6, 7, 14, 15);
+
+        u32 i = 0;
+        for (; i + N <= len; i += N)
         {
-            auto yd = scale * ys;
-            auto rs = row_begin(src, ys);
+            auto lo = _mm512_setzero_si512();
+            auto hi = _mm512_setzero_si512();
 
-            for (u32 xs = 0; xs < src.width; xs++)
+            for (u32 v = 0; v < n_rows; v += 2)
             {
-                auto xd = scale * xs;
+                auto a = _mm512_cvtepu8_epi16(_mm256_loadu_si256((__m256i const*)(src + v * stride + i)));
+                auto b = v + 1 < n_rows 
+                    ? _mm512_cvtepu8_epi16(_mm256_loadu_si256((__m256i const*)(src + (v + 1) * stride + i)))
+                    : _mm512_setzero_si512();
 
-                auto p = rs[xs];
+                auto w = _mm512_set1_epi32((i32)weight_pair(weights, v, n_rows));
 
-                for (u32 v = 0; v < scale; v++)
-                {
-                    auto rd = row_begin(dst, yd + v) + xd;
-                    for (u32 u = 0; u < scale; u++)
-                    {
-                        rd[u] = p;
-                    }
-                }
+                lo = _mm512_add_epi32(lo, _mm512_madd_epi16(_mm512_unpacklo_epi16(a, b), w));
+                hi = _mm512_add_epi32(hi, _mm512_madd_epi16(_mm512_unpackhi_epi16(a, b), w));
             }
+
+            _mm512_storeu_si512((void*)(dst + i), _mm512_permutex2var_epi64(lo, idx_lo, hi));
+            _mm512_storeu_si512((void*)(dst + i + N / 2), _mm512_permutex2var_epi64(lo, idx_hi, hi));
         }
+
+        vwsum_rows_tail(src, stride, weights, n_rows, dst, i, len);
     }
 
 
-    template <class SRC, class DST>
-    void scale_up_matrix(SRC const& src, DST const& dst, u32 scale)
+    CPU_TARGET("avx512f,avx512bw")
+    static void dup2_u8_avx512(void const* src_v, void* dst_v, u32 n)
     {
-        switch (scale)
-        {
-        case 2:
-        case 3:
-        case 4:
-        case 5:
-        case 6:
-        case 7:
-        case 8:
-        {
-            auto tval = row_begin(src, 0)[0];
-            scale_up_matrix_t(tval, src, dst, scale);
-        }
-            break;
+        constexpr u32 N = 32;
 
-        default:
-            scale_up_matrix_s(src, dst, scale);
-            break;
+        auto src = (u8 const*)src_v;
+        auto dst = (u8*)dst_v;
+
+        u32 i = 0;
+        for (; i + N <= n; i += N)
+        {
+            auto x = _mm512_cvtepu8_epi16(_mm256_loadu_si256((__m256i const*)(src + i)));
+            x = _mm512_or_si512(x, _mm512_slli_epi16(x, 8));
+            _mm512_storeu_si512((void*)(dst + 2 * i), x);
         }
-    }
-    
-    
-    void scale_down(ImageView const& src, ImageView const& dst)
-    {
-        auto scale = src.width / dst.width;
 
-        assert(src.matrix_data_);
-        assert(dst.matrix_data_);
-        assert(src.width);
-        assert(src.height);
-        assert(dst.width);
-        assert(dst.height);
-        assert(src.width == scale * dst.width);
-        assert(src.height == scale * dst.height);
-        assert(scale > 1);
-        
-        scale_down_rgba(src, dst, scale);
+        dup_tail<u8, 2>(src, dst, i, n);
     }
 
 
-    void scale_down(GrayView const& src, GrayView const& dst)
+    CPU_TARGET("avx512f,avx512bw")
+    static void dup4_u8_avx512(void const* src_v, void* dst_v, u32 n)
     {
-        assert(src.matrix_data_);
-        assert(dst.matrix_data_);
-        assert(src.width);
-        assert(src.height);
-        assert(dst.width);
-        assert(dst.height);
+        constexpr u32 N = 16;
 
-        auto scale = src.width / dst.width;
-        
-        assert(src.width == scale * dst.width);
-        assert(src.height == scale * dst.height);
-        assert(scale > 1);
-        
-        scale_down_gray(src, dst, scale);
+        auto src = (u8 const*)src_v;
+        auto dst = (u8*)dst_v;
+
+        u32 i = 0;
+        for (; i + N <= n; i += N)
+        {
+            auto x = _mm512_cvtepu8_epi32(_mm_loadu_si128((__m128i const*)(src + i)));
+            x = _mm512_or_si512(x, _mm512_slli_epi32(x, 8));
+            x = _mm512_or_si512(x, _mm512_slli_epi32(x, 16));
+            _mm512_storeu_si512((void*)(dst + 4 * i), x);
+        }
+
+        dup_tail<u8, 4>(src, dst, i, n);
     }
 
 
-    void scale_up(ImageView const& src, ImageView const& dst)
+    CPU_TARGET("avx512f,avx512bw")
+    static void dup2_u32_avx512(void const* src_v, void* dst_v, u32 n)
     {
-        assert(src.matrix_data_);
-        assert(dst.matrix_data_);
-        assert(src.width);
-        assert(src.height);
-        assert(dst.width);
-        assert(dst.height);
+        constexpr u32 N = 8;
 
-        auto scale = dst.width / src.width;
-        
-        assert(dst.width == src.width * scale);
-        assert(dst.height == src.height * scale);
-        assert(scale > 1);
+        auto src = (u32 const*)src_v;
+        auto dst = (u32*)dst_v;
+
+        u32 i = 0;
+        for (; i + N <= n; i += N)
+        {
+            auto x = _mm512_cvtepu32_epi64(_mm256_loadu_si256((__m256i const*)(src + i)));
+            x = _mm512_or_si512(x, _mm512_slli_epi64(x, 32));
+            _mm512_storeu_si512((void*)(dst + 2 * i), x);
+        }
 
-        scale_up_matrix(src, dst, scale);
+        dup_tail<u32, 2>(src, dst, i, n);
     }
+}
+}
 
+#endif // CPU_X64
 
-    void scale_up(GrayView const& src, GrayView const& dst)
+
+/* simd dispatch */
+
+namespace image
+{
+namespace simd
+{
+    static Kernels make_kernels(cpu::SIMD level)
     {
-        assert(src.matrix_data_);
-        assert(dst.matrix_data_);
-        assert(src.width);
-        assert(src.height);
-        assert(dst.width);
-        assert(dst.height);
+        Kernels k{};
 
-        auto scale = dst.width / src.width;
-        
-        assert(dst.width == src.width * scale);
-        assert(dst.height == src.height * scale);
-        assert(scale > 1);
+        k.bit_sums = bit_sums_scalar;
+        k.vwsum_rows = vwsum_rows_scalar;
+        k.yuv_rgba = yuv_rgba_scalar;
 
-        scale_up_matrix(src, dst, scale);
-    }
+#ifdef CPU_X64
 
+        k.level = level;
 
-    void resize(ImageView const& src, ImageView const& dst)
-    {        
-        assert(src.width);
-		assert(src.height);
-		assert(src.matrix_data_);
-		assert(dst.width);
-		assert(dst.height);
-        assert(dst.matrix_data_);
+        switch (level)
+        {
+        case cpu::SIMD::AVX512:
+            k.vsum_rows = vsum_rows_avx512;
+            k.vwsum_rows = vwsum_rows_avx512;
+            k.yuv_rgba = yuv_rgba_avx2;
+            k.dup2_u8 = dup2_u8_avx512;
+            k.dup4_u8 = dup4_u8_avx512;
+            k.dup2_u32 = dup2_u32_avx512;
+            k.bit_sums = bit_sums_popcnt;
+            break;
 
-		int channels = 4;
-        auto layout = stbir_pixel_layout::STBIR_RGBA_NO_AW; // alpha channel doesn't matter
+        case cpu::SIMD::AVX2:
+            k.vsum_rows = vsum_rows_avx2;
+            k.vwsum_rows = vwsum_rows_avx2;
+            k.yuv_rgba = yuv_rgba_avx2;
+            k.dup2_u8 = dup2_u8_avx2;
+            k.dup4_u8 = dup4_u8_avx2;
+            k.dup2_u32 = dup2_u32_avx2;
+            k.bit_sums = bit_sums_popcnt;
+            break;
 
-		int width_src = (int)(src.width);
-		int height_src = (int)(src.height);
-		int stride_bytes_src = width_src * channels;
-        u8* data_src = (u8*)src.matrix_data_;
+        case cpu::SIMD::SSE4_1:
+            k.vsum_rows = vsum_rows_sse41;
+            k.vwsum_rows = vwsum_rows_sse41;
+            k.dup2_u8 = dup2_u8_sse41;
+            k.dup4_u8 = dup4_u8_sse41;
+            k.dup2_u32 = dup2_u32_sse41;
+            break;
 
-		int width_dst = (int)(dst.width);
-		int height_dst = (int)(dst.height);
-		int stride_bytes_dst = width_dst * channels;
-        u8* data_dst = (u8*)dst.matrix_data_;
+        default:
+            k.level = cpu::SIMD::None;
+            break;
+        }
 
-        auto data = stbir_resize_uint8_linear(
-			data_src, width_src, height_src, stride_bytes_src,
-			data_dst, width_dst, height_dst, stride_bytes_dst,
-			layout);
+#endif
 
-		assert(data && " *** stbir_resize_uint8_linear() failed *** ");
+        return k;
     }
 
 
-    void resize(ImageView const& src, SubView const& dst)
-    {        
-        assert(src.width);
-		assert(src.height);
-		assert(src.matrix_data_);
-		assert(dst.width);
-		assert(dst.height);
-        assert(dst.matrix_data_);
+    static Kernels& kernels()
+    {
+        static Kernels k = make_kernels(cpu::simd_level());
+        return k;
+    }
 
-		int channels = 4;
-        auto layout = stbir_pixel_layout::STBIR_RGBA_NO_AW; // alpha channel doesn't matter
 
-		int width_src = (int)(src.width);
-		int height_src = (int)(src.height);
-		int stride_bytes_src = width_src * channels;
-        u8* data_src = (u8*)src.matrix_data_;
+    // Integer row sums replace the per pixel f32 accumulation.
+    // The float ops per output pixel are the same as the scalar kernels, results are bit exact.
 
-		int width_dst = (int)(dst.width);
-		int height_dst = (int)(dst.height);
-		int stride_bytes_dst = (int)(dst.matrix_width) * channels;
-        u8* data_dst = (u8*)row_begin(dst, 0);
+    template <class SRC, class DST, class FN>
+    static void scale_down_gray_simd(SRC const& src, DST const& dst, u32 scale, Kernels const& k, FN const& to_dst)
+    {
+        assert(scale <= SCALE_MAX);
 
-        auto data = stbir_resize_uint8_linear(
-			data_src, width_src, height_src, stride_bytes_src,
-			data_dst, width_dst, height_dst, stride_bytes_dst,
-			layout);
+        f32 const i_scale = 1.0f / (scale * scale);
+
+        u16 sums[VSUM_LEN];
+        u8* rs[SCALE_MAX] = { 0 };
+
+        auto const chunk_w = VSUM_LEN / scale;
 
-		assert(data && " *** stbir_resize_uint8_linear() failed *** ");
+        for (u32 yd = 0; yd < dst.height; yd++)
+        {
+            auto ys = scale * yd;
+
+            auto rd = row_begin(dst, yd);
+            for (u32 i = 0; i < scale; i++)
+            {
+                rs[i] = row_begin(src, ys + i);
+            }
+
+            for (u32 x_begin = 0; x_begin < dst.width; x_begin += chunk_w)
+            {
+                auto n = num::min(chunk_w, dst.width - x_begin);
+                auto len = n * scale;
+
+                k.vsum_rows(rs, scale, sums, len);
+                for (u32 i = 0; i < scale; i++)
+                {
+                    rs[i] += len;
+                }
+
+                hsum_gray(sums, rd + x_begin, n, scale, i_scale, to_dst);
+            }
+        }
     }
 
 
-    void resize(GrayView const& src, GrayView const& dst)
+    static void scale_down_rgba_simd(ImageView const& src, ImageView const& dst, u32 scale, Kernels const& k)
     {
-        assert(src.width);
-		assert(src.height);
-		assert(src.matrix_data_);
-		assert(dst.width);
-		assert(dst.height);
-        assert(dst.matrix_data_);
+        constexpr u32 CH = 4;
 
-        int channels = 1;
-        auto layout = stbir_pixel_layout::STBIR_1CHANNEL;
+        assert(scale <= SCALE_MAX);
 
-		int width_src = (int)(src.width);
-		int height_src = (int)(src.height);
-		int stride_bytes_src = width_src * channels;
-        u8* data_src = (u8*)src.matrix_data_;
+        f32 const i_scale = 1.0f / (scale * scale);
+
+        u16 sums[VSUM_LEN];
+        u8* rs[SCALE_MAX] = { 0 };
+
+        auto const chunk_w = VSUM_LEN / (scale * CH);
+
+        for (u32 yd = 0; yd < dst.height; yd++)
+        {
+            auto ys = scale * yd;
+
+            auto rd = row_begin(dst, yd);
+            for (u32 i = 0; i < scale; i++)
+            {
+                rs[i] = (u8*)row_begin(src, ys + i);
+            }
+
+            for (u32 x_begin = 0; x_begin < dst.width; x_begin += chunk_w)
+            {
+                auto n = num::min(chunk_w, dst.width - x_begin);
+                auto len = n * scale * CH;
+
+                k.vsum_rows(rs, scale, sums, len);
+                for (u32 i = 0; i < scale; i++)
+                {
+                    rs[i] += len;
+                }
+
+                hsum_rgba(sums, rd + x_begin, n, scale, i_scale);
+            }
+        }
+    }
+
+
+    // one row is expanded, the others are copies of it
+    template <typename T>
+    static void scale_up_simd(MatrixView2D<T> const& src, MatrixView2D<T> const& dst, u32 scale, dup_fn dup)
+    {
+        auto const row_bytes = sizeof(T) * dst.width;
+
+        for (u32 ys = 0; ys < src.height; ys++)
+        {
+            auto yd = scale * ys;
+            auto rs = row_begin(src, ys);
+            auto rd = row_begin(dst, yd);
+
+            if (dup)
+            {
+                dup(rs, rd, src.width);
+            }
+            else
+            {
+                expand_row(rs, rd, src.width, scale);
+            }
+
+            for (u32 v = 1; v < scale; v++)
+            {
+                std::memcpy(row_begin(dst, yd + v), rd, row_bytes);
+            }
+        }
+    }
+}
+}
+
+
+namespace image
+{
+    void set_simd(cpu::SIMD level)
+    {
+        auto max = cpu::simd_level();
+
+        simd::kernels() = simd::make_kernels(level < max ? level : max);
+    }
+
+
+    cpu::SIMD get_simd()
+    {
+        return simd::kernels().level;
+    }
+}
+
+
+/* resize */
+
+namespace image
+{
+    // splits of the output run on the thread pool
+    static bool resize_u8(u8* data_src, int width_src, int height_src, int stride_bytes_src, 
+        u8* data_dst, int width_dst, int height_dst, int stride_bytes_dst, stbir_pixel_layout layout)
+    {
+        STBIR_RESIZE resize;
+        stbir_resize_init(&resize,
+            data_src, width_src, height_src, stride_bytes_src,
+            data_dst, width_dst, height_dst, stride_bytes_dst,
+            layout, STBIR_TYPE_UINT8);
+
+        auto n_src = (u64)width_src * height_src;
+        auto n_dst = (u64)width_dst * height_dst;
+        auto n_threads = thread_pool::n_workers() + 1;
+
+        if (n_threads < 2 || num::max(n_src, n_dst) < thread_pool::row_partition().serial_pixels)
+        {
+            return stbir_resize_extended(&resize);
+        }
+
+        auto n_splits = stbir_build_samplers_with_splits(&resize, (int)n_threads);
+        if (!n_splits)
+        {
+            return false;
+        }
+
+        std::atomic<bool> ok = true;
+
+        thread_pool::parallel_for((u32)n_splits, 1, [&](u32 begin, u32 end)
+        {
+            if (!stbir_resize_extended_split(&resize, (int)begin, (int)(end - begin)))
+            {
+                ok = false;
+            }
+        });
+
+        stbir_free_samplers(&resize);
+
+        return ok;
+    }
+}
+
+
+/* resize plan */
+
+namespace image
+{
+    void destroy_resize_plan(ResizePlan& plan)
+    {
+        auto resize = (STBIR_RESIZE*)plan.resize_;
+        if (resize)
+        {
+            stbir_free_samplers(resize);
+            mem::free(resize);
+        }
+
+        plan = {};
+    }
+
+
+    static bool build_resize_plan(ResizePlan& plan, u32 width_src, u32 height_src, u32 width_dst, u32 height_dst, u32 channels)
+    {
+        TRACE_ZONE("img::build_resize_plan");
+
+        destroy_resize_plan(plan);
+
+        auto resize = mem::malloc<STBIR_RESIZE>(1, "resize plan");
+        if (!resize)
+        {
+            return false;
+        }
+
+        // alpha channel doesn't matter
+        auto layout = channels == 4 ? STBIR_RGBA_NO_AW : STBIR_1CHANNEL;
+
+        // buffers are set for each resize
+        stbir_resize_init(resize,
+            0, (int)width_src, (int)height_src, 0,
+            0, (int)width_dst, (int)height_dst, 0,
+            layout, STBIR_TYPE_UINT8);
+
+        auto n_threads = thread_pool::n_workers() + 1;
+
+        auto n_splits = stbir_build_samplers_with_splits(resize, (int)n_threads);
+        if (!n_splits)
+        {
+            mem::free(resize);
+            return false;
+        }
+
+        plan.width_src = width_src;
+        plan.height_src = height_src;
+        plan.width_dst = width_dst;
+        plan.height_dst = height_dst;
+        plan.channels = channels;
+        plan.n_splits = (u32)n_splits;
+        plan.resize_ = resize;
+
+        return true;
+    }
+
+
+    static bool plan_matches(ResizePlan const& plan, u32 width_src, u32 height_src, u32 width_dst, u32 height_dst, u32 channels)
+    {
+        return
+            plan.resize_ &&
+            plan.width_src == width_src &&
+            plan.height_src == height_src &&
+            plan.width_dst == width_dst &&
+            plan.height_dst == height_dst &&
+            plan.channels == channels;
+    }
+
+
+    template <class SRC, class DST>
+    static bool resize_plan(ResizePlan& plan, SRC const& src, u32 stride_src, DST const& dst, u32 stride_dst, u32 channels)
+    {
+        assert(src.width);
+        assert(src.height);
+        assert(dst.width);
+        assert(dst.height);
+
+        if (!plan_matches(plan, src.width, src.height, dst.width, dst.height, channels) &&
+            !build_resize_plan(plan, src.width, src.height, dst.width, dst.height, channels))
+        {
+            return false;
+        }
+
+        auto resize = (STBIR_RESIZE*)plan.resize_;
+
+        stbir_set_buffer_ptrs(resize,
+            row_begin(src, 0), (int)(stride_src * channels),
+            row_begin(dst, 0), (int)(stride_dst * channels));
+
+        auto n_src = (u64)src.width * src.height;
+        auto n_dst = (u64)dst.width * dst.height;
+
+        if (plan.n_splits < 2 || num::max(n_src, n_dst) < thread_pool::row_partition().serial_pixels)
+        {
+            // all splits on the calling thread
+            return stbir_resize_extended(resize);
+        }
+
+        std::atomic<bool> ok = true;
+
+        thread_pool::parallel_for(plan.n_splits, 1, [&](u32 begin, u32 end)
+        {
+            if (!stbir_resize_extended_split(resize, (int)begin, (int)(end - begin)))
+            {
+                ok = false;
+            }
+        });
+
+        return ok;
+    }
+
+
+    void resize(ResizePlan& plan, ImageView const& src, ImageView const& dst)
+    {
+        TRACE_ZONE("img::resize");
+
+        assert(src.matrix_data_);
+        assert(dst.matrix_data_);
+
+        auto ok = resize_plan(plan, src, src.width, dst, dst.width, 4);
+        assert(ok && " *** resize_plan() failed *** ");
+    }
+
+
+    void resize(ResizePlan& plan, ImageView const& src, SubView const& dst)
+    {
+        TRACE_ZONE("img::resize");
+
+        assert(src.matrix_data_);
+        assert(dst.matrix_data_);
+
+        auto ok = resize_plan(plan, src, src.width, dst, dst.matrix_width, 4);
+        assert(ok && " *** resize_plan() failed *** ");
+    }
+
+
+    void resize(ResizePlan& plan, SubView const& src, SubView const& dst)
+    {
+        TRACE_ZONE("img::resize");
+
+        assert(src.matrix_data_);
+        assert(dst.matrix_data_);
+
+        auto ok = resize_plan(plan, src, src.matrix_width, dst, dst.matrix_width, 4);
+        assert(ok && " *** resize_plan() failed *** ");
+    }
+
+
+    void resize(ResizePlan& plan, GrayView const& src, GrayView const& dst)
+    {
+        TRACE_ZONE("img::resize");
+
+        assert(src.matrix_data_);
+        assert(dst.matrix_data_);
+
+        auto ok = resize_plan(plan, src, src.width, dst, dst.width, 1);
+        assert(ok && " *** resize_plan() failed *** ");
+    }
+}
+
+
+/* resize area */
+
+namespace image
+{
+    /*  Dst pixel i covers src [i * n_src / n_dst, (i + 1) * n_src / n_dst).
+        In units of 1 / n_dst src pixels both edges are integers, so the overlap with each src pixel is exact.
+        Weights are rounded from the cumulative overlap and always sum to AREA_ONE,
+        a flat image stays flat and the result never overflows u32. */
+
+    constexpr u32 AREA_BITS = 12;
+    constexpr u32 AREA_ONE = 1u << AREA_BITS;
+
+    constexpr u32 AREA_SHIFT = 2 * AREA_BITS;
+    constexpr u32 AREA_ROUND = 1u << (AREA_SHIFT - 1);
+
+
+    // returns the number of weights written
+    static u32 build_area_taps(AreaTap* taps, u16* weights, u32 offset, u32 n_src, u32 n_dst)
+    {
+        auto const cum_weight = [&](u64 overlap)
+        {
+            return (u32)((overlap * AREA_ONE + n_src / 2) / n_src);
+        };
+
+        u32 n_weights = 0;
+
+        for (u32 i = 0; i < n_dst; i++)
+        {
+            u64 lo = (u64)i * n_src;
+            u64 hi = lo + n_src;
+
+            auto begin = (u32)(lo / n_dst);
+            auto end = (u32)((hi + n_dst - 1) / n_dst);
+
+            auto& tap = taps[i];
+            tap.begin = begin;
+            tap.count = end - begin;
+            tap.weights = offset + n_weights;
+
+            u32 prev = 0;
+            for (u32 j = begin; j < end; j++)
+            {
+                auto overlap = num::min((u64)(j + 1) * n_dst, hi) - lo;
+                auto cum = cum_weight(overlap);
+
+                weights[tap.weights + j - begin] = (u16)(cum - prev);
+                prev = cum;
+            }
+
+            n_weights += tap.count;
+        }
+
+        return n_weights;
+    }
+
+
+    bool create_area_plan(AreaPlan& plan, u32 width_src, u32 height_src, u32 width_dst, u32 height_dst)
+    {
+        TRACE_ZONE("img::create_area_plan");
+
+        assert(width_src);
+        assert(height_src);
+        assert(width_dst);
+        assert(height_dst);
+
+        destroy_area_plan(plan);
+
+        // each dst pixel adds at most one tap to its share of src pixels
+        auto n_taps = width_dst + height_dst;
+        auto n_weights = width_src + width_dst + height_src + height_dst;
+
+        auto taps = mem::malloc<AreaTap>(n_taps, "area taps");
+        if (!taps)
+        {
+            return false;
+        }
+
+        auto weights = mem::malloc<u16>(n_weights, "area weights");
+        if (!weights)
+        {
+            mem::free(taps);
+            return false;
+        }
+
+        plan.width_src = width_src;
+        plan.height_src = height_src;
+        plan.width_dst = width_dst;
+        plan.height_dst = height_dst;
+        plan.x_taps = taps;
+        plan.y_taps = taps + width_dst;
+        plan.weights = weights;
+
+        auto n_x = build_area_taps(plan.x_taps, weights, 0, width_src, width_dst);
+        build_area_taps(plan.y_taps, weights, n_x, height_src, height_dst);
+
+        return true;
+    }
+
+
+    void destroy_area_plan(AreaPlan& plan)
+    {
+        if (plan.x_taps)
+        {
+            mem::free(plan.x_taps);
+        }
+
+        if (plan.weights)
+        {
+            mem::free(plan.weights);
+        }
+
+        plan = {};
+    }
+
+
+    static bool area_plan_matches(AreaPlan const& plan, u32 width_src, u32 height_src, u32 width_dst, u32 height_dst)
+    {
+        return
+            plan.x_taps &&
+            plan.width_src == width_src &&
+            plan.height_src == height_src &&
+            plan.width_dst == width_dst &&
+            plan.height_dst == height_dst;
+    }
+
+
+    // dst columns [x_begin, x_end) from the weighted row sums of src columns from c_begin
+    template <u32 CH>
+    static void hsum_area(AreaPlan const& plan, u32 const* sums, u32 c_begin, u8* dst, u32 x_begin, u32 x_end)
+    {
+        for (u32 x = x_begin; x < x_end; x++)
+        {
+            auto& tap = plan.x_taps[x];
+            auto w = plan.weights + tap.weights;
+            auto s = sums + (tap.begin - c_begin) * CH;
+
+            u32 total[CH] = { 0 };
+
+            for (u32 k = 0; k < tap.count; k++)
+            {
+                for (u32 c = 0; c < CH; c++)
+                {
+                    total[c] += w[k] * s[k * CH + c];
+                }
+            }
+
+            for (u32 c = 0; c < CH; c++)
+            {
+                dst[x * CH + c] = (u8)((total[c] + AREA_ROUND) >> AREA_SHIFT);
+            }
+        }
+    }
+
+
+    // CH bytes per pixel, dst rows [0, height) are plan rows [dst_y, dst_y + height)
+    template <u32 CH>
+    static void resize_area_rows_t(AreaPlan const& plan, u8 const* src, u64 src_stride, u8* dst, u64 dst_stride, u32 dst_y, u32 height)
+    {
+        constexpr u32 max_pixels = simd::AREA_LEN / CH;
+
+        u32 sums[simd::AREA_LEN];
+
+        auto vwsum_rows = simd::kernels().vwsum_rows;
+
+        auto width = plan.width_dst;
+
+        for (u32 y = 0; y < height; y++)
+        {
+            auto& y_tap = plan.y_taps[dst_y + y];
+            auto src_rows = src + y_tap.begin * src_stride;
+            auto y_weights = plan.weights + y_tap.weights;
+            auto d = dst + y * dst_stride;
+
+            // chunks of whole dst columns
+            u32 x_begin = 0;
+            while (x_begin < width)
+            {
+                auto c_begin = plan.x_taps[x_begin].begin;
+
+                auto x_end = x_begin + 1;
+                while (x_end < width)
+                {
+                    auto& tap = plan.x_taps[x_end];
+                    if (tap.begin + tap.count - c_begin > max_pixels)
+                    {
+                        break;
+                    }
+
+                    x_end++;
+                }
+
+                auto& last = plan.x_taps[x_end - 1];
+                auto n_pixels = last.begin + last.count - c_begin;
+
+                assert(n_pixels <= max_pixels);
+
+                vwsum_rows(src_rows + c_begin * CH, src_stride, y_weights, y_tap.count, sums, n_pixels * CH);
+                hsum_area<CH>(plan, sums, c_begin, d, x_begin, x_end);
+
+                x_begin = x_end;
+            }
+        }
+    }
+
+
+    template <u32 CH, class VIEW>
+    static void resize_area_t(AreaPlan& plan, VIEW const& src, VIEW const& dst)
+    {
+        assert(src.matrix_data_);
+        assert(dst.matrix_data_);
+
+        if (!area_plan_matches(plan, src.width, src.height, dst.width, dst.height) &&
+            !create_area_plan(plan, src.width, src.height, dst.width, dst.height))
+        {
+            assert(" *** create_area_plan() failed *** " && false);
+            return;
+        }
+
+        auto src_data = (u8 const*)src.matrix_data_;
+        auto dst_data = (u8*)dst.matrix_data_;
+
+        u64 src_stride = (u64)src.width * CH;
+        u64 dst_stride = (u64)dst.width * CH;
+
+        // src rows per dst row
+        auto row_pixels = num::max(src.width * (src.height / dst.height), dst.width);
+
+        thread_pool::parallel_for_rows(dst.height, row_pixels, [&](u32 y_begin, u32 y_end)
+        {
+            resize_area_rows_t<CH>(plan, src_data, src_stride, dst_data + y_begin * dst_stride, dst_stride, y_begin, y_end - y_begin);
+        });
+    }
+
+
+    void resize_area(AreaPlan& plan, ImageView const& src, ImageView const& dst)
+    {
+        TRACE_ZONE("img::resize_area");
+
+        resize_area_t<4>(plan, src, dst);
+    }
+
+
+    void resize_area(AreaPlan& plan, GrayView const& src, GrayView const& dst)
+    {
+        TRACE_ZONE("img::resize_area");
+
+        resize_area_t<1>(plan, src, dst);
+    }
+
+
+    void resize_area_rows(AreaPlan const& plan, GrayView const& src, GrayView const& dst, u32 dst_y)
+    {
+        TRACE_ZONE("img::resize_area_rows");
+
+        assert(src.matrix_data_);
+        assert(dst.matrix_data_);
+        assert(plan.x_taps);
+        assert(src.width == plan.width_src);
+        assert(src.height == plan.height_src);
+        assert(dst.width == plan.width_dst);
+        assert(dst_y + dst.height <= plan.height_dst);
+
+        resize_area_rows_t<1>(plan, src.matrix_data_, src.width, dst.matrix_data_, dst.width, dst_y, dst.height);
+    }
+}
+
+
+namespace image
+{
+    template <class SRC, class DST>
+    void scale_down_rgba_t(SRC const& src, DST const& dst, u32 scale)
+    {     
+        constexpr u32 SCALE_MAX = 8;
+
+        assert(scale <= SCALE_MAX);
+
+        const f32 i_scale = 1.0f / (scale * scale);
+
+        Pixel* rd = 0;
+
+        Pixel* rs[SCALE_MAX] = { 0 };
+
+        Pixel ps;
+
+        f32 red = 0.0f;
+        f32 green = 0.0f;
+        f32 blue = 0.0f;
+
+        for (u32 yd = 0; yd < dst.height; yd++)
+        {
+            auto ys = scale * yd;
+
+            rd = row_begin(dst, yd);
+            for (u32 i = 0; i < scale; i++)
+            {
+                rs[i] = row_begin(src, ys + i);
+            }
+
+            for (u32 xd = 0; xd < dst.width; xd++)
+            {
+                red   = 0.0f;
+                green = 0.0f;
+                blue  = 0.0f;
+
+                for (u32 v = 0; v < scale; v++)
+                {
+                    for (u32 u = 0; u < scale; u++)
+                    {
+                        ps = rs[v][u];
+                        red   += ps.red;
+                        green += ps.green;
+                        blue  += ps.blue;
+                    }
+
+                    rs[v] += scale;
+                }
+
+                red   *= i_scale;
+                green *= i_scale;
+                blue  *= i_scale;
+
+                rd[xd] = to_pixel((u8)red, (u8)green, (u8)blue);
+            }
+        }
+    }
+    
+    
+    template <class SRC, class DST>
+    static void scale_down_rgba_s(SRC const& src, DST const& dst, u32 scale)
+    {
+        f32 const i_scale = 1.0f / (scale * scale);
+
+        Pixel* rd = 0;
+        Pixel* rs = 0;
+
+        Pixel ps;
+
+        f32 red = 0.0f;
+        f32 green = 0.0f;
+        f32 blue = 0.0f;
+
+        for (u32 yd = 0; yd < dst.height; yd++)
+        {
+            auto ys = scale * yd;
+
+            rd = row_begin(dst, yd);
+
+            for (u32 xd = 0; xd < dst.width; xd++)
+            {
+                auto xs = scale * xd;
+
+                red   = 0.0f;
+                green = 0.0f;
+                blue  = 0.0f;
+
+                for (u32 v = 0; v < scale; v++)
+                {
+                    rs = row_begin(src, ys + v) + xs;
+                    for (u32 u = 0; u < scale; u++)
+                    {
+                        auto s = rs[u];
+                        red   += s.red;
+                        green += s.green;
+                        blue  += s.blue;
+                    }
+                }
+
+                red   *= i_scale;
+                green *= i_scale;
+                blue  *= i_scale;
+
+                rd[xd] = to_pixel((u8)red, (u8)green, (u8)blue);
+            }
+        }
+    }
+
+
+    template <class SRC, class DST>
+    static void scale_down_gray_t(SRC const& src, DST const& dst, u32 scale)
+    {
+        constexpr u32 SCALE_MAX = 8;
+
+        assert(scale <= SCALE_MAX);
+
+        const f32 i_scale = 1.0f / (scale * scale);
+
+        u8* rd = 0;
+
+        u8* rs[SCALE_MAX] = { 0 };
+
+        f32 gray = 0.0f;
+
+        for (u32 yd = 0; yd < dst.height; yd++)
+        {
+            auto ys = scale * yd;
+
+            rd = row_begin(dst, yd);
+            for (u32 i = 0; i < scale; i++)
+            {
+                rs[i] = row_begin(src, ys + i);
+            }
+
+            for (u32 xd = 0; xd < dst.width; xd++)
+            {
+                gray = 0.0f;
+
+                for (u32 v = 0; v < scale; v++)
+                {
+                    for (u32 u = 0; u < scale; u++)
+                    {
+                        gray += rs[v][u];
+                    }
+
+                    rs[v] += scale;
+                }
+
+                gray *= i_scale;
+
+                rd[xd] = (u8)gray;
+            }
+        }
+    }
+
+
+    template <class SRC, class DST>
+    static void scale_down_gray_s(SRC const& src, DST const& dst, u32 scale)
+    {        
+        f32 const i_scale = 1.0f / (scale * scale);
+
+        f32 gray = 0.0f;
+
+        for (u32 yd = 0; yd < dst.height; yd++)
+        {
+            auto ys = scale * yd;
+
+            auto rd = row_begin(dst, yd);
+
+            for (u32 xd = 0; xd < dst.width; xd++)
+            {
+                auto xs = scale * xd;
+
+                gray = 0.0f;
+
+                for (u32 v = 0; v < scale; v++)
+                {
+                    auto rs = row_begin(src, ys + v) + xs;
+                    for (u32 u = 0; u < scale; u++)
+                    {
+                        gray += rs[u];
+                    }
+                }
+
+                gray *= i_scale;
+
+                rd[xd] = (u8)gray;
+            }
+        }
+    }
+
+
+    template <class SRC, class DST>
+    static void scale_down_rgba(SRC const& src, DST const& dst, u32 scale)
+    {       
+        switch (scale)
+        {
+        case 2:
+        case 3:
+        case 4:
+        case 5:
+        case 6:
+        case 7:
+        case 8:
+            scale_down_rgba_t(src, dst, scale);
+            break;
+
+        default:
+            scale_down_rgba_s(src, dst, scale);
+            break;
+        }        
+    }
+
+
+    template <class SRC, class DST>
+    static void scale_down_gray(SRC const& src, DST const& dst, u32 scale)
+    {       
+        switch (scale)
+        {
+        case 2:
+        case 3:
+        case 4:
+        case 5:
+        case 6:
+        case 7:
+        case 8:
+            scale_down_gray_t(src, dst, scale);
+            break;
+
+        default:
+            scale_down_gray_s(src, dst, scale);
+            break;
+        }
+    }
+    
+
+    template <class SRC, class DST, class T>
+    void scale_up_matrix_t(T tval, SRC const& src, DST const& dst, u32 scale)
+    {   
+        constexpr u32 SCALE_MAX = 8;
+        
+        T ps = tval;
+
+        T* rd[scale] = { 0 };
+        
+        for (u32 ys = 0; ys < src.height; ys++)
+        {
+            auto yd = scale * ys;
+            auto rs = row_begin(src, ys);
+
+            for (u32 i = 0; i < scale; i++)
+            {
+                rd[i] = row_begin(dst, yd + i);
+            }
+
+            for (u32 xs = 0; xs < src.width; xs++)
+            {
+                ps = rs[xs];
+
+                for (u32 v = 0; v < scale; v++)
+                {
+                    for (u32 u = 0; u < scale; u++)
+                    {
+                        rd[v][u] = ps;
+                    }
+
+                    rd[v] += scale;
+                }
+            }
+        }
+    }
+
+
+    template <class SRC, class DST>
+    void scale_up_matrix_s(SRC const& src, DST const& dst, u32 scale)
+    {        
+        for (u32 ys = 0; ys < src.height; ys++)
+        {
+            auto yd = scale * ys;
+            auto rs = row_begin(src, ys);
+
+            for (u32 xs = 0; xs < src.width; xs++)
+            {
+                auto xd = scale * xs;
+
+                auto p = rs[xs];
+
+                for (u32 v = 0; v < scale; v++)
+                {
+                    auto rd = row_begin(dst, yd + v) + xd;
+                    for (u32 u = 0; u < scale; u++)
+                    {
+                        rd[u] = p;
+                    }
+                }
+            }
+        }
+    }
+
+
+    template <class SRC, class DST>
+    void scale_up_matrix(SRC const& src, DST const& dst, u32 scale)
+    {
+        switch (scale)
+        {
+        case 2:
+        case 3:
+        case 4:
+        case 5:
+        case 6:
+        case 7:
+        case 8:
+        {
+            auto tval = row_begin(src, 0)[0];
+            scale_up_matrix_t(tval, src, dst, scale);
+        }
+            break;
+
+        default:
+            scale_up_matrix_s(src, dst, scale);
+            break;
+        }
+    }
+    
+    
+    void scale_down(ImageView const& src, ImageView const& dst)
+    {
+        TRACE_ZONE("img::scale_down");
+
+        auto scale = src.width / dst.width;
+
+        assert(src.matrix_data_);
+        assert(dst.matrix_data_);
+        assert(src.width);
+        assert(src.height);
+        assert(dst.width);
+        assert(dst.height);
+        assert(src.width == scale * dst.width);
+        assert(src.height == scale * dst.height);
+        assert(scale > 1);
+
+        auto& k = simd::kernels();
+        auto use_simd = k.level != cpu::SIMD::None && scale <= simd::SCALE_MAX;
+
+        auto const scale_rows = [&](ImageView const& s, ImageView const& d)
+        {
+            if (use_simd)
+            {
+                simd::scale_down_rgba_simd(s, d, scale, k);
+            }
+            else
+            {
+                scale_down_rgba(s, d, scale);
+            }
+        };
+
+        parallel_rows(src, dst, scale, 1, scale_rows);
+    }
+
+
+    void scale_down(GrayView const& src, GrayView const& dst)
+    {
+        TRACE_ZONE("img::scale_down");
+
+        assert(src.matrix_data_);
+        assert(dst.matrix_data_);
+        assert(src.width);
+        assert(src.height);
+        assert(dst.width);
+        assert(dst.height);
+
+        auto scale = src.width / dst.width;
+        
+        assert(src.width == scale * dst.width);
+        assert(src.height == scale * dst.height);
+        assert(scale > 1);
+
+        auto& k = simd::kernels();
+        auto use_simd = k.level != cpu::SIMD::None && scale <= simd::SCALE_MAX;
+
+        auto const scale_rows = [&](GrayView const& s, GrayView const& d)
+        {
+            if (use_simd)
+            {
+                simd::scale_down_gray_simd(s, d, scale, k, [](u8 g){ return g; });
+            }
+            else
+            {
+                scale_down_gray(s, d, scale);
+            }
+        };
+
+        parallel_rows(src, dst, scale, 1, scale_rows);
+    }
+
+
+    void scale_up(ImageView const& src, ImageView const& dst)
+    {
+        TRACE_ZONE("img::scale_up");
+
+        assert(src.matrix_data_);
+        assert(dst.matrix_data_);
+        assert(src.width);
+        assert(src.height);
+        assert(dst.width);
+        assert(dst.height);
+
+        auto scale = dst.width / src.width;
+        
+        assert(dst.width == src.width * scale);
+        assert(dst.height == src.height * scale);
+        assert(scale > 1);
+
+        auto& k = simd::kernels();
+        auto dup = scale == 2 ? k.dup2_u32 : 0;
+
+        auto const scale_rows = [&](ImageView const& s, ImageView const& d)
+        {
+            if (k.level != cpu::SIMD::None)
+            {
+                simd::scale_up_simd(s, d, scale, dup);
+            }
+            else
+            {
+                scale_up_matrix(s, d, scale);
+            }
+        };
+
+        parallel_rows(src, dst, 1, scale, scale_rows);
+    }
+
+
+    void scale_up(GrayView const& src, GrayView const& dst)
+    {
+        TRACE_ZONE("img::scale_up");
+
+        assert(src.matrix_data_);
+        assert(dst.matrix_data_);
+        assert(src.width);
+        assert(src.height);
+        assert(dst.width);
+        assert(dst.height);
+
+        auto scale = dst.width / src.width;
+        
+        assert(dst.width == src.width * scale);
+        assert(dst.height == src.height * scale);
+        assert(scale > 1);
+
+        auto& k = simd::kernels();
+        auto dup = scale == 2 ? k.dup2_u8 : (scale == 4 ? k.dup4_u8 : 0);
+
+        auto const scale_rows = [&](GrayView const& s, GrayView const& d)
+        {
+            if (k.level != cpu::SIMD::None)
+            {
+                simd::scale_up_simd(s, d, scale, dup);
+            }
+            else
+            {
+                scale_up_matrix(s, d, scale);
+            }
+        };
+
+        parallel_rows(src, dst, 1, scale, scale_rows);
+    }
+
+
+    void resize(ImageView const& src, ImageView const& dst)
+    {        
+        TRACE_ZONE("img::resize");
+
+        assert(src.width);
+		assert(src.height);
+		assert(src.matrix_data_);
+		assert(dst.width);
+		assert(dst.height);
+        assert(dst.matrix_data_);
+
+		int channels = 4;
+        auto layout = stbir_pixel_layout::STBIR_RGBA_NO_AW; // alpha channel doesn't matter
+
+		int width_src = (int)(src.width);
+		int height_src = (int)(src.height);
+		int stride_bytes_src = width_src * channels;
+        u8* data_src = (u8*)src.matrix_data_;
+
+		int width_dst = (int)(dst.width);
+		int height_dst = (int)(dst.height);
+		int stride_bytes_dst = width_dst * channels;
+        u8* data_dst = (u8*)dst.matrix_data_;
+
+        auto ok = resize_u8(
+			data_src, width_src, height_src, stride_bytes_src,
+			data_dst, width_dst, height_dst, stride_bytes_dst,
+			layout);
+
+		assert(ok && " *** resize_u8() failed *** ");
+    }
+
+
+    void resize(ImageView const& src, SubView const& dst)
+    {        
+        TRACE_ZONE("img::resize");
+
+        assert(src.width);
+		assert(src.height);
+		assert(src.matrix_data_);
+		assert(dst.width);
+		assert(dst.height);
+        assert(dst.matrix_data_);
+
+		int channels = 4;
+        auto layout = stbir_pixel_layout::STBIR_RGBA_NO_AW; // alpha channel doesn't matter
+
+		int width_src = (int)(src.width);
+		int height_src = (int)(src.height);
+		int stride_bytes_src = width_src * channels;
+        u8* data_src = (u8*)src.matrix_data_;
+
+		int width_dst = (int)(dst.width);
+		int height_dst = (int)(dst.height);
+		int stride_bytes_dst = (int)(dst.matrix_width) * channels;
+        u8* data_dst = (u8*)row_begin(dst, 0);
+
+        auto ok = resize_u8(
+			data_src, width_src, height_src, stride_bytes_src,
+			data_dst, width_dst, height_dst, stride_bytes_dst,
+			layout);
+
+		assert(ok && " *** resize_u8() failed *** ");
+    }
+
+
+    void resize(SubView const& src, SubView const& dst)
+    {        
+        TRACE_ZONE("img::resize");
+
+        assert(src.width);
+		assert(src.height);
+		assert(src.matrix_data_);
+		assert(dst.width);
+		assert(dst.height);
+        assert(dst.matrix_data_);
+
+		int channels = 4;
+        auto layout = stbir_pixel_layout::STBIR_RGBA_NO_AW; // alpha channel doesn't matter
+
+		int width_src = (int)(src.width);
+		int height_src = (int)(src.height);
+		int stride_bytes_src = (int)(src.matrix_width) * channels;
+        u8* data_src = (u8*)row_begin(src, 0);
+
+		int width_dst = (int)(dst.width);
+		int height_dst = (int)(dst.height);
+		int stride_bytes_dst = (int)(dst.matrix_width) * channels;
+        u8* data_dst = (u8*)row_begin(dst, 0);
+
+        auto ok = resize_u8(
+			data_src, width_src, height_src, stride_bytes_src,
+			data_dst, width_dst, height_dst, stride_bytes_dst,
+			layout);
+
+		assert(ok && " *** resize_u8() failed *** ");
+    }
+
+
+    void resize(GrayView const& src, GrayView const& dst)
+    {
+        TRACE_ZONE("img::resize");
+
+        assert(src.width);
+		assert(src.height);
+		assert(src.matrix_data_);
+		assert(dst.width);
+		assert(dst.height);
+        assert(dst.matrix_data_);
+
+        int channels = 1;
+        auto layout = stbir_pixel_layout::STBIR_1CHANNEL;
+
+		int width_src = (int)(src.width);
+		int height_src = (int)(src.height);
+		int stride_bytes_src = width_src * channels;
+        u8* data_src = (u8*)src.matrix_data_;
+
+		int width_dst = (int)(dst.width);
+		int height_dst = (int)(dst.height);
+		int stride_bytes_dst = width_dst * channels;
+        u8* data_dst = (u8*)dst.matrix_data_;
+
+        auto ok = resize_u8(
+			data_src, width_src, height_src, stride_bytes_src,
+			data_dst, width_dst, height_dst, stride_bytes_dst,
+			layout);
+
+		assert(ok && " *** resize_u8() failed *** ");
+    }
+}
+
+
+/* map */
+
+namespace image
+{
+    void map(GrayView const& src, ImageView const& dst)
+    {
+        TRACE_ZONE("img::map");
+
+        assert(src.matrix_data_);
+        assert(src.width);
+        assert(src.height);
+        assert(dst.matrix_data_);
+        assert(dst.width);
+        assert(dst.height);
+        assert(src.width == dst.width);
+        assert(src.height == dst.height);
+
+        auto const func = [](u8 sp)
+        {
+            return to_pixel(sp);
+        };
+
+        span::transform(to_span(src), to_span(dst), func);
+    }
+
+
+    static void map_scale_down_s(GrayView const& src, ImageView const& dst, u32 scale)
+    {
+        constexpr u32 SCALE_MAX = 8;
+
+        assert(scale <= SCALE_MAX);
+
+        f32 const i_scale = 1.0f / (scale * scale);
+
+        Pixel* rd = 0;
+        u8* rs[SCALE_MAX] = { 0 };
+
+        f32 gray = 0.0f;
+
+        for (u32 yd = 0; yd < dst.height; yd++)
+        {
+            auto ys = scale * yd;
+
+            rd = row_begin(dst, yd);
+            for (u32 i = 0; i < scale; i++)
+            {
+                rs[i] = row_begin(src, ys + i);
+            }
+
+            for (u32 xd = 0; xd < dst.width; xd++)
+            {
+                gray = 0.0f;
+
+                for (u32 v = 0; v < scale; v++)
+                {
+                    for (u32 u = 0; u < scale; u++)
+                    {
+                        gray += rs[v][u];
+                    }
+
+                    rs[v] += scale;
+                }
+
+                gray *= i_scale;
+
+                rd[xd] = to_pixel((u8)gray);
+            }
+        }
+    }
+
+
+    void map_scale_down(GrayView const& src, ImageView const& dst)
+    {
+        TRACE_ZONE("img::map_scale_down");
+
+        constexpr u32 SCALE_MAX = 8;
+        auto scale = src.width / dst.width;
+
+        assert(src.matrix_data_);
+        assert(dst.matrix_data_);
+        assert(src.width == scale * dst.width);
+        assert(src.height == scale * dst.height);
+        assert(scale > 1);
+        assert(scale <= SCALE_MAX);
+
+        auto& k = simd::kernels();
+
+        auto const scale_rows = [&](GrayView const& s, ImageView const& d)
+        {
+            if (k.level != cpu::SIMD::None)
+            {
+                simd::scale_down_gray_simd(s, d, scale, k, [](u8 g){ return to_pixel(g); });
+            }
+            else
+            {
+                map_scale_down_s(s, d, scale);
+            }
+        };
+
+        parallel_rows(src, dst, scale, 1, scale_rows);
+    }
+
+
+    void map_scale_up(GrayView const& src, ImageView const& dst)
+    {
+        TRACE_ZONE("img::map_scale_up");
+
+        auto scale = dst.width / src.width;
+
+        assert(src.matrix_data_);
+        assert(dst.matrix_data_);
+        assert(dst.width == src.width * scale);
+        assert(dst.height == src.height * scale);
+        assert(scale > 1);
+
+        internal::transform_scale_up(src, dst, scale, [](u8 p){ return to_pixel(p); });
+    }
+}
+
+
+/* draw */
+
+namespace image
+{
+    void draw_rect(ImageView const& view, Rect2Du32 const& rect, Pixel color, u32 thick)
+    {
+        auto region = sub_view(view, rect);
+        auto w = region.width;
+        auto h = region.height;
+        auto t = thick;
+
+        auto ok = w && h && t;
+        if (!ok)
+        {
+            return;
+        }
+
+        auto top    = make_rect(0,     0,     w, t);
+        auto bottom = make_rect(0,     h - t, w, t);
+        auto left   = make_rect(0,     t,     t, h - 2 * t);
+        auto right  = make_rect(w - t, t,     t, h - 2 * t);
+
+        fill(sub_view(region, top), color);
+        fill(sub_view(region, bottom), color);
+        fill(sub_view(region, left), color);
+        fill(sub_view(region, right), color);
+    }
+}
+
+
+/* convolve */
+
+namespace image
+{
+namespace conv
+{
+    template <u32 N>
+    class Kernel1D
+    {
+    public:
+        i32 taps[N];
+    };
+
+
+    // k[y][x] = scale * col[y] * row[x]
+    // integer taps, the scale is applied once to the result
+    template <u32 N>
+    class SeparableKernel
+    {
+    public:
+        Kernel1D<N> row;
+        Kernel1D<N> col;
+
+        f32 scale;
+    };
+
+
+    template <u32 N>
+    constexpr f32 at(SeparableKernel<N> const& k, u32 y, u32 x)
+    {
+        return k.scale * (f32)(k.col.taps[y] * k.row.taps[x]);
+    }
+
+
+    constexpr bool near(f32 a, f32 b)
+    {
+        constexpr f32 eps = 1e-6f;
+
+        auto d = a - b;
+        return d < eps && d > -eps;
+    }
+
+
+    // rank 1, every 2x2 minor is zero
+    template <u32 N, u32 NN>
+    constexpr bool is_separable(f32 const (&k)[NN])
+    {
+        static_assert(NN == N * N);
+
+        for (u32 y0 = 0; y0 < N; y0++)
+        {
+            for (u32 y1 = y0 + 1; y1 < N; y1++)
+            {
+                for (u32 x0 = 0; x0 < N; x0++)
+                {
+                    for (u32 x1 = x0 + 1; x1 < N; x1++)
+                    {
+                        auto a = k[y0 * N + x0] * k[y1 * N + x1];
+                        auto b = k[y0 * N + x1] * k[y1 * N + x0];
+                        if (!near(a, b))
+                        {
+                            return false;
+                        }
+                    }
+                }
+            }
+        }
+
+        return true;
+    }
+
+
+    template <u32 N, u32 NN>
+    constexpr bool matches(SeparableKernel<N> const& sk, f32 const (&k)[NN])
+    {
+        static_assert(NN == N * N);
+
+        for (u32 y = 0; y < N; y++)
+        {
+            for (u32 x = 0; x < N; x++)
+            {
+                if (!near(at(sk, y, x), k[y * N + x]))
+                {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+
+    template <auto const& K>
+    constexpr u32 kernel_size()
+    {
+        return sizeof(K.row.taps) / sizeof(K.row.taps[0]);
+    }
+
+
+    // taps are compile time constants, zero taps generate no code
+
+    template <auto const& K, typename T, size_t... I>
+    static inline i32 dot_row(T const* s, std::index_sequence<I...>)
+    {
+        return (0 + ... + (K.row.taps[I] ? K.row.taps[I] * (i32)s[I] : 0));
+    }
+
+
+    template <auto const& K, size_t... I>
+    static inline i32 dot_col(i32 const* const* rows, u32 x, std::index_sequence<I...>)
+    {
+        return (0 + ... + (K.col.taps[I] ? K.col.taps[I] * rows[I][x] : 0));
+    }
+
+
+    // dst columns per strip, ring buffers stay on the stack
+    constexpr u32 STRIP_WIDTH = 256;
+
+
+    // Two kernels over the same source, out(a, b) combines the integer results.
+    // Each source row is filtered horizontally once per strip into a ring of N rows,
+    // the vertical pass reads the ring.
+    // src is read kernel_size / 2 pixels outside of its bounds.
+    template <auto const& KA, auto const& KB, class FN>
+    static void convolve2(GraySubView const& src, GraySubView const& dst, FN const& out)
+    {
+        constexpr u32 N = kernel_size<KA>();
+        constexpr i32 R = N / 2;
+        constexpr auto idx = std::make_index_sequence<N>{};
+
+        static_assert(kernel_size<KB>() == N);
+
+        i32 ring_a[N][STRIP_WIDTH];
+        i32 ring_b[N][STRIP_WIDTH];
+
+        i32 const* rows_a[N] = { 0 };
+        i32 const* rows_b[N] = { 0 };
+
+        i32 const h = (i32)dst.height;
+
+        for (u32 x_begin = 0; x_begin < dst.width; x_begin += STRIP_WIDTH)
+        {
+            auto w = num::min(STRIP_WIDTH, dst.width - x_begin);
+
+            for (i32 ys = -R; ys < h + R; ys++)
+            {
+                auto slot = (u32)(ys + R) % N;
+                auto rs = row_begin(src, ys) + x_begin - R;
+                auto ra = ring_a[slot];
+                auto rb = ring_b[slot];
+
+                for (u32 x = 0; x < w; x++)
+                {
+                    ra[x] = dot_row<KA>(rs + x, idx);
+                    rb[x] = dot_row<KB>(rs + x, idx);
+                }
+
+                // last source row of dst row yd
+                auto yd = ys - R;
+                if (yd < 0)
+                {
+                    continue;
+                }
+
+                for (u32 i = 0; i < N; i++)
+                {
+                    rows_a[i] = ring_a[(yd + i) % N];
+                    rows_b[i] = ring_b[(yd + i) % N];
+                }
+
+                auto rd = row_begin(dst, (u32)yd) + x_begin;
+
+                for (u32 x = 0; x < w; x++)
+                {
+                    rd[x] = out(dot_col<KA>(rows_a, x, idx), dot_col<KB>(rows_b, x, idx));
+                }
+            }
+        }
+    }
+}
+}
+
+
+namespace image
+{
+    static constexpr f32 GRAD_X_5X5[25] = 
+    {
+          0.0f,   0.0f, 0.0f,  0.0f,  0.0f,
+        -0.08f, -0.12f, 0.0f, 0.12f, 0.08f,
+		-0.24f, -0.36f, 0.0f, 0.36f, 0.24f,
+		-0.08f, -0.12f, 0.0f, 0.12f, 0.08f,
+          0.0f,   0.0f, 0.0f,  0.0f,  0.0f,
+    };
+
+
+    static constexpr f32 GRAD_Y_5X5[25] = 
+    {
+        0.0f, -0.08f, -0.24f, -0.08f, 0.0f,
+		0.0f, -0.12f, -0.36f, -0.12f, 0.0f,
+		0.0f,   0.0f,   0.0f,   0.0f, 0.0f,
+		0.0f,  0.12f,  0.36f,  0.12f, 0.0f,
+		0.0f,  0.08f,  0.24f,  0.08f, 0.0f,
+    };
+
+
+    // smooth [1 3 1] across the derivative 0.04 * [-2 -3 0 3 2]
+
+    static constexpr conv::SeparableKernel<5> GRAD_X_SEP = 
+    {
+        { -2, -3, 0, 3, 2 },
+        {  0,  1, 3, 1, 0 },
+        0.04f
+    };
+
+
+    static constexpr conv::SeparableKernel<5> GRAD_Y_SEP = 
+    {
+        {  0,  1, 3, 1, 0 },
+        { -2, -3, 0, 3, 2 },
+        0.04f
+    };
+
+
+    static_assert(conv::is_separable<5>(GRAD_X_5X5));
+    static_assert(conv::is_separable<5>(GRAD_Y_5X5));
+    static_assert(conv::matches(GRAD_X_SEP, GRAD_X_5X5));
+    static_assert(conv::matches(GRAD_Y_SEP, GRAD_Y_5X5));
+    static_assert(GRAD_X_SEP.scale == GRAD_Y_SEP.scale);
+
+
+    static void gradients_5x5(GraySubView const& src, GraySubView const& dst)
+    {
+        auto const magnitude = [](i32 gx, i32 gy)
+        {
+            auto g = num::q_hypot((f32)gx, (f32)gy) * GRAD_X_SEP.scale;
+            return (u8)num::min(g, 255.0f);
+        };
+
+        conv::convolve2<GRAD_X_SEP, GRAD_Y_SEP>(src, dst, magnitude);
+    }
+}
+
+
+/* gradients */
+
+namespace image
+{
+    void gradients(GrayView const& src, GrayView const& dst)
+    {
+        TRACE_ZONE("img::gradients");
+
+        assert(src.matrix_data_);
+        assert(dst.matrix_data_);
+        assert(src.width == dst.width);
+        assert(src.height == dst.height);
+
+        // for 5x5 kernel = 5 / 2;
+        constexpr u32 kd = 5 / 2;
+
+        Rect2Du32 r{};
+        r.x_begin = kd;
+        r.x_end = src.width - kd;
+        r.y_begin = kd;
+        r.y_end = src.height - kd;
+
+        auto sub_src = sub_view(src, r);
+        auto sub_dst = sub_view(dst, r);
+
+        parallel_rows(sub_src, sub_dst, 1, 1, [](auto const& s, auto const& d){ gradients_5x5(s, d); });
+
+        /*auto top = make_rect(0, 0, dst.width, kd);
+        auto bottom = make_rect(0, r.y_end, dst.width, kd);
+        auto left = make_rect(0, kd, kd, h);
+        auto right = make_rect(r.x_end, kd, kd, h);
+
+        fill(sub_view(dst, top), 0);
+        fill(sub_view(dst, bottom), 0);
+        fill(sub_view(dst, left), 0);
+        fill(sub_view(dst, right), 0);*/        
+    }
+    
+}
+
+
+/* bit mask */
+
+namespace image
+{
+    BitMaskView make_bit_mask(u32 width, u32 height, Buffer64& buffer)
+    {
+        BitMaskView view{};
+
+        view.row_words = bit_mask_row_words(width);
+        view.matrix_data_ = mb::push_elements(buffer, view.row_words * height);
+        if (view.matrix_data_)
+        {
+            view.width = width;
+            view.height = height;
+        }
+
+        return view;
+    }
+
+
+    void to_bit_mask(GrayView const& src, BitMaskView const& dst)
+    {
+        TRACE_ZONE("img::to_bit_mask");
+
+        assert(src.matrix_data_);
+        assert(dst.matrix_data_);
+        assert(src.width == dst.width);
+        assert(src.height == dst.height);
+
+        for (u32 y = 0; y < src.height; y++)
+        {
+            auto s = row_begin(src, y);
+            auto d = row_begin(dst, y);
+
+            for (u32 w = 0; w < dst.row_words; w++)
+            {
+                auto x_begin = w * 64;
+                auto x_end = num::min(x_begin + 64, src.width);
+
+                u64 bits = 0;
+                for (u32 x = x_begin; x < x_end; x++)
+                {
+                    bits |= (u64)(s[x] != 0) << (x - x_begin);
+                }
+
+                d[w] = bits;
+            }
+        }
+    }
+
+
+    void map(BitMaskView const& src, GrayView const& dst)
+    {
+        TRACE_ZONE("img::map");
+
+        assert(src.matrix_data_);
+        assert(dst.matrix_data_);
+        assert(src.width == dst.width);
+        assert(src.height == dst.height);
+
+        for (u32 y = 0; y < src.height; y++)
+        {
+            auto s = row_begin(src, y);
+            auto d = row_begin(dst, y);
+
+            for (u32 x = 0; x < src.width; x++)
+            {
+                d[x] = (s[x / 64] >> (x % 64)) & 1 ? 255 : 0;
+            }
+        }
+    }
+}
+
+
+/* morphology */
+
+namespace image
+{
+    /*  Separable and bit parallel, 64 pixels per word operation.
+        Each row is combined with the rows above and below, then with its left and right
+        neighbors one pixel at a time by shifting the words of the row.
+        Pixels outside the mask are ones for erode and zeros for dilate, so they do not change the result. */
+
+    template <bool ERODE>
+    static inline u64 morph_op(u64 a, u64 b)
+    {
+        if constexpr (ERODE)
+        {
+            return a & b;
+        }
+        else
+        {
+            return a | b;
+        }
+    }
+
+
+    // one pixel to the left and right, in place
+    template <bool ERODE>
+    static void morph_row_step(u64* row, u32 n_words, u64 last_bits)
+    {
+        constexpr u64 fill = ERODE ? ~(u64)0 : 0;
+
+        // bits past the width act as outside pixels
+        row[n_words - 1] = (row[n_words - 1] & last_bits) | (fill & ~last_bits);
+
+        u64 prev = fill;
+
+        for (u32 i = 0; i < n_words; i++)
+        {
+            auto w = row[i];
+            auto next = i + 1 < n_words ? row[i + 1] : fill;
+
+            // bit x from x - 1 and from x + 1
+            auto left = (w << 1) | (prev >> 63);
+            auto right = (w >> 1) | (next << 63);
+
+            row[i] = morph_op<ERODE>(w, morph_op<ERODE>(left, right));
+            prev = w;
+        }
+
+        row[n_words - 1] &= last_bits;
+    }
+
+
+    template <bool ERODE>
+    static void morph(BitMaskView const& src, BitMaskView const& dst, u32 radius)
+    {
+        assert(src.matrix_data_);
+        assert(dst.matrix_data_);
+        assert(src.matrix_data_ != dst.matrix_data_);
+        assert(src.width == dst.width);
+        assert(src.height == dst.height);
+
+        auto n_words = src.row_words;
+        auto h = src.height;
+
+        auto tail = src.width % 64;
+        auto last_bits = tail ? ((u64)1 << tail) - 1 : ~(u64)0;
+
+        for (u32 y = 0; y < h; y++)
+        {
+            auto y_begin = y > radius ? y - radius : 0;
+            auto y_end = num::min(y + radius + 1, h);
+
+            auto d = row_begin(dst, y);
+            std::memcpy(d, row_begin(src, y_begin), n_words * sizeof(u64));
+
+            for (u32 v = y_begin + 1; v < y_end; v++)
+            {
+                auto s = row_begin(src, v);
+                for (u32 i = 0; i < n_words; i++)
+                {
+                    d[i] = morph_op<ERODE>(d[i], s[i]);
+                }
+            }
+
+            for (u32 r = 0; r < radius; r++)
+            {
+                morph_row_step<ERODE>(d, n_words, last_bits);
+            }
+        }
+    }
+
+
+    void erode(BitMaskView const& src, BitMaskView const& dst, u32 radius)
+    {
+        TRACE_ZONE("img::erode");
+
+        morph<true>(src, dst, radius);
+    }
+
+
+    void dilate(BitMaskView const& src, BitMaskView const& dst, u32 radius)
+    {
+        TRACE_ZONE("img::dilate");
+
+        morph<false>(src, dst, radius);
+    }
+
+
+    void opening(BitMaskView const& src, BitMaskView const& tmp, BitMaskView const& dst, u32 radius)
+    {
+        TRACE_ZONE("img::opening");
+
+        morph<true>(src, tmp, radius);
+        morph<false>(tmp, dst, radius);
+    }
+
+
+    void closing(BitMaskView const& src, BitMaskView const& tmp, BitMaskView const& dst, u32 radius)
+    {
+        TRACE_ZONE("img::closing");
+
+        morph<false>(src, tmp, radius);
+        morph<true>(tmp, dst, radius);
+    }
+}
+
+
+/* centroid */
+
+namespace image
+{
+    template <class VIEW>
+    Point2Du32 centroid_gray(VIEW const& src, Point2Du32 default_pt, f32 sensitivity)
+	{	
+		f64 total = 0.0;
+		f64 x_total = 0.0;
+		f64 y_total = 0.0;
+
+        auto w = src.width;
+        auto h = src.height;
+
+        auto s = num::clamp(sensitivity, 0.0f, 1.0f);
+        
+        auto total_min = 1 + (1.0f - s) * (w * h - 1);
+
+		for (u32 y = 0; y < h; ++y)
+		{
+			auto s = row_begin(src, y);
+			for (u32 x = 0; x < w; ++x)
+			{
+				u64 val = s[x] ? 1 : 0;
+				total += val;
+				x_total += x * val;
+				y_total += y * val;
+			}
+		}
+
+		if (total < total_min)
+		{			
+            return default_pt;
+		}
+		else
+		{
+            return {
+                (u32)(x_total / total),
+			    (u32)(y_total / total)
+            };
+            
+		}
+	}
+
+
+    Point2Du32 centroid(GrayView const& src, Point2Du32 default_pt, f32 sensitivity)
+    {
+        TRACE_ZONE("img::centroid");
+
+        return centroid_gray(src, default_pt, sensitivity);
+    }
+
+
+    Point2Du32 centroid(GrayView const& src, f32 sensitivity)
+	{	
+        TRACE_ZONE("img::centroid");
+
+		Point2Du32 default_pt = { src.width / 2, src.height / 2 };
+
+        return centroid_gray(src, default_pt, sensitivity);
+	}
+
+
+    Point2Du32 centroid(GraySubView const& src, Point2Du32 default_pt, f32 sensitivity)
+    {
+        TRACE_ZONE("img::centroid");
+
+        return centroid_gray(src, default_pt, sensitivity);
+    }
+
+
+    // integer sums of each row from popcounts, 64 pixels at a time
+    static Point2Du32 centroid_bits(u64 const* data, u32 row_words, u32 x_begin, u32 y_begin, u32 w, u32 h, Point2Du32 default_pt, f32 sensitivity)
+    {
+        auto bit_sums = simd::kernels().bit_sums;
+
+        u64 total = 0;
+        u64 x_total = 0;
+        u64 y_total = 0;
+
+        auto s = num::clamp(sensitivity, 0.0f, 1.0f);
+
+        auto total_min = 1 + (1.0f - s) * (w * h - 1);
+
+        for (u32 y = 0; y < h; y++)
+        {
+            u64 count = 0;
+            u64 x_sum = 0;
+            bit_sums(data + (u64)(y_begin + y) * row_words, x_begin, w, count, x_sum);
+
+            total += count;
+            x_total += x_sum;
+            y_total += (u64)y * count;
+        }
+
+        if ((f64)total < total_min)
+        {
+            return default_pt;
+        }
+
+        return {
+            (u32)(x_total / total),
+            (u32)(y_total / total)
+        };
+    }
+
+
+    Point2Du32 centroid(BitMaskView const& src, Point2Du32 default_pt, f32 sensitivity)
+    {
+        TRACE_ZONE("img::centroid");
+
+        assert(src.matrix_data_);
+
+        return centroid_bits(src.matrix_data_, src.row_words, 0, 0, src.width, src.height, default_pt, sensitivity);
+    }
+
+
+    Point2Du32 centroid(BitMaskSubView const& src, Point2Du32 default_pt, f32 sensitivity)
+    {
+        TRACE_ZONE("img::centroid");
+
+        assert(src.matrix_data_);
+
+        return centroid_bits(src.matrix_data_, src.row_words, src.x_begin, src.y_begin, src.width, src.height, default_pt, sensitivity);
+    }
+}
+
+
+/* pyramid */
+
+namespace image
+{
+    bool create_pyramid(ImagePyramid& pyr, GrayView const& frame, u32 width, u32 height, u32 n_levels)
+    {
+        assert(frame.matrix_data_);
+        assert(n_levels > 1 && n_levels <= ImagePyramid::max_levels);
+
+        // each level after 1 is exactly half
+        auto div = 1u << (n_levels - 2);
+        if (width % div || height % div)
+        {
+            return false;
+        }
+
+        destroy_pyramid(pyr);
+
+        u32 n_pixels = 0;
+        for (u32 i = 1; i < n_levels; i++)
+        {
+            n_pixels += (width >> (i - 1)) * (height >> (i - 1));
+        }
+
+        pyr.buffer8 = create_buffer8(n_pixels, "pyramid");
+        if (!pyr.buffer8.ok)
+        {
+            return false;
+        }
+
+        pyr.levels[0] = frame;
+
+        for (u32 i = 1; i < n_levels; i++)
+        {
+            pyr.levels[i] = make_view(width >> (i - 1), height >> (i - 1), pyr.buffer8);
+        }
+
+        pyr.n_levels = n_levels;
+        pyr.built = 1;
+
+        return true;
+    }
+
+
+    void destroy_pyramid(ImagePyramid& pyr)
+    {
+        mb::destroy_buffer(pyr.buffer8);
+        destroy_area_plan(pyr.plan);
+
+        pyr.n_levels = 0;
+        pyr.built = 0;
+    }
+
+
+    void reset_pyramid(ImagePyramid& pyr)
+    {
+        std::lock_guard<std::mutex> lock(pyr.mutex);
+
+        pyr.built = 1;
+    }
+
+
+    static void build_level(ImagePyramid& pyr, u32 level)
+    {
+        auto& src = pyr.levels[level - 1];
+        auto& dst = pyr.levels[level];
+
+        auto scale = src.width / dst.width;
+
+        if (level > 1)
+        {
+            scale_down(src, dst);
+        }
+        else if (src.width == dst.width && src.height == dst.height)
+        {
+            span::copy(to_span(src), to_span(dst));
+        }
+        else if (src.width == scale * dst.width && src.height == scale * dst.height)
+        {
+            scale_down(src, dst);
+        }
+        else
+        {
+            resize_area(pyr.plan, src, dst);
+        }
+
+        pyr.built |= 1u << level;
+    }
+
+
+    GrayView pyramid_level(ImagePyramid& pyr, u32 level)
+    {
+        TRACE_ZONE("img::pyramid_level");
+
+        assert(level < pyr.n_levels);
+
+        std::lock_guard<std::mutex> lock(pyr.mutex);
+
+        auto k = level;
+        while (!(pyr.built & (1u << k)))
+        {
+            k--;
+        }
+
+        for (k++; k <= level; k++)
+        {
+            build_level(pyr, k);
+        }
+
+        return pyr.levels[level];
+    }
+}
+
+
+/* yuv */
+
+namespace image
+{
+    // rgb to yuv in 16 bit fixed point
+    class YUVCoeffs
+    {
+    public:
+        i32 y_r;
+        i32 y_g;
+        i32 y_b;
+        i32 u_r;
+        i32 u_g;
+        i32 u_b;
+        i32 v_r;
+        i32 v_g;
+        i32 v_b;
+
+        // 16 limited, 0 full
+        i32 y_offset;
+
+        simd::YUVRGB to_rgb;
+    };
+
+
+    constexpr i32 YUV_BITS = 16;
+    constexpr i32 YUV_ROUND = 1 << (YUV_BITS - 1);
+
+
+    static constexpr i32 to_fixed(f64 value, i32 bits)
+    {
+        return (i32)(value * (1 << bits) + (value < 0.0 ? -0.5 : 0.5));
+    }
+
+
+    static constexpr YUVCoeffs make_yuv_coeffs(f64 kr, f64 kb, bool full)
+    {
+        auto kg = 1.0 - kr - kb;
+
+        auto y_scale = full ? 1.0 : 219.0 / 255.0;
+        auto c_scale = full ? 1.0 : 224.0 / 255.0;
+
+        auto cb = c_scale / (2.0 * (1.0 - kb));
+        auto cr = c_scale / (2.0 * (1.0 - kr));
+
+        YUVCoeffs c{};
+
+        c.y_r = to_fixed(y_scale * kr, YUV_BITS);
+        c.y_g = to_fixed(y_scale * kg, YUV_BITS);
+        c.y_b = to_fixed(y_scale * kb, YUV_BITS);
+        c.u_r = to_fixed(-cb * kr, YUV_BITS);
+        c.u_g = to_fixed(-cb * kg, YUV_BITS);
+        c.u_b = to_fixed(cb * (1.0 - kb), YUV_BITS);
+        c.v_r = to_fixed(cr * (1.0 - kr), YUV_BITS);
+        c.v_g = to_fixed(-cr * kg, YUV_BITS);
+        c.v_b = to_fixed(-cr * kb, YUV_BITS);
+
+        c.y_offset = full ? 0 : 16;
+
+        constexpr auto bits = simd::YUV_RGB_BITS;
+
+        auto& rgb = c.to_rgb;
+        rgb.y_offset = (i16)c.y_offset;
+        rgb.y_mul = (i16)to_fixed(1.0 / y_scale, bits);
+        rgb.r_v = (i16)to_fixed(2.0 * (1.0 - kr) / c_scale, bits);
+        rgb.g_u = (i16)to_fixed(2.0 * kb * (1.0 - kb) / (kg * c_scale), bits);
+        rgb.g_v = (i16)to_fixed(2.0 * kr * (1.0 - kr) / (kg * c_scale), bits);
+        rgb.b_u = (i16)to_fixed(2.0 * (1.0 - kb) / c_scale, bits);
+
+        return c;
+    }
+
+
+    // by YUVSpace
+    static constexpr YUVCoeffs yuv_coeffs[] = 
+    {
+        make_yuv_coeffs(0.299, 0.114, false),
+        make_yuv_coeffs(0.299, 0.114, true),
+        make_yuv_coeffs(0.2126, 0.0722, false),
+        make_yuv_coeffs(0.2126, 0.0722, true),
+    };
+
+
+    static inline u8 rgb_to_y(i32 r, i32 g, i32 b, YUVCoeffs const& c)
+    {
+        return simd::clamp_u8((c.y_r * r + c.y_g * g + c.y_b * b + (c.y_offset << YUV_BITS) + YUV_ROUND) >> YUV_BITS);
+    }
+
+
+    static inline UVu8 rgb_to_uv(i32 r, i32 g, i32 b, YUVCoeffs const& c)
+    {
+        constexpr i32 offset = (128 << YUV_BITS) + YUV_ROUND;
+
+        UVu8 uv{};
+        uv.u = simd::clamp_u8((c.u_r * r + c.u_g * g + c.u_b * b + offset) >> YUV_BITS);
+        uv.v = simd::clamp_u8((c.v_r * r + c.v_g * g + c.v_b * b + offset) >> YUV_BITS);
+
+        return uv;
+    }
+
+
+    YUVu8 to_yuv(Pixel p, YUVSpace space)
+    {
+        auto& c = yuv_coeffs[(u32)space];
+
+        auto uv = rgb_to_uv(p.red, p.green, p.blue, c);
+
+        YUVu8 yuv{};
+        yuv.y = rgb_to_y(p.red, p.green, p.blue, c);
+        yuv.u = uv.u;
+        yuv.v = uv.v;
+
+        return yuv;
+    }
+
+
+    Pixel to_pixel(YUVu8 yuv, YUVSpace space)
+    {
+        return simd::yuv_rgba_pixel(yuv.y, yuv.u, yuv.v, yuv_coeffs[(u32)space].to_rgb);
+    }
+}
+
+
+namespace image
+{
+    // u and v of one chroma row, sample i at u[i * step] and v[i * step]
+    class ChromaRow
+    {
+    public:
+        u8* u;
+        u8* v;
+        u32 step;
+    };
+
+
+    static ChromaRow chroma_row(I420View const& view, u32 cy)
+    {
+        return { row_begin(view.u, cy), row_begin(view.v, cy), 1 };
+    }
+
+
+    static ChromaRow chroma_row(NV12View const& view, u32 cy)
+    {
+        auto uv = (u8*)row_begin(view.uv, cy);
+        return { uv, uv + 1, 2 };
+    }
+
+
+    static ChromaRow chroma_row(I444View const& view, u32 cy)
+    {
+        return { row_begin(view.u, cy), row_begin(view.v, cy), 1 };
+    }
+
+
+    // pixel to chroma coordinates
+    static constexpr u32 chroma_shift(I420View const&) { return 1; }
+
+    static constexpr u32 chroma_shift(NV12View const&) { return 1; }
+
+    static constexpr u32 chroma_shift(I444View const&) { return 0; }
+
+
+    template <typename T>
+    static MatrixSubView2D<T> make_plane(T* data, u32 stride, u32 width, u32 height)
+    {
+        MatrixSubView2D<T> plane{};
+
+        plane.matrix_data_ = data;
+        plane.matrix_width = stride;
+        plane.x_begin = 0;
+        plane.y_begin = 0;
+        plane.width = width;
+        plane.height = height;
+
+        return plane;
+    }
+
+
+    static Rect2Du32 chroma_rect(Rect2Du32 const& range)
+    {
+        assert(range.x_begin % 2 == 0);
+        assert(range.y_begin % 2 == 0);
+
+        Rect2Du32 c_range{};
+        c_range.x_begin = range.x_begin / 2;
+        c_range.y_begin = range.y_begin / 2;
+        c_range.x_end = chroma_420(range.x_end);
+        c_range.y_end = chroma_420(range.y_end);
+
+        return c_range;
+    }
+
+
+    I420View make_i420(u32 width, u32 height, Buffer8& buffer)
+    {
+        I420View view{};
+
+        auto data = mb::push_elements(buffer, yuv420_bytes(width, height));
+        if (!data)
+        {
+            return view;
+        }
+
+        auto cw = chroma_420(width);
+        auto ch = chroma_420(height);
+
+        view.width = width;
+        view.height = height;
+        view.y = make_plane(data, width, width, height);
+        view.u = make_plane(data + width * height, cw, cw, ch);
+        view.v = make_plane(data + width * height + cw * ch, cw, cw, ch);
+
+        return view;
+    }
+
+
+    NV12View make_nv12(u32 width, u32 height, Buffer8& buffer)
+    {
+        NV12View view{};
+
+        auto data = mb::push_elements(buffer, yuv420_bytes(width, height));
+        if (!data)
+        {
+            return view;
+        }
+
+        auto cw = chroma_420(width);
+        auto ch = chroma_420(height);
+
+        view.width = width;
+        view.height = height;
+        view.y = make_plane(data, width, width, height);
+        view.uv = make_plane((UVu8*)(data + width * height), cw, cw, ch);
+
+        return view;
+    }
+
+
+    I444View make_i444(u32 width, u32 height, Buffer8& buffer)
+    {
+        I444View view{};
+
+        auto data = mb::push_elements(buffer, yuv444_bytes(width, height));
+        if (!data)
+        {
+            return view;
+        }
+
+        auto n = width * height;
+
+        view.width = width;
+        view.height = height;
+        view.y = make_plane(data, width, width, height);
+        view.u = make_plane(data + n, width, width, height);
+        view.v = make_plane(data + 2 * n, width, width, height);
+
+        return view;
+    }
+
+
+    I420View make_i420(u32 width, u32 height, u8* const* planes, i32 const* strides)
+    {
+        assert(strides[0] >= (i32)width);
+        assert(strides[1] >= (i32)chroma_420(width));
+        assert(strides[2] >= (i32)chroma_420(width));
+
+        auto cw = chroma_420(width);
+        auto ch = chroma_420(height);
+
+        I420View view{};
+
+        view.width = width;
+        view.height = height;
+        view.y = make_plane(planes[0], (u32)strides[0], width, height);
+        view.u = make_plane(planes[1], (u32)strides[1], cw, ch);
+        view.v = make_plane(planes[2], (u32)strides[2], cw, ch);
+
+        return view;
+    }
+
+
+    NV12View make_nv12(u32 width, u32 height, u8* const* planes, i32 const* strides)
+    {
+        assert(strides[0] >= (i32)width);
+        assert(strides[1] >= (i32)(2 * chroma_420(width)));
+        assert(strides[1] % 2 == 0);
+
+        auto cw = chroma_420(width);
+        auto ch = chroma_420(height);
+
+        NV12View view{};
+
+        view.width = width;
+        view.height = height;
+        view.y = make_plane(planes[0], (u32)strides[0], width, height);
+        view.uv = make_plane((UVu8*)planes[1], (u32)strides[1] / 2, cw, ch);
+
+        return view;
+    }
+
+
+    I444View make_i444(u32 width, u32 height, u8* const* planes, i32 const* strides)
+    {
+        assert(strides[0] >= (i32)width);
+        assert(strides[1] >= (i32)width);
+        assert(strides[2] >= (i32)width);
+
+        I444View view{};
+
+        view.width = width;
+        view.height = height;
+        view.y = make_plane(planes[0], (u32)strides[0], width, height);
+        view.u = make_plane(planes[1], (u32)strides[1], width, height);
+        view.v = make_plane(planes[2], (u32)strides[2], width, height);
+
+        return view;
+    }
+
+
+    I420View sub_view(I420View const& view, Rect2Du32 const& range)
+    {
+        auto c_range = chroma_rect(range);
+
+        I420View sub{};
+
+        sub.width = range.x_end - range.x_begin;
+        sub.height = range.y_end - range.y_begin;
+        sub.y = sub_view(view.y, range);
+        sub.u = sub_view(view.u, c_range);
+        sub.v = sub_view(view.v, c_range);
+
+        return sub;
+    }
+
+
+    NV12View sub_view(NV12View const& view, Rect2Du32 const& range)
+    {
+        auto c_range = chroma_rect(range);
+
+        NV12View sub{};
+
+        sub.width = range.x_end - range.x_begin;
+        sub.height = range.y_end - range.y_begin;
+        sub.y = sub_view(view.y, range);
+        sub.uv = sub_view(view.uv, c_range);
+
+        return sub;
+    }
+
+
+    I444View sub_view(I444View const& view, Rect2Du32 const& range)
+    {
+        I444View sub{};
+
+        sub.width = range.x_end - range.x_begin;
+        sub.height = range.y_end - range.y_begin;
+        sub.y = sub_view(view.y, range);
+        sub.u = sub_view(view.u, range);
+        sub.v = sub_view(view.v, range);
+
+        return sub;
+    }
+}
+
+
+/* yuv fill copy */
+
+namespace image
+{
+    static void fill(UVSubView const& view, UVu8 value)
+    {
+        for (u32 y = 0; y < view.height; y++)
+        {
+            span::fill(row_span(view, y), value);
+        }
+    }
+
+
+    template <class PLANE>
+    static void copy_plane(PLANE const& src, PLANE const& dst)
+    {
+        assert(src.matrix_data_);
+        assert(dst.matrix_data_);
+        assert(dst.width == src.width);
+        assert(dst.height == src.height);
+
+        parallel_rows(src, dst, 1, 1, [](auto const& s, auto const& d){ copy_sub_view(s, d); });
+    }
+
+
+    void fill(I420View const& view, YUVu8 color)
+    {
+        assert(view.width);
+        assert(view.height);
+
+        fill(view.y, color.y);
+        fill(view.u, color.u);
+        fill(view.v, color.v);
+    }
+
+
+    void fill(NV12View const& view, YUVu8 color)
+    {
+        assert(view.width);
+        assert(view.height);
+
+        fill(view.y, color.y);
+        fill(view.uv, UVu8{ color.u, color.v });
+    }
+
+
+    void fill(I444View const& view, YUVu8 color)
+    {
+        assert(view.width);
+        assert(view.height);
+
+        fill(view.y, color.y);
+        fill(view.u, color.u);
+        fill(view.v, color.v);
+    }
+
+
+    void copy(I420View const& src, I420View const& dst)
+    {
+        TRACE_ZONE("img::copy yuv");
+
+        copy_plane(src.y, dst.y);
+        copy_plane(src.u, dst.u);
+        copy_plane(src.v, dst.v);
+    }
+
+
+    void copy(NV12View const& src, NV12View const& dst)
+    {
+        TRACE_ZONE("img::copy yuv");
+
+        copy_plane(src.y, dst.y);
+        copy_plane(src.uv, dst.uv);
+    }
+
+
+    void copy(I444View const& src, I444View const& dst)
+    {
+        TRACE_ZONE("img::copy yuv");
+
+        copy_plane(src.y, dst.y);
+        copy_plane(src.u, dst.u);
+        copy_plane(src.v, dst.v);
+    }
+}
+
+
+/* yuv scale down */
+
+namespace image
+{
+    template <class SRC, class DST>
+    static void scale_down_uv(SRC const& src, DST const& dst, u32 scale)
+    {
+        f32 const i_scale = 1.0f / (scale * scale);
+
+        f32 u = 0.0f;
+        f32 v = 0.0f;
+
+        for (u32 yd = 0; yd < dst.height; yd++)
+        {
+            auto ys = scale * yd;
+
+            auto rd = row_begin(dst, yd);
+
+            for (u32 xd = 0; xd < dst.width; xd++)
+            {
+                auto xs = scale * xd;
+
+                u = 0.0f;
+                v = 0.0f;
+
+                for (u32 dy = 0; dy < scale; dy++)
+                {
+                    auto rs = row_begin(src, ys + dy) + xs;
+                    for (u32 dx = 0; dx < scale; dx++)
+                    {
+                        u += rs[dx].u;
+                        v += rs[dx].v;
+                    }
+                }
+
+                u *= i_scale;
+                v *= i_scale;
+
+                rd[xd] = UVu8{ (u8)u, (u8)v };
+            }
+        }
+    }
+
+
+    // row sums of u and v together, same results as scale_down_uv
+    template <class SRC, class DST>
+    static void scale_down_uv_simd(SRC const& src, DST const& dst, u32 scale, simd::Kernels const& k)
+    {
+        constexpr u32 CH = 2;
+
+        assert(scale <= simd::SCALE_MAX);
+
+        f32 const i_scale = 1.0f / (scale * scale);
+
+        u16 sums[simd::VSUM_LEN];
+        u8* rs[simd::SCALE_MAX] = { 0 };
+
+        auto const chunk_w = simd::VSUM_LEN / (scale * CH);
+
+        for (u32 yd = 0; yd < dst.height; yd++)
+        {
+            auto ys = scale * yd;
+
+            auto rd = row_begin(dst, yd);
+            for (u32 i = 0; i < scale; i++)
+            {
+                rs[i] = (u8*)row_begin(src, ys + i);
+            }
+
+            for (u32 x_begin = 0; x_begin < dst.width; x_begin += chunk_w)
+            {
+                auto n = num::min(chunk_w, dst.width - x_begin);
+                auto len = n * scale * CH;
+
+                k.vsum_rows(rs, scale, sums, len);
+                for (u32 i = 0; i < scale; i++)
+                {
+                    rs[i] += len;
+                }
+
+                auto s = sums;
+                for (u32 i = 0; i < n; i++)
+                {
+                    u32 u = 0;
+                    u32 v = 0;
+                    for (u32 dx = 0; dx < scale; dx++)
+                    {
+                        u += s[CH * dx];
+                        v += s[CH * dx + 1];
+                    }
+
+                    s += CH * scale;
+
+                    rd[x_begin + i] = UVu8{ (u8)((f32)u * i_scale), (u8)((f32)v * i_scale) };
+                }
+            }
+        }
+    }
+
+
+    static void scale_down_plane(GraySubView const& src, GraySubView const& dst, u32 scale)
+    {
+        assert(src.matrix_data_);
+        assert(dst.matrix_data_);
+        assert(src.width == scale * dst.width);
+        assert(src.height == scale * dst.height);
+
+        auto& k = simd::kernels();
+        auto use_simd = k.level != cpu::SIMD::None && scale <= simd::SCALE_MAX;
+
+        auto const scale_rows = [&](GraySubView const& s, GraySubView const& d)
+        {
+            if (use_simd)
+            {
+                simd::scale_down_gray_simd(s, d, scale, k, [](u8 g){ return g; });
+            }
+            else
+            {
+                scale_down_gray(s, d, scale);
+            }
+        };
+
+        parallel_rows(src, dst, scale, 1, scale_rows);
+    }
+
+
+    static void scale_down_plane(UVSubView const& src, UVSubView const& dst, u32 scale)
+    {
+        assert(src.matrix_data_);
+        assert(dst.matrix_data_);
+        assert(src.width == scale * dst.width);
+        assert(src.height == scale * dst.height);
+
+        auto& k = simd::kernels();
+        auto use_simd = k.level != cpu::SIMD::None && scale <= simd::SCALE_MAX;
+
+        auto const scale_rows = [&](UVSubView const& s, UVSubView const& d)
+        {
+            if (use_simd)
+            {
+                scale_down_uv_simd(s, d, scale, k);
+            }
+            else
+            {
+                scale_down_uv(s, d, scale);
+            }
+        };
+
+        parallel_rows(src, dst, scale, 1, scale_rows);
+    }
+
+
+    template <class VIEW>
+    static u32 yuv_scale(VIEW const& src, VIEW const& dst)
+    {
+        assert(dst.width);
+        assert(dst.height);
+
+        auto scale = src.width / dst.width;
+
+        assert(src.width == scale * dst.width);
+        assert(src.height == scale * dst.height);
+        assert(scale > 1);
+
+        return scale;
+    }
+
+
+    void scale_down(I420View const& src, I420View const& dst)
+    {
+        TRACE_ZONE("img::scale_down yuv");
+
+        auto scale = yuv_scale(src, dst);
+
+        scale_down_plane(src.y, dst.y, scale);
+        scale_down_plane(src.u, dst.u, scale);
+        scale_down_plane(src.v, dst.v, scale);
+    }
+
+
+    void scale_down(NV12View const& src, NV12View const& dst)
+    {
+        TRACE_ZONE("img::scale_down yuv");
+
+        auto scale = yuv_scale(src, dst);
+
+        scale_down_plane(src.y, dst.y, scale);
+        scale_down_plane(src.uv, dst.uv, scale);
+    }
+
+
+    void scale_down(I444View const& src, I444View const& dst)
+    {
+        TRACE_ZONE("img::scale_down yuv");
+
+        auto scale = yuv_scale(src, dst);
+
+        scale_down_plane(src.y, dst.y, scale);
+        scale_down_plane(src.u, dst.u, scale);
+        scale_down_plane(src.v, dst.v, scale);
+    }
+}
+
+
+/* yuv draw */
+
+namespace image
+{
+    template <class VIEW>
+    static void draw_rect_yuv(VIEW const& view, Rect2Du32 const& rect, YUVu8 color, u32 thick)
+    {
+        // 1 for 4:2:0
+        u32 const odd = (1u << chroma_shift(view)) - 1;
+
+        auto r = rect;
+        r.x_begin &= ~odd;
+        r.y_begin &= ~odd;
+        r.x_end = num::min(r.x_end + (r.x_end & odd), view.width);
+        r.y_end = num::min(r.y_end + (r.y_end & odd), view.height);
+
+        auto region = sub_view(view, r);
+        auto w = region.width;
+        auto h = region.height;
+        auto t = (thick + odd) & ~odd;
+
+        auto ok = w && h && t;
+        if (!ok)
+        {
+            return;
+        }
+
+        if (2 * t >= w || 2 * t >= h)
+        {
+            fill(region, color);
+            return;
+        }
+
+        // w or h is odd at the right or bottom edge of the view
+        auto x_right = (w - t) & ~odd;
+        auto y_bottom = (h - t) & ~odd;
+
+        auto top    = make_rect(0,       0,        w,           t);
+        auto bottom = make_rect(0,       y_bottom, w,           h - y_bottom);
+        auto left   = make_rect(0,       t,        t,           y_bottom - t);
+        auto right  = make_rect(x_right, t,        w - x_right, y_bottom - t);
+
+        fill(sub_view(region, top), color);
+        fill(sub_view(region, bottom), color);
+        fill(sub_view(region, left), color);
+        fill(sub_view(region, right), color);
+    }
+
+
+    void draw_rect(I420View const& view, Rect2Du32 const& rect, YUVu8 color, u32 thick)
+    {
+        draw_rect_yuv(view, rect, color, thick);
+    }
+
+
+    void draw_rect(NV12View const& view, Rect2Du32 const& rect, YUVu8 color, u32 thick)
+    {
+        draw_rect_yuv(view, rect, color, thick);
+    }
+
+
+    void draw_rect(I444View const& view, Rect2Du32 const& rect, YUVu8 color, u32 thick)
+    {
+        draw_rect_yuv(view, rect, color, thick);
+    }
+}
+
+
+/* yuv map */
+
+namespace image
+{
+    // pixels per chunk of a row, on the stack
+    constexpr u32 YUV_LEN = 2048;
+
+
+    // u and v for each of len pixels from x of row y
+    class ChromaLine
+    {
+    public:
+        u8 const* u;
+        u8 const* v;
+    };
+
+
+    static void dup2(simd::Kernels const& k, u8 const* src, u8* dst, u32 n)
+    {
+        if (k.dup2_u8)
+        {
+            k.dup2_u8(src, dst, n);
+        }
+        else
+        {
+            simd::dup_tail<u8, 2>(src, dst, 0, n);
+        }
+    }
+
+
+    // tmp holds 2 * (YUV_LEN + 2) bytes, 4:2:0 samples are repeated from the even pixel before x
+    static ChromaLine chroma_line(I420View const& src, u32 x, u32 y, u32 len, u8* tmp, simd::Kernels const& k)
+    {
+        auto n = (x % 2 + len + 1) / 2;
+        auto u = tmp;
+        auto v = tmp + YUV_LEN + 2;
+
+        dup2(k, row_begin(src.u, y / 2) + x / 2, u, n);
+        dup2(k, row_begin(src.v, y / 2) + x / 2, v, n);
+
+        return { u + x % 2, v + x % 2 };
+    }
+
+
+    static ChromaLine chroma_line(NV12View const& src, u32 x, u32 y, u32 len, u8* tmp, simd::Kernels const&)
+    {
+        auto n = (x % 2 + len + 1) / 2;
+        auto u = tmp;
+        auto v = tmp + YUV_LEN + 2;
+
+        auto uv = row_begin(src.uv, y / 2) + x / 2;
+        for (u32 i = 0; i < n; i++)
+        {
+            u[2 * i] = u[2 * i + 1] = uv[i].u;
+            v[2 * i] = v[2 * i + 1] = uv[i].v;
+        }
+
+        return { u + x % 2, v + x % 2 };
+    }
+
+
+    static ChromaLine chroma_line(I444View const& src, u32 x, u32 y, u32, u8*, simd::Kernels const&)
+    {
+        return { row_begin(src.u, y) + x, row_begin(src.v, y) + x };
+    }
+
+
+    template <class VIEW>
+    static void map_yuv_rgba_rows(VIEW const& src, Rect2Du32 const& range, ImageView const& dst, simd::YUVRGB const& c, u32 y_begin, u32 y_end)
+    {
+        auto& k = simd::kernels();
+
+        u8 tmp[2 * (YUV_LEN + 2)];
+
+        for (u32 y = y_begin; y < y_end; y++)
+        {
+            auto ys = range.y_begin + y;
+            auto ry = row_begin(src.y, ys) + range.x_begin;
+            auto rd = row_begin(dst, y);
+
+            for (u32 x = 0; x < dst.width; x += YUV_LEN)
+            {
+                auto n = num::min(YUV_LEN, dst.width - x);
+                auto cl = chroma_line(src, range.x_begin + x, ys, n, tmp, k);
+
+                k.yuv_rgba(ry + x, cl.u, cl.v, rd + x, n, c);
+            }
+        }
+    }
+
+
+    static void vsum(simd::Kernels const& k, u8* const* rows, u32 n_rows, u16* sums, u32 len)
+    {
+        if (k.vsum_rows)
+        {
+            k.vsum_rows(rows, n_rows, sums, len);
+        }
+        else
+        {
+            simd::vsum_rows_tail(rows, n_rows, sums, 0, len);
+        }
+    }
+
+
+    // n averages of scale x scale from the rows, truncated like scale_down
+    static void box_row(simd::Kernels const& k, u8** rows, u32 scale, u16* sums, u8* dst, u32 n)
+    {
+        if (scale == 1)
+        {
+            std::memcpy(dst, rows[0], n);
+            rows[0] += n;
+            return;
+        }
+
+        auto len = n * scale;
+
+        vsum(k, rows, scale, sums, len);
+        for (u32 i = 0; i < scale; i++)
+        {
+            rows[i] += len;
+        }
+
+        simd::hsum_gray(sums, dst, n, scale, 1.0f / (scale * scale), [](u8 g){ return g; });
+    }
+
+
+    // interleaved u and v to separate rows
+    static void box_row_uv(simd::Kernels const& k, u8** rows, u32 scale, u16* sums, u8* u, u8* v, u32 n)
+    {
+        constexpr u32 CH = 2;
+
+        if (scale == 1)
+        {
+            auto uv = rows[0];
+            for (u32 i = 0; i < n; i++)
+            {
+                u[i] = uv[CH * i];
+                v[i] = uv[CH * i + 1];
+            }
+
+            rows[0] += CH * n;
+            return;
+        }
+
+        f32 const i_scale = 1.0f / (scale * scale);
+
+        auto len = n * scale * CH;
+
+        vsum(k, rows, scale, sums, len);
+        for (u32 i = 0; i < scale; i++)
+        {
+            rows[i] += len;
+        }
+
+        for (u32 i = 0; i < n; i++)
+        {
+            u32 su = 0;
+            u32 sv = 0;
+            for (u32 dx = 0; dx < scale; dx++)
+            {
+                su += sums[CH * dx];
+                sv += sums[CH * dx + 1];
+            }
+
+            sums += CH * scale;
+
+            u[i] = (u8)((f32)su * i_scale);
+            v[i] = (u8)((f32)sv * i_scale);
+        }
+    }
+
+
+    // rows of the u and v planes or the uv plane, each with one pointer per row in the box
+    class ChromaBox
+    {
+    public:
+        u8* u[simd::SCALE_MAX];
+        u8* v[simd::SCALE_MAX];
+    };
+
+
+    static ChromaBox chroma_box(I420View const& src, u32 cx, u32 cy, u32 scale)
+    {
+        ChromaBox box{};
+        for (u32 i = 0; i < scale; i++)
+        {
+            box.u[i] = row_begin(src.u, cy + i) + cx;
+            box.v[i] = row_begin(src.v, cy + i) + cx;
+        }
+
+        return box;
+    }
+
+
+    static ChromaBox chroma_box(NV12View const& src, u32 cx, u32 cy, u32 scale)
+    {
+        ChromaBox box{};
+        for (u32 i = 0; i < scale; i++)
+        {
+            box.u[i] = (u8*)(row_begin(src.uv, cy + i) + cx);
+        }
+
+        return box;
+    }
+
+
+    static ChromaBox chroma_box(I444View const& src, u32 cx, u32 cy, u32 scale)
+    {
+        ChromaBox box{};
+        for (u32 i = 0; i < scale; i++)
+        {
+            box.u[i] = row_begin(src.u, cy + i) + cx;
+            box.v[i] = row_begin(src.v, cy + i) + cx;
+        }
+
+        return box;
+    }
+
+
+    static void box_chroma(simd::Kernels const& k, ChromaBox& box, NV12View const&, u32 scale, u16* sums, u8* u, u8* v, u32 n)
+    {
+        box_row_uv(k, box.u, scale, sums, u, v, n);
+    }
+
+
+    template <class VIEW>
+    static void box_chroma(simd::Kernels const& k, ChromaBox& box, VIEW const&, u32 scale, u16* sums, u8* u, u8* v, u32 n)
+    {
+        box_row(k, box.u, scale, sums, u, n);
+        box_row(k, box.v, scale, sums, v, n);
+    }
+
+
+    // luma and chroma are averaged to one sample per dst pixel, then converted
+    template <class VIEW>
+    static void map_scale_down_yuv_rows(VIEW const& src, Rect2Du32 const& range, ImageView const& dst, u32 scale, simd::YUVRGB const& c, u32 y_begin, u32 y_end)
+    {
+        auto& k = simd::kernels();
+
+        auto const sh = chroma_shift(src);
+        auto const c_scale = scale >> sh;
+
+        u16 sums[simd::VSUM_LEN];
+        u8 y_row[YUV_LEN];
+        u8 u_row[YUV_LEN];
+        u8 v_row[YUV_LEN];
+        u8* rs[simd::SCALE_MAX] = { 0 };
+
+        auto const chunk_w = num::min(YUV_LEN, simd::VSUM_LEN / scale);
+
+        for (u32 yd = y_begin; yd < y_end; yd++)
+        {
+            auto ys = range.y_begin + scale * yd;
+
+            for (u32 i = 0; i < scale; i++)
+            {
+                rs[i] = row_begin(src.y, ys + i) + range.x_begin;
+            }
 
-		int width_dst = (int)(dst.width);
-		int height_dst = (int)(dst.height);
-		int stride_bytes_dst = width_dst * channels;
-        u8* data_dst = (u8*)dst.matrix_data_;
+            auto box = chroma_box(src, range.x_begin >> sh, ys >> sh, c_scale);
 
-        auto data = stbir_resize_uint8_linear(
-			data_src, width_src, height_src, stride_bytes_src,
-			data_dst, width_dst, height_dst, stride_bytes_dst,
-			layout);
+            auto rd = row_begin(dst, yd);
 
-		assert(data && " *** stbir_resize_uint8_linear() failed *** ");
-    }
-}
+            for (u32 x = 0; x < dst.width; x += chunk_w)
+            {
+                auto n = num::min(chunk_w, dst.width - x);
 
+                box_row(k, rs, scale, sums, y_row, n);
+                box_chroma(k, box, src, c_scale, sums, u_row, v_row, n);
 
-/* map */
+                k.yuv_rgba(y_row, u_row, v_row, rd + x, n, c);
+            }
+        }
+    }
 
-namespace image
-{
-    void map(GrayView const& src, ImageView const& dst)
+
+    template <class VIEW>
+    static void map_yuv_rgba(VIEW const& src, Rect2Du32 const& range, ImageView const& dst, YUVSpace space)
     {
-        assert(src.matrix_data_);
-        assert(src.width);
-        assert(src.height);
+        TRACE_ZONE("img::map yuv");
+
+        assert(src.y.matrix_data_);
         assert(dst.matrix_data_);
-        assert(dst.width);
-        assert(dst.height);
-        assert(src.width == dst.width);
-        assert(src.height == dst.height);
+        assert(range.x_end <= src.width);
+        assert(range.y_end <= src.height);
+        assert(dst.width == range.x_end - range.x_begin);
+        assert(dst.height == range.y_end - range.y_begin);
 
-        fn<Pixel(u8)> func = [](u8 sp)
-        {
-            return to_pixel(sp);
-        };
+        auto& c = yuv_coeffs[(u32)space].to_rgb;
 
-        span::transform(to_span(src), to_span(dst), func);
+        auto const rows = [&](u32 begin, u32 end){ map_yuv_rgba_rows(src, range, dst, c, begin, end); };
+
+        thread_pool::parallel_for_rows(dst.height, dst.width, rows);
     }
 
 
-    void map_scale_down(GrayView const& src, ImageView const& dst)
+    template <class VIEW>
+    static void map_scale_down_yuv(VIEW const& src, Rect2Du32 const& range, ImageView const& dst, YUVSpace space)
     {
-        constexpr u32 SCALE_MAX = 8;
-        auto scale = src.width / dst.width;
+        TRACE_ZONE("img::map_scale_down yuv");
 
-        assert(src.matrix_data_);
+        auto const sh = chroma_shift(src);
+        auto const odd = (1u << sh) - 1;
+
+        auto scale = (range.x_end - range.x_begin) / dst.width;
+
+        assert(src.y.matrix_data_);
         assert(dst.matrix_data_);
-        assert(src.width == scale * dst.width);
-        assert(src.height == scale * dst.height);
-        assert(scale > 1);
-        assert(scale <= SCALE_MAX);
-        
-        f32 const i_scale = 1.0f / (scale * scale);
+        assert(range.x_end <= src.width);
+        assert(range.y_end <= src.height);
+        assert(range.x_end - range.x_begin == scale * dst.width);
+        assert(range.y_end - range.y_begin == scale * dst.height);
+        assert(scale > 1 && scale <= simd::SCALE_MAX);
+        assert(!(scale & odd));
+        assert(!(range.x_begin & odd));
+        assert(!(range.y_begin & odd));
 
-        Pixel* rd = 0;
-        u8* rs[SCALE_MAX] = { 0 };
+        auto& c = yuv_coeffs[(u32)space].to_rgb;
 
-        f32 gray = 0.0f;
+        auto const rows = [&](u32 begin, u32 end){ map_scale_down_yuv_rows(src, range, dst, scale, c, begin, end); };
 
-        for (u32 yd = 0; yd < dst.height; yd++)
+        thread_pool::parallel_for_rows(dst.height, dst.width * scale * scale, rows);
+    }
+
+
+    // chroma rows cy_begin to cy_end and their luma rows
+    template <class VIEW>
+    static void map_rgba_yuv_rows(ImageView const& src, VIEW const& dst, YUVCoeffs const& c, u32 cy_begin, u32 cy_end)
+    {
+        auto const sh = chroma_shift(dst);
+
+        auto const x_last = src.width - 1;
+        auto const y_last = src.height - 1;
+        auto const c_width = (src.width + sh) >> sh;
+
+        for (u32 cy = cy_begin; cy < cy_end; cy++)
         {
-            auto ys = scale * yd;
+            auto y0 = cy << sh;
+            auto y1 = num::min(y0 + sh, y_last);
 
-            rd = row_begin(dst, yd);
-            for (u32 i = 0; i < scale; i++)
+            for (u32 y = y0; y <= y1; y++)
             {
-                rs[i] = row_begin(src, ys + i);
+                auto rs = row_begin(src, y);
+                auto ry = row_begin(dst.y, y);
+
+                for (u32 x = 0; x < src.width; x++)
+                {
+                    auto p = rs[x];
+                    ry[x] = rgb_to_y(p.red, p.green, p.blue, c);
+                }
             }
 
-            for (u32 xd = 0; xd < dst.width; xd++)
-            {
-                gray = 0.0f;
+            // 2 x 2 average, edge pixels repeated
+            auto rs0 = row_begin(src, y0);
+            auto rs1 = row_begin(src, y1);
+            auto rc = chroma_row(dst, cy);
 
-                for (u32 v = 0; v < scale; v++)
-                {
-                    for (u32 u = 0; u < scale; u++)
-                    {
-                        gray += rs[v][u];
-                    }
+            for (u32 cx = 0; cx < c_width; cx++)
+            {
+                auto x0 = cx << sh;
+                auto x1 = num::min(x0 + sh, x_last);
 
-                    rs[v] += scale;
-                }
+                auto p00 = rs0[x0];
+                auto p01 = rs0[x1];
+                auto p10 = rs1[x0];
+                auto p11 = rs1[x1];
 
-                gray *= i_scale;
+                auto r = (p00.red + p01.red + p10.red + p11.red + 2) >> 2;
+                auto g = (p00.green + p01.green + p10.green + p11.green + 2) >> 2;
+                auto b = (p00.blue + p01.blue + p10.blue + p11.blue + 2) >> 2;
 
-                rd[xd] = to_pixel((u8)gray);
+                auto uv = rgb_to_uv(r, g, b, c);
+                rc.u[cx * rc.step] = uv.u;
+                rc.v[cx * rc.step] = uv.v;
             }
         }
     }
 
 
-    void map_scale_up(GrayView const& src, ImageView const& dst)
+    template <class VIEW>
+    static void map_rgba_yuv(ImageView const& src, VIEW const& dst, YUVSpace space)
     {
-        auto scale = dst.width / src.width;
+        TRACE_ZONE("img::map yuv");
 
         assert(src.matrix_data_);
-        assert(dst.matrix_data_);
-        assert(dst.width == src.width * scale);
-        assert(dst.height == src.height * scale);
-        assert(scale > 1);
-
-        transform_scale_up_matrix(src, dst, scale, [](u8 p){ return to_pixel(p); });
-    }
-}
+        assert(dst.y.matrix_data_);
+        assert(dst.width == src.width);
+        assert(dst.height == src.height);
 
+        auto& c = yuv_coeffs[(u32)space];
 
-/* draw */
+        auto const sh = chroma_shift(dst);
+        auto const c_height = (src.height + sh) >> sh;
 
-namespace image
-{
-    void draw_rect(ImageView const& view, Rect2Du32 const& rect, Pixel color, u32 thick)
-    {
-        auto region = sub_view(view, rect);
-        auto w = region.width;
-        auto h = region.height;
-        auto t = thick;
+        auto const rows = [&](u32 begin, u32 end){ map_rgba_yuv_rows(src, dst, c, begin, end); };
 
-        auto ok = w && h && t;
-        if (!ok)
-        {
-            return;
-        }
+        thread_pool::parallel_for_rows(c_height, src.width << sh, rows);
+    }
 
-        auto top    = make_rect(0,     0,     w, t);
-        auto bottom = make_rect(0,     h - t, w, t);
-        auto left   = make_rect(0,     t,     t, h - 2 * t);
-        auto right  = make_rect(w - t, t,     t, h - 2 * t);
 
-        fill(sub_view(region, top), color);
-        fill(sub_view(region, bottom), color);
-        fill(sub_view(region, left), color);
-        fill(sub_view(region, right), color);
+    void map(I420View const& src, ImageView const& dst, YUVSpace space)
+    {
+        map_yuv_rgba(src, make_rect(src.width, src.height), dst, space);
     }
-}
-
 
-/* convolve */
 
-namespace image
-{
-    static constexpr f32 GRAD_X_5X5[25] = 
+    void map(I420View const& src, Rect2Du32 const& range, ImageView const& dst, YUVSpace space)
     {
-          0.0f,   0.0f, 0.0f,  0.0f,  0.0f,
-        -0.08f, -0.12f, 0.0f, 0.12f, 0.08f
-		-0.24f, -0.36f, 0.0f, 0.36f, 0.24f
-		-0.08f, -0.12f, 0.0f, 0.12f, 0.08f,
-          0.0f,   0.0f, 0.0f,  0.0f,  0.0f,
-    };
+        map_yuv_rgba(src, range, dst, space);
+    }
 
 
-    static constexpr f32 GRAD_Y_5X5[25] = 
+    void map_scale_down(I420View const& src, ImageView const& dst, YUVSpace space)
     {
-        0.0f, -0.08f, -0.24f, -0.08f, 0.0f,
-		0.0f, -0.12f, -0.36f, -0.12f, 0.0f,
-		0.0f,   0.0f,   0.0f,   0.0f, 0.0f,
-		0.0f,  0.12f,  0.36f,  0.12f, 0.0f,
-		0.0f,  0.08f,  0.24f,  0.08f, 0.0f,
-    };
+        map_scale_down_yuv(src, make_rect(src.width, src.height), dst, space);
+    }
 
 
-    static void gradients_5x5(GraySubView const& src, GraySubView const& dst)
+    void map_scale_down(I420View const& src, Rect2Du32 const& range, ImageView const& dst, YUVSpace space)
     {
-        auto kx0 = (f32*)GRAD_X_5X5;
-        auto kx1 = kx0 + 5;
-        auto kx2 = kx1 + 5;
-        auto kx3 = kx2 + 5;
-        auto kx4 = kx3 + 5;
-
-        auto ky0 = (f32*)GRAD_Y_5X5;
-        auto ky1 = ky0 + 5;
-        auto ky2 = ky1 + 5;
-        auto ky3 = ky2 + 5;
-        auto ky4 = ky3 + 5;
+        map_scale_down_yuv(src, range, dst, space);
+    }
 
-        u8* src_rows[5] = { 0 };
 
-        auto const set_src_rows = [&](u32 y)
-        {
-            src_rows[0] = row_begin(src, (i32)y - 2) - 2;
-            src_rows[1] = row_begin(src, (i32)y - 1) - 2;
-            src_rows[2] = row_begin(src, (i32)y) - 2;
-            src_rows[3] = row_begin(src, (i32)y + 1) - 2;
-            src_rows[4] = row_begin(src, (i32)y + 2) - 2;
-        };
+    void map(NV12View const& src, ImageView const& dst, YUVSpace space)
+    {
+        map_yuv_rgba(src, make_rect(src.width, src.height), dst, space);
+    }
 
-        auto const grad = [&](u32 x)
-        {
-            auto s0 = src_rows[0] + x;
-            auto s1 = src_rows[1] + x;
-            auto s2 = src_rows[2] + x;
-            auto s3 = src_rows[3] + x;
-            auto s4 = src_rows[4] + x;
 
-            f32 gx0 = 0.0f;
-            f32 gx1 = 0.0f;
-            f32 gx2 = 0.0f;
-            f32 gx3 = 0.0f;
-            f32 gx4 = 0.0f;
+    void map(NV12View const& src, Rect2Du32 const& range, ImageView const& dst, YUVSpace space)
+    {
+        map_yuv_rgba(src, range, dst, space);
+    }
 
-            f32 gy0 = 0.0f;
-            f32 gy1 = 0.0f;
-            f32 gy2 = 0.0f;
-            f32 gy3 = 0.0f;
-            f32 gy4 = 0.0f;
 
-            for (u32 i = 0; i < 5; i++)
-            {
-                gx0 += s0[i] * kx0[i];
-                gy0 += s0[i] * ky0[i];
+    void map_scale_down(NV12View const& src, ImageView const& dst, YUVSpace space)
+    {
+        map_scale_down_yuv(src, make_rect(src.width, src.height), dst, space);
+    }
 
-                gx1 += s1[i] * kx1[i];
-                gy1 += s1[i] * ky1[i];
 
-                gx2 += s2[i] * kx2[i];
-                gy2 += s2[i] * ky2[i];
+    void map_scale_down(NV12View const& src, Rect2Du32 const& range, ImageView const& dst, YUVSpace space)
+    {
+        map_scale_down_yuv(src, range, dst, space);
+    }
 
-                gx3 += s3[i] * kx3[i];
-                gy3 += s3[i] * ky3[i];
 
-                gx4 += s4[i] * kx4[i];
-                gy4 += s4[i] * ky4[i];
-            }
+    void map(I444View const& src, ImageView const& dst, YUVSpace space)
+    {
+        map_yuv_rgba(src, make_rect(src.width, src.height), dst, space);
+    }
 
-            auto gx = gx0 + gx1 + gx2 + gx3 + gx4;
-            auto gy = gy0 + gy1 + gy2 + gy3 + gy4;
 
-            return (u8)num::q_hypot(gx, gy);
-        };
+    void map(I444View const& src, Rect2Du32 const& range, ImageView const& dst, YUVSpace space)
+    {
+        map_yuv_rgba(src, range, dst, space);
+    }
 
-        auto w = dst.width;
-        auto h = dst.height;
 
-        for (u32 y = 0; y < h; y++)
-        {
-            set_src_rows(y);
-            auto d = row_begin(dst, y);
-            for (u32 x = 0; x < w; x++)
-            {
-                d[x] = grad(x);
-            }
-        }
+    void map_scale_down(I444View const& src, ImageView const& dst, YUVSpace space)
+    {
+        map_scale_down_yuv(src, make_rect(src.width, src.height), dst, space);
     }
-}
 
 
-/* gradients */
-
-namespace image
-{
-    void gradients(GrayView const& src, GrayView const& dst)
+    void map_scale_down(I444View const& src, Rect2Du32 const& range, ImageView const& dst, YUVSpace space)
     {
-        assert(src.matrix_data_);
-        assert(dst.matrix_data_);
-        assert(src.width == dst.width);
-        assert(src.height == dst.height);
+        map_scale_down_yuv(src, range, dst, space);
+    }
 
-        // for 5x5 kernel = 5 / 2;
-        constexpr u32 kd = 5 / 2;
 
-        Rect2Du32 r{};
-        r.x_begin = kd;
-        r.x_end = src.width - kd;
-        r.y_begin = kd;
-        r.y_end = src.height - kd;
+    void map(ImageView const& src, I420View const& dst, YUVSpace space)
+    {
+        map_rgba_yuv(src, dst, space);
+    }
 
-        auto sub_src = sub_view(src, r);
-        auto sub_dst = sub_view(dst, r);
 
-        gradients_5x5(sub_src, sub_dst);
+    void map(ImageView const& src, NV12View const& dst, YUVSpace space)
+    {
+        map_rgba_yuv(src, dst, space);
+    }
 
-        /*auto top = make_rect(0, 0, dst.width, kd);
-        auto bottom = make_rect(0, r.y_end, dst.width, kd);
-        auto left = make_rect(0, kd, kd, h);
-        auto right = make_rect(r.x_end, kd, kd, h);
 
-        fill(sub_view(dst, top), 0);
-        fill(sub_view(dst, bottom), 0);
-        fill(sub_view(dst, left), 0);
-        fill(sub_view(dst, right), 0);*/        
+    void map(ImageView const& src, I444View const& dst, YUVSpace space)
+    {
+        map_rgba_yuv(src, dst, space);
     }
-    
 }
 
 
-/* centroid */
+/* read write */
 
 namespace image
 {
-    template <class VIEW>
-    Point2Du32 centroid_gray(VIEW const& src, Point2Du32 default_pt, f32 sensitivity)
-	{	
-		f64 total = 0.0;
-		f64 x_total = 0.0;
-		f64 y_total = 0.0;
-
-        auto w = src.width;
-        auto h = src.height;
+    bool write_image(ImageView const& view, cstr file_path)
+    {
+        TRACE_ZONE("img::write_image");
 
-        auto s = num::clamp(sensitivity, 0.0f, 1.0f);
-        
-        auto total_min = 1 + (1.0f - s) * (w * h - 1);
+        assert(view.matrix_data_);
 
-		for (u32 y = 0; y < h; ++y)
-		{
-			auto s = row_begin(src, y);
-			for (u32 x = 0; x < w; ++x)
-			{
-				u64 val = s[x] ? 1 : 0;
-				total += val;
-				x_total += x * val;
-				y_total += y * val;
-			}
-		}
+        int w = (int)view.width;
+        int h = (int)view.height;
+        int channels = 4;
+        int stride_bytes = w * channels;
 
-		if (total < total_min)
-		{			
-            return default_pt;
-		}
-		else
-		{
-            return {
-                (u32)(x_total / total),
-			    (u32)(y_total / total)
-            };
-            
-		}
-	}
+        return stbi_write_png(file_path, w, h, channels, view.matrix_data_, stride_bytes) != 0;
+    }
 
 
-    Point2Du32 centroid(GrayView const& src, Point2Du32 default_pt, f32 sensitivity)
+    bool read_image(Image& image, cstr file_path, cstr tag)
     {
-        return centroid_gray(src, default_pt, sensitivity);
-    }
+        TRACE_ZONE("img::read_image");
 
+        int w = 0;
+        int h = 0;
+        int n_file_channels = 0;
+        int channels = 4;
 
-    Point2Du32 centroid(GrayView const& src, f32 sensitivity)
-	{	
-		Point2Du32 default_pt = { src.width / 2, src.height / 2 };
+        auto data = stbi_load(file_path, &w, &h, &n_file_channels, channels);
+        if (!data)
+        {
+            return false;
+        }
 
-        return centroid_gray(src, default_pt, sensitivity);
-	}
+        if (!create_image(image, (u32)w, (u32)h, tag))
+        {
+            stbi_image_free(data);
+            return false;
+        }
 
+        auto src = span::to_span((Pixel*)data, image.width * image.height);
+        span::copy(src, to_span(make_view(image)));
 
-    Point2Du32 centroid(GraySubView const& src, Point2Du32 default_pt, f32 sensitivity)
-    {
-        return centroid_gray(src, default_pt, sensitivity);
+        stbi_image_free(data);
+
+        return true;
     }
-}
\ No newline at end of file
+}
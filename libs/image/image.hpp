@@ -1,6 +1,11 @@
 #pragma once
 
 #include "../span/span.hpp"
+#include "../util/cpu_features.hpp"
+#include "../util/trace.hpp"
+
+#include <cstring>
+#include <mutex>
 
 namespace mb = memory_buffer;
 
@@ -357,6 +362,7 @@ namespace image
 
 namespace image
 {
+    // an indirect call per pixel, for callers that hold a fn
     void transform(ImageView const& src, ImageView const& dst, fn<Pixel(Pixel)> const& func);
 
     void transform_scale_up(GrayView const& src, ImageView const& dst, fn<Pixel(u8)> const& func);
@@ -365,6 +371,169 @@ namespace image
 }
 
 
+namespace image
+{
+namespace internal
+{
+    template <class FN>
+    inline void transform(ImageView const& src, ImageView const& dst, FN const& func)
+    {
+        auto s = src.matrix_data_;
+        auto d = dst.matrix_data_;
+        auto n = (u64)src.width * src.height;
+
+        for (u64 i = 0; i < n; i++)
+        {
+            d[i] = func(s[i]);
+        }
+    }
+
+
+    // each src row fills the first of its dst rows, the others are copies of it
+    template <u32 S, class FN>
+    inline void transform_scale_up(GrayView const& src, ImageView const& dst, u32 scale, FN const& func)
+    {
+        auto const s = S ? S : scale;
+        auto const row_bytes = sizeof(Pixel) * dst.width;
+
+        for (u32 ys = 0; ys < src.height; ys++)
+        {
+            auto yd = s * ys;
+            auto rs = row_begin(src, ys);
+            auto rd = row_begin(dst, yd);
+
+            for (u32 xs = 0; xs < src.width; xs++)
+            {
+                auto p = func(rs[xs]);
+                for (u32 u = 0; u < s; u++)
+                {
+                    rd[s * xs + u] = p;
+                }
+            }
+
+            for (u32 v = 1; v < s; v++)
+            {
+                std::memcpy(row_begin(dst, yd + v), rd, row_bytes);
+            }
+        }
+    }
+
+
+    template <u32 S, class FN>
+    inline void transform_scale_up(GrayView const& src1, GrayView const& src2, ImageView const& dst, u32 scale, FN const& func)
+    {
+        auto const s = S ? S : scale;
+        auto const row_bytes = sizeof(Pixel) * dst.width;
+
+        for (u32 ys = 0; ys < src1.height; ys++)
+        {
+            auto yd = s * ys;
+            auto rs1 = row_begin(src1, ys);
+            auto rs2 = row_begin(src2, ys);
+            auto rd = row_begin(dst, yd);
+
+            for (u32 xs = 0; xs < src1.width; xs++)
+            {
+                auto p = func(rs1[xs], rs2[xs]);
+                for (u32 u = 0; u < s; u++)
+                {
+                    rd[s * xs + u] = p;
+                }
+            }
+
+            for (u32 v = 1; v < s; v++)
+            {
+                std::memcpy(row_begin(dst, yd + v), rd, row_bytes);
+            }
+        }
+    }
+
+
+    template <class FN>
+    inline void transform_scale_up(GrayView const& src, ImageView const& dst, u32 scale, FN const& func)
+    {
+        switch (scale)
+        {
+        case 2: transform_scale_up<2>(src, dst, scale, func); break;
+        case 3: transform_scale_up<3>(src, dst, scale, func); break;
+        case 4: transform_scale_up<4>(src, dst, scale, func); break;
+        default: transform_scale_up<0>(src, dst, scale, func); break;
+        }
+    }
+
+
+    template <class FN>
+    inline void transform_scale_up(GrayView const& src1, GrayView const& src2, ImageView const& dst, u32 scale, FN const& func)
+    {
+        switch (scale)
+        {
+        case 2: transform_scale_up<2>(src1, src2, dst, scale, func); break;
+        case 3: transform_scale_up<3>(src1, src2, dst, scale, func); break;
+        case 4: transform_scale_up<4>(src1, src2, dst, scale, func); break;
+        default: transform_scale_up<0>(src1, src2, dst, scale, func); break;
+        }
+    }
+}
+}
+
+
+/*  Overloads for lambdas and other function objects, the call per pixel is inlined.
+    Chosen over the fn versions unless the argument is a fn. */
+
+namespace image
+{
+    template <class FN>
+    inline void transform(ImageView const& src, ImageView const& dst, FN const& func)
+    {
+        TRACE_ZONE("img::transform");
+
+        assert(src.matrix_data_);
+        assert(dst.matrix_data_);
+        assert(src.width == dst.width);
+        assert(src.height == dst.height);
+
+        internal::transform(src, dst, func);
+    }
+
+
+    template <class FN>
+    inline void transform_scale_up(GrayView const& src, ImageView const& dst, FN const& func)
+    {
+        TRACE_ZONE("img::transform_scale_up");
+
+        auto scale = dst.width / src.width;
+
+        assert(src.matrix_data_);
+        assert(dst.matrix_data_);
+        assert(dst.width == src.width * scale);
+        assert(dst.height == src.height * scale);
+        assert(scale > 1);
+
+        internal::transform_scale_up(src, dst, scale, func);
+    }
+
+
+    template <class FN>
+    inline void transform_scale_up(GrayView const& src1, GrayView const& src2, ImageView const& dst, FN const& func)
+    {
+        TRACE_ZONE("img::transform_scale_up");
+
+        auto scale = dst.width / src1.width;
+
+        assert(src1.matrix_data_);
+        assert(src2.matrix_data_);
+        assert(dst.matrix_data_);
+        assert(src1.width == src2.width);
+        assert(src1.height == src2.height);
+        assert(dst.width == src1.width * scale);
+        assert(dst.height == src1.height * scale);
+        assert(scale > 1);
+
+        internal::transform_scale_up(src1, src2, dst, scale, func);
+    }
+}
+
+
 /* resize */
 
 namespace image
@@ -383,7 +552,135 @@ namespace image
 
     void resize(ImageView const& src, SubView const& dst);
 
+    void resize(SubView const& src, SubView const& dst);
+
     void resize(GrayView const& src, GrayView const& dst);
+
+
+    // Filter weights and scratch for one src size, dst size and pixel layout.
+    // Built on first use and rebuilt only when the sizes change, so repeated resizes do not allocate.
+    class ResizePlan
+    {
+    public:
+        u32 width_src = 0;
+        u32 height_src = 0;
+        u32 width_dst = 0;
+        u32 height_dst = 0;
+        u32 channels = 0;
+
+        // output splits for the thread pool
+        u32 n_splits = 0;
+
+        // stb_image_resize2 state
+        void* resize_ = 0;
+    };
+
+
+    void destroy_resize_plan(ResizePlan& plan);
+
+    void resize(ResizePlan& plan, ImageView const& src, ImageView const& dst);
+
+    void resize(ResizePlan& plan, ImageView const& src, SubView const& dst);
+
+    void resize(ResizePlan& plan, SubView const& src, SubView const& dst);
+
+    void resize(ResizePlan& plan, GrayView const& src, GrayView const& dst);
+
+
+    // src range and weights of one dst row or column
+    class AreaTap
+    {
+    public:
+        u32 begin = 0;
+        u32 count = 0;
+
+        // offset into AreaPlan::weights
+        u32 weights = 0;
+    };
+
+
+    // Area average for any src/dst ratio, weights in 12 bit fixed point.
+    // The taps are built for one src size and dst size and only read by the resize,
+    // so one plan can be used by several threads.
+    class AreaPlan
+    {
+    public:
+        u32 width_src = 0;
+        u32 height_src = 0;
+        u32 width_dst = 0;
+        u32 height_dst = 0;
+
+        AreaTap* x_taps = 0;
+        AreaTap* y_taps = 0;
+
+        u16* weights = 0;
+    };
+
+
+    bool create_area_plan(AreaPlan& plan, u32 width_src, u32 height_src, u32 width_dst, u32 height_dst);
+
+    void destroy_area_plan(AreaPlan& plan);
+
+    // the plan is rebuilt when the sizes change
+    void resize_area(AreaPlan& plan, ImageView const& src, ImageView const& dst);
+
+    void resize_area(AreaPlan& plan, GrayView const& src, GrayView const& dst);
+
+    // dst holds the plan rows from dst_y, e.g. a tile, runs on the calling thread
+    void resize_area_rows(AreaPlan const& plan, GrayView const& src, GrayView const& dst, u32 dst_y);
+}
+
+
+/* pyramid */
+
+namespace image
+{
+    /*  Gray levels of one frame. Level 0 is the frame, level 1 is scaled from it by any ratio
+        and each level after that is half the size of the one before.
+        A level is built on first use from the nearest level already built, so the frame is read once.
+        Levels are built under the lock, readers on different threads share them. */
+    class ImagePyramid
+    {
+    public:
+        constexpr static u32 max_levels = 6;
+
+        u32 n_levels = 0;
+        GrayView levels[max_levels];
+
+        // bit per level, for the current frame
+        u32 built = 0;
+
+        // frame to level 1 when the ratio is not an integer
+        AreaPlan plan;
+
+        std::mutex mutex;
+
+        Buffer8 buffer8;
+    };
+
+
+    // level 1 is width x height, n_levels counts the frame
+    bool create_pyramid(ImagePyramid& pyr, GrayView const& frame, u32 width, u32 height, u32 n_levels);
+
+    void destroy_pyramid(ImagePyramid& pyr);
+
+    // the frame has changed, levels are built again on use
+    void reset_pyramid(ImagePyramid& pyr);
+
+    GrayView pyramid_level(ImagePyramid& pyr, u32 level);
+}
+
+
+/* simd */
+
+namespace image
+{
+    // Kernels for scale_down, scale_up, map_scale_down, resize_area and yuv to rgba.
+    // Detected at startup, limited to what the cpu supports. SIMD::None runs the scalar kernels.
+    // Not thread safe, set before processing starts.
+    void set_simd(cpu::SIMD level);
+
+    cpu::SIMD get_simd();
 }
 
 
@@ -415,6 +712,99 @@ namespace image
 }
 
 
+/* bit mask */
+
+namespace image
+{
+    using Buffer64 = MemoryBuffer<u64>;
+
+
+    // 1 bit per pixel, pixel x is bit x % 64 of word x / 64
+    // each row starts on a new word
+    class BitMaskView
+    {
+    public:
+        u64* matrix_data_ = 0;
+        u32 row_words = 0;
+
+        u32 width = 0;
+        u32 height = 0;
+    };
+
+
+    class BitMaskSubView
+    {
+    public:
+        u64* matrix_data_ = 0;
+        u32 row_words = 0;
+
+        u32 x_begin = 0;
+        u32 y_begin = 0;
+
+        u32 width = 0;
+        u32 height = 0;
+    };
+
+
+    inline constexpr u32 bit_mask_row_words(u32 width)
+    {
+        return (width + 63) / 64;
+    }
+
+
+    inline Buffer64 create_buffer64(u32 n_words, cstr tag)
+	{
+		Buffer64 buffer;
+		mb::create_buffer(buffer, n_words, tag);
+		return buffer;
+	}
+
+
+    BitMaskView make_bit_mask(u32 width, u32 height, Buffer64& buffer);
+
+
+    static inline u64* row_begin(BitMaskView const& view, u32 y)
+    {
+        return view.matrix_data_ + (u64)y * view.row_words;
+    }
+
+
+    inline BitMaskSubView sub_view(BitMaskView const& view, Rect2Du32 const& range)
+    {
+        BitMaskSubView sub_view{};
+
+        sub_view.matrix_data_ = view.matrix_data_;
+        sub_view.row_words = view.row_words;
+        sub_view.x_begin = range.x_begin;
+        sub_view.y_begin = range.y_begin;
+        sub_view.width = range.x_end - range.x_begin;
+        sub_view.height = range.y_end - range.y_begin;
+
+        return sub_view;
+    }
+
+
+    // bit set where src is not 0
+    void to_bit_mask(GrayView const& src, BitMaskView const& dst);
+
+    // 255 where the bit is set, 0 otherwise
+    void map(BitMaskView const& src, GrayView const& dst);
+
+
+    // Square of (2 * radius + 1) x (2 * radius + 1) pixels, pixels outside the mask are ignored.
+    // src and dst are different views.
+    void erode(BitMaskView const& src, BitMaskView const& dst, u32 radius);
+
+    void dilate(BitMaskView const& src, BitMaskView const& dst, u32 radius);
+
+    // erode then dilate, removes specks smaller than the square
+    void opening(BitMaskView const& src, BitMaskView const& tmp, BitMaskView const& dst, u32 radius);
+
+    // dilate then erode, fills gaps smaller than the square
+    void closing(BitMaskView const& src, BitMaskView const& tmp, BitMaskView const& dst, u32 radius);
+}
+
+
 /* centroid */
 
 namespace image
@@ -422,4 +812,211 @@ namespace image
     Point2Du32 centroid(GrayView const& src, Point2Du32 default_pt, f32 sensitivity);
 
     Point2Du32 centroid(GraySubView const& src, Point2Du32 default_pt, f32 sensitivity);
-}
\ No newline at end of file
+
+    // same result as a GrayView of 0 and 255
+    Point2Du32 centroid(BitMaskView const& src, Point2Du32 default_pt, f32 sensitivity);
+
+    Point2Du32 centroid(BitMaskSubView const& src, Point2Du32 default_pt, f32 sensitivity);
+}
+
+
+/* yuv */
+
+namespace image
+{
+    class YUVu8
+    {
+    public:
+        u8 y;
+        u8 u;
+        u8 v;
+    };
+
+
+    // chroma sample of NV12
+    class UVu8
+    {
+    public:
+        u8 u;
+        u8 v;
+    };
+
+
+    using UVSubView = MatrixSubView2D<UVu8>;
+
+
+    // matrix coefficients and range, limited range is y 16 - 235 and u, v 16 - 240
+    enum class YUVSpace : u8
+    {
+        BT601_Limited = 0,
+        BT601_Full,
+        BT709_Limited,
+        BT709_Full
+    };
+
+
+    /*  Planar frames in the layouts decoders produce.
+        Each plane is a sub view of its own memory, so decoder planes with padded rows are used in place.
+        4:2:0 chroma is one sample per 2 x 2 pixels, (width + 1) / 2 x (height + 1) / 2. */
+
+    // y, u and v planes, 4:2:0
+    class I420View
+    {
+    public:
+        u32 width = 0;
+        u32 height = 0;
+
+        GraySubView y;
+        GraySubView u;
+        GraySubView v;
+    };
+
+
+    // y plane and interleaved u, v plane, 4:2:0
+    class NV12View
+    {
+    public:
+        u32 width = 0;
+        u32 height = 0;
+
+        GraySubView y;
+        UVSubView uv;
+    };
+
+
+    // y, u and v planes, all full size
+    class I444View
+    {
+    public:
+        u32 width = 0;
+        u32 height = 0;
+
+        GraySubView y;
+        GraySubView u;
+        GraySubView v;
+    };
+
+
+    inline constexpr u32 chroma_420(u32 n)
+    {
+        return (n + 1) / 2;
+    }
+
+
+    // bytes of all planes
+    inline constexpr u32 yuv420_bytes(u32 width, u32 height)
+    {
+        return width * height + 2 * chroma_420(width) * chroma_420(height);
+    }
+
+
+    inline constexpr u32 yuv444_bytes(u32 width, u32 height)
+    {
+        return 3 * width * height;
+    }
+
+
+    YUVu8 to_yuv(Pixel p, YUVSpace space);
+
+    Pixel to_pixel(YUVu8 yuv, YUVSpace space);
+
+
+    // planes pushed to buffer
+    I420View make_i420(u32 width, u32 height, Buffer8& buffer);
+
+    NV12View make_nv12(u32 width, u32 height, Buffer8& buffer);
+
+    I444View make_i444(u32 width, u32 height, Buffer8& buffer);
+
+    // planes owned by the caller, e.g. AVFrame data and linesize
+    I420View make_i420(u32 width, u32 height, u8* const* planes, i32 const* strides);
+
+    NV12View make_nv12(u32 width, u32 height, u8* const* planes, i32 const* strides);
+
+    I444View make_i444(u32 width, u32 height, u8* const* planes, i32 const* strides);
+
+
+    // 4:2:0 ranges begin on even x and y
+    I420View sub_view(I420View const& view, Rect2Du32 const& range);
+
+    NV12View sub_view(NV12View const& view, Rect2Du32 const& range);
+
+    I444View sub_view(I444View const& view, Rect2Du32 const& range);
+
+
+    void fill(I420View const& view, YUVu8 color);
+
+    void fill(NV12View const& view, YUVu8 color);
+
+    void fill(I444View const& view, YUVu8 color);
+
+
+    void copy(I420View const& src, I420View const& dst);
+
+    void copy(NV12View const& src, NV12View const& dst);
+
+    void copy(I444View const& src, I444View const& dst);
+
+
+    // integer ratio, 4:2:0 dst width and height are even or the ratio is odd
+    void scale_down(I420View const& src, I420View const& dst);
+
+    void scale_down(NV12View const& src, NV12View const& dst);
+
+    void scale_down(I444View const& src, I444View const& dst);
+
+
+    // 4:2:0 edges are moved out to even pixels so luma and chroma cover the same area
+    void draw_rect(I420View const& view, Rect2Du32 const& rect, YUVu8 color, u32 thick);
+
+    void draw_rect(NV12View const& view, Rect2Du32 const& rect, YUVu8 color, u32 thick);
+
+    void draw_rect(I444View const& view, Rect2Du32 const& rect, YUVu8 color, u32 thick);
+
+
+    // 4:2:0 chroma is the nearest sample up and the 2 x 2 average down
+    void map(I420View const& src, ImageView const& dst, YUVSpace space);
+
+    void map(NV12View const& src, ImageView const& dst, YUVSpace space);
+
+    void map(I444View const& src, ImageView const& dst, YUVSpace space);
+
+    // range of src to dst, may begin on any pixel
+    void map(I420View const& src, Rect2Du32 const& range, ImageView const& dst, YUVSpace space);
+
+    void map(NV12View const& src, Rect2Du32 const& range, ImageView const& dst, YUVSpace space);
+
+    void map(I444View const& src, Rect2Du32 const& range, ImageView const& dst, YUVSpace space);
+
+    // src or range is scale times dst, an average per dst pixel before converting.
+    // 4:2:0 scales are even and ranges begin on even pixels, so each dst pixel has whole chroma samples.
+    void map_scale_down(I420View const& src, ImageView const& dst, YUVSpace space);
+
+    void map_scale_down(NV12View const& src, ImageView const& dst, YUVSpace space);
+
+    void map_scale_down(I444View const& src, ImageView const& dst, YUVSpace space);
+
+    void map_scale_down(I420View const& src, Rect2Du32 const& range, ImageView const& dst, YUVSpace space);
+
+    void map_scale_down(NV12View const& src, Rect2Du32 const& range, ImageView const& dst, YUVSpace space);
+
+    void map_scale_down(I444View const& src, Rect2Du32 const& range, ImageView const& dst, YUVSpace space);
+
+    void map(ImageView const& src, I420View const& dst, YUVSpace space);
+
+    void map(ImageView const& src, NV12View const& dst, YUVSpace space);
+
+    void map(ImageView const& src, I444View const& dst, YUVSpace space);
+}
+
+
+/* read write */
+
+namespace image
+{
+    // png
+    bool write_image(ImageView const& view, cstr file_path);
+
+    // png, creates image
+    bool read_image(Image& image, cstr file_path, cstr tag);
+}
@@ -0,0 +1,302 @@
+#pragma once
+
+#include "thread_pool.hpp"
+#include "../util/trace.hpp"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <cassert>
+
+
+namespace thread_pool
+{
+    constexpr u32 MAX_WORKERS = 64;
+
+
+    class Pool
+    {
+    public:
+        std::mutex mutex;
+        std::condition_variable cv;
+
+        std::deque<fn_task> tasks;
+
+        bool running = false;
+
+        u32 n_workers = 0;
+        std::thread workers[MAX_WORKERS];
+    };
+
+
+    static Pool pool;
+
+
+    static void run_worker()
+    {
+        TRACE_THREAD("pool worker");
+
+        for (;;)
+        {
+            fn_task task;
+
+            {
+                std::unique_lock<std::mutex> lock(pool.mutex);
+
+                pool.cv.wait(lock, [](){ return !pool.running || !pool.tasks.empty(); });
+
+                if (!pool.running)
+                {
+                    return;
+                }
+
+                task = std::move(pool.tasks.front());
+                pool.tasks.pop_front();
+            }
+
+            task();
+        }
+    }
+}
+
+
+namespace thread_pool
+{
+    bool init(u32 n_workers)
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+
+        if (pool.running)
+        {
+            return true;
+        }
+
+        if (!n_workers)
+        {
+            n_workers = std::thread::hardware_concurrency();
+        }
+
+        n_workers = n_workers ? n_workers : 1;
+        n_workers = n_workers < MAX_WORKERS ? n_workers : MAX_WORKERS;
+
+        pool.running = true;
+
+        for (u32 i = 0; i < n_workers; i++)
+        {
+            pool.workers[i] = std::thread(run_worker);
+        }
+
+        pool.n_workers = n_workers;
+
+        return true;
+    }
+
+
+    void shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(pool.mutex);
+
+            pool.running = false;
+            pool.tasks.clear();
+        }
+
+        pool.cv.notify_all();
+
+        for (u32 i = 0; i < pool.n_workers; i++)
+        {
+            if (pool.workers[i].joinable())
+            {
+                pool.workers[i].join();
+            }
+        }
+
+        pool.n_workers = 0;
+    }
+
+
+    bool submit(fn_task const& task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(pool.mutex);
+
+            if (!pool.running)
+            {
+                return false;
+            }
+
+            pool.tasks.push_back(task);
+        }
+
+        pool.cv.notify_one();
+
+        return true;
+    }
+
+
+    u32 n_workers()
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+
+        return pool.n_workers;
+    }
+
+
+    u32 n_queued()
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+
+        return (u32)pool.tasks.size();
+    }
+}
+
+
+/* parallel for */
+
+namespace thread_pool
+{
+    // chunks per thread, for load balance
+    constexpr u32 CHUNKS_PER_THREAD = 4;
+
+
+    static RowPartition partition;
+
+
+    class RangeJob
+    {
+    public:
+        u32 n = 0;
+        u32 chunk = 0;
+        u32 n_chunks = 0;
+
+        fn_range const* fn = 0;
+
+        std::atomic<u32> next_chunk = 0;
+        std::atomic<u32> n_done = 0;
+    };
+
+
+    // false when all chunks are taken
+    // fn is only used while a chunk is not done
+    static bool run_chunk(RangeJob& job)
+    {
+        auto c = job.next_chunk.fetch_add(1);
+        if (c >= job.n_chunks)
+        {
+            return false;
+        }
+
+        auto begin = c * job.chunk;
+        auto end = begin + job.chunk;
+        end = end < job.n ? end : job.n;
+
+        (*job.fn)(begin, end);
+
+        if (job.n_done.fetch_add(1) + 1 == job.n_chunks)
+        {
+            job.n_done.notify_all();
+        }
+
+        return true;
+    }
+
+
+    void set_row_partition(RowPartition const& p)
+    {
+        partition = p;
+    }
+
+
+    RowPartition row_partition()
+    {
+        return partition;
+    }
+
+
+    void parallel_for(u32 n, u32 grain, fn_range const& fn)
+    {
+        grain = grain ? grain : 1;
+
+        auto max_chunks = (n + grain - 1) / grain;
+        if (max_chunks < 2)
+        {
+            fn(0, n);
+            return;
+        }
+
+        // helpers may start after the caller has returned, they keep the job alive
+        auto job = std::make_shared<RangeJob>();
+        job->n = n;
+        job->fn = &fn;
+
+        u32 n_helpers = 0;
+
+        {
+            std::lock_guard<std::mutex> lock(pool.mutex);
+
+            if (pool.running && pool.n_workers)
+            {
+                auto n_chunks = CHUNKS_PER_THREAD * (pool.n_workers + 1);
+                n_chunks = n_chunks < max_chunks ? n_chunks : max_chunks;
+
+                job->chunk = (n + n_chunks - 1) / n_chunks;
+                job->n_chunks = (n + job->chunk - 1) / job->chunk;
+
+                n_helpers = job->n_chunks - 1;
+                n_helpers = n_helpers < pool.n_workers ? n_helpers : pool.n_workers;
+
+                // short tasks, ahead of the queue
+                for (u32 i = 0; i < n_helpers; i++)
+                {
+                    pool.tasks.push_front([job](){ while (run_chunk(*job)) {} });
+                }
+            }
+        }
+
+        // not under the lock, fn may call parallel_for
+        if (!job->n_chunks)
+        {
+            fn(0, n);
+            return;
+        }
+
+        if (n_helpers > 1)
+        {
+            pool.cv.notify_all();
+        }
+        else
+        {
+            pool.cv.notify_one();
+        }
+
+        while (run_chunk(*job)) {}
+
+        auto n_done = job->n_done.load();
+        while (n_done < job->n_chunks)
+        {
+            job->n_done.wait(n_done);
+            n_done = job->n_done.load();
+        }
+    }
+
+
+    void parallel_for_rows(u32 height, u32 row_pixels, fn_range const& fn)
+    {
+        auto p = partition;
+
+        row_pixels = row_pixels ? row_pixels : 1;
+
+        if ((u64)height * row_pixels < p.serial_pixels)
+        {
+            fn(0, height);
+            return;
+        }
+
+        auto grain = p.grain_pixels / row_pixels;
+
+        parallel_for(height, grain, fn);
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "../util/types.hpp"
+
+#include <functional>
+
+
+/*  One set of persistent worker threads shared by the whole program.
+    Tasks run in submission order, so tasks that resubmit themselves
+    take turns with every other queued task. */
+
+namespace thread_pool
+{
+    using fn_task = std::function<void()>;
+
+
+    // n_workers = 0 for one worker per hardware thread
+    bool init(u32 n_workers);
+
+    // waits for running tasks, queued tasks are dropped
+    void shutdown();
+
+    // false if the pool is not running
+    bool submit(fn_task const& task);
+
+    u32 n_workers();
+
+    u32 n_queued();
+}
+
+
+/*  Data parallel loops.
+    The calling thread works through the chunks together with the workers,
+    so it is safe to call from a task that is already running on the pool.
+    Every index is visited exactly once by the same code, results do not depend on the split. */
+
+namespace thread_pool
+{
+    using fn_range = std::function<void(u32 begin, u32 end)>;
+
+
+    class RowPartition
+    {
+    public:
+        // minimum work per chunk
+        u32 grain_pixels = 64 * 1024;
+
+        // smaller images run on the calling thread
+        u32 serial_pixels = 256 * 1024;
+    };
+
+
+    // not thread safe, set before processing starts
+    void set_row_partition(RowPartition const& partition);
+
+    RowPartition row_partition();
+
+
+    // fn(begin, end) over [0, n) in chunks of at least grain
+    void parallel_for(u32 n, u32 grain, fn_range const& fn);
+
+    // fn(y_begin, y_end) over rows, row_pixels is the work per row
+    void parallel_for_rows(u32 height, u32 row_pixels, fn_range const& fn);
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "types.hpp"
+
+/*  Instruction set detection for runtime dispatch.
+    Kernels are compiled per instruction set with CPU_TARGET,
+    the build itself does not need -mavx2 etc. */
+
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+#define CPU_X64
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+#endif
+
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CPU_TARGET(isa) __attribute__((target(isa)))
+#else
+#define CPU_TARGET(isa)
+#endif
+
+
+namespace cpu
+{
+    // ordered, each level includes the ones below
+    enum class SIMD : u8
+    {
+        None = 0,
+        SSE4_1,
+        AVX2,
+        AVX512
+    };
+
+
+    inline cstr to_cstr(SIMD level)
+    {
+        switch (level)
+        {
+        case SIMD::None: return "scalar";
+        case SIMD::SSE4_1: return "sse4.1";
+        case SIMD::AVX2: return "avx2";
+        case SIMD::AVX512: return "avx512";
+        }
+
+        return "";
+    }
+
+
+    inline SIMD detect_simd()
+    {
+#if defined(CPU_X64) && (defined(__GNUC__) || defined(__clang__))
+
+        __builtin_cpu_init();
+
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        {
+            return SIMD::AVX512;
+        }
+
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return SIMD::AVX2;
+        }
+
+        if (__builtin_cpu_supports("sse4.1"))
+        {
+            return SIMD::SSE4_1;
+        }
+
+        return SIMD::None;
+
+#elif defined(CPU_X64) && defined(_MSC_VER)
+
+        int regs[4] = { 0 };
+
+        __cpuid(regs, 1);
+        bool sse41 = regs[2] & (1 << 19);
+        bool osxsave = regs[2] & (1 << 27);
+
+        // registers saved by the os
+        auto xcr0 = osxsave ? _xgetbv(0) : 0;
+        bool os_avx = (xcr0 & 0x06) == 0x06;
+        bool os_avx512 = (xcr0 & 0xE6) == 0xE6;
+
+        __cpuidex(regs, 7, 0);
+        bool avx2 = regs[1] & (1 << 5);
+        bool avx512 = (regs[1] & (1 << 16)) && (regs[1] & (1 << 30));
+
+        if (avx512 && os_avx512)
+        {
+            return SIMD::AVX512;
+        }
+
+        if (avx2 && os_avx)
+        {
+            return SIMD::AVX2;
+        }
+
+        return sse41 ? SIMD::SSE4_1 : SIMD::None;
+
+#else
+
+        return SIMD::None;
+
+#endif
+    }
+
+
+    // detected once
+    inline SIMD simd_level()
+    {
+        static SIMD const level = detect_simd();
+        return level;
+    }
+}
@@ -2,6 +2,8 @@
 
 #include "types.hpp"
 
+#include <cstring>
+
 #define NO_NUMERIC_CMATH
 
 #ifdef NO_NUMERIC_CMATH
@@ -270,15 +272,16 @@ namespace numeric
     
     inline f32 q_rsqrt(f32 number)
     {
-        long i;
+        // 32 bit, long is 64 bit on linux
+        i32 i;
         float x2, y;
         constexpr float threehalfs = 1.5F;
 
         x2 = number * 0.5F;
         y  = number;
-        i  = * ( long * ) &y;
+        std::memcpy(&i, &y, sizeof(i));
         i  = 0x5f3759df - ( i >> 1 );
-        y  = * ( float * ) &i;
+        std::memcpy(&y, &i, sizeof(y));
         y  = y * ( threehalfs - ( x2 * y * y ) );   // 1st iteration
         // y  = y * ( threehalfs - ( x2 * y * y ) );   // 2nd iteration, this can be removed
 
@@ -293,15 +296,16 @@ namespace numeric
             return 0.0f;
         }
 
-        long i;
+        // 32 bit, long is 64 bit on linux
+        i32 i;
         float x2, y;
         constexpr float threehalfs = 1.5F;
 
         x2 = number * 0.5F;
         y  = number;
-        i  = * ( long * ) &y;
+        std::memcpy(&i, &y, sizeof(i));
         i  = 0x5f3759df - ( i >> 1 );
-        y  = * ( float * ) &i;
+        std::memcpy(&y, &i, sizeof(y));
         y  = y * ( threehalfs - ( x2 * y * y ) );   // 1st iteration
         y  = y * ( threehalfs - ( x2 * y * y ) );   // 2nd iteration
 
@@ -0,0 +1,279 @@
+#pragma once
+
+#include "types.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <ctime>
+
+
+/*  Rolling per-stage timings.
+    Each stage is written by a single worker thread, read without locks by the ui thread.
+    A reader may see a sample that is being overwritten, never a torn value.
+    Wall and thread cpu totals accumulate until reset, for end of run reports.
+    Any thread may reset, the writer of a stage clears it at its next record. */
+
+namespace perf
+{
+    constexpr u32 MAX_STAGES = 8;
+    constexpr u32 N_SAMPLES = 128;
+
+    static_assert((N_SAMPLES & (N_SAMPLES - 1)) == 0);
+
+    using clock = std::chrono::steady_clock;
+    using time_point = clock::time_point;
+
+
+    class StageTimes
+    {
+    public:
+        std::atomic<u32> counts[MAX_STAGES];
+        std::atomic<f32> samples_ms[MAX_STAGES][N_SAMPLES];
+
+        // since the last reset
+        std::atomic<f64> total_wall_ms[MAX_STAGES];
+        std::atomic<f64> total_cpu_ms[MAX_STAGES];
+
+        // a stage is cleared when its id is behind reset_id
+        std::atomic<u32> reset_id;
+        std::atomic<u32> stage_reset_ids[MAX_STAGES];
+    };
+
+
+    // wall clock and cpu time of the calling thread
+    class Stamp
+    {
+    public:
+        time_point wall;
+        f64 cpu_ms = 0.0;
+    };
+
+
+    class Elapsed
+    {
+    public:
+        f32 wall_ms = 0.0f;
+        f32 cpu_ms = 0.0f;
+    };
+
+
+    class StageSummary
+    {
+    public:
+        u32 n_samples = 0;
+
+        f32 last_ms = 0.0f;
+        f32 mean_ms = 0.0f;
+        f32 p50_ms = 0.0f;
+        f32 p95_ms = 0.0f;
+        f32 max_ms = 0.0f;
+
+        u32 total_count = 0;
+        f64 total_wall_ms = 0.0;
+        f64 total_cpu_ms = 0.0;
+    };
+
+
+    inline time_point now()
+    {
+        return clock::now();
+    }
+
+
+    inline f32 ms_since(time_point begin)
+    {
+        std::chrono::duration<f32, std::milli> ms = clock::now() - begin;
+        return ms.count();
+    }
+
+
+    inline f64 thread_cpu_ms()
+    {
+#if defined _WIN32
+
+        return 0.0;
+
+#else
+
+        timespec ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+        return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+
+#endif
+    }
+
+
+    inline Stamp stamp()
+    {
+        Stamp st{};
+        st.wall = now();
+        st.cpu_ms = thread_cpu_ms();
+
+        return st;
+    }
+
+
+    inline Elapsed elapsed_since(Stamp const& begin)
+    {
+        Elapsed el{};
+        el.cpu_ms = (f32)(thread_cpu_ms() - begin.cpu_ms);
+        el.wall_ms = ms_since(begin.wall);
+
+        return el;
+    }
+
+
+    inline Elapsed sub(Elapsed a, Elapsed b)
+    {
+        Elapsed el{};
+        el.wall_ms = a.wall_ms - b.wall_ms;
+        el.cpu_ms = a.cpu_ms - b.cpu_ms;
+
+        return el;
+    }
+
+
+    inline Elapsed add(Elapsed a, Elapsed b)
+    {
+        Elapsed el{};
+        el.wall_ms = a.wall_ms + b.wall_ms;
+        el.cpu_ms = a.cpu_ms + b.cpu_ms;
+
+        return el;
+    }
+
+
+    // summaries are empty until each stage records again
+    inline void reset(StageTimes& times)
+    {
+        times.reset_id.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+
+    inline bool is_reset(StageTimes const& times, u32 stage)
+    {
+        auto id = times.reset_id.load(std::memory_order_acquire);
+
+        return times.stage_reset_ids[stage].load(std::memory_order_acquire) != id;
+    }
+
+
+    inline void record(StageTimes& times, u32 stage, Elapsed el)
+    {
+        constexpr auto mask = N_SAMPLES - 1;
+
+        auto id = times.reset_id.load(std::memory_order_acquire);
+        if (times.stage_reset_ids[stage].load(std::memory_order_relaxed) != id)
+        {
+            times.counts[stage].store(0, std::memory_order_relaxed);
+            times.total_wall_ms[stage].store(0.0, std::memory_order_relaxed);
+            times.total_cpu_ms[stage].store(0.0, std::memory_order_relaxed);
+            times.stage_reset_ids[stage].store(id, std::memory_order_release);
+        }
+
+        auto wall_ms = times.total_wall_ms[stage].load(std::memory_order_relaxed);
+        auto cpu_ms = times.total_cpu_ms[stage].load(std::memory_order_relaxed);
+        times.total_wall_ms[stage].store(wall_ms + el.wall_ms, std::memory_order_relaxed);
+        times.total_cpu_ms[stage].store(cpu_ms + el.cpu_ms, std::memory_order_relaxed);
+
+        auto n = times.counts[stage].load(std::memory_order_relaxed);
+        times.samples_ms[stage][n & mask].store(el.wall_ms, std::memory_order_relaxed);
+        times.counts[stage].store(n + 1, std::memory_order_release);
+    }
+
+
+    template <typename STAGE>
+    inline void record(StageTimes* times, STAGE stage, Elapsed el)
+    {
+        if (times)
+        {
+            record(*times, (u32)stage, el);
+        }
+    }
+
+
+    inline StageSummary summarize(StageTimes const& times, u32 stage)
+    {
+        constexpr auto mask = N_SAMPLES - 1;
+
+        StageSummary sum{};
+
+        if (is_reset(times, stage))
+        {
+            return sum;
+        }
+
+        auto count = times.counts[stage].load(std::memory_order_acquire);
+        auto n = std::min(count, N_SAMPLES);
+        if (!n)
+        {
+            return sum;
+        }
+
+        sum.total_count = count;
+        sum.total_wall_ms = times.total_wall_ms[stage].load(std::memory_order_relaxed);
+        sum.total_cpu_ms = times.total_cpu_ms[stage].load(std::memory_order_relaxed);
+
+        f32 values[N_SAMPLES] = { 0 };
+        f32 total = 0.0f;
+
+        for (u32 i = 0; i < n; i++)
+        {
+            values[i] = times.samples_ms[stage][(count - 1 - i) & mask].load(std::memory_order_relaxed);
+            total += values[i];
+        }
+
+        sum.n_samples = n;
+        sum.last_ms = values[0];
+        sum.mean_ms = total / n;
+
+        std::sort(values, values + n);
+
+        sum.p50_ms = values[(n - 1) * 50 / 100];
+        sum.p95_ms = values[(n - 1) * 95 / 100];
+        sum.max_ms = values[n - 1];
+
+        return sum;
+    }
+
+
+    template <typename STAGE>
+    inline StageSummary summarize(StageTimes const& times, STAGE stage)
+    {
+        return summarize(times, (u32)stage);
+    }
+
+
+    // records the time from construction to destruction
+    class StageTimer
+    {
+    private:
+        StageTimes* times_ = 0;
+        u32 stage_ = 0;
+        Stamp start_;
+
+    public:
+        template <typename STAGE>
+        StageTimer(StageTimes* times, STAGE stage)
+        {
+            times_ = times;
+            stage_ = (u32)stage;
+
+            if (times_)
+            {
+                start_ = stamp();
+            }
+        }
+
+
+        ~StageTimer()
+        {
+            if (times_)
+            {
+                record(*times_, stage_, elapsed_since(start_));
+            }
+        }
+    };
+}
@@ -0,0 +1,270 @@
+#pragma once
+
+/*  Scoped timing zones exported as Chrome Trace Event JSON (Perfetto, chrome://tracing).
+    Each thread writes to its own preallocated ring of events.
+    All macros compile to nothing unless TRACE_ZONES is defined. */
+
+//#define TRACE_ZONES
+
+
+#ifdef TRACE_ZONES
+
+#include "types.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+
+namespace trace
+{
+    constexpr u32 MAX_THREADS = 16;
+    constexpr u32 MAX_EVENTS = 1 << 16; // per thread
+
+    static_assert((MAX_EVENTS & (MAX_EVENTS - 1)) == 0);
+
+
+    class ZoneEvent
+    {
+    public:
+        cstr name = 0;
+        i64 begin_ns = 0;
+        i64 end_ns = 0;
+    };
+
+
+    class ThreadBuffer
+    {
+    public:
+        u32 thread_id = 0;
+        std::atomic<cstr> thread_name = 0;
+
+        // a running thread writes to the buffer
+        std::atomic<bool> in_use = false;
+
+        std::atomic<u64> count;
+
+        ZoneEvent events[MAX_EVENTS];
+    };
+
+
+    inline ThreadBuffer thread_buffers[MAX_THREADS];
+
+    inline std::atomic<u32> n_thread_buffers = 0;
+
+    inline thread_local ThreadBuffer* thread_buffer = 0;
+
+
+    // releases the buffer of a thread when the thread exits
+    class ThreadOwner
+    {
+    public:
+        ThreadBuffer* buffer = 0;
+
+        ~ThreadOwner()
+        {
+            if (buffer)
+            {
+                buffer->in_use.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+
+    inline thread_local ThreadOwner thread_owner;
+
+    inline auto const start_time = std::chrono::steady_clock::now();
+
+
+    inline i64 now_ns()
+    {
+        auto dt = std::chrono::steady_clock::now() - start_time;
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(dt).count();
+    }
+
+
+    inline ThreadBuffer* get_thread_buffer()
+    {
+        if (thread_buffer)
+        {
+            return thread_buffer;
+        }
+
+        auto id = n_thread_buffers.fetch_add(1);
+        if (id >= MAX_THREADS)
+        {
+            // too many threads, events are dropped
+            n_thread_buffers = MAX_THREADS;
+            return 0;
+        }
+
+        thread_buffer = thread_buffers + id;
+        thread_buffer->thread_id = id + 1;
+        thread_buffer->in_use.store(true, std::memory_order_relaxed);
+        thread_owner.buffer = thread_buffer;
+
+        return thread_buffer;
+    }
+
+
+    // Call first thing on a thread, before any zone.
+    // A thread reuses the buffer of a finished thread with the same name,
+    // so short lived worker threads do not use up the buffers.
+    // Buffers of running threads are never shared.
+    inline void set_thread_name(cstr name)
+    {
+        if (!thread_buffer)
+        {
+            u32 n_threads = n_thread_buffers.load();
+            n_threads = n_threads < MAX_THREADS ? n_threads : MAX_THREADS;
+
+            for (u32 t = 0; t < n_threads; t++)
+            {
+                auto buffer = thread_buffers + t;
+                auto buffer_name = buffer->thread_name.load(std::memory_order_acquire);
+                if (!buffer_name || std::strcmp(buffer_name, name) != 0)
+                {
+                    continue;
+                }
+
+                bool in_use = false;
+                if (buffer->in_use.compare_exchange_strong(in_use, true, std::memory_order_acquire))
+                {
+                    thread_buffer = buffer;
+                    thread_owner.buffer = buffer;
+                    return;
+                }
+            }
+        }
+
+        auto buffer = get_thread_buffer();
+        if (buffer)
+        {
+            buffer->thread_name.store(name, std::memory_order_release);
+        }
+    }
+
+
+    inline void add_event(ThreadBuffer& buffer, cstr name, i64 begin_ns, i64 end_ns)
+    {
+        constexpr auto mask = MAX_EVENTS - 1;
+
+        auto n = buffer.count.load(std::memory_order_relaxed);
+
+        auto& ev = buffer.events[n & mask];
+        ev.name = name;
+        ev.begin_ns = begin_ns;
+        ev.end_ns = end_ns;
+
+        buffer.count.store(n + 1, std::memory_order_release);
+    }
+
+
+    // name must be a string literal
+    class Zone
+    {
+    private:
+        ThreadBuffer* buffer_ = 0;
+        cstr name_ = 0;
+        i64 begin_ns_ = 0;
+
+    public:
+        Zone(cstr name)
+        {
+            buffer_ = get_thread_buffer();
+            name_ = name;
+            begin_ns_ = now_ns();
+        }
+
+
+        ~Zone()
+        {
+            if (buffer_)
+            {
+                add_event(*buffer_, name_, begin_ns_, now_ns());
+            }
+        }
+    };
+
+
+    // Events recorded while writing may be incomplete
+    inline bool write_json(cstr file_path)
+    {
+        constexpr auto mask = MAX_EVENTS - 1;
+        constexpr f64 i_us = 1.0 / 1000.0;
+
+        auto file = std::fopen(file_path, "w");
+        if (!file)
+        {
+            return false;
+        }
+
+        std::fprintf(file, "{\"traceEvents\":[\n");
+
+        cstr sep = "";
+
+        u32 n_threads = n_thread_buffers.load();
+        n_threads = n_threads < MAX_THREADS ? n_threads : MAX_THREADS;
+
+        for (u32 t = 0; t < n_threads; t++)
+        {
+            auto& buffer = thread_buffers[t];
+
+            auto thread_name = buffer.thread_name.load(std::memory_order_acquire);
+            if (thread_name)
+            {
+                std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                    sep, buffer.thread_id, thread_name);
+                sep = ",\n";
+            }
+
+            auto count = buffer.count.load(std::memory_order_acquire);
+            auto first = count > MAX_EVENTS ? count - MAX_EVENTS : 0;
+
+            for (auto i = first; i < count; i++)
+            {
+                auto& ev = buffer.events[i & mask];
+
+                std::fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    sep, ev.name, buffer.thread_id, ev.begin_ns * i_us, (ev.end_ns - ev.begin_ns) * i_us);
+                sep = ",\n";
+            }
+        }
+
+        std::fprintf(file, "\n]}\n");
+        std::fclose(file);
+
+        return true;
+    }
+
+
+    inline void clear()
+    {
+        u32 n_threads = n_thread_buffers.load();
+        n_threads = n_threads < MAX_THREADS ? n_threads : MAX_THREADS;
+
+        for (u32 t = 0; t < n_threads; t++)
+        {
+            thread_buffers[t].count.store(0, std::memory_order_release);
+        }
+    }
+}
+
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#define TRACE_ZONE(name) trace::Zone TRACE_CONCAT(trace_zone_, __LINE__)(name)
+#define TRACE_THREAD(name) trace::set_thread_name(name)
+#define TRACE_WRITE(file_path) trace::write_json(file_path)
+#define TRACE_CLEAR() trace::clear()
+
+#else
+
+#define TRACE_ZONE(name)
+#define TRACE_THREAD(name)
+#define TRACE_WRITE(file_path)
+#define TRACE_CLEAR()
+
+#endif
@@ -1,5 +1,7 @@
 #include "motion.hpp"
 #include "../util/numeric.hpp"
+#include "../util/trace.hpp"
+#include "../thread_pool/thread_pool.hpp"
 
 
 namespace motion
@@ -12,11 +14,33 @@ namespace motion
     }
 
 
+    // scale when src is an exact multiple of dst, 1 for the same size, 0 otherwise
+    static u32 integer_scale(u32 src_w, u32 src_h, u32 dst_w, u32 dst_h)
+    {
+        auto scale = src_w / dst_w;
+
+        return scale && src_w == scale * dst_w && src_h == scale * dst_h ? scale : 0;
+    }
+
+
+    // integer ratios keep the box kernels, any other ratio is area averaged
     template <class SRC, class DST>
-    static void resize_down(SRC const& src, DST const& dst)
+    static void resize_down(img::AreaPlan& plan, SRC const& src, DST const& dst)
     {
-        img::scale_down(src, dst);
-        //img::resize(src, dst);
+        auto scale = integer_scale(src.width, src.height, dst.width, dst.height);
+
+        if (scale == 1)
+        {
+            span::copy(img::to_span(src), img::to_span(dst));
+        }
+        else if (scale)
+        {
+            img::scale_down(src, dst);
+        }
+        else
+        {
+            img::resize_area(plan, src, dst);
+        }
     }
 }
 
@@ -26,36 +50,39 @@ namespace motion
     namespace num = numeric;
 
 
-    static Matrix32 make_matrix(u32 w, u32 h, img::Buffer32& buffer32)
+    static Totals16 make_totals(u32 w, u32 h, MemoryBuffer<u16>& buffer16)
     {
-        Matrix32 mat{};
+        Totals16 mat{};
         mat.width = w;
         mat.height = h;
-        mat.matrix_data_ = (f32*)mb::push_elements(buffer32, w * h);
+        mat.matrix_data_ = mb::push_elements(buffer16, w * h);
 
         return mat;
     }
 
 
+    static bool is_window(u32 count)
+    {
+        return count == 4 || count == 8 || count == 16 || count == 32;
+    }
+
+
     static void next(GrayMotion& mot)
     { 
-        static_assert(GrayMotion::count % 2 == 0);
+        assert(is_window(mot.count));
 
-        constexpr auto mask = GrayMotion::count - 1;
+        auto mask = mot.count - 1;
 
         mot.index = (mot.index + 1) & mask;
     }
 
 
-    static Matrix32 front(GrayMotion const& mot) 
+    static img::GrayView front(GrayMotion const& mot) 
     { 
         return mot.list[mot.index]; 
     }
 
 
-    static f32 val_to_f32(u8 v) { return (f32)v; }
-
-
     f32 map_f(f32 x)
     {
         f32 m = 1.0f;
@@ -80,6 +107,98 @@ namespace motion
     }
 
 
+    // smallest integer >= N * thresh
+    template <u32 N>
+    static i32 total_threshold(f32 thresh)
+    {
+        auto nt = N * thresh;
+        auto it = (i32)nt;
+
+        return it + ((f32)it < nt);
+    }
+
+
+    /*  Bit set where a value is far enough from the average of the history,
+        then the value replaces the oldest frame of the history.
+        |total - N * value| >= N * thresh is the same test as |total / N - value| >= thresh */
+
+    template <u32 N, typename T>
+    static void update_history_row(u8 const* v, T* t, u8* f, u64* mask, u32 width, i32 thresh_n)
+    {
+        static_assert((N & (N - 1)) == 0);
+        static_assert(N * 255 <= (T)~(T)0);
+
+        for (u32 x_begin = 0; x_begin < width; x_begin += 64)
+        {
+            auto x_end = num::min(x_begin + 64, width);
+
+            u64 bits = 0;
+            for (u32 x = x_begin; x < x_end; x++)
+            {
+                auto d = (i32)t[x] - (i32)(N * v[x]);
+                bits |= (u64)((d < 0 ? -d : d) >= thresh_n) << (x - x_begin);
+            }
+
+            mask[x_begin / 64] = bits;
+        }
+
+        for (u32 x = 0; x < width; x++)
+        {
+            t[x] = (T)(t[x] - f[x] + v[x]);
+            f[x] = v[x];
+        }
+    }
+
+
+    template <u32 N>
+    static void update_history_rows(GrayMotion& mot, f32 thresh, u32 y_begin, u32 y_end)
+    {
+        auto thresh_n = total_threshold<N>(thresh);
+        auto history = front(mot);
+        auto width = mot.values.width;
+
+        for (u32 y = y_begin; y < y_end; y++)
+        {
+            auto v = img::row_begin(mot.values, y);
+            auto t = img::row_begin(mot.totals, y);
+            auto f = img::row_begin(history, y);
+
+            update_history_row<N>(v, t, f, img::row_begin(mot.mask, y), width, thresh_n);
+        }
+    }
+
+
+    // one instantiation per window
+    static void update_history_rows(GrayMotion& mot, f32 thresh, u32 y_begin, u32 y_end)
+    {
+        switch (mot.count)
+        {
+        case 4: update_history_rows<4>(mot, thresh, y_begin, y_end); break;
+        case 8: update_history_rows<8>(mot, thresh, y_begin, y_end); break;
+        case 16: update_history_rows<16>(mot, thresh, y_begin, y_end); break;
+        case 32: update_history_rows<32>(mot, thresh, y_begin, y_end); break;
+
+        default:
+            assert(" *** bad motion window *** " && false);
+            break;
+        }
+    }
+
+
+    static void filter_mask(GrayMotion& mot)
+    {
+        if (mot.open_radius)
+        {
+            img::opening(mot.mask, mot.mask_tmp, mot.mask, mot.open_radius);
+        }
+
+        if (mot.close_radius)
+        {
+            img::closing(mot.mask, mot.mask_tmp, mot.mask, mot.close_radius);
+        }
+    }
+
+
     static Rect2Du32 rect_scale_down(Rect2Du32 rect, u32 scale)
     {
         rect.x_begin /= scale;
@@ -91,11 +210,23 @@ namespace motion
     }
 
 
-    Point2Du32 scale_point_up(Point2Du32 pt, u32 scale)
+    // any ratio, from a view of src_w x src_h to one of dst_w x dst_h
+    static Rect2Du32 rect_scale_down(Rect2Du32 rect, u32 src_w, u32 src_h, u32 dst_w, u32 dst_h)
+    {
+        rect.x_begin = (u32)((u64)rect.x_begin * dst_w / src_w);
+        rect.x_end = (u32)((u64)rect.x_end * dst_w / src_w);
+        rect.y_begin = (u32)((u64)rect.y_begin * dst_h / src_h);
+        rect.y_end = (u32)((u64)rect.y_end * dst_h / src_h);
+
+        return rect;
+    }
+
+
+    Point2Du32 scale_point_up(Point2Du32 pt, u32 src_w, u32 src_h, u32 dst_w, u32 dst_h)
     {
         return {
-            pt.x * scale,
-            pt.y * scale
+            (u32)((u64)pt.x * dst_w / src_w),
+            (u32)((u64)pt.y * dst_h / src_h)
         };
     }
 }
@@ -103,38 +234,79 @@ namespace motion
 
 namespace motion
 {
-    bool create(GrayMotion& mot, u32 width, u32 height)
+    u32 motion_window(f64 fps)
     {
-        auto n32 = width * height * (mot.count + 1);
-        auto n8 = width * height * 2;
+        if (fps <= 0.0)
+        {
+            return 8;
+        }
+
+        // nearest power of 2 to fps * 8 / 30
+        if (fps < 22.0) { return 4; }
+        if (fps < 45.0) { return 8; }
+        if (fps < 90.0) { return 16; }
+
+        return 32;
+    }
+
+
+    f32 motion_threshold(f32 sensitivity)
+    {
+        return (1.0f - map_f(sensitivity)) * 255;
+    }
 
-        auto& buffer32 = mot.buffer32;
-        auto& buffer8 = mot.buffer8;
 
-        buffer32 = img::create_buffer32(n32, "Motion 32");
-        if (!buffer32.ok)
+    bool create(GrayMotion& mot, u32 width, u32 height, u32 window)
+    {
+        assert(is_window(window));
+        if (!is_window(window))
         {
-            return false;
+            window = 8;
         }
 
+        mot.count = window;
+        mot.index = 0;
+
+        auto n8 = width * height * (window + 2);
+        auto n16 = width * height;
+        auto n64 = img::bit_mask_row_words(width) * height * 2;
+
+        auto& buffer8 = mot.buffer8;
+        auto& buffer16 = mot.buffer16;
+        auto& buffer64 = mot.buffer64;
+
         buffer8 = img::create_buffer8(n8, "Motion 8");
         if (!buffer8.ok)
         {
             return false;
         }
 
-        mb::zero_buffer(buffer32);
+        if (!mb::create_buffer(buffer16, n16, "Motion 16"))
+        {
+            return false;
+        }
+
+        buffer64 = img::create_buffer64(n64, "Motion 64");
+        if (!buffer64.ok)
+        {
+            return false;
+        }
+
         mb::zero_buffer(buffer8);
+        mb::zero_buffer(buffer16);
+        mb::zero_buffer(buffer64);
 
         for (u32 i = 0; i < mot.count; i++)
         {
-            mot.list[i] = make_matrix(width, height, buffer32);
+            mot.list[i] = img::make_view(width, height, buffer8);
         }
 
-        mot.totals = make_matrix(width, height, buffer32);
+        mot.totals = make_totals(width, height, buffer16);
 
         mot.values = img::make_view(width, height, buffer8);
         mot.out = img::make_view(width, height, buffer8);
+        mot.mask = img::make_bit_mask(width, height, buffer64);
+        mot.mask_tmp = img::make_bit_mask(width, height, buffer64);
 
         return true;
     }
@@ -142,89 +314,81 @@ namespace motion
 
     void destroy(GrayMotion& mot)
     {
-        mb::destroy_buffer(mot.buffer32);
         mb::destroy_buffer(mot.buffer8);
+        mb::destroy_buffer(mot.buffer16);
+        mb::destroy_buffer(mot.buffer64);
+        img::destroy_area_plan(mot.values_plan);
     }
 
 
     void update(GrayMotion& mot, img::GrayView const& src)
     {
-        constexpr auto i_count = 1.0f / GrayMotion::count;
+        TRACE_ZONE("motion::update");
 
-        auto thresh = (1.0f - map_f(mot.motion_sensitivity)) * 255;
+        auto thresh = motion_threshold(mot.motion_sensitivity);
 
         auto loc_base = 0.5f;
 
         auto loc_s = mot.locate_sensitivity;
 
-        auto const abs_avg_delta = [&](u8 v, f32 t)
-        {
-            return num::abs(t * i_count - v) >= thresh ? 255 : 0; 
-        };
-
-        auto t = img::to_span(mot.totals);
-        auto f = img::to_span(front(mot));
-        auto v = img::to_span(mot.values);
-        auto o = img::to_span(mot.out);
+        auto motion_begin = perf::stamp();
 
-        resize_down(src, mot.values);
-        span::transform(v, t, o, abs_avg_delta);
+        resize_down(mot.values_plan, src, mot.values);
+        update_history_rows(mot, thresh, 0, mot.values.height);
+        filter_mask(mot);
 
-        mot.location = img::centroid(mot.out, mot.location, loc_s);
+        auto centroid_begin = perf::stamp();
+        mot.location = img::centroid(mot.mask, mot.location, loc_s);
+        auto centroid = perf::elapsed_since(centroid_begin);
 
-        span::sub(t, f, t);
-        span::transform(v, f, val_to_f32);
-        span::add(t, f, t);
         next(mot);
+
+        perf::record(mot.stage_times, MotionStage::Centroid, centroid);
+        perf::record(mot.stage_times, MotionStage::Motion, perf::sub(perf::elapsed_since(motion_begin), centroid));
     }    
 
 
     void update(GrayMotion& mot, img::GrayView const& src, Rect2Du32 scan_rect)
     {
-        constexpr auto i_count = 1.0f / GrayMotion::count;
+        TRACE_ZONE("motion::update");
 
-        auto thresh = (1.0f - map_f(mot.motion_sensitivity)) * 255;
+        auto thresh = motion_threshold(mot.motion_sensitivity);
 
         auto loc_base = 0.5f;
 
         auto loc_s = mot.locate_sensitivity;
 
-        auto const abs_avg_delta = [&](u8 v, f32 t)
-        {
-            return num::abs(t * i_count - v) >= thresh ? 255 : 0; 
-        };
+        auto motion_begin = perf::stamp();
 
-        auto t = img::to_span(mot.totals);
-        auto f = img::to_span(front(mot));
-        auto v = img::to_span(mot.values);
-        auto o = img::to_span(mot.out);
+        resize_down(mot.values_plan, src, mot.values);
+        update_history_rows(mot, thresh, 0, mot.values.height);
+        filter_mask(mot);
 
-        resize_down(src, mot.values);
-        span::transform(v, t, o, abs_avg_delta);
-
-        auto scale = src.width / mot.values.width;
-        auto rect = rect_scale_down(scan_rect, scale);
+        auto rect = rect_scale_down(scan_rect, src.width, src.height, mot.values.width, mot.values.height);
 
         Point2Du32 pt = {
             mot.location.x - rect.x_begin,
             mot.location.y - rect.y_begin
         };
 
-        pt = img::centroid(img::sub_view(mot.out, rect), pt, loc_s);
+        auto centroid_begin = perf::stamp();
+        pt = img::centroid(img::sub_view(mot.mask, rect), pt, loc_s);
+        auto centroid = perf::elapsed_since(centroid_begin);
 
         mot.location.x = pt.x + rect.x_begin;
         mot.location.y = pt.y + rect.y_begin;
 
-        span::sub(t, f, t);
-        span::transform(v, f, val_to_f32);
-        span::add(t, f, t);
         next(mot);
+
+        perf::record(mot.stage_times, MotionStage::Centroid, centroid);
+        perf::record(mot.stage_times, MotionStage::Motion, perf::sub(perf::elapsed_since(motion_begin), centroid));
     }
 
 
     void update(GrayMotion& mot, img::GrayView const& src, img::GrayView const& dst)
     {
         update(mot, src);
+        img::map(mot.mask, mot.out);
         resize_up(mot.out, dst);
     }
 
@@ -232,21 +396,176 @@ namespace motion
     void update(GrayMotion& mot, img::GrayView const& src, Rect2Du32 src_scan_rect, img::GrayView const& dst)
     {
         update(mot, src, src_scan_rect);
+        img::map(mot.mask, mot.out);
         resize_up(mot.out, dst);
     }
 }
 
 
+/* fused */
+
+namespace motion
+{
+    /*  GradientMotion::update streams the source once, one tile of motion rows at a time.
+        A tile is scaled to proc rows, gradients are taken and scaled to motion rows,
+        and the history is updated while the rows are still in cache.
+        Each band of tiles has its own scratch and the bands run on the thread pool. */
+
+    // motion rows per tile
+    constexpr u32 TILE_ROWS = 8;
+
+    // proc rows above and below a tile needed by the 5x5 gradients
+    constexpr u32 HALO_ROWS = 2;
+
+    constexpr u32 TILE_PROC_ROWS = 2 * TILE_ROWS + 2 * HALO_ROWS;
+
+
+    class BandTimes
+    {
+    public:
+        perf::Elapsed resize;
+        perf::Elapsed gradients;
+        perf::Elapsed motion;
+    };
+
+
+    static void lap(perf::Stamp& begin, perf::Elapsed& total, bool timed)
+    {
+        if (!timed)
+        {
+            return;
+        }
+
+        auto end = perf::stamp();
+
+        std::chrono::duration<f32, std::milli> ms = end.wall - begin.wall;
+        total.wall_ms += ms.count();
+        total.cpu_ms += (f32)(end.cpu_ms - begin.cpu_ms);
+
+        begin = end;
+    }
+
+
+    static img::GrayView row_band(img::GrayView const& view, u32 y_begin, u32 height)
+    {
+        auto band = view;
+        band.matrix_data_ += (u64)y_begin * view.width;
+        band.height = height;
+
+        return band;
+    }
+
+
+    static void copy_rows(img::GrayView const& src, u32 src_y, img::GrayView const& dst, u32 dst_y, u32 height)
+    {
+        span::copy(img::to_span(row_band(src, src_y, height)), img::to_span(row_band(dst, dst_y, height)));
+    }
+
+
+    static void update_band(GradientMotion& gm, MotionBand const& band, img::GrayView const& src, f32 thresh, BandTimes& times)
+    {
+        auto& mot = gm.edge_motion;
+
+        auto proc_h = gm.proc_gray_view.height;
+        auto proc_scale = integer_scale(src.width, src.height, gm.proc_gray_view.width, proc_h);
+        auto write_views = gm.write_proc_views;
+
+        bool timed = gm.stage_times;
+        perf::Stamp stamp{};
+        if (timed)
+        {
+            stamp = perf::stamp();
+        }
+
+        for (u32 y_begin = band.y_begin; y_begin < band.y_end; y_begin += TILE_ROWS)
+        {
+            auto y_end = num::min(y_begin + TILE_ROWS, band.y_end);
+            auto n_proc = 2 * (y_end - y_begin);
+
+            // proc row of the first tile row, negative for the top of the image
+            auto top = (i32)(2 * y_begin) - (i32)HALO_ROWS;
+
+            auto const tile_row = [&](u32 proc_y){ return (u32)((i32)proc_y - top); };
+
+            // halo rows from the previous tile are already scaled
+            u32 fill_begin = 0;
+            if (y_begin == band.y_begin)
+            {
+                fill_begin = (u32)num::max(top, 0);
+            }
+            else
+            {
+                copy_rows(band.gray, 2 * TILE_ROWS, band.gray, 0, 2 * HALO_ROWS);
+                fill_begin = (u32)top + 2 * HALO_ROWS;
+            }
+
+            auto fill_end = num::min(2 * y_end + HALO_ROWS, proc_h);
+
+            auto tile_gray = row_band(band.gray, 0, n_proc + 2 * HALO_ROWS);
+            auto tile_edges = row_band(band.edges, 0, n_proc + 2 * HALO_ROWS);
+
+            auto tile_fill = row_band(tile_gray, tile_row(fill_begin), fill_end - fill_begin);
+
+            if (proc_scale == 1)
+            {
+                copy_rows(src, fill_begin, tile_gray, tile_row(fill_begin), fill_end - fill_begin);
+            }
+            else if (proc_scale)
+            {
+                img::scale_down(row_band(src, fill_begin * proc_scale, (fill_end - fill_begin) * proc_scale), tile_fill);
+            }
+            else
+            {
+                img::resize_area_rows(gm.proc_plan, src, tile_fill, fill_begin);
+            }
+
+            lap(stamp, times.resize, timed);
+
+            img::gradients(tile_gray, tile_edges);
+
+            // no gradients for the 2 rows at the top and bottom of the image
+            for (u32 y = 2 * y_begin; y < 2 * y_end; y++)
+            {
+                if (y < HALO_ROWS || y + HALO_ROWS >= proc_h)
+                {
+                    img::fill(row_band(tile_edges, tile_row(y), 1), 0);
+                }
+            }
+
+            lap(stamp, times.gradients, timed);
+
+            img::scale_down(row_band(tile_edges, HALO_ROWS, n_proc), row_band(mot.values, y_begin, y_end - y_begin));
+
+            update_history_rows(mot, thresh, y_begin, y_end);
+
+            lap(stamp, times.motion, timed);
+
+            if (write_views)
+            {
+                // rows below the last motion row belong to the last tile
+                auto gray_end = y_end == mot.values.height ? fill_end : 2 * y_end;
+
+                copy_rows(tile_gray, tile_row(2 * y_begin), gm.proc_gray_view, 2 * y_begin, gray_end - 2 * y_begin);
+                copy_rows(tile_edges, HALO_ROWS, gm.proc_edges_view, 2 * y_begin, n_proc);
+            }
+        }
+    }
+}
+
+
 namespace motion
 {
-    bool create(GradientMotion& gm, u32 width, u32 height)
+    bool create(GradientMotion& gm, u32 width, u32 height, u32 window)
     {
         auto process_w = width;
         auto process_h = height;
         auto motion_w = process_w / 2;
         auto motion_h = process_h / 2;
 
-        auto n_pixels8 = process_w * process_h * 3;
+        auto n_tiles = (motion_h + TILE_ROWS - 1) / TILE_ROWS;
+        auto n_bands = num::min(n_tiles, GradientMotion::max_bands);
+
+        auto n_pixels8 = process_w * process_h * 3 + n_bands * 2 * process_w * TILE_PROC_ROWS;
 
         gm.buffer8 = img::create_buffer8(n_pixels8, "buffer8");
         if (!gm.buffer8.ok)
@@ -260,7 +579,18 @@ namespace motion
         gm.proc_edges_view = img::make_view(process_w, process_h, gm.buffer8);
         gm.proc_motion_view = img::make_view(process_w, process_h, gm.buffer8);
 
-        if (!motion::create(gm.edge_motion, motion_w, motion_h))
+        gm.n_bands = n_bands;
+
+        for (u32 i = 0; i < n_bands; i++)
+        {
+            auto& band = gm.bands[i];
+            band.y_begin = motion_h * i / n_bands;
+            band.y_end = motion_h * (i + 1) / n_bands;
+            band.gray = img::make_view(process_w, TILE_PROC_ROWS, gm.buffer8);
+            band.edges = img::make_view(process_w, TILE_PROC_ROWS, gm.buffer8);
+        }
+
+        if (!motion::create(gm.edge_motion, motion_w, motion_h, window))
         {
             return false;
         }
@@ -271,19 +601,87 @@ namespace motion
 
     void update(GradientMotion& gm, img::GrayView const& src_gray, Rect2Du32 src_scan_rect)
     {
+        TRACE_ZONE("motion::update");
+
+        auto& mot = gm.edge_motion;
         auto& gray = gm.proc_gray_view;
-        auto& edges = gm.proc_edges_view;
-        auto& motion = gm.proc_motion_view;
 
-        auto proc_scale = src_gray.width / gray.width;
-        auto motion_scale = src_gray.width / gm.edge_motion.out.width;
+        assert(gray.width == 2 * mot.out.width);
+
+        auto proc_scale = integer_scale(src_gray.width, src_gray.height, gray.width, gray.height);
+
+        auto& plan = gm.proc_plan;
+        if (!proc_scale && (plan.width_src != src_gray.width || plan.height_src != src_gray.height))
+        {
+            // first frame or a new source size
+            if (!img::create_area_plan(plan, src_gray.width, src_gray.height, gray.width, gray.height))
+            {
+                assert(" *** create_area_plan() failed *** " && false);
+                return;
+            }
+        }
+
+        auto proc_scan_rect = rect_scale_down(src_scan_rect, src_gray.width, src_gray.height, gray.width, gray.height);
+
+        auto thresh = motion_threshold(mot.motion_sensitivity);
+
+        BandTimes band_times[GradientMotion::max_bands] = {};
+
+        auto const bands = [&](u32 begin, u32 end)
+        {
+            for (u32 i = begin; i < end; i++)
+            {
+                update_band(gm, gm.bands[i], src_gray, thresh, band_times[i]);
+            }
+        };
+
+        auto band_pixels = src_gray.width * src_gray.height / gm.n_bands;
+
+        thread_pool::parallel_for_rows(gm.n_bands, band_pixels, bands);
+
+        auto filter_begin = perf::stamp();
+        filter_mask(mot);
+        auto filter = perf::elapsed_since(filter_begin);
+
+        // same as GrayMotion update with a scan rect
+        auto rect = rect_scale_down(proc_scan_rect, 2);
+
+        Point2Du32 pt = {
+            mot.location.x - rect.x_begin,
+            mot.location.y - rect.y_begin
+        };
 
-        auto proc_scan_rect = rect_scale_down(src_scan_rect, proc_scale);
+        auto centroid_begin = perf::stamp();
+        pt = img::centroid(img::sub_view(mot.mask, rect), pt, mot.locate_sensitivity);
+        auto centroid = perf::elapsed_since(centroid_begin);
 
-        resize_down(src_gray, gray);
-        img::gradients(gray, edges);
-        update(gm.edge_motion, edges, proc_scan_rect, motion);
+        mot.location.x = pt.x + rect.x_begin;
+        mot.location.y = pt.y + rect.y_begin;
+
+        next(mot);
 
-        gm.src_location = scale_point_up(gm.edge_motion.location, motion_scale);
+        if (gm.write_proc_views)
+        {
+            img::map(mot.mask, mot.out);
+            resize_up(mot.out, gm.proc_motion_view);
+        }
+
+        gm.src_location = scale_point_up(mot.location, mot.out.width, mot.out.height, src_gray.width, src_gray.height);
+
+        if (gm.stage_times)
+        {
+            BandTimes total{};
+            for (u32 i = 0; i < gm.n_bands; i++)
+            {
+                total.resize = perf::add(total.resize, band_times[i].resize);
+                total.gradients = perf::add(total.gradients, band_times[i].gradients);
+                total.motion = perf::add(total.motion, band_times[i].motion);
+            }
+
+            perf::record(gm.stage_times, MotionStage::Resize, total.resize);
+            perf::record(gm.stage_times, MotionStage::Gradients, total.gradients);
+            perf::record(gm.stage_times, MotionStage::Motion, perf::add(total.motion, filter));
+            perf::record(gm.stage_times, MotionStage::Centroid, centroid);
+        }
     }
-}
\ No newline at end of file
+}
@@ -1,42 +1,89 @@
 #pragma once
 
 #include "../image/image.hpp"
+#include "../util/stage_times.hpp"
 
 namespace motion
 {
     namespace img = image;
 
-    using Matrix32 = MatrixView2D<f32>;
+    using Totals16 = MatrixView2D<u16>;
+
+
+    enum class MotionStage : u32
+    {
+        Resize = 0,
+        Gradients,
+        Motion,
+        Centroid,
+
+        Count
+    };
 
 
     class GrayMotion
     {
     public:
 
-        constexpr static u32 count = 0b1000; // 30fps
+        constexpr static u32 max_count = 32;
+
+        // frames of history, 4, 8, 16 or 32, set by create
+        u32 count = 8;
 
         f32 motion_sensitivity = 0.9f;
         f32 locate_sensitivity = 0.98f;
 
+        // optional, in pixels of the mask, 0 is off
+        // open removes specks of noise, close joins motion split by small gaps
+        u32 open_radius = 0;
+        u32 close_radius = 0;
+
         u32 index = 0;
 
-        Matrix32 list[count] = { 0 };
-        Matrix32 totals;
+        // the last count values in a ring and their sum
+        img::GrayView list[max_count];
+        Totals16 totals;
 
         img::GrayView values;
+
+        // src to values when the ratio is not an integer, rebuilt when the src size changes
+        img::AreaPlan values_plan;
+
+        // 1 bit per pixel where motion was detected
+        img::BitMaskView mask;
+        img::BitMaskView mask_tmp;
+
+        // the mask as 0 or 255, only written by the updates with a dst
         img::GrayView out;
 
         Point2Du32 location;
 
-        img::Buffer32 buffer32;
         img::Buffer8 buffer8;
+        MemoryBuffer<u16> buffer16;
+        img::Buffer64 buffer64;
+
+        // optional, records MotionStage::Motion and MotionStage::Centroid
+        perf::StageTimes* stage_times = 0;
     };
 
 
-    bool create(GrayMotion& mot, u32 width, u32 height);
+    // frames of history for about the same time at any source frame rate, 8 at 30fps
+    u32 motion_window(f64 fps);
+
+    // difference from the history average where a pixel is motion, in 0 - 255
+    f32 motion_threshold(f32 sensitivity);
+
+    bool create(GrayMotion& mot, u32 width, u32 height, u32 window);
 
     void destroy(GrayMotion& mot);
 
+
+    inline bool create(GrayMotion& mot, u32 width, u32 height)
+    {
+        return create(mot, width, height, 8);
+    }
+
+
     void update(GrayMotion& mot, img::GrayView const& src);
 
     void update(GrayMotion& mot, img::GrayView const& src, Rect2Du32 scan_rect);
@@ -50,29 +97,63 @@ namespace motion
 
 namespace motion
 {
+    // rows of motion resolution processed together, with scratch for one tile
+    class MotionBand
+    {
+    public:
+        u32 y_begin = 0;
+        u32 y_end = 0;
+
+        img::GrayView gray;
+        img::GrayView edges;
+    };
+
+
     class GradientMotion
     {
     public:
+        constexpr static u32 max_bands = 8;
+
         img::GrayView proc_gray_view;
         img::GrayView proc_edges_view;
         img::GrayView proc_motion_view;
+
+        // src to proc_gray_view when the ratio is not an integer, rebuilt when the src size changes
+        img::AreaPlan proc_plan;
+
+        // the proc views are only written when set, e.g. when they are displayed
+        bool write_proc_views = false;
         
         Point2Du32 src_location;
         
         GrayMotion edge_motion;
 
+        u32 n_bands = 0;
+        MotionBand bands[max_bands];
+
         img::Buffer8 buffer8;
+
+        // optional, records all MotionStage values
+        perf::StageTimes* stage_times = 0;
     };
 
 
     inline void destroy(GradientMotion& gm)
     {
         destroy(gm.edge_motion);
+        img::destroy_area_plan(gm.proc_plan);
         mb::destroy_buffer(gm.buffer8);
     }
 
 
-    bool create(GradientMotion& gm, u32 width, u32 height);
+    bool create(GradientMotion& gm, u32 width, u32 height, u32 window);
+
+
+    inline bool create(GradientMotion& gm, u32 width, u32 height)
+    {
+        return create(gm, width, height, 8);
+    }
+
 
     void update(GradientMotion& gm, img::GrayView const& src_gray, Rect2Du32 src_scan_rect);
 }
\ No newline at end of file
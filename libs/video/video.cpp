@@ -1,5 +1,7 @@
 #include "video.hpp"
 #include "../alloc_type/alloc_type.hpp"
+#include "../util/trace.hpp"
+#include "../util/numeric.hpp"
 
 // sudo apt-get install ffmpeg libavformat-dev libavcodec-dev libavutil-dev libswscale-dev
 extern "C" {
@@ -7,13 +9,36 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libswscale/swscale.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
 }
 
 #include <cassert>
+#include <new>
+#include <mutex>
+#include <condition_variable>
+#include <semaphore>
+#include <thread>
 
 
 namespace video
 {
+    /*  The pool holds a reference to the current frame.
+        The decoder writes to a free frame and publishes it as the new current frame.
+        Consumers acquire the current frame and it is not reused until they release it. */
+    class FramePool
+    {
+    public:
+        std::mutex mutex;
+        std::condition_variable cv;
+
+        u32 n_frames = 0;
+        u32 current_slot = 0;
+
+        u32 ref_counts[MAX_POOL_FRAMES] = { 0 };
+        VideoFrame frames[MAX_POOL_FRAMES];
+    };
+
+
     class VideoReaderContext
     {
     public:
@@ -28,18 +53,29 @@ namespace video
         AVPacket* packet;
         AVFrame* av_frame;
         
-        AVFrame* av_rgba;
+        AVFrame* av_rgba = 0;
 
-        VideoFrame display_frames[2];
-        b8 display_frame_id = 0;
+        // av_frame to av_rgba, created on the first capture and kept until close_video
+        SwsContext* capture_sws = 0;
+
+        FramePool frame_pool;
+
+        // of the current frame
+        u64 frame_index = 0;
+
+        // from the VideoReader at open_video
+        u32 pyramid_width = 0;
+        u32 pyramid_height = 0;
+        u32 pyramid_levels = 0;
+
+        img::ImagePyramid pyramids[MAX_POOL_FRAMES];
 
         img::Buffer32 buffer32;
         img::Buffer8 buffer8;
+    };
 
-        VideoFrame display_frame_read() { return display_frames[display_frame_id]; }
-        VideoFrame display_frame_write() { return display_frames[!display_frame_id]; }
 
-    };
+    class EncodeWorker;
 
 
     class VideoWriterContext
@@ -58,6 +94,16 @@ namespace video
         AVFrame* av_rgba;
 
         i64 packet_duration = -1;
+
+        // keyframe every gop_size frames, 0 to let the encoder decide
+        u32 gop_size = 0;
+        u64 frame_index = 0;
+
+        // encodes on its own thread when the writer is in a writer list, kept until close_video
+        EncodeWorker* encode_worker = 0;
+
+        // thread cpu time of the encode worker, written by the worker while a job runs
+        f64 encode_cpu_ms = 0.0;
     };
 
 
@@ -89,6 +135,101 @@ namespace video
     }
 
 
+    static FrameRef make_frame_ref(FramePool const& pool, u32 slot)
+    {
+        FrameRef ref{};
+        ref.frame = pool.frames[slot];
+        ref.slot = slot;
+        ref.ok = true;
+
+        return ref;
+    }
+
+
+    // blocks until a frame is free
+    static FrameRef acquire_free_frame(FramePool& pool)
+    {
+        std::unique_lock<std::mutex> lock(pool.mutex);
+
+        u32 slot = pool.n_frames;
+
+        auto const find_free = [&]()
+        {
+            for (u32 i = 0; i < pool.n_frames; i++)
+            {
+                if (!pool.ref_counts[i])
+                {
+                    slot = i;
+                    return true;
+                }
+            }
+
+            return false;
+        };
+
+        pool.cv.wait(lock, find_free);
+
+        pool.ref_counts[slot] = 1;
+
+        return make_frame_ref(pool, slot);
+    }
+
+
+    static void publish_frame(FramePool& pool, FrameRef const& ref)
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+
+        pool.ref_counts[pool.current_slot]--;
+
+        pool.current_slot = ref.slot;
+        pool.ref_counts[ref.slot]++;
+
+        pool.cv.notify_all();
+    }
+
+
+    static void release_frame(FramePool& pool, FrameRef& ref)
+    {
+        if (!ref.ok)
+        {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(pool.mutex);
+
+            assert(pool.ref_counts[ref.slot]);
+            pool.ref_counts[ref.slot]--;
+        }
+
+        pool.cv.notify_all();
+
+        ref.ok = false;
+    }
+
+
+    // blocks until the pool holds the only reference
+    static void wait_frames_released(FramePool& pool)
+    {
+        std::unique_lock<std::mutex> lock(pool.mutex);
+
+        auto const released = [&]()
+        {
+            for (u32 i = 0; i < pool.n_frames; i++)
+            {
+                if (pool.ref_counts[i] != (i == pool.current_slot))
+                {
+                    return false;
+                }
+            }
+
+            return true;
+        };
+
+        pool.cv.wait(lock, released);
+    }
+
+
 
 }
 
@@ -121,6 +262,8 @@ namespace video
 
     static void convert_frame(AVFrame* src, AVFrame* dst)
     {
+        TRACE_ZONE("video::convert_frame");
+
         auto sws_ctx = create_sws(src, dst);
         
         sws_scale(
@@ -133,7 +276,9 @@ namespace video
     
 
     static void convert_frame(AVFrame* src, AVFrame* dst, SwsContext* sws)
-    {        
+    {
+        TRACE_ZONE("video::convert_frame");
+
         sws_scale(
             sws,
             src->data, src->linesize, 0, src->height,
@@ -141,12 +286,65 @@ namespace video
     }
 
 
-    static void capture_frame(VideoReaderContext& ctx, SwsContext* sws)
+    static inline void count_decoded(FrameCounts* counts)
+    {
+        if (counts)
+        {
+            counts->decoded.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+
+    static inline void count_skipped(FrameCounts* counts)
+    {
+        if (counts)
+        {
+            counts->skipped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+
+    static inline void count_encoded(FrameCounts* counts)
+    {
+        if (counts)
+        {
+            counts->encoded.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+
+    // the returned frame is current and held until released
+    static u64 to_frame_index(VideoReaderContext const& ctx, i64 ts)
+    {
+        auto stream = ctx.video_stream;
+        auto start = stream->start_time == AV_NOPTS_VALUE ? 0 : stream->start_time;
+
+        auto index = av_rescale_q(ts - start, stream->time_base, av_inv_q(stream->avg_frame_rate));
+
+        return index > 0 ? (u64)index : 0;
+    }
+
+
+    static i64 to_stream_ts(VideoReaderContext const& ctx, u64 frame_index)
+    {
+        auto stream = ctx.video_stream;
+        auto start = stream->start_time == AV_NOPTS_VALUE ? 0 : stream->start_time;
+
+        return start + av_rescale_q((i64)frame_index, av_inv_q(stream->avg_frame_rate), stream->time_base);
+    }
+
+
+    static FrameRef capture_frame(VideoReaderContext& ctx, SwsContext* sws, perf::StageTimes* times)
     {
+        TRACE_ZONE("video::capture_frame");
+
+        auto ref = acquire_free_frame(ctx.frame_pool);
+
+        perf::StageTimer timer(times, VideoStage::Capture);
+
         convert_frame(ctx.av_frame, ctx.av_rgba, sws);
 
-        ctx.display_frame_id = !ctx.display_frame_id;
-        auto write_frame = ctx.display_frame_write();
+        auto write_frame = ref.frame;
 
         u32 w = write_frame.rgba.width;
         u32 h = write_frame.rgba.height;
@@ -158,19 +356,43 @@ namespace video
         auto src_gray = span::to_span(ctx.av_frame->data[0], w * h);
         auto dst_gray = img::to_span(write_frame.gray);
         span::copy(src_gray, dst_gray);
+
+        if (write_frame.pyramid)
+        {
+            img::reset_pyramid(*write_frame.pyramid);
+        }
+
+        ctx.frame_index = to_frame_index(ctx, ctx.av_frame->best_effort_timestamp);
+
+        publish_frame(ctx.frame_pool, ref);
+
+        return ref;
     }
     
 
-    static void encode_video_frame(VideoWriterContext const& ctx, i64 pts)
+    static void encode_video_frame(VideoWriterContext& ctx, i64 pts, perf::StageTimes* times, FrameCounts* counts)
     {
+        TRACE_ZONE("video::encode_video_frame");
+
         auto encoder = ctx.video_codec_ctx;
         auto frame = ctx.av_frame;
         auto duration = ctx.packet_duration;
         auto stream = ctx.video_stream;
 
+        auto encode_begin = perf::stamp();
+        perf::Elapsed mux{};
+
         // Set PTS (Presentation Time Stamp)
         frame->pts = pts;
 
+        // forced keyframes line up across writers fed the same frames
+        if (ctx.gop_size)
+        {
+            frame->pict_type = (ctx.frame_index % ctx.gop_size) ? AV_PICTURE_TYPE_NONE : AV_PICTURE_TYPE_I;
+        }
+
+        ctx.frame_index++;
+
         if (av_frame_make_writable(frame) < 0)
         {
             assert("*** av_frame_make_writable ***" && false);
@@ -179,6 +401,8 @@ namespace video
         // Send frame to encoder
         if (avcodec_send_frame(encoder, frame) >= 0) 
         {
+            count_encoded(counts);
+
             // Receive packet from encoder and write it
             AVPacket packet;
             av_init_packet(&packet);
@@ -197,24 +421,37 @@ namespace video
                 {
                     packet.dts = packet.pts;  // Simple assignment if no B-frames
                 }
+
+                auto mux_begin = perf::stamp();
                 av_interleaved_write_frame(ctx.format_ctx, &packet);
+                mux = perf::add(mux, perf::elapsed_since(mux_begin));
+
                 av_packet_unref(&packet);
             }
-        }       
+        }
+
+        perf::record(times, VideoStage::Encode, perf::sub(perf::elapsed_since(encode_begin), mux));
+        perf::record(times, VideoStage::Mux, mux);
     }
 
 
-    static void copy_audio(VideoReaderContext const& src_ctx, VideoWriterContext const& dst_ctx)
+    static void rescale_audio(AVPacket* packet, AVStream* in_stream, AVStream* out_stream)
     {
-        auto packet = src_ctx.packet;
-        auto in_stream = src_ctx.audio_stream;
-        auto out_stream = dst_ctx.audio_stream;
-
         packet->pts = av_rescale_q_rnd(packet->pts, in_stream->time_base, out_stream->time_base, (AVRounding)(AV_ROUND_NEAR_INF|AV_ROUND_PASS_MINMAX)); 
         packet->dts = av_rescale_q_rnd(packet->dts, in_stream->time_base, out_stream->time_base, (AVRounding)(AV_ROUND_NEAR_INF|AV_ROUND_PASS_MINMAX)); 
         packet->duration = av_rescale_q(packet->duration, in_stream->time_base, out_stream->time_base);
         packet->pos = -1; 
         packet->stream_index = out_stream->index;
+    }
+
+
+    static void copy_audio(VideoReaderContext const& src_ctx, VideoWriterContext const& dst_ctx)
+    {
+        TRACE_ZONE("video::copy_audio");
+
+        auto packet = src_ctx.packet;
+
+        rescale_audio(packet, src_ctx.audio_stream, dst_ctx.audio_stream);
 
         av_interleaved_write_frame(dst_ctx.format_ctx, packet);
     }
@@ -222,6 +459,8 @@ namespace video
     
     static void flush_encoder(VideoWriterContext& ctx)
     {
+        TRACE_ZONE("video::flush_encoder");
+
         auto encoder = ctx.video_codec_ctx;
         auto duration = ctx.packet_duration;
         auto stream = ctx.video_stream;
@@ -252,20 +491,81 @@ namespace video
 }
 
 
+/* seek */
+
+namespace video
+{
+    static bool seek_keyframe(VideoReaderContext& ctx, u64 frame_index)
+    {
+        auto ts = to_stream_ts(ctx, frame_index);
+
+        if (av_seek_frame(ctx.format_ctx, ctx.video_stream->index, ts, AVSEEK_FLAG_BACKWARD) < 0)
+        {
+            return false;
+        }
+
+        avcodec_flush_buffers(ctx.video_codec_ctx);
+
+        return true;
+    }
+
+
+    // next video frame into ctx.av_frame, other packets are dropped
+    static bool decode_next_frame(VideoReaderContext& ctx)
+    {
+        auto packet = ctx.packet;
+        auto decoder = ctx.video_codec_ctx;
+        auto frame = ctx.av_frame;
+        int video_stream_index = ctx.video_stream->index;
+
+        // frames left from the last packet
+        if (avcodec_receive_frame(decoder, frame) == 0)
+        {
+            return true;
+        }
+
+        while (av_read_frame(ctx.format_ctx, packet) >= 0)
+        {
+            if (packet->stream_index != video_stream_index)
+            {
+                av_packet_unref(packet);
+                continue;
+            }
+
+            auto sent = avcodec_send_packet(decoder, packet);
+            av_packet_unref(packet);
+
+            if (sent == 0 && avcodec_receive_frame(decoder, frame) == 0)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+}
+
+
 /* for_each_frame */
 
 namespace video
 {
+    static SwsContext* get_capture_sws(VideoReaderContext& ctx);
+
+
+    // false when the frame buffers could not be created
     template <class FN> // std::function<void()>
-    static void for_each_video_frame(VideoReader const& src, FN const& on_read_video)
+    static bool for_each_video_frame(VideoReader const& src, FN const& on_read_video)
     {
-        auto ctx = get_context(src);
+        TRACE_ZONE("video::for_each_video_frame");
+
+        auto& ctx = get_context(src);
         auto packet = ctx.packet;
         auto decoder = ctx.video_codec_ctx;
         auto frame = ctx.av_frame;
         int video_stream_index = ctx.video_stream->index;
 
-        SwsContext* sws = 0;
+        auto decode_begin = perf::stamp();
 
         while (av_read_frame(ctx.format_ctx, packet) >= 0) 
         {
@@ -277,27 +577,44 @@ namespace video
                     // Receive frame from decoder
                     while (avcodec_receive_frame(decoder, frame) == 0) 
                     {     
+                        perf::record(src.stage_times, VideoStage::Decode, perf::elapsed_since(decode_begin));
+                        count_decoded(src.frame_counts);
+
+                        auto sws = get_capture_sws(ctx);
                         if (!sws)
                         {
-                            sws = create_sws(ctx.av_frame, ctx.av_rgba);
+                            av_packet_unref(packet);
+                            return false;
+                        }
+
+                        auto ref = capture_frame(ctx, sws, src.stage_times);
+                        {
+                            TRACE_ZONE("video::on_read_video");
+                            on_read_video();
                         }
-                        
-                        capture_frame(ctx, sws);
-                        on_read_video();
+                        release_frame(ctx.frame_pool, ref);
+
+                        decode_begin = perf::stamp();
                     }
                 }
+                else
+                {
+                    count_skipped(src.frame_counts);
+                }
             }
             av_packet_unref(packet);
         }
 
-        sws_freeContext(sws);
+        return true;
     }
 
 
     template <class FN1, class FN2> // std::function<void()>
-    static void for_each_audio_video_frame(VideoReader const& src, FN1 const& on_read_video, FN2 const& on_read_audio)
+    static bool for_each_audio_video_frame(VideoReader const& src, FN1 const& on_read_video, FN2 const& on_read_audio)
     {
-        auto ctx = get_context(src);
+        TRACE_ZONE("video::for_each_audio_video_frame");
+
+        auto& ctx = get_context(src);
         auto packet = ctx.packet;
         auto decoder = ctx.video_codec_ctx;
         auto frame = ctx.av_frame;
@@ -308,7 +625,7 @@ namespace video
             audio_stream_index = ctx.audio_stream->index;
         }
 
-        SwsContext* sws = 0;
+        auto decode_begin = perf::stamp();
 
         while (av_read_frame(ctx.format_ctx, packet) >= 0) 
         {
@@ -320,15 +637,30 @@ namespace video
                     // Receive frame from decoder
                     while (avcodec_receive_frame(decoder, frame) == 0) 
                     {      
+                        perf::record(src.stage_times, VideoStage::Decode, perf::elapsed_since(decode_begin));
+                        count_decoded(src.frame_counts);
+
+                        auto sws = get_capture_sws(ctx);
                         if (!sws)
                         {
-                            sws = create_sws(ctx.av_frame, ctx.av_rgba);
+                            av_packet_unref(packet);
+                            return false;
                         }
-                        
-                        capture_frame(ctx, sws);
-                        on_read_video();
+
+                        auto ref = capture_frame(ctx, sws, src.stage_times);
+                        {
+                            TRACE_ZONE("video::on_read_video");
+                            on_read_video();
+                        }
+                        release_frame(ctx.frame_pool, ref);
+
+                        decode_begin = perf::stamp();
                     }
                 }
+                else
+                {
+                    count_skipped(src.frame_counts);
+                }
             }
             else if (packet->stream_index == audio_stream_index)
             {
@@ -337,14 +669,17 @@ namespace video
             av_packet_unref(packet);
         }
 
-        sws_freeContext(sws);
+        return true;
     }
 
 
+    // true at the end of the stream, false when cond stops it or the frame buffers could not be created
     template <class FN> // std::function<void()>, std::function<bool()>
     static bool for_each_video_frame(VideoReader const& src, FN const& on_read_video, fn_bool const& cond)
     {
-        auto ctx = get_context(src);
+        TRACE_ZONE("video::for_each_video_frame");
+
+        auto& ctx = get_context(src);
         auto packet = ctx.packet;
         auto decoder = ctx.video_codec_ctx;
         auto frame = ctx.av_frame;
@@ -357,7 +692,7 @@ namespace video
             return !done;
         };
 
-        SwsContext* sws = 0;
+        auto decode_begin = perf::stamp();
 
         while (cond() && read()) 
         {
@@ -369,21 +704,34 @@ namespace video
                     // Receive frame from decoder
                     while (avcodec_receive_frame(decoder, frame) == 0) 
                     {
+                        perf::record(src.stage_times, VideoStage::Decode, perf::elapsed_since(decode_begin));
+                        count_decoded(src.frame_counts);
+
+                        auto sws = get_capture_sws(ctx);
                         if (!sws)
                         {
-                            sws = create_sws(ctx.av_frame, ctx.av_rgba);
+                            av_packet_unref(packet);
+                            return false;
+                        }
+
+                        auto ref = capture_frame(ctx, sws, src.stage_times);
+                        {
+                            TRACE_ZONE("video::on_read_video");
+                            on_read_video();
                         }
-                        
-                        capture_frame(ctx, sws);
-                        on_read_video();
+                        release_frame(ctx.frame_pool, ref);
+
+                        decode_begin = perf::stamp();
                     }
                 }
+                else
+                {
+                    count_skipped(src.frame_counts);
+                }
             }            
             av_packet_unref(packet);
         }
 
-        sws_freeContext(sws);
-
         return done;
     }
 
@@ -391,7 +739,9 @@ namespace video
     template <class FN1, class FN2> // std::function<void()>, std::function<bool()>
     static bool for_each_audio_video_frame(VideoReader const& src, FN1 const& on_read_video, FN2 const& on_read_audio, fn_bool const& cond)
     {
-        auto ctx = get_context(src);
+        TRACE_ZONE("video::for_each_audio_video_frame");
+
+        auto& ctx = get_context(src);
         auto packet = ctx.packet;
         auto decoder = ctx.video_codec_ctx;
         auto frame = ctx.av_frame;
@@ -409,7 +759,7 @@ namespace video
             return !done;
         };
 
-        SwsContext* sws = 0;
+        auto decode_begin = perf::stamp();
 
         while (cond() && read()) 
         {
@@ -421,15 +771,30 @@ namespace video
                     // Receive frame from decoder
                     while (avcodec_receive_frame(decoder, frame) == 0) 
                     {
+                        perf::record(src.stage_times, VideoStage::Decode, perf::elapsed_since(decode_begin));
+                        count_decoded(src.frame_counts);
+
+                        auto sws = get_capture_sws(ctx);
                         if (!sws)
                         {
-                            sws = create_sws(ctx.av_frame, ctx.av_rgba);
+                            av_packet_unref(packet);
+                            return false;
+                        }
+
+                        auto ref = capture_frame(ctx, sws, src.stage_times);
+                        {
+                            TRACE_ZONE("video::on_read_video");
+                            on_read_video();
                         }
-                        
-                        capture_frame(ctx, sws);
-                        on_read_video();
+                        release_frame(ctx.frame_pool, ref);
+
+                        decode_begin = perf::stamp();
                     }
                 }
+                else
+                {
+                    count_skipped(src.frame_counts);
+                }
             }
             else if (packet->stream_index == audio_stream_index)
             {
@@ -438,8 +803,6 @@ namespace video
             av_packet_unref(packet);
         }
 
-        sws_freeContext(sws);
-
         return done;
     }
 
@@ -450,7 +813,7 @@ namespace video
 
 namespace video
 {
-    static bool create_video_stream(VideoReaderContext& src_ctx, VideoWriterContext& ctx, u32 width, u32 height)
+    static bool create_video_stream(VideoReaderContext& src_ctx, VideoWriterContext& ctx, VideoWriter const& dst, u32 width, u32 height)
     {
         auto src_stream = src_ctx.video_stream;
         
@@ -493,6 +856,23 @@ namespace video
         ctx.video_codec_ctx->time_base = src_stream->time_base;
         ctx.video_codec_ctx->framerate = src_stream->avg_frame_rate;
 
+        if (dst.bit_rate)
+        {
+            ctx.video_codec_ctx->bit_rate = dst.bit_rate;
+            ctx.video_codec_ctx->rc_max_rate = dst.bit_rate;
+            ctx.video_codec_ctx->rc_buffer_size = (int)(dst.bit_rate * 2);
+        }
+
+        if (dst.gop_size)
+        {
+            ctx.video_codec_ctx->gop_size = (int)dst.gop_size;
+            ctx.video_codec_ctx->keyint_min = (int)dst.gop_size;
+            ctx.video_codec_ctx->flags |= AV_CODEC_FLAG_CLOSED_GOP;
+
+            // no scene cut keyframes, only the forced ones. Not every encoder has the option
+            av_opt_set_int(ctx.video_codec_ctx, "sc_threshold", 0, AV_OPT_SEARCH_CHILDREN);
+        }
+
         if (avcodec_open2(ctx.video_codec_ctx, dst_video_codec, nullptr) != 0)
         {
             assert("*** avcodec_open2 - video ***" && false);
@@ -633,38 +1013,111 @@ namespace video
     }
 
 
-    static bool create_av_frame(VideoWriterContext& ctx, u32 width, u32 height, AVPixelFormat fmt)
+    // not done by open_video, readers that only probe or seek never allocate
+    static bool create_frame_buffers(VideoReaderContext& ctx)
     {
-        int w = (int)width;
-        int h = (int)height;
-        int align = 32;
+        if (ctx.av_rgba)
+        {
+            return true;
+        }
 
-        AVFrame* avframe = av_frame_alloc();
-        if (!avframe)
+        auto w = (u32)ctx.video_codec_ctx->width;
+        auto h = (u32)ctx.video_codec_ctx->height;
+
+        if (!create_av_rgba(ctx, w, h))
         {
-            assert("*** av_frame_alloc ***" && false);
             return false;
         }
 
-        avframe->format = (int)fmt;
-        avframe->width = w;
-        avframe->height = h;
+        auto& pool = ctx.frame_pool;
 
-        if (av_frame_get_buffer(avframe, align) < 0)
+        u32 n_pool_pixels = pool.n_frames * w * h;
+
+        ctx.buffer32 = img::create_buffer32(n_pool_pixels, "frame_pool rgba");
+        ctx.buffer8 = img::create_buffer8(n_pool_pixels, "frame_pool gray");
+
+        if (!ctx.buffer32.ok || !ctx.buffer8.ok)
         {
-            assert("*** av_frame_get_buffer ***" && false);
-            av_frame_free(&avframe);
+            mb::destroy_buffer(ctx.buffer32);
+            mb::destroy_buffer(ctx.buffer8);
+            av_frame_free(&ctx.av_rgba);
             return false;
         }
 
-        ctx.av_frame = avframe;
+        mb::zero_buffer(ctx.buffer32);
+        mb::zero_buffer(ctx.buffer8);
 
-        return true;
-    }
+        // consumers may be reading the current frame
+        std::lock_guard<std::mutex> lock(pool.mutex);
 
+        for (u32 i = 0; i < pool.n_frames; i++)
+        {
+            auto& frame = pool.frames[i];
+            frame.rgba = img::make_view(w, h, ctx.buffer32);
+            frame.gray = img::make_view(w, h, ctx.buffer8);
 
-    static bool create_av_rgba(VideoWriterContext& ctx, u32 width, u32 height)
-    {
+            auto& pyr = ctx.pyramids[i];
+            if (ctx.pyramid_levels > 1 && img::create_pyramid(pyr, frame.gray, ctx.pyramid_width, ctx.pyramid_height, ctx.pyramid_levels))
+            {
+                frame.pyramid = &pyr;
+            }
+        }
+
+        return true;
+    }
+
+
+    static SwsContext* get_capture_sws(VideoReaderContext& ctx)
+    {
+        if (ctx.capture_sws)
+        {
+            return ctx.capture_sws;
+        }
+
+        if (!create_frame_buffers(ctx))
+        {
+            assert("*** create_frame_buffers ***" && false);
+            return 0;
+        }
+
+        ctx.capture_sws = create_sws(ctx.av_frame, ctx.av_rgba);
+
+        return ctx.capture_sws;
+    }
+
+
+    static bool create_av_frame(VideoWriterContext& ctx, u32 width, u32 height, AVPixelFormat fmt)
+    {
+        int w = (int)width;
+        int h = (int)height;
+        int align = 32;
+
+        AVFrame* avframe = av_frame_alloc();
+        if (!avframe)
+        {
+            assert("*** av_frame_alloc ***" && false);
+            return false;
+        }
+
+        avframe->format = (int)fmt;
+        avframe->width = w;
+        avframe->height = h;
+
+        if (av_frame_get_buffer(avframe, align) < 0)
+        {
+            assert("*** av_frame_get_buffer ***" && false);
+            av_frame_free(&avframe);
+            return false;
+        }
+
+        ctx.av_frame = avframe;
+
+        return true;
+    }
+
+
+    static bool create_av_rgba(VideoWriterContext& ctx, u32 width, u32 height)
+    {
         auto w = (int)width;
         auto h = (int)height;
         auto fmt = AV_PIX_FMT_RGBA;
@@ -706,7 +1159,89 @@ namespace video
 
 namespace video
 {
+    // waits for encodes in flight, see multiple writers
+    static void stop_encode_worker(VideoWriterContext& ctx);
+
     
+    // container headers only, e.g. the mp4 moov box
+    constexpr i64 PROBE_SIZE = 256 * 1024;
+    constexpr i64 PROBE_ANALYZE_DURATION = AV_TIME_BASE / 10;
+
+
+    static bool has_video_params(AVFormatContext* format_ctx, int stream_index)
+    {
+        if (stream_index < 0)
+        {
+            return false;
+        }
+
+        auto stream = format_ctx->streams[stream_index];
+        auto cp = stream->codecpar;
+
+        return cp->width > 0 && cp->height > 0 && stream->avg_frame_rate.num > 0 && format_ctx->duration > 0;
+    }
+
+
+    bool probe_video(cstr filepath, VideoInfo& info)
+    {
+        TRACE_ZONE("video::probe_video");
+
+        auto format_ctx = avformat_alloc_context();
+        if (!format_ctx)
+        {
+            return false;
+        }
+
+        format_ctx->probesize = PROBE_SIZE;
+        format_ctx->max_analyze_duration = PROBE_ANALYZE_DURATION;
+
+        // frees format_ctx on failure
+        if (avformat_open_input(&format_ctx, filepath, nullptr, nullptr) != 0)
+        {
+            return false;
+        }
+
+        auto video_index = av_find_best_stream(format_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+
+        // reads and parses packets, only when the headers are not enough
+        if (!has_video_params(format_ctx, video_index))
+        {
+            avformat_find_stream_info(format_ctx, nullptr);
+            video_index = av_find_best_stream(format_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        }
+
+        if (video_index < 0)
+        {
+            avformat_close_input(&format_ctx);
+            return false;
+        }
+
+        auto stream = format_ctx->streams[video_index];
+        auto cp = stream->codecpar;
+
+        auto rate = stream->avg_frame_rate.num ? stream->avg_frame_rate : stream->r_frame_rate;
+
+        info.frame_width = (u32)cp->width;
+        info.frame_height = (u32)cp->height;
+        info.fps = rate.den ? av_q2d(rate) : 0.0;
+
+        if (format_ctx->duration > 0)
+        {
+            info.duration_s = (f64)format_ctx->duration / AV_TIME_BASE;
+        }
+        else if (stream->duration > 0)
+        {
+            info.duration_s = stream->duration * av_q2d(stream->time_base);
+        }
+
+        info.has_audio = av_find_best_stream(format_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0) >= 0;
+
+        avformat_close_input(&format_ctx);
+
+        return info.frame_width && info.frame_height;
+    }
+
+
     bool open_video(VideoReader& video, cstr filepath)
     {
         auto data = mem::malloc<VideoReaderContext>("video context");
@@ -715,6 +1250,8 @@ namespace video
             return false;
         }
 
+        new (data) VideoReaderContext();
+
         video.video_handle = (u64)data;
 
         auto& ctx = get_context(video);
@@ -809,6 +1346,7 @@ namespace video
         video.frame_width = (u32)cp->width;
         video.frame_height = (u32)cp->height;        
         video.fps = av_q2d(ctx.video_stream->avg_frame_rate);
+        video.duration_s = ctx.format_ctx->duration > 0 ? (f64)ctx.format_ctx->duration / AV_TIME_BASE : 0.0;
         
         ctx.audio_codec_ctx = 0;
         ctx.audio_stream = 0;
@@ -829,35 +1367,20 @@ namespace video
             }
         }
 
-        auto close_4 = [&]()
-        {
-            close_3();
-            av_packet_free(&ctx.packet);
-        };
-
-        if (!create_av_rgba(ctx, video.frame_width, video.frame_height))
-        {
-            close_4();
-            return false;
-        }
-
-        u32 n_display_pixels = 2 * video.frame_width * video.frame_height;
+        // write, current and one consumer
+        auto n_frames = numeric::clamp(video.n_pool_frames, 3u, MAX_POOL_FRAMES);
 
-        ctx.buffer32 = img::create_buffer32(n_display_pixels, "display_frames rgba");
-        ctx.buffer8 = img::create_buffer8(n_display_pixels, "display_frames gray");
+        // frame buffers are allocated by the first decode
+        auto& pool = ctx.frame_pool;
+        pool.n_frames = n_frames;
+        pool.current_slot = 0;
+        pool.ref_counts[0] = 1;
 
-        if (!ctx.buffer32.ok || !ctx.buffer8.ok)
-        {
-            close_4();
-            mb::destroy_buffer(ctx.buffer32);
-            mb::destroy_buffer(ctx.buffer8);
-        }
+        video.n_pool_frames = n_frames;
 
-        for (u32 i = 0; i < 2; i++)
-        {
-            ctx.display_frames[i].rgba = img::make_view(video.frame_width, video.frame_height, ctx.buffer32);
-            ctx.display_frames[i].gray = img::make_view(video.frame_width, video.frame_height, ctx.buffer8);
-        }
+        ctx.pyramid_width = video.pyramid_width;
+        ctx.pyramid_height = video.pyramid_height;
+        ctx.pyramid_levels = video.pyramid_levels;
 
         return true;
     }
@@ -871,7 +1394,10 @@ namespace video
         }
 
         auto& ctx = get_context(video);
+
+        wait_frames_released(ctx.frame_pool);
         
+        sws_freeContext(ctx.capture_sws);
         av_frame_free(&ctx.av_frame);
         av_frame_free(&ctx.av_rgba);
         av_packet_free(&ctx.packet);
@@ -882,6 +1408,12 @@ namespace video
         mb::destroy_buffer(ctx.buffer32);
         mb::destroy_buffer(ctx.buffer8);
 
+        for (auto& pyr : ctx.pyramids)
+        {
+            img::destroy_pyramid(pyr);
+        }
+
+        ctx.~VideoReaderContext();
         mem::free(&ctx);
 
         video.video_handle = 0;
@@ -918,6 +1450,8 @@ namespace video
             return false;
         }
 
+        new (data) VideoWriterContext();
+
         dst.video_handle = (u64)data;
 
         auto& src_ctx = get_context(src);
@@ -937,7 +1471,10 @@ namespace video
             return false;
         }
 
-        if (!create_video_stream(src_ctx, ctx, dst_width, dst_height))
+        ctx.gop_size = dst.gop_size;
+        ctx.frame_index = 0;
+
+        if (!create_video_stream(src_ctx, ctx, dst, dst_width, dst_height))
         {
             assert(false);
             return false;
@@ -987,6 +1524,8 @@ namespace video
 
         auto& ctx = get_context(video);
 
+        stop_encode_worker(ctx);
+
         avio_closep(&ctx.format_ctx->pb);
         
         av_frame_free(&ctx.av_frame);
@@ -997,6 +1536,7 @@ namespace video
         }
         avformat_free_context(ctx.format_ctx);
 
+        ctx.~VideoWriterContext();
         mem::free(&ctx);
 
         video.video_handle = 0;
@@ -1012,6 +1552,7 @@ namespace video
 
         auto& ctx = get_context(video);
 
+        stop_encode_worker(ctx);
         flush_encoder(ctx);       
 
         av_write_trailer(ctx.format_ctx); 
@@ -1021,8 +1562,11 @@ namespace video
     
     void process_video(VideoReader const& src, VideoWriter& dst, fn_frame_to_rgba const& cb)
     {
-        auto src_ctx = get_context(src);
-        auto dst_ctx = get_context(dst);
+        auto& src_ctx = get_context(src);
+        auto& dst_ctx = get_context(dst);
+
+        // frames from a writer list are written first
+        stop_encode_worker(dst_ctx);
 
         auto src_av = src_ctx.av_frame;
         auto dst_av = dst_ctx.av_frame;
@@ -1031,8 +1575,13 @@ namespace video
         auto const on_read_video = [&]()
         {
             cb(current_frame(src), get_frame_rgba(dst_ctx));
-            convert_frame(dst_rgba, dst_av);
-            encode_video_frame(dst_ctx, src_av->pts);
+
+            {
+                perf::StageTimer timer(dst.stage_times, VideoStage::Convert);
+                convert_frame(dst_rgba, dst_av);
+            }
+
+            encode_video_frame(dst_ctx, src_av->pts, dst.stage_times, dst.frame_counts);
         };
 
         if (src_ctx.audio_stream && dst_ctx.audio_stream)
@@ -1053,8 +1602,11 @@ namespace video
     
     bool process_video(VideoReader const& src, VideoWriter& dst, fn_frame_to_rgba const& cb, fn_bool const& proc_cond)
     {
-        auto src_ctx = get_context(src);
-        auto dst_ctx = get_context(dst);
+        auto& src_ctx = get_context(src);
+        auto& dst_ctx = get_context(dst);
+
+        // frames from a writer list are written first
+        stop_encode_worker(dst_ctx);
 
         auto src_av = src_ctx.av_frame;
         auto dst_av = dst_ctx.av_frame;
@@ -1063,8 +1615,13 @@ namespace video
         auto const on_read_video = [&]()
         {
             cb(current_frame(src), get_frame_rgba(dst_ctx));
-            convert_frame(dst_rgba, dst_av);
-            encode_video_frame(dst_ctx, src_av->pts);
+
+            {
+                perf::StageTimer timer(dst.stage_times, VideoStage::Convert);
+                convert_frame(dst_rgba, dst_av);
+            }
+
+            encode_video_frame(dst_ctx, src_av->pts, dst.stage_times, dst.frame_counts);
         };
 
         if (src_ctx.audio_stream && dst_ctx.audio_stream)
@@ -1083,11 +1640,888 @@ namespace video
     }
     
     
+    u64 current_frame_index(VideoReader const& video)
+    {
+        return get_context(video).frame_index;
+    }
+
+
+    bool seek_frame(VideoReader const& video, u64 frame_index)
+    {
+        TRACE_ZONE("video::seek_frame");
+
+        auto& ctx = get_context(video);
+
+        if (!seek_keyframe(ctx, frame_index))
+        {
+            return false;
+        }
+
+        // only the target frame is converted
+        while (decode_next_frame(ctx))
+        {
+            if (to_frame_index(ctx, ctx.av_frame->best_effort_timestamp) < frame_index)
+            {
+                continue;
+            }
+
+            auto sws = get_capture_sws(ctx);
+            if (!sws)
+            {
+                return false;
+            }
+
+            auto ref = capture_frame(ctx, sws, video.stage_times);
+            release_frame(ctx.frame_pool, ref);
+
+            return true;
+        }
+
+        return false;
+    }
+
+
     VideoFrame current_frame(VideoReader const& video)
     {
-        return get_context(video).display_frame_read();
+        auto& pool = get_context(video).frame_pool;
+
+        std::lock_guard<std::mutex> lock(pool.mutex);
+
+        return pool.frames[pool.current_slot];
+    }
+
+
+    FrameRef acquire_current_frame(VideoReader const& video)
+    {
+        auto& pool = get_context(video).frame_pool;
+
+        std::lock_guard<std::mutex> lock(pool.mutex);
+
+        pool.ref_counts[pool.current_slot]++;
+
+        return make_frame_ref(pool, pool.current_slot);
+    }
+
+
+    void release_frame(VideoReader const& video, FrameRef& ref)
+    {
+        release_frame(get_context(video).frame_pool, ref);
+    }
+
+
+    u32 n_free_frames(VideoReader const& video)
+    {
+        auto& pool = get_context(video).frame_pool;
+
+        std::lock_guard<std::mutex> lock(pool.mutex);
+
+        u32 n = 0;
+        for (u32 i = 0; i < pool.n_frames; i++)
+        {
+            n += !pool.ref_counts[i];
+        }
+
+        return n;
+    }
+
+}
+
+
+/* multiple writers */
+
+namespace video
+{
+    constexpr u32 MAX_AUDIO_PACKETS = 64;
+
+
+    class EncodeJob
+    {
+    public:
+        i64 pts = 0;
+
+        u32 n_audio = 0;
+        AVPacket* audio[MAX_AUDIO_PACKETS];
+    };
+
+
+    /*  One per writer in a writer list, created by the first process_video with the list.
+        The thread stays for the rest of the run, so encodes in flight carry over
+        from one process_video call to the next. close_video waits for them. */
+    class EncodeWorker
+    {
+    public:
+        VideoWriterContext* ctx = 0;
+
+        perf::StageTimes* stage_times = 0;
+        FrameCounts* frame_counts = 0;
+
+        std::thread thread;
+        std::binary_semaphore start{ 0 };
+        std::binary_semaphore done{ 0 };
+
+        bool stop = false;
+
+        // dispatching thread only
+        bool busy = false;
+
+        // owned by the worker while busy
+        EncodeJob job;
+
+        // audio packets collected by the decode thread for the next job
+        EncodeJob pending;
+    };
+
+
+    static void write_audio_packets(VideoWriterContext const& ctx, EncodeJob& job)
+    {
+        for (u32 i = 0; i < job.n_audio; i++)
+        {
+            av_interleaved_write_frame(ctx.format_ctx, job.audio[i]);
+            av_packet_free(&job.audio[i]);
+        }
+
+        job.n_audio = 0;
+    }
+
+
+    static void run_encode_worker(EncodeWorker& worker)
+    {
+        TRACE_THREAD("encode");
+
+        auto& ctx = *worker.ctx;
+
+        for (;;)
+        {
+            worker.start.acquire();
+            if (worker.stop)
+            {
+                return;
+            }
+
+            auto cpu_begin = perf::thread_cpu_ms();
+
+            write_audio_packets(ctx, worker.job);
+
+            {
+                perf::StageTimer timer(worker.stage_times, VideoStage::Convert);
+                convert_frame(ctx.av_rgba, ctx.av_frame);
+            }
+
+            encode_video_frame(ctx, worker.job.pts, worker.stage_times, worker.frame_counts);
+
+            ctx.encode_cpu_ms += perf::thread_cpu_ms() - cpu_begin;
+
+            worker.done.release();
+        }
+    }
+
+
+    static void wait_idle(EncodeWorker& worker)
+    {
+        if (worker.busy)
+        {
+            worker.done.acquire();
+            worker.busy = false;
+        }
+    }
+
+
+    // worker must be idle
+    static void dispatch_encode(EncodeWorker& worker, i64 pts)
+    {
+        auto& job = worker.job;
+        auto& pending = worker.pending;
+
+        job.pts = pts;
+        job.n_audio = pending.n_audio;
+        for (u32 i = 0; i < pending.n_audio; i++)
+        {
+            job.audio[i] = pending.audio[i];
+        }
+
+        pending.n_audio = 0;
+
+        worker.busy = true;
+        worker.start.release();
     }
 
+
+    static EncodeWorker* start_encode_worker(VideoWriterContext& ctx, VideoWriter const& dst)
+    {
+        if (ctx.encode_worker)
+        {
+            return ctx.encode_worker;
+        }
+
+        auto data = mem::malloc<EncodeWorker>("encode worker");
+        if (!data)
+        {
+            return 0;
+        }
+
+        auto worker = new (data) EncodeWorker();
+        worker->ctx = &ctx;
+        worker->stage_times = dst.stage_times;
+        worker->frame_counts = dst.frame_counts;
+        worker->thread = std::thread(run_encode_worker, std::ref(*worker));
+
+        ctx.encode_worker = worker;
+
+        return worker;
+    }
+
+
+    // the last frame and pending audio are written before the thread exits
+    static void stop_encode_worker(VideoWriterContext& ctx)
+    {
+        auto worker = ctx.encode_worker;
+        if (!worker)
+        {
+            return;
+        }
+
+        wait_idle(*worker);
+        write_audio_packets(ctx, worker->pending);
+
+        worker->stop = true;
+        worker->start.release();
+        worker->thread.join();
+
+        worker->~EncodeWorker();
+        mem::free(worker);
+
+        ctx.encode_worker = 0;
+    }
+
+
+    // each writer gets its own copy of the packet, written with its next frame
+    static void add_audio(EncodeWorker& worker, VideoReaderContext const& src_ctx)
+    {
+        auto& pending = worker.pending;
+
+        if (pending.n_audio == MAX_AUDIO_PACKETS)
+        {
+            wait_idle(worker);
+            write_audio_packets(*worker.ctx, pending);
+        }
+
+        auto packet = av_packet_clone(src_ctx.packet);
+        if (!packet)
+        {
+            assert("*** av_packet_clone ***" && false);
+            return;
+        }
+
+        rescale_audio(packet, src_ctx.audio_stream, worker.ctx->audio_stream);
+
+        pending.audio[pending.n_audio++] = packet;
+    }
+
+
+    bool process_video(VideoReader const& src, SpanView<VideoWriter> const& dst_list, fn_frame_to_rgba_list const& cb, fn_bool const& proc_cond)
+    {
+        u32 n_writers = dst_list.length;
+
+        assert(n_writers && n_writers <= MAX_WRITERS);
+        if (!n_writers || n_writers > MAX_WRITERS)
+        {
+            return true;
+        }
+
+        auto& src_ctx = get_context(src);
+        auto src_av = src_ctx.av_frame;
+
+        EncodeWorker* workers[MAX_WRITERS];
+        img::ImageView views[MAX_WRITERS];
+
+        bool write_audio = false;
+
+        for (u32 i = 0; i < n_writers; i++)
+        {
+            auto& dst = dst_list.data[i];
+            auto& ctx = get_context(dst);
+
+            workers[i] = start_encode_worker(ctx, dst);
+            if (!workers[i])
+            {
+                assert("*** start_encode_worker ***" && false);
+                return true;
+            }
+
+            views[i] = get_frame_rgba(ctx);
+
+            write_audio |= ctx.audio_stream != 0;
+        }
+
+        SpanView<img::ImageView> view_list{};
+        view_list.data = views;
+        view_list.length = n_writers;
+
+        auto const on_read_video = [&]()
+        {
+            // out views are still being encoded
+            for (u32 i = 0; i < n_writers; i++)
+            {
+                wait_idle(*workers[i]);
+            }
+
+            cb(current_frame(src), view_list);
+
+            for (u32 i = 0; i < n_writers; i++)
+            {
+                dispatch_encode(*workers[i], src_av->pts);
+            }
+        };
+
+        auto const on_read_audio = [&]()
+        {
+            for (u32 i = 0; i < n_writers; i++)
+            {
+                if (workers[i]->ctx->audio_stream)
+                {
+                    add_audio(*workers[i], src_ctx);
+                }
+            }
+        };
+
+        bool done = false;
+
+        if (src_ctx.audio_stream && write_audio)
+        {
+            done = for_each_audio_video_frame(src, on_read_video, on_read_audio, proc_cond);
+        }
+        else
+        {
+            done = for_each_video_frame(src, on_read_video, proc_cond);
+        }
+
+        // the last frame is still encoding, the next call or close_video waits for it
+
+        return done;
+    }
+
+
+    void process_video(VideoReader const& src, SpanView<VideoWriter> const& dst_list, fn_frame_to_rgba_list const& cb)
+    {
+        auto const cond = [](){ return true; };
+
+        process_video(src, dst_list, cb, cond);
+    }
+
+
+    f64 encode_cpu_ms(VideoWriter const& video)
+    {
+        auto& ctx = get_context(video);
+
+        if (ctx.encode_worker)
+        {
+            wait_idle(*ctx.encode_worker);
+        }
+
+        return ctx.encode_cpu_ms;
+    }
+}
+
+
+/* thumbnails */
+
+namespace video
+{
+    static bool decode_keyframe(AVFormatContext* format_ctx, AVCodecContext* decoder, AVPacket* packet, AVFrame* frame, int stream_index)
+    {
+        while (av_read_frame(format_ctx, packet) >= 0)
+        {
+            if (packet->stream_index != stream_index)
+            {
+                av_packet_unref(packet);
+                continue;
+            }
+
+            auto sent = avcodec_send_packet(decoder, packet);
+            av_packet_unref(packet);
+
+            if (sent == 0 && avcodec_receive_frame(decoder, frame) == 0)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+
+    bool make_thumbnail_strip(cstr filepath, img::ImageView const& strip, u32 n_thumbs)
+    {
+        TRACE_ZONE("video::make_thumbnail_strip");
+
+        assert(n_thumbs && strip.width % n_thumbs == 0);
+
+        u32 thumb_w = strip.width / n_thumbs;
+        u32 thumb_h = strip.height;
+
+        AVFormatContext* format_ctx = 0;
+        AVCodecContext* decoder = 0;
+        AVPacket* packet = 0;
+        AVFrame* frame = 0;
+        SwsContext* sws = 0;
+
+        auto const close = [&]()
+        {
+            sws_freeContext(sws);
+            av_frame_free(&frame);
+            av_packet_free(&packet);
+            avcodec_free_context(&decoder);
+            avformat_close_input(&format_ctx);
+        };
+
+        if (avformat_open_input(&format_ctx, filepath, nullptr, nullptr) != 0)
+        {
+            return false;
+        }
+
+        AVCodec* codec = 0;
+        int stream_index = -1;
+
+        if (avformat_find_stream_info(format_ctx, nullptr) < 0 ||
+            (stream_index = av_find_best_stream(format_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0)) < 0)
+        {
+            close();
+            return false;
+        }
+
+        auto stream = format_ctx->streams[stream_index];
+
+        decoder = avcodec_alloc_context3(codec);
+        if (!decoder || avcodec_parameters_to_context(decoder, stream->codecpar) < 0)
+        {
+            close();
+            return false;
+        }
+
+        // frames that are not keyframes are dropped before decoding
+        decoder->skip_frame = AVDISCARD_NONKEY;
+
+        if (avcodec_open2(decoder, codec, nullptr) != 0)
+        {
+            close();
+            return false;
+        }
+
+        packet = av_packet_alloc();
+        frame = av_frame_alloc();
+        if (!packet || !frame)
+        {
+            close();
+            return false;
+        }
+
+        auto start = stream->start_time == AV_NOPTS_VALUE ? 0 : stream->start_time;
+        auto duration = stream->duration;
+        if (duration == AV_NOPTS_VALUE || duration <= 0)
+        {
+            duration = av_rescale_q(format_ctx->duration, AVRational{ 1, AV_TIME_BASE }, stream->time_base);
+        }
+
+        constexpr auto black = img::to_pixel(0);
+
+        u32 n_found = 0;
+
+        for (u32 i = 0; i < n_thumbs; i++)
+        {
+            auto cell = img::sub_view(strip, img::make_rect(i * thumb_w, 0, thumb_w, thumb_h));
+
+            // middle of each section of the video
+            auto ts = start + duration * (2 * i + 1) / (2 * n_thumbs);
+
+            if (av_seek_frame(format_ctx, stream_index, ts, AVSEEK_FLAG_BACKWARD) < 0)
+            {
+                img::fill(cell, black);
+                continue;
+            }
+
+            avcodec_flush_buffers(decoder);
+
+            if (!decode_keyframe(format_ctx, decoder, packet, frame, stream_index))
+            {
+                img::fill(cell, black);
+                continue;
+            }
+
+            if (!sws)
+            {
+                sws = sws_getContext(
+                    frame->width, frame->height, (AVPixelFormat)frame->format,
+                    (int)thumb_w, (int)thumb_h, AV_PIX_FMT_RGBA,
+                    SWS_AREA, nullptr, nullptr, nullptr);
+            }
+
+            u8* dst_data[4] = { (u8*)img::row_begin(cell, 0), 0, 0, 0 };
+            int dst_linesize[4] = { (int)(strip.width * sizeof(img::Pixel)), 0, 0, 0 };
+
+            sws_scale(sws, frame->data, frame->linesize, 0, frame->height, dst_data, dst_linesize);
+
+            n_found++;
+        }
+
+        close();
+
+        return n_found > 0;
+    }
+}
+
+
+/* frame cache */
+
+namespace video
+{
+    class CacheSlot
+    {
+    public:
+        img::ImageView view;
+
+        u64 frame_index = 0;
+        u64 key_index = 0;
+        u64 last_used = 0;
+
+        bool used = false;
+    };
+
+
+    class FrameCacheContext
+    {
+    public:
+        u32 n_slots = 0;
+        CacheSlot* slots = 0;
+
+        img::Buffer32 buffer32;
+
+        // access counter for lru
+        u64 clock = 0;
+
+        u64 last_index = 0;
+
+        // used slots, read by n_cached_frames from any thread
+        std::atomic<u32> n_used = 0;
+    };
+
+
+    static inline FrameCacheContext& get_context(FrameCache const& cache)
+    {
+        return *(FrameCacheContext*)(cache.cache_handle);
+    }
+
+
+    static CacheSlot* find_slot(FrameCacheContext& ctx, u64 frame_index)
+    {
+        for (u32 i = 0; i < ctx.n_slots; i++)
+        {
+            auto& slot = ctx.slots[i];
+            if (slot.used && slot.frame_index == frame_index)
+            {
+                return &slot;
+            }
+        }
+
+        return 0;
+    }
+
+
+    // a free slot, else the oldest slot of the least recently used GOP.
+    // Slots used after fill_clock belong to the fill in progress and are kept
+    static CacheSlot& evict_slot(FrameCacheContext& ctx, u64 fill_clock)
+    {
+        CacheSlot* lru = 0;
+
+        for (u32 i = 0; i < ctx.n_slots; i++)
+        {
+            auto& slot = ctx.slots[i];
+            if (!slot.used)
+            {
+                return slot;
+            }
+
+            if (slot.last_used > fill_clock)
+            {
+                continue;
+            }
+
+            if (!lru || slot.last_used < lru->last_used)
+            {
+                lru = &slot;
+            }
+        }
+
+        // a fill stores at most n_slots frames
+        assert(lru);
+
+        // drop the rest of its GOP with it
+        auto key_index = lru->key_index;
+        for (u32 i = 0; i < ctx.n_slots; i++)
+        {
+            auto& slot = ctx.slots[i];
+            if (slot.used && slot.key_index == key_index && slot.last_used <= fill_clock && &slot != lru)
+            {
+                slot.used = false;
+                ctx.n_used.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+
+        lru->used = false;
+        ctx.n_used.fetch_sub(1, std::memory_order_relaxed);
+
+        return *lru;
+    }
+
+
+    /*  Decodes from the keyframe before frame_index up to the keyframe that ends the last GOP.
+        Only the n_slots frames around frame_index are stored, so a GOP longer than the cache
+        does not evict its own frames. */
+    static bool fill_gops(FrameCacheContext& ctx, VideoReaderContext& src_ctx, u64 frame_index, u32 n_gops)
+    {
+        TRACE_ZONE("video::fill_gops");
+
+        if (!seek_keyframe(src_ctx, frame_index))
+        {
+            return false;
+        }
+
+        auto half = (u64)ctx.n_slots / 2;
+        auto begin = frame_index > half ? frame_index - half : 0;
+        auto end = begin + ctx.n_slots;
+
+        auto fill_clock = ctx.clock;
+
+        SwsContext* sws = 0;
+
+        bool found = false;
+        u64 key_index = 0;
+        u32 n_keys = 0;
+
+        while (decode_next_frame(src_ctx))
+        {
+            auto frame = src_ctx.av_frame;
+            auto index = to_frame_index(src_ctx, frame->best_effort_timestamp);
+
+            if (frame->key_frame)
+            {
+                key_index = index;
+                if (found && ++n_keys > n_gops)
+                {
+                    break;
+                }
+            }
+
+            if (index == frame_index)
+            {
+                found = true;
+                n_keys = 1;
+            }
+            else if (!found && index > frame_index)
+            {
+                // no frame with this index
+                break;
+            }
+
+            if (index >= end)
+            {
+                break;
+            }
+
+            if (index < begin)
+            {
+                continue;
+            }
+
+            auto slot = find_slot(ctx, index);
+            if (!slot)
+            {
+                slot = &evict_slot(ctx, fill_clock);
+
+                if (!sws)
+                {
+                    auto& view = slot->view;
+                    sws = sws_getContext(
+                        frame->width, frame->height, (AVPixelFormat)frame->format,
+                        (int)view.width, (int)view.height, AV_PIX_FMT_RGBA,
+                        SWS_BILINEAR, nullptr, nullptr, nullptr);
+                }
+
+                u8* dst_data[4] = { (u8*)slot->view.matrix_data_, 0, 0, 0 };
+                int dst_linesize[4] = { (int)(slot->view.width * sizeof(img::Pixel)), 0, 0, 0 };
+
+                sws_scale(sws, frame->data, frame->linesize, 0, frame->height, dst_data, dst_linesize);
+
+                slot->frame_index = index;
+                slot->used = true;
+                ctx.n_used.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            slot->key_index = key_index;
+            slot->last_used = ++ctx.clock;
+        }
+
+        sws_freeContext(sws);
+
+        return found;
+    }
+
+
+    bool create_frame_cache(FrameCache& cache, u32 width, u32 height, u64 budget_bytes)
+    {
+        u64 frame_pixels = (u64)width * height;
+        u64 n_slots = budget_bytes / (frame_pixels * sizeof(img::Pixel));
+
+        // pixel count fits a u32
+        u64 max_slots = 0xFFFFFFFFull / frame_pixels;
+        n_slots = n_slots < max_slots ? n_slots : max_slots;
+
+        assert(n_slots >= 2 && "*** frame cache budget too small ***");
+        if (n_slots < 2)
+        {
+            return false;
+        }
+
+        auto data = mem::malloc<FrameCacheContext>("frame cache context");
+        if (!data)
+        {
+            return false;
+        }
+
+        new (data) FrameCacheContext();
+
+        auto& ctx = *data;
+
+        ctx.slots = mem::malloc<CacheSlot>((u32)n_slots, "frame cache slots");
+        if (!ctx.slots)
+        {
+            mem::free(data);
+            return false;
+        }
+
+        ctx.buffer32 = img::create_buffer32((u32)(n_slots * frame_pixels), "frame cache");
+        if (!ctx.buffer32.ok)
+        {
+            mem::free(ctx.slots);
+            mem::free(data);
+            return false;
+        }
+
+        ctx.n_slots = (u32)n_slots;
+        for (u32 i = 0; i < ctx.n_slots; i++)
+        {
+            new (ctx.slots + i) CacheSlot();
+            ctx.slots[i].view = img::make_view(width, height, ctx.buffer32);
+        }
+
+        cache.cache_handle = (u64)data;
+        cache.frame_width = width;
+        cache.frame_height = height;
+        cache.n_hits.store(0, std::memory_order_relaxed);
+        cache.n_misses.store(0, std::memory_order_relaxed);
+
+        return true;
+    }
+
+
+    void destroy_frame_cache(FrameCache& cache)
+    {
+        if (!cache.cache_handle)
+        {
+            return;
+        }
+
+        auto& ctx = get_context(cache);
+
+        mb::destroy_buffer(ctx.buffer32);
+        mem::free(ctx.slots);
+
+        ctx.~FrameCacheContext();
+        mem::free(&ctx);
+
+        cache.cache_handle = 0;
+    }
+
+
+    void clear_frame_cache(FrameCache& cache)
+    {
+        if (!cache.cache_handle)
+        {
+            return;
+        }
+
+        auto& ctx = get_context(cache);
+
+        for (u32 i = 0; i < ctx.n_slots; i++)
+        {
+            ctx.slots[i].used = false;
+        }
+
+        ctx.n_used.store(0, std::memory_order_relaxed);
+    }
+
+
+    u32 n_cached_frames(FrameCache const& cache)
+    {
+        if (!cache.cache_handle)
+        {
+            return 0;
+        }
+
+        return get_context(cache).n_used.load(std::memory_order_relaxed);
+    }
+
+
+    bool read_cached_frame(FrameCache& cache, VideoReader const& video, u64 frame_index, img::ImageView const& dst)
+    {
+        TRACE_ZONE("video::read_cached_frame");
+
+        assert(dst.width == cache.frame_width);
+        assert(dst.height == cache.frame_height);
+
+        auto& ctx = get_context(cache);
+
+        auto slot = find_slot(ctx, frame_index);
+        if (slot)
+        {
+            cache.n_hits.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            cache.n_misses.fetch_add(1, std::memory_order_relaxed);
+
+            // stepping forward also decodes the GOP after
+            u32 n_gops = frame_index > ctx.last_index ? 2 : 1;
+
+            if (!fill_gops(ctx, get_context(video), frame_index, n_gops))
+            {
+                return false;
+            }
+
+            slot = find_slot(ctx, frame_index);
+            if (!slot)
+            {
+                return false;
+            }
+        }
+
+        ctx.last_index = frame_index;
+
+        // touch the whole GOP
+        auto key_index = slot->key_index;
+        auto clock = ++ctx.clock;
+        for (u32 i = 0; i < ctx.n_slots; i++)
+        {
+            auto& s = ctx.slots[i];
+            if (s.used && s.key_index == key_index)
+            {
+                s.last_used = clock;
+            }
+        }
+
+        span::copy(img::to_span(slot->view), img::to_span(dst));
+
+        return true;
+    }
 }
 
 
@@ -1,8 +1,10 @@
 #pragma once
 
 #include "../image/image.hpp"
+#include "../util/stage_times.hpp"
 
 #include <initializer_list>
+#include <atomic>
 #include <functional>
 
 
@@ -16,9 +18,58 @@ namespace video
     public:
         img::ImageView rgba;
         img::GrayView gray;
+
+        // gray levels of this frame, 0 when the reader has no pyramid size
+        img::ImagePyramid* pyramid = 0;
+    };
+
+
+    constexpr u32 MAX_POOL_FRAMES = 8;
+
+    constexpr u32 MAX_WRITERS = 8;
+
+
+    // a reference counted frame from a reader's frame pool
+    class FrameRef
+    {
+    public:
+        VideoFrame frame;
+
+        u32 slot = 0;
+        bool ok = false;
+    };
+
+
+    enum class VideoStage : u32
+    {
+        Decode = 0, // demux + decode
+        Capture,    // capture_frame
+        Convert,    // rgba to encoder format
+        Encode,
+        Mux,
+
+        Count
+    };
+
+
+    // written by the video workers, read by the ui thread
+    class FrameCounts
+    {
+    public:
+        std::atomic<u64> decoded = 0;
+        std::atomic<u64> skipped = 0; // video packets rejected by the decoder
+        std::atomic<u64> encoded = 0;
     };
 
 
+    inline void reset(FrameCounts& counts)
+    {
+        counts.decoded.store(0, std::memory_order_relaxed);
+        counts.skipped.store(0, std::memory_order_relaxed);
+        counts.encoded.store(0, std::memory_order_relaxed);
+    }
+
+
     class VideoReader
     {
     public:
@@ -29,6 +80,35 @@ namespace video
         u32 frame_height = 0;
 
         f64 fps = 0.0;
+        f64 duration_s = 0.0;
+
+        // frames in the pool, 3 to MAX_POOL_FRAMES, allocated by the first decode
+        u32 n_pool_frames = 4;
+
+        // optional, level 1 size and levels of a gray pyramid with each frame, set before open_video
+        u32 pyramid_width = 0;
+        u32 pyramid_height = 0;
+        u32 pyramid_levels = 0;
+
+        // optional, records VideoStage::Decode and VideoStage::Capture
+        perf::StageTimes* stage_times = 0;
+
+        // optional, counts decoded and skipped
+        FrameCounts* frame_counts = 0;
+    };
+
+
+    // container metadata from probe_video
+    class VideoInfo
+    {
+    public:
+        u32 frame_width = 0;
+        u32 frame_height = 0;
+
+        f64 fps = 0.0;
+        f64 duration_s = 0.0;
+
+        bool has_audio = false;
     };
 
 
@@ -42,6 +122,19 @@ namespace video
         u32 frame_height = 0;
 
         bool write_audio = true;
+
+        // bits per second, 0 for the encoder default
+        i64 bit_rate = 0;
+
+        // frames between keyframes, 0 for the encoder default.
+        // Writers with the same gop_size fed the same frames have aligned keyframes
+        u32 gop_size = 0;
+
+        // optional, records VideoStage::Convert, VideoStage::Encode and VideoStage::Mux
+        perf::StageTimes* stage_times = 0;
+
+        // optional, counts encoded
+        FrameCounts* frame_counts = 0;
     };
     
     
@@ -50,16 +143,25 @@ namespace video
 
     using fn_frame_to_rgba = fn<void(VideoFrame, img::ImageView const&)>;
 
+    // one out view per writer, in writer order
+    using fn_frame_to_rgba_list = fn<void(VideoFrame, SpanView<img::ImageView> const&)>;
+
     using fn_frame = fn<void(VideoFrame)>;
     using fn_bool = fn<bool()>;
 
 
+    // no decoder and no frame buffers, reads as little of the file as the container allows
+    bool probe_video(cstr filepath, VideoInfo& info);
+
+    // frame buffers are allocated by the first decode
     bool open_video(VideoReader& video, cstr filepath);
 
+    // waits for acquired frames to be released, no frame may be acquired once it is called
     void close_video(VideoReader& video);
 
     void process_video(VideoReader const& src, fn_frame const& cb);
 
+    // true at the end of the stream, false when proc_cond stops it or the frame buffers could not be created
     bool process_video(VideoReader const& src, fn_frame const& cb, fn_bool const& proc_cond);
     
     
@@ -73,12 +175,83 @@ namespace video
 
     bool process_video(VideoReader const& src, VideoWriter& dst, fn_frame_to_rgba const& cb, fn_bool const& proc_cond);
 
+    // one decode for several writers, each writer encodes on its own thread.
+    // The threads are kept until close_video, the last frame of a call may still be encoding when it returns
+    void process_video(VideoReader const& src, SpanView<VideoWriter> const& dst_list, fn_frame_to_rgba_list const& cb);
 
+    bool process_video(VideoReader const& src, SpanView<VideoWriter> const& dst_list, fn_frame_to_rgba_list const& cb, fn_bool const& proc_cond);
+
+    // thread cpu time spent by the encode thread of a writer since create_video, waits for the frame in flight
+    f64 encode_cpu_ms(VideoWriter const& video);
+
+
+    // latest decoded frame, only stable on the decoding thread e.g. in process_video callbacks
     VideoFrame current_frame(VideoReader const& video);
+
+    // latest decoded frame, not overwritten until released
+    FrameRef acquire_current_frame(VideoReader const& video);
+
+    void release_frame(VideoReader const& video, FrameRef& ref);
+
+    // 0 when decoding is blocked waiting for consumers to release frames
+    u32 n_free_frames(VideoReader const& video);
+
+    // frames from the start of the stream
+    u64 current_frame_index(VideoReader const& video);
+
+    // decodes up to frame_index and makes it the current frame, process_video continues after it
+    bool seek_frame(VideoReader const& video, u64 frame_index);
     
 }
 
 
+/* thumbnails */
+
+namespace video
+{
+    // keyframes only, evenly spaced through the video, one per cell of a horizontal strip.
+    // Opens its own decoder, does not need open_video
+    bool make_thumbnail_strip(cstr filepath, img::ImageView const& strip, u32 n_thumbs);
+}
+
+
+/* frame cache */
+
+namespace video
+{
+    /*  Decoded frames at display resolution, grouped by GOP.
+        A miss decodes the GOP holding the frame, stepping forward also decodes the GOP after it.
+        Only the n_slots frames around the requested frame are kept.
+        The least recently used GOP is evicted first, never the one being filled.
+        Pixels are allocated once with the "frame cache" memory tag. */
+    class FrameCache
+    {
+    public:
+        u64 cache_handle = 0;
+
+        u32 frame_width = 0;
+        u32 frame_height = 0;
+
+        // written by read_cached_frame, read from any thread
+        std::atomic<u32> n_hits = 0;
+        std::atomic<u32> n_misses = 0;
+    };
+
+
+    bool create_frame_cache(FrameCache& cache, u32 width, u32 height, u64 budget_bytes);
+
+    void destroy_frame_cache(FrameCache& cache);
+
+    void clear_frame_cache(FrameCache& cache);
+
+    // safe to call while a frame is being read
+    u32 n_cached_frames(FrameCache const& cache);
+
+    // moves the reader on a miss, seek_frame before processing again
+    bool read_cached_frame(FrameCache& cache, VideoReader const& video, u64 frame_index, img::ImageView const& dst);
+}
+
+
 /* Deprecated */
 
 namespace video
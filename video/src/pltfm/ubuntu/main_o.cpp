@@ -3,6 +3,7 @@
 #include "../../../../libs/alloc_type/alloc_type.cpp"
 #include "../../../../libs/image/image.cpp"
 #include "../../../../libs/span/span.cpp"
+#include "../../../../libs/thread_pool/thread_pool.cpp"
 #include "../../../../libs/video/video.cpp"
 #include "../../../../libs/video/motion.cpp"
 #include "../../video_display/video_display.cpp"
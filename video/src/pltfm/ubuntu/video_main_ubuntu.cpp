@@ -150,6 +150,8 @@ static void render_imgui_frame()
     vd::video_frame_window(vd_state);
     vd::video_preview_window(vd_state);
     vd::video_vfx_window(vd_state);
+    vd::video_performance_window(vd_state);
+    vd::video_sessions_window(vd_state);
 
     ui::render(ui_state);
 }
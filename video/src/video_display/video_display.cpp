@@ -1,9 +1,12 @@
 #include "video_display.hpp"
 #include "../../../libs/util/stopwatch.hpp"
 #include "../../../libs/util/numeric.hpp"
+#include "../../../libs/util/trace.hpp"
+#include "../../../libs/alloc_type/alloc_type.hpp"
 #include "../../../libs/stb_libs/qsprintf.hpp"
 
 #include <thread>
+#include <cstdio>
 
 
 /* vectors */
@@ -141,6 +144,80 @@ namespace internal
     }
 
 
+    constexpr u64 FNV_OFFSET = 14695981039346656037ull;
+
+
+    static u64 fnv1a(u64 hash, u8 const* bytes, u64 n_bytes)
+    {
+        constexpr u64 FNV_PRIME = 1099511628211ull;
+
+        for (u64 i = 0; i < n_bytes; i++)
+        {
+            hash ^= bytes[i];
+            hash *= FNV_PRIME;
+        }
+
+        return hash;
+    }
+
+
+    // FNV-1a of the file size and the first and last blocks
+    static u64 file_fingerprint(fs::path const& path)
+    {
+        constexpr u32 BLOCK_SIZE = 64 * 1024;
+
+        u64 hash = FNV_OFFSET;
+
+        auto const hash_bytes = [&](u8 const* bytes, u64 n_bytes)
+        {
+            hash = fnv1a(hash, bytes, n_bytes);
+        };
+
+        std::error_code ec;
+        u64 size = fs::file_size(path, ec);
+        if (ec)
+        {
+            return 0;
+        }
+
+        hash_bytes((u8*)&size, sizeof(size));
+
+        auto file = std::fopen(path.string().c_str(), "rb");
+        if (!file)
+        {
+            return 0;
+        }
+
+        static thread_local u8 block[BLOCK_SIZE];
+
+        auto n_read = std::fread(block, 1, BLOCK_SIZE, file);
+        hash_bytes(block, n_read);
+
+        if (size > 2 * BLOCK_SIZE)
+        {
+            std::fseek(file, -(long)BLOCK_SIZE, SEEK_END);
+            n_read = std::fread(block, 1, BLOCK_SIZE, file);
+            hash_bytes(block, n_read);
+        }
+
+        std::fclose(file);
+
+        return hash;
+    }
+
+
+    // vfx and motion take their level from the frame, the full resolution gray is read once
+    static void set_frame_pyramid(vid::VideoReader& video)
+    {
+        static_assert(DISPLAY_FRAME_WIDTH == 2 * PROCESS_IMAGE_WIDTH);
+        static_assert(DISPLAY_FRAME_HEIGHT == 2 * PROCESS_IMAGE_HEIGHT);
+
+        video.pyramid_width = DISPLAY_FRAME_WIDTH;
+        video.pyramid_height = DISPLAY_FRAME_HEIGHT;
+        video.pyramid_levels = PROCESS_LEVEL + 1;
+    }
+
+
     static bool load_src_video(VideoMotionState& vms, fs::path const& video_path)
     {
         if (!fs::exists(video_path) || !fs::is_regular_file(video_path))
@@ -149,6 +226,8 @@ namespace internal
             return false;
         }
 
+        set_frame_pyramid(vms.src_video);
+
         auto ok = vid::open_video(vms.src_video, video_path.string().c_str());
         if (!ok)
         {
@@ -170,7 +249,10 @@ namespace internal
 
         motion::destroy(vms.gm);
 
-        if (!motion::create(vms.gm, process_w, process_h))
+        // history covers about the same time at any frame rate
+        auto window = motion::motion_window(vms.src_video.fps);
+
+        if (!motion::create(vms.gm, process_w, process_h, window))
         {
             return false;
         }
@@ -259,6 +341,197 @@ namespace internal
     }
     
     
+    static void set_run_stats(DisplayState& state)
+    {
+        state.vms.src_video.stage_times = &state.video_times;
+        state.vms.gm.stage_times = &state.motion_times;
+        state.dst_video.stage_times = &state.video_times;
+
+        state.vms.src_video.frame_counts = &state.frame_counts;
+        state.dst_video.frame_counts = &state.frame_counts;
+    }
+
+
+    static void reset_run_stats(DisplayState& state)
+    {
+        perf::reset(state.video_times);
+        perf::reset(state.motion_times);
+        perf::reset(state.display_times);
+
+        vid::reset(state.frame_counts);
+
+        mem::reset_memory_peaks();
+    }
+
+
+    // integer scale with the same aspect as the proxy, 0 for no proxy
+    static u32 proxy_scale(u32 src_w, u32 src_h)
+    {
+        auto scale = src_w / PROXY_WIDTH;
+        if (scale < 2 || src_w != scale * PROXY_WIDTH || src_h != scale * PROXY_HEIGHT)
+        {
+            return 0;
+        }
+
+        return scale;
+    }
+
+
+    static bool transcode_proxy(ProxyVideo& proxy)
+    {
+        TRACE_ZONE("transcode_proxy");
+
+        vid::VideoReader src_video;
+        if (!vid::open_video(src_video, proxy.src_path.string().c_str()))
+        {
+            return false;
+        }
+
+        vid::VideoWriter dst_video;
+        dst_video.write_audio = false;
+        dst_video.bit_rate = PROXY_BIT_RATE;
+        dst_video.gop_size = 1; // every frame a keyframe
+
+        auto temp_path = fs::path(PROXY_DIR) / "vdtemp_proxy.mp4";
+        auto temp_str = temp_path.string();
+
+        if (!vid::create_video(src_video, dst_video, temp_str.c_str(), PROXY_WIDTH, PROXY_HEIGHT))
+        {
+            vid::close_video(src_video);
+            return false;
+        }
+
+        auto const proc = [&](auto const& fr_src, auto const& v_out)
+        {
+            img::resize(fr_src.rgba, v_out);
+            proxy.frames_built++;
+        };
+
+        auto const cond = [&](){ return !proxy.cancel; };
+
+        auto done = vid::process_video(src_video, dst_video, proc, cond);
+
+        vid::close_video(src_video);
+
+        std::error_code ec;
+
+        if (!done)
+        {
+            vid::close_video(dst_video);
+            fs::remove(temp_path, ec);
+            return false;
+        }
+
+        vid::save_and_close_video(dst_video);
+        fs::rename(temp_path, proxy.proxy_path, ec);
+
+        return !ec;
+    }
+
+
+    static void run_proxy(ProxyVideo& proxy)
+    {
+        TRACE_THREAD("proxy");
+
+        std::error_code ec;
+        fs::create_directories(PROXY_DIR, ec);
+
+        // cached from an earlier load of the same source
+        if (!fs::exists(proxy.proxy_path) && !transcode_proxy(proxy))
+        {
+            proxy.status = proxy.cancel ? ProxyStatus::None : ProxyStatus::Fail;
+            return;
+        }
+
+        if (proxy.cancel)
+        {
+            proxy.status = ProxyStatus::None;
+            return;
+        }
+
+        set_frame_pyramid(proxy.proxy_video);
+
+        if (!vid::open_video(proxy.proxy_video, proxy.proxy_path.string().c_str()))
+        {
+            proxy.status = ProxyStatus::Fail;
+            return;
+        }
+
+        proxy.status = ProxyStatus::Ready;
+    }
+
+
+    static void start_proxy(DisplayState& state)
+    {
+        stop_proxy(state);
+
+        auto& proxy = state.proxy;
+
+        auto dims = state.src_dims();
+
+        proxy.scale = proxy_scale(dims.x, dims.y);
+        if (!proxy.scale)
+        {
+            return;
+        }
+
+        char name[48] = { 0 };
+        stb::qsnprintf(name, 48, "proxy_%016llx%s", (unsigned long long)file_fingerprint(state.src_video_filepath), VIDEO_EXTENSION);
+
+        proxy.src_path = state.src_video_filepath;
+        proxy.proxy_path = fs::path(PROXY_DIR) / name;
+
+        proxy.cancel = false;
+        proxy.frames_built = 0;
+        proxy.status = ProxyStatus::Building;
+
+        proxy.thread = std::thread(run_proxy, std::ref(proxy));
+    }
+
+
+    // back to the first frame, same lock as reload_video
+    static void reopen_proxy(DisplayState& state)
+    {
+        auto& proxy = state.proxy;
+
+        if (proxy.status != ProxyStatus::Ready)
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(state.vfx_mutex);
+
+        vid::close_video(proxy.proxy_video);
+
+        set_frame_pyramid(proxy.proxy_video);
+
+        if (!vid::open_video(proxy.proxy_video, proxy.proxy_path.string().c_str()))
+        {
+            proxy.status = ProxyStatus::Fail;
+        }
+    }
+
+
+    // the reader of the last play or generate, the source unless the proxy is still open
+    static vid::VideoReader& frame_reader(DisplayState& state)
+    {
+        auto proxy_ready = state.proxy.status == ProxyStatus::Ready;
+
+        return state.play_proxy && proxy_ready ? state.proxy.proxy_video : state.vms.src_video;
+    }
+
+
+    // play and generate continue from the last stepped frame
+    static void seek_scrub_frame(DisplayState& state, vid::VideoReader const& video)
+    {
+        if (state.scrub_seek)
+        {
+            state.scrub_seek = false;
+            vid::seek_frame(video, state.scrub_index);
+        }
+    }
+
+
     static bool load_video(DisplayState& state)
     {
         reset_video_status(state);
@@ -291,13 +564,30 @@ namespace internal
 
         state.vms.out_region = get_crop_rect(vms.out_position, w, h, vms.out_limit_region);
 
+        set_run_stats(state);
+
+        state.play_proxy = false;
+        start_proxy(state);
+
+        vid::clear_frame_cache(state.frame_cache);
+        state.scrub_index = 0;
+        state.scrub_seek = false;
+
         return true;
     }
 
 
+    // load_status is InProgress, the vfx thread no longer acquires frames once it has the lock
     static bool reload_video(DisplayState& state)
     {
-        vid::close_video(state.vms.src_video);
+        {
+            std::lock_guard<std::mutex> lock(state.vfx_mutex);
+            vid::close_video(state.vms.src_video);
+        }
+
+        // play sets it again when the proxy is ready
+        state.play_proxy = false;
+
         reset_video_status(state);
 
         if (!load_src_video(state.vms, state.src_video_filepath))
@@ -305,6 +595,12 @@ namespace internal
             return false;
         }
 
+        set_run_stats(state);
+
+        reopen_proxy(state);
+
+        state.scrub_seek = false;
+
         return true;
     }
 
@@ -320,30 +616,58 @@ namespace internal
     }
 
 
-    static void update_out_position(DisplayState& state)
+    // any ratio, from a view of src_w x src_h to one of dst_w x dst_h
+    static Rect2Du32 rect_scale_down(Rect2Du32 rect, u32 src_w, u32 src_h, u32 dst_w, u32 dst_h)
     {
-        if (!state.motion_on)
-        {
-            return;
-        }
+        rect.x_begin = (u32)((u64)rect.x_begin * dst_w / src_w);
+        rect.x_end = (u32)((u64)rect.x_end * dst_w / src_w);
+        rect.y_begin = (u32)((u64)rect.y_begin * dst_h / src_h);
+        rect.y_end = (u32)((u64)rect.y_end * dst_h / src_h);
+
+        return rect;
+    }
 
-        auto& vms = state.vms;
 
-        auto fp = vec::to_f32(vms.gm.src_location);
-        auto dp = vec::to_f32(vms.out_position);
+    static Point2Du32 move_position(Point2Du32 target, Point2Du32 position, f32 acc)
+    {
+        auto fp = vec::to_f32(target);
+        auto dp = vec::to_f32(position);
 
         auto d_px = vec::sub(fp, dp);
-        
-        auto acc = vms.out_position_acc;
 
         auto v_px = vec::mul(d_px, acc);
 
-        vms.out_position = vec::to_unsigned<u32>(vec::add(dp, v_px));
+        return vec::to_unsigned<u32>(vec::add(dp, v_px));
+    }
+
+
+    static void update_out_position(VideoMotionState& vms)
+    {
+        vms.out_position = move_position(vms.gm.src_location, vms.out_position, vms.out_position_acc);
+    }
+
+
+    // motion runs on the process level of a source or proxy frame,
+    // regions and positions stay in source coordinates
+    static void update_motion(VideoMotionState& vms, vid::VideoFrame const& frame)
+    {
+        auto src_w = vms.src_video.frame_width;
+        auto src_h = vms.src_video.frame_height;
+
+        auto gray = frame.pyramid ? img::pyramid_level(*frame.pyramid, PROCESS_LEVEL) : frame.gray;
+
+        motion::update(vms.gm, gray, rect_scale_down(vms.scan_region, src_w, src_h, gray.width, gray.height));
+
+        auto& location = vms.gm.src_location;
+        location.x = (u32)((u64)location.x * src_w / gray.width);
+        location.y = (u32)((u64)location.y * src_h / gray.height);
     }
 
 
     static void update_vfx(DisplayState& state)
     {
+        TRACE_ZONE("update_vfx");
+
         auto display_scale = state.display_scale();
 
         if (!display_scale || state.load_status != VideoLoadStatus::Loaded)
@@ -351,6 +675,8 @@ namespace internal
             return;
         }
 
+        state.frames_displayed = state.frames_processed.load();
+
         auto& vms = state.vms;
         auto& out_rect = vms.out_region;
         auto& proc_gray = vms.gm.proc_gray_view;
@@ -370,8 +696,34 @@ namespace internal
         }
         else
         {
-            auto gray = vid::current_frame(vms.src_video).gray;
-            img::map_scale_down(gray, state.vfx_view);
+            std::lock_guard<std::mutex> lock(state.vfx_mutex);
+
+            // a reload may have started since the check above
+            if (state.load_status != VideoLoadStatus::Loaded)
+            {
+                return;
+            }
+
+            auto& reader = frame_reader(state);
+            auto ref = vid::acquire_current_frame(reader);
+            if (!ref.frame.gray.matrix_data_)
+            {
+                // nothing decoded yet
+                img::fill(state.vfx_view, img::to_pixel(0));
+            }
+            else if (ref.frame.pyramid)
+            {
+                img::map(img::pyramid_level(*ref.frame.pyramid, VFX_LEVEL), state.vfx_view);
+            }
+            else if (ref.frame.gray.width == state.vfx_view.width)
+            {
+                img::map(ref.frame.gray, state.vfx_view);
+            }
+            else
+            {
+                img::map_scale_down(ref.frame.gray, state.vfx_view);
+            }
+            vid::release_frame(reader, ref);
         }
 
         if (state.show_out_region)
@@ -379,186 +731,1230 @@ namespace internal
             auto rect = rect_scale_down(vms.out_limit_region, display_scale);
             img::draw_rect(state.vfx_view, rect, dark_green, line_th);
 
-            rect = rect_scale_down(out_rect, display_scale);
-            img::draw_rect(state.vfx_view, rect, green, line_th);
+            rect = rect_scale_down(out_rect, display_scale);
+            img::draw_rect(state.vfx_view, rect, green, line_th);
+        }
+
+        if (state.show_scan_region)
+        {
+            auto rect = rect_scale_down(vms.scan_region, display_scale);
+            img::draw_rect(state.vfx_view, rect, red, line_th);
+        }
+
+        img::copy(state.vfx_view, state.display_vfx_view);
+    }
+
+
+    static void process_frame_read(DisplayState& state, vid::VideoFrame src_frame)
+    {
+        TRACE_ZONE("process_frame_read");
+
+        auto& vms = state.vms;
+        auto& out_rect = vms.out_region;
+        
+        auto src_rgba = src_frame.rgba;
+        auto out = state.out_view();
+
+        auto w = state.out_width;
+        auto h = state.out_height;
+
+        auto times = &state.display_times;
+
+        // 1 for the source, the proxy scale for a proxy frame
+        auto scale = vms.src_video.frame_width / src_rgba.width;
+
+        perf::record(times, DisplayStage::Frame, perf::elapsed_since(state.frame_time));
+        state.frame_time = perf::stamp();
+
+        {
+            perf::StageTimer timer(times, DisplayStage::Motion);
+
+            // the planes are only drawn with show_motion
+            vms.gm.write_proc_views = state.show_motion;
+
+            update_motion(vms, src_frame);
+        }
+
+        if (state.motion_on)
+        {
+            update_out_position(vms);
+        }
+
+        out_rect = get_crop_rect(vms.out_position, w, h, vms.out_limit_region);
+
+        if (scale > 1)
+        {
+            // the proxy crop goes straight to the preview
+            perf::StageTimer timer(times, DisplayStage::Preview);
+            img::resize(state.preview_plan, img::sub_view(src_rgba, rect_scale_down(out_rect, scale)), state.preview_dst);
+        }
+        else
+        {
+            {
+                perf::StageTimer timer(times, DisplayStage::Crop);
+                img::copy(img::sub_view(src_rgba, out_rect), out);
+            }
+            {
+                perf::StageTimer timer(times, DisplayStage::Preview);
+                img::resize(state.preview_plan, out, state.preview_dst);
+            }
+        }
+
+        state.frames_processed++;
+    }
+
+
+    static void process_frame_write(DisplayState& state, vid::VideoFrame src_frame, img::ImageView const& dst)
+    {
+        process_frame_read(state, src_frame);
+
+        img::copy(state.out_view(), dst);
+    }
+
+
+    // largest size of the target aspect up to 1080 lines
+    static Vec2Du32 target_out_size(OutTarget const& target, u32 src_w, u32 src_h)
+    {
+        u32 h = src_h < HEIGHT_1080P ? src_h : HEIGHT_1080P;
+        u32 w = h * target.aspect_w / target.aspect_h;
+        if (w > src_w)
+        {
+            w = src_w;
+            h = w * target.aspect_h / target.aspect_w;
+        }
+
+        // encoders want even dimensions
+        return { w & ~1u, h & ~1u };
+    }
+
+
+    static bool region_fits(Rect2Du32 region, Vec2Du32 size, u32 src_w, u32 src_h)
+    {
+        return 
+            region.x_end <= src_w && region.y_end <= src_h &&
+            region.x_begin + size.x <= region.x_end && 
+            region.y_begin + size.y <= region.y_end;
+    }
+
+
+    // a region that does not fit the out size becomes the main limit region, or the whole frame
+    static Rect2Du32 target_limit_region(OutTarget const& target, VideoMotionState const& vms, Vec2Du32 size)
+    {
+        auto src_w = vms.src_video.frame_width;
+        auto src_h = vms.src_video.frame_height;
+
+        if (region_fits(target.out_limit_region, size, src_w, src_h))
+        {
+            return target.out_limit_region;
+        }
+
+        if (region_fits(vms.out_limit_region, size, src_w, src_h))
+        {
+            return vms.out_limit_region;
+        }
+
+        return img::make_rect(src_w, src_h);
+    }
+
+    
+    static bool begin_out_targets(DisplayState& state)
+    {
+        auto& vms = state.vms;
+
+        auto src_w = vms.src_video.frame_width;
+        auto src_h = vms.src_video.frame_height;
+
+        for (u32 i = 0; i < N_OUT_TARGETS; i++)
+        {
+            auto& target = state.out_targets[i];
+            if (!target.enabled)
+            {
+                continue;
+            }
+
+            auto size = target_out_size(target, src_w, src_h);
+
+            target.out_width = size.x;
+            target.out_height = size.y;
+
+            target.out_position = vms.out_position;
+            target.out_limit_region = target_limit_region(target, vms, size);
+
+            char temp_name[32] = { 0 };
+            stb::qsnprintf(temp_name, 32, "vdtemp_target_%u.mp4", i);
+            target.temp_path = fs::path(OUT_VIDEO_DIR) / temp_name;
+
+            // stage times and frame counts stay with the main writer
+            target.dst_video.write_audio = state.dst_video.write_audio;
+            target.dst_video.stage_times = 0;
+            target.dst_video.frame_counts = 0;
+
+            auto temp_path = target.temp_path.string();
+            if (!vid::create_video(vms.src_video, target.dst_video, temp_path.c_str(), target.out_width, target.out_height))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+
+    static void end_out_targets(DisplayState& state)
+    {
+        for (auto& target : state.out_targets)
+        {
+            if (!target.dst_video.video_handle)
+            {
+                continue;
+            }
+
+            vid::save_and_close_video(target.dst_video);
+
+            char name[32] = { 0 };
+            stb::qsnprintf(name, 32, "out_video_%s", target.file_tag);
+            fs::rename(target.temp_path, timestamp_file_path(OUT_VIDEO_DIR, name, VIDEO_EXTENSION));
+        }
+    }
+
+
+    // renditions smaller than the main out video
+    static bool use_rendition(DisplayState const& state, Rendition const& rend)
+    {
+        return rend.enabled && rend.height < state.out_height;
+    }
+
+
+    static u32 rendition_gop_size(DisplayState const& state)
+    {
+        for (auto& rend : state.renditions)
+        {
+            if (use_rendition(state, rend))
+            {
+                auto gop = (u32)(state.vms.src_video.fps * RENDITION_GOP_SECONDS + 0.5);
+                return gop ? gop : 1;
+            }
+        }
+
+        return 0;
+    }
+
+
+    static bool begin_renditions(DisplayState& state, u32 gop_size)
+    {
+        auto& vms = state.vms;
+
+        for (u32 i = 0; i < N_RENDITIONS; i++)
+        {
+            auto& rend = state.renditions[i];
+            if (!use_rendition(state, rend))
+            {
+                continue;
+            }
+
+            // same aspect as the main crop, even dimensions
+            rend.out_width = (state.out_width * rend.height / state.out_height) & ~1u;
+            rend.out_height = rend.height & ~1u;
+
+            char temp_name[32] = { 0 };
+            stb::qsnprintf(temp_name, 32, "vdtemp_rendition_%u.mp4", i);
+            rend.temp_path = fs::path(OUT_VIDEO_DIR) / temp_name;
+
+            rend.dst_video.write_audio = state.dst_video.write_audio;
+            rend.dst_video.bit_rate = rend.bit_rate;
+            rend.dst_video.gop_size = gop_size;
+            rend.dst_video.stage_times = 0;
+            rend.dst_video.frame_counts = 0;
+
+            auto temp_path = rend.temp_path.string();
+            if (!vid::create_video(vms.src_video, rend.dst_video, temp_path.c_str(), rend.out_width, rend.out_height))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+
+    static void end_renditions(DisplayState& state)
+    {
+        for (auto& rend : state.renditions)
+        {
+            if (!rend.dst_video.video_handle)
+            {
+                continue;
+            }
+
+            vid::save_and_close_video(rend.dst_video);
+            img::destroy_resize_plan(rend.resize_plan);
+
+            char name[32] = { 0 };
+            stb::qsnprintf(name, 32, "out_video_%s", rend.label);
+            fs::rename(rend.temp_path, timestamp_file_path(OUT_VIDEO_DIR, name, VIDEO_EXTENSION));
+        }
+    }
+
+
+    // main writer first, then each open target writer, then each open rendition writer
+    static u32 get_writers(DisplayState& state, vid::VideoWriter* writers)
+    {
+        u32 n = 0;
+        writers[n++] = state.dst_video;
+
+        for (auto& target : state.out_targets)
+        {
+            if (target.dst_video.video_handle)
+            {
+                writers[n++] = target.dst_video;
+            }
+        }
+
+        for (auto& rend : state.renditions)
+        {
+            if (rend.dst_video.video_handle)
+            {
+                writers[n++] = rend.dst_video;
+            }
+        }
+
+        return n;
+    }
+
+
+    // returns the index of the first rendition view
+    static u32 process_frame_targets(DisplayState& state, vid::VideoFrame src_frame, SpanView<img::ImageView> const& dst_list)
+    {
+        process_frame_write(state, src_frame, dst_list.data[0]);
+
+        auto& vms = state.vms;
+
+        u32 d = 1;
+        for (auto& target : state.out_targets)
+        {
+            if (!target.dst_video.video_handle)
+            {
+                continue;
+            }
+
+            if (state.motion_on)
+            {
+                target.out_position = move_position(vms.gm.src_location, target.out_position, target.out_position_acc);
+            }
+
+            target.out_region = get_crop_rect(target.out_position, target.out_width, target.out_height, target.out_limit_region);
+
+            img::copy(img::sub_view(src_frame.rgba, target.out_region), dst_list.data[d++]);
+        }
+
+        return d;
+    }
+
+
+    // the main crop is scaled down once, each rendition is resized from the next larger one
+    static void process_frame_renditions(DisplayState& state, SpanView<img::ImageView> const& dst_list, u32 d)
+    {
+        TRACE_ZONE("process_frame_renditions");
+
+        perf::StageTimer timer(&state.display_times, DisplayStage::Ladder);
+
+        auto src = dst_list.data[0];
+
+        for (auto& rend : state.renditions)
+        {
+            if (!rend.dst_video.video_handle)
+            {
+                continue;
+            }
+
+            auto dst = dst_list.data[d++];
+            img::resize(rend.resize_plan, src, dst);
+            src = dst;
+        }
+    }
+
+
+    static void process_frame_list(DisplayState& state, vid::VideoFrame src_frame, SpanView<img::ImageView> const& dst_list)
+    {
+        auto d = process_frame_targets(state, src_frame, dst_list);
+
+        if (d < dst_list.length)
+        {
+            process_frame_renditions(state, dst_list, d);
+        }
+    }
+
+
+    static void play_video_slice(DisplayState& state);
+
+    static void generate_video_slice(DisplayState& state);
+
+
+    static bool submit_slice(DisplayState& state)
+    {
+        switch (state.play_status)
+        {
+        case VPS::Play:
+            return thread_pool::submit([&](){ play_video_slice(state); });
+
+        case VPS::Generate:
+            return thread_pool::submit([&](){ generate_video_slice(state); });
+
+        default:
+            return false;
+        }
+    }
+
+
+    // at most one reader task per state is queued or running
+    static void start_task(DisplayState& state)
+    {
+        if (!state.task_active.exchange(true) && !submit_slice(state))
+        {
+            state.task_active = false;
+        }
+    }
+
+
+    // called at the end of each slice, step and reload
+    static void next_task(DisplayState& state)
+    {
+        if (submit_slice(state))
+        {
+            return;
+        }
+
+        state.task_active = false;
+
+        // status may have changed while ending
+        start_task(state);
+    }
+
+
+    static void play_video_slice(DisplayState& state)
+    {
+        TRACE_ZONE("play_video_slice");
+
+        auto& src_video = frame_reader(state);
+
+        seek_scrub_frame(state, src_video);
+
+        u32 n_frames = 0;
+
+        auto const proc = [&](auto const& fr_src)
+        {
+            process_frame_read(state, fr_src);
+            n_frames++;
+        };
+
+        auto const cond = [&](){ return state.play_status == VPS::Play && n_frames < SLICE_FRAMES; };
+
+        state.frame_time = perf::stamp();
+
+        if (vid::process_video(src_video, proc, cond))
+        {
+            reset_video_status(state);
+            state.play_status = VPS::Pause;
+        }
+        else if (cond())
+        {
+            // stopped before cond did, the frame buffers could not be created
+            state.play_status = VPS::Pause;
+        }
+
+        next_task(state);
+    }
+
+
+    class RunInfo
+    {
+    public:
+        fs::path src_path;
+        fs::path out_path;
+
+        perf::Elapsed run;
+    };
+
+
+    static void write_json_string(FILE* file, cstr str)
+    {
+        std::fputc('"', file);
+
+        for (auto c = str; *c; c++)
+        {
+            switch (*c)
+            {
+            case '"':  std::fputs("\\\"", file); break;
+            case '\\': std::fputs("\\\\", file); break;
+            case '\n': std::fputs("\\n", file); break;
+            case '\t': std::fputs("\\t", file); break;
+
+            default:
+                if ((u8)*c < 0x20)
+                {
+                    std::fprintf(file, "\\u%04x", (u32)(u8)*c);
+                }
+                else
+                {
+                    std::fputc(*c, file);
+                }
+            }
+        }
+
+        std::fputc('"', file);
+    }
+
+
+    static void write_stage(FILE* file, cstr sep, perf::StageTimes const& times, u32 stage, cstr name)
+    {
+        auto sum = perf::summarize(times, stage);
+
+        std::fprintf(file, 
+            "%s\n    { \"stage\": \"%s\", \"count\": %u, \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"p50_ms\": %.3f, \"p95_ms\": %.3f, \"max_ms\": %.3f }",
+            sep, name, sum.total_count, sum.total_wall_ms, sum.total_cpu_ms, sum.p50_ms, sum.p95_ms, sum.max_ms);
+    }
+
+
+    // writes <out_path>.json next to the generated video
+    static bool write_run_report(DisplayState const& state, RunInfo const& info)
+    {
+        using VS = vid::VideoStage;
+        using MS = motion::MotionStage;
+        using DS = DisplayStage;
+
+        auto& src = state.vms.src_video;
+        auto& counts = state.frame_counts;
+
+        auto report_path = info.out_path;
+        report_path.replace_extension(".json");
+
+        auto file = std::fopen(report_path.string().c_str(), "w");
+        if (!file)
+        {
+            return false;
+        }
+
+        std::error_code ec;
+        u64 src_bytes = fs::file_size(info.src_path, ec);
+        src_bytes = ec ? 0 : src_bytes;
+
+        u64 out_bytes = fs::file_size(info.out_path, ec);
+        out_bytes = ec ? 0 : out_bytes;
+
+        f64 duration_s = src.fps > 0.0 ? counts.encoded / src.fps : 0.0;
+        f64 bitrate = duration_s > 0.0 ? out_bytes * 8.0 / duration_s : 0.0;
+        f64 fps = info.run.wall_ms > 0.0f ? counts.encoded * 1000.0 / info.run.wall_ms : 0.0;
+
+        std::fprintf(file, "{\n");
+
+        std::fprintf(file, "  \"input\": {\n    \"path\": ");
+        write_json_string(file, info.src_path.string().c_str());
+        std::fprintf(file, ",\n    \"fingerprint\": \"%016llx\",\n", (unsigned long long)file_fingerprint(info.src_path));
+        std::fprintf(file, "    \"bytes\": %llu,\n", (unsigned long long)src_bytes);
+        std::fprintf(file, "    \"width\": %u,\n    \"height\": %u,\n    \"fps\": %.3f\n  },\n", src.frame_width, src.frame_height, src.fps);
+
+        std::fprintf(file, "  \"output\": {\n    \"path\": ");
+        write_json_string(file, info.out_path.string().c_str());
+        std::fprintf(file, ",\n    \"width\": %u,\n    \"height\": %u,\n", state.out_width, state.out_height);
+        std::fprintf(file, "    \"bytes\": %llu,\n", (unsigned long long)out_bytes);
+        std::fprintf(file, "    \"duration_s\": %.3f,\n    \"bitrate_bps\": %.0f\n  },\n", duration_s, bitrate);
+
+        std::fprintf(file, "  \"frames\": { \"decoded\": %llu, \"skipped\": %llu, \"encoded\": %llu },\n",
+            (unsigned long long)counts.decoded, (unsigned long long)counts.skipped, (unsigned long long)counts.encoded);
+
+        std::fprintf(file, "  \"run\": { \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"fps\": %.3f },\n", info.run.wall_ms, info.run.cpu_ms, fps);
+
+        auto& vt = state.video_times;
+        auto& mt = state.motion_times;
+        auto& dt = state.display_times;
+
+        std::fprintf(file, "  \"stages\": [");
+        write_stage(file, "",  vt, (u32)VS::Decode,    "decode");
+        write_stage(file, ",", vt, (u32)VS::Capture,   "capture");
+        write_stage(file, ",", dt, (u32)DS::Motion,    "motion");
+        write_stage(file, ",", mt, (u32)MS::Resize,    "motion.resize");
+        write_stage(file, ",", mt, (u32)MS::Gradients, "motion.gradients");
+        write_stage(file, ",", mt, (u32)MS::Motion,    "motion.motion");
+        write_stage(file, ",", mt, (u32)MS::Centroid,  "motion.centroid");
+        write_stage(file, ",", dt, (u32)DS::Crop,      "crop");
+        write_stage(file, ",", dt, (u32)DS::Preview,   "preview");
+        write_stage(file, ",", dt, (u32)DS::Ladder,    "renditions");
+        write_stage(file, ",", vt, (u32)VS::Convert,   "convert");
+        write_stage(file, ",", vt, (u32)VS::Encode,    "encode");
+        write_stage(file, ",", vt, (u32)VS::Mux,       "mux");
+        write_stage(file, ",", dt, (u32)DS::Frame,     "frame");
+        std::fprintf(file, "\n  ],\n");
+
+        auto mem_stats = mem::query_memory_stats();
+
+        std::fprintf(file, "  \"memory\": {\n    \"peak_bytes\": %llu,\n    \"complete\": %s,\n    \"tags\": [",
+            (unsigned long long)mem_stats.bytes_peak, mem_stats.complete ? "true" : "false");
+        for (u32 i = 0; i < mem_stats.n_tags; i++)
+        {
+            auto& ts = mem_stats.tags[i];
+
+            std::fprintf(file, "%s\n      { \"tag\": ", i ? "," : "");
+            write_json_string(file, ts.tag);
+            std::fprintf(file, ", \"peak_bytes\": %llu, \"allocations\": %u }", (unsigned long long)ts.bytes_peak, ts.n_allocations);
+        }
+        std::fprintf(file, "\n    ]\n  }\n}\n");
+
+        std::fclose(file);
+
+        return true;
+    }
+
+
+    static bool begin_generate_video(DisplayState& state)
+    {
+        img::fill(state.display_preview_view, img::to_pixel(0));
+
+        reset_run_stats(state);
+        state.run_begin = perf::stamp();
+        state.run_cpu_ms = 0.0;
+
+        auto& src_video = state.vms.src_video;
+        auto& dst_video = state.dst_video;
+
+        // keyframes line up with the renditions
+        auto gop_size = rendition_gop_size(state);
+        dst_video.gop_size = gop_size;
+
+        if (!vid::create_video(src_video, dst_video, OUT_VIDEO_TEMP_PATH, state.out_width, state.out_height))
+        {
+            return false;
+        }
+
+        return begin_out_targets(state) && begin_renditions(state, gop_size);
+    }
+
+
+    static void end_generate_video(DisplayState& state)
+    {
+        auto& src_video = state.vms.src_video;
+        auto& dst_video = state.dst_video;
+
+        // encode threads of the writer list are not in the slice cpu times
+        vid::VideoWriter writers[1 + N_OUT_TARGETS + N_RENDITIONS];
+        auto n_writers = get_writers(state, writers);
+        for (u32 i = 0; i < n_writers; i++)
+        {
+            state.run_cpu_ms += vid::encode_cpu_ms(writers[i]);
+        }
+
+        reset_video_status(state);
+        vid::close_video(src_video);
+        vid::save_and_close_video(dst_video);
+        end_out_targets(state);
+        end_renditions(state);
+
+        auto out_path = timestamp_file_path(OUT_VIDEO_DIR, "out_video", VIDEO_EXTENSION);
+        fs::rename(OUT_VIDEO_TEMP_PATH, out_path);
+
+        if (state.write_run_report)
+        {
+            RunInfo info{};
+            info.src_path = state.src_video_filepath;
+            info.out_path = out_path;
+            info.run.wall_ms = perf::ms_since(state.run_begin.wall);
+            info.run.cpu_ms = (f32)state.run_cpu_ms;
+
+            write_run_report(state, info);
+        }
+    }
+
+
+    static void generate_video_slice(DisplayState& state)
+    {
+        TRACE_ZONE("generate_video_slice");
+
+        auto slice_begin = perf::stamp();
+
+        auto& src_video = state.vms.src_video;
+        auto& dst_video = state.dst_video;
+
+        // a paused video continues with the same writer
+        if (!dst_video.video_handle && !begin_generate_video(state))
+        {
+            assert("*** vid::create_video ***" && false);
+            state.play_status = VPS::Pause;
+            next_task(state);
+            return;
+        }
+
+        seek_scrub_frame(state, src_video);
+
+        u32 n_frames = 0;
+
+        auto const proc = [&](auto const& fr_src, auto const& v_out)
+        {
+            process_frame_write(state, fr_src, v_out);
+            n_frames++;
+        };
+
+        auto const proc_list = [&](auto const& fr_src, auto const& v_out_list)
+        {
+            process_frame_list(state, fr_src, v_out_list);
+            n_frames++;
+        };
+
+        auto const cond = [&](){ return state.play_status == VPS::Generate && n_frames < SLICE_FRAMES; };
+
+        state.frame_time = perf::stamp();
+
+        vid::VideoWriter writers[1 + N_OUT_TARGETS + N_RENDITIONS];
+
+        SpanView<vid::VideoWriter> writer_list{};
+        writer_list.data = writers;
+        writer_list.length = get_writers(state, writers);
+
+        bool done = false;
+
+        if (writer_list.length > 1)
+        {
+            done = vid::process_video(src_video, writer_list, proc_list, cond);
+        }
+        else
+        {
+            done = vid::process_video(src_video, dst_video, proc, cond);
+        }
+
+        // slices run on different workers, cpu time is only valid per slice
+        state.run_cpu_ms += perf::elapsed_since(slice_begin).cpu_ms;
+
+        if (done)
+        {
+            end_generate_video(state);
+            state.play_status = VPS::Pause;
+        }
+        else if (cond())
+        {
+            // stopped before cond did, the frame buffers could not be created
+            state.play_status = VPS::Pause;
+        }
+
+        next_task(state);
+    }
+
+
+    void load_video_async(DisplayState& state)
+    {
+        auto const load = [&]()
+        {
+            TRACE_ZONE("load_video");
+
+            state.load_status = VLS::InProgress;
+            auto ok = load_video(state);
+            if (ok)
+            {
+                state.load_status = VLS::Loaded;
+                state.play_status = VPS::Pause;
+            }
+            else
+            {
+                state.load_status = VLS::NotLoaded;
+                state.play_status = VPS::NotLoaded;
+            }            
+        };
+
+        thread_pool::submit(load);
+    }
+
+
+    void reload_video_async(DisplayState& state)
+    {
+        // closes the reader, wait for any slice or step
+        if (state.task_active.exchange(true))
+        {
+            return;
+        }
+
+        auto const load = [&]()
+        {
+            TRACE_ZONE("reload_video");
+
+            state.load_status = VLS::InProgress;
+            auto ok = reload_video(state);
+            if (ok)
+            {
+                state.load_status = VLS::Loaded;
+                state.play_status = VPS::Pause;
+            }
+            else
+            {
+                state.load_status = VLS::NotLoaded;
+                state.play_status = VPS::NotLoaded;
+            }
+
+            next_task(state);
+        };
+
+        if (!thread_pool::submit(load))
+        {
+            state.task_active = false;
+        }
+    }
+
+
+    void play_video_async(DisplayState& state)
+    {
+        using VPS = VideoPlayStatus;
+
+        // a step or the last slice still owns the reader
+        if (state.play_status != VPS::Pause || state.task_active)
+        {
+            return;
+        }
+
+        img::fill(state.display_preview_view, img::to_pixel(0));
+
+        auto& proxy = state.proxy;
+
+        state.play_proxy = state.use_proxy && proxy.status == ProxyStatus::Ready;
+        if (state.play_proxy)
+        {
+            proxy.proxy_video.stage_times = &state.video_times;
+            proxy.proxy_video.frame_counts = &state.frame_counts;
+        }
+
+        state.play_status = VPS::Play;
+        start_task(state);
+    }
+
+
+    void generate_video_async(DisplayState& state)
+    {
+        using VPS = VideoPlayStatus;
+
+        if (state.play_status != VPS::Pause || state.task_active)
+        {
+            return;
+        }
+
+        state.play_proxy = false;
+
+        state.play_status = VPS::Generate;
+        start_task(state);
+    }
+
+
+    // FNV-1a of the path and modified time, a changed file gets a new strip
+    static fs::path thumb_file_path(fs::path const& src_path)
+    {
+        std::error_code ec;
+        auto mtime = fs::last_write_time(src_path, ec).time_since_epoch().count();
+        if (ec)
+        {
+            return {};
+        }
+
+        auto path_str = src_path.string();
+
+        auto hash = fnv1a(FNV_OFFSET, (u8 const*)path_str.data(), path_str.size());
+        hash = fnv1a(hash, (u8 const*)&mtime, sizeof(mtime));
+
+        char name[48] = { 0 };
+        stb::qsnprintf(name, 48, "thumbs_%016llx.png", (unsigned long long)hash);
+
+        return fs::path(THUMB_DIR) / name;
+    }
+
+
+    static void build_thumb_strip(ThumbStrip& thumbs)
+    {
+        TRACE_ZONE("build_thumb_strip");
+
+        constexpr u32 strip_w = N_THUMBS * THUMB_WIDTH;
+        constexpr u32 strip_h = THUMB_HEIGHT;
+
+        auto thumb_path = thumb_file_path(thumbs.src_path);
+        auto thumb_str = thumb_path.string();
+        auto src_str = thumbs.src_path.string();
+
+        if (!vid::probe_video(src_str.c_str(), thumbs.info))
+        {
+            thumbs.status = ThumbStatus::Fail;
+            return;
+        }
+
+        std::error_code ec;
+
+        if (!thumb_path.empty() && fs::exists(thumb_path, ec) && img::read_image(thumbs.strip, thumb_str.c_str(), "thumb strip"))
+        {
+            if (thumbs.strip.width == strip_w && thumbs.strip.height == strip_h)
+            {
+                thumbs.status = ThumbStatus::Ready;
+                return;
+            }
+
+            // written with other thumbnail dimensions
+            img::destroy_image(thumbs.strip);
+        }
+
+        if (!img::create_image(thumbs.strip, strip_w, strip_h, "thumb strip"))
+        {
+            thumbs.status = ThumbStatus::Fail;
+            return;
+        }
+
+        auto view = img::make_view(thumbs.strip);
+
+        if (!vid::make_thumbnail_strip(src_str.c_str(), view, N_THUMBS))
+        {
+            thumbs.status = ThumbStatus::Fail;
+            return;
+        }
+
+        if (!thumb_path.empty())
+        {
+            fs::create_directories(THUMB_DIR, ec);
+            img::write_image(view, thumb_str.c_str());
+        }
+
+        thumbs.status = ThumbStatus::Ready;
+    }
+
+
+    static ThumbStrip* find_thumb_strip(DisplayState& state, fs::path const& src_path)
+    {
+        for (auto& thumbs : state.thumb_strips)
+        {
+            // the path is set before the status
+            if (thumbs.status != ThumbStatus::Empty && thumbs.src_path == src_path)
+            {
+                return &thumbs;
+            }
+        }
+
+        return 0;
+    }
+
+
+    // ui thread only
+    static ThumbStrip* add_thumb_strip(DisplayState& state, fs::path const& src_path)
+    {
+        auto found = find_thumb_strip(state, src_path);
+        if (found)
+        {
+            return found;
+        }
+
+        for (auto& thumbs : state.thumb_strips)
+        {
+            if (thumbs.status != ThumbStatus::Empty)
+            {
+                continue;
+            }
+
+            thumbs.src_path = src_path;
+            thumbs.status = ThumbStatus::Building;
+
+            if (!thread_pool::submit([&thumbs](){ build_thumb_strip(thumbs); }))
+            {
+                thumbs.status = ThumbStatus::Fail;
+            }
+
+            return &thumbs;
+        }
+
+        return 0;
+    }
+
+
+    // the strip scaled to the bottom of the video window with a mark at frame_index
+    static void draw_timeline(DisplayState& state, u64 frame_index)
+    {
+        auto thumbs = find_thumb_strip(state, state.src_video_filepath);
+        if (!thumbs || thumbs->status != ThumbStatus::Ready)
+        {
+            return;
+        }
+
+        constexpr auto red = img::to_pixel(255, 0, 0);
+        constexpr u32 mark_w = 2;
+
+        auto view = state.display_src_view;
+        auto y = view.height - TIMELINE_HEIGHT;
+
+        img::resize(img::make_view(thumbs->strip), img::sub_view(view, img::make_rect(0, y, view.width, TIMELINE_HEIGHT)));
+
+        auto& video = state.vms.src_video;
+        auto n_frames = video.fps * video.duration_s;
+        if (n_frames < 1.0)
+        {
+            return;
+        }
+
+        auto x = (u32)(frame_index / n_frames * view.width);
+        x = x < view.width - mark_w ? x : view.width - mark_w;
+
+        img::fill(img::sub_view(view, img::make_rect(x, y, mark_w, TIMELINE_HEIGHT)), red);
+    }
+
+
+    void scan_thumbs_async(DisplayState& state)
+    {
+        std::error_code ec;
+
+        for (auto const& entry : fs::directory_iterator(SRC_VIDEO_DIR, ec))
+        {
+            auto& path = entry.path();
+            if (entry.is_regular_file(ec) && path.extension() == VIDEO_EXTENSION)
+            {
+                add_thumb_strip(state, path);
+            }
+        }
+    }
+
+
+    // probed by the thumbnail task, no need to open the video
+    void selected_video_info(DisplayState& state)
+    {
+        auto thumbs = find_thumb_strip(state, state.src_video_filepath);
+        if (!thumbs || thumbs->status != ThumbStatus::Ready)
+        {
+            return;
+        }
+
+        auto& info = thumbs->info;
+
+        ImGui::Text("%ux%u %3.1f fps %.1f s%s", info.frame_width, info.frame_height, info.fps, info.duration_s, info.has_audio ? " audio" : "");
+    }
+
+
+    // keyframes of the selected video until it is loaded
+    void update_thumb_preview(DisplayState& state)
+    {
+        auto& path = state.src_video_filepath;
+
+        if (path.empty() || state.load_status != VLS::NotLoaded || path == state.thumb_preview_path)
+        {
+            return;
+        }
+
+        auto thumbs = add_thumb_strip(state, path);
+        if (!thumbs || thumbs->status != ThumbStatus::Ready)
+        {
+            return;
+        }
+
+        constexpr u32 n_cols = DISPLAY_FRAME_WIDTH / THUMB_WIDTH;
+        constexpr u32 n_rows = (N_THUMBS + n_cols - 1) / n_cols;
+
+        auto view = state.display_src_view;
+        auto strip = img::make_view(thumbs->strip);
+
+        u32 y_begin = (view.height - n_rows * THUMB_HEIGHT) / 2;
+
+        img::fill(view, img::to_pixel(0));
+
+        for (u32 i = 0; i < N_THUMBS; i++)
+        {
+            auto x = (i % n_cols) * THUMB_WIDTH;
+            auto y = y_begin + (i / n_cols) * THUMB_HEIGHT;
+
+            auto src = img::sub_view(strip, img::make_rect(i * THUMB_WIDTH, 0, THUMB_WIDTH, THUMB_HEIGHT));
+            auto dst = img::sub_view(view, img::make_rect(x, y, THUMB_WIDTH, THUMB_HEIGHT));
+
+            img::copy(src, dst);
+        }
+
+        state.thumb_preview_path = path;
+    }
+
+
+    void step_frame_async(DisplayState& state, i32 n_frames)
+    {
+        if (state.play_status != VPS::Pause || state.task_active.exchange(true))
+        {
+            return;
+        }
+
+        auto const step = [&state, n_frames]()
+        {
+            TRACE_ZONE("step_frame");
+
+            auto& video = frame_reader(state);
+
+            if (!state.scrub_seek)
+            {
+                state.scrub_index = vid::current_frame_index(video);
+            }
+
+            auto index = state.scrub_index;
+            if (n_frames < 0)
+            {
+                index = index > (u64)(-n_frames) ? index + n_frames : 0;
+            }
+            else
+            {
+                index += n_frames;
+            }
+
+            if (vid::read_cached_frame(state.frame_cache, video, index, state.display_src_view))
+            {
+                state.scrub_index = index;
+                draw_timeline(state, index);
+            }
+
+            // a miss moves the reader
+            state.scrub_seek = true;
+
+            next_task(state);
+        };
+
+        if (!thread_pool::submit(step))
+        {
+            state.task_active = false;
+        }
+    }
+
+
+    static bool load_session(VideoSession& session)
+    {
+        auto& vms = session.vms;
+
+        if (!load_src_video(vms, session.src_path))
+        {
+            return false;
         }
 
-        if (state.show_scan_region)
+        if (!init_vms(vms))
         {
-            auto rect = rect_scale_down(vms.scan_region, display_scale);
-            img::draw_rect(state.vfx_view, rect, red, line_th);
+            assert("*** init_vms ***" && false);
+            return false;
         }
 
-        img::copy(state.vfx_view, state.display_vfx_view);
+        auto src_w = vms.src_video.frame_width;
+        auto src_h = vms.src_video.frame_height;
+
+        auto w = num::clamp(session.out_width, DISPLAY_FRAME_HEIGHT, src_w);
+        auto h = num::clamp(session.out_height, DISPLAY_FRAME_HEIGHT, src_h);
+
+        session.out_width = w;
+        session.out_height = h;
+
+        vms.out_region = get_crop_rect(vms.out_position, w, h, vms.out_limit_region);
+
+        vms.src_video.frame_counts = &session.frame_counts;
+        session.dst_video.frame_counts = &session.frame_counts;
+
+        return vid::create_video(vms.src_video, session.dst_video, session.temp_path.string().c_str(), w, h);
     }
 
 
-    static void process_frame_read(DisplayState& state, vid::VideoFrame src_frame)
+    static void process_session_frame(VideoSession& session, vid::VideoFrame src_frame, img::ImageView const& dst)
     {
-        auto& vms = state.vms;
-        auto& out_rect = vms.out_region;
-        
-        auto src_gray = src_frame.gray;
-        auto src_rgba = src_frame.rgba;
-        auto out = state.out_view();
+        auto& vms = session.vms;
 
-        auto w = state.out_width;
-        auto h = state.out_height;
+        update_motion(vms, src_frame);
 
-        motion::update(vms.gm, src_gray, vms.scan_region);
-        update_out_position(state);
+        if (session.motion_on)
+        {
+            update_out_position(vms);
+        }
 
-        out_rect = get_crop_rect(vms.out_position, w, h, vms.out_limit_region);
-        img::copy(img::sub_view(src_rgba, out_rect), out);
-        img::resize(out, state.preview_dst);
+        vms.out_region = get_crop_rect(vms.out_position, session.out_width, session.out_height, vms.out_limit_region);
+
+        img::copy(img::sub_view(src_frame.rgba, vms.out_region), dst);
     }
 
 
-    static void process_frame_write(DisplayState& state, vid::VideoFrame src_frame, img::ImageView const& dst)
+    static void end_session(VideoSession& session)
     {
-        process_frame_read(state, src_frame);
+        vid::close_video(session.vms.src_video);
+        vid::save_and_close_video(session.dst_video);
 
-        img::copy(state.out_view(), dst);
+        auto name = "out_" + session.src_path.stem().string();
+        auto out_path = timestamp_file_path(OUT_VIDEO_DIR, name.c_str(), VIDEO_EXTENSION);
+        fs::rename(session.temp_path, out_path);
+
+        session.status = SessionStatus::Done;
     }
 
-    
-    static void process_play_video(DisplayState& state)
+
+    // each slice requeues itself behind the other sessions
+    static void session_slice(VideoSession& session)
     {
-        img::fill(state.display_preview_view, img::to_pixel(0));
+        TRACE_ZONE("session_slice");
 
-        auto& src_video = state.vms.src_video;
+        u32 n_frames = 0;
 
-        auto const proc = [&](auto const& fr_src)
+        auto const proc = [&](auto const& fr_src, auto const& v_out)
         {
-            process_frame_read(state, fr_src);            
+            process_session_frame(session, fr_src, v_out);
+            n_frames++;
         };
 
-        auto const cond = [&](){ return state.play_status == VPS::Play; };        
+        auto const cond = [&](){ return session.status == SessionStatus::Generate && n_frames < SLICE_FRAMES; };
 
-        if (vid::process_video(src_video, proc, cond))
+        if (vid::process_video(session.vms.src_video, session.dst_video, proc, cond))
         {
-            reset_video_status(state);
+            end_session(session);
+            return;
         }
-    }
-
-
-    static void process_generate_video(DisplayState& state)
-    {
-        img::fill(state.display_preview_view, img::to_pixel(0));
-
-        auto& src_video = state.vms.src_video;
-        auto& dst_video = state.dst_video;
 
-        auto temp_path = OUT_VIDEO_TEMP_PATH;
-        auto ok = vid::create_video(src_video, dst_video, temp_path, state.out_width, state.out_height);
-        if (!ok)
+        if (cond())
         {
-            assert("*** vid::create_video ***" && false);
+            // stopped before cond did, the frame buffers could not be created
+            session.status = SessionStatus::Fail;
             return;
         }
 
-        auto const proc = [&](auto const& fr_src, auto const& v_out)
-        {
-            process_frame_write(state, fr_src, v_out);
-        };
-
-        auto const cond = [&](){ return state.play_status == VPS::Generate; };   
-
-        if (vid::process_video(src_video, dst_video, proc, cond))
+        if (session.status == SessionStatus::Generate)
         {
-            reset_video_status(state);
-            vid::close_video(src_video);
-            vid::save_and_close_video(dst_video);
-            fs::rename(temp_path, timestamp_file_path(OUT_VIDEO_DIR, "out_video", VIDEO_EXTENSION));
+            thread_pool::submit([&](){ session_slice(session); });
         }
     }
 
 
-    void load_video_async(DisplayState& state)
+    void add_sessions_async(DisplayState& state)
     {
-        auto const load = [&]()
-        {
-            state.load_status = VLS::InProgress;
-            auto ok = load_video(state);
-            if (ok)
-            {
-                state.load_status = VLS::Loaded;
-                state.play_status = VPS::Pause;
-            }
-            else
-            {
-                state.load_status = VLS::NotLoaded;
-                state.play_status = VPS::NotLoaded;
-            }            
-        };
+        using SS = SessionStatus;
 
-        std::thread th(load);
-        th.detach();
-    }
+        u32 out_w = state.out_width ? state.out_width : WIDTH_720P;
+        u32 out_h = state.out_height ? state.out_height : HEIGHT_720P;
 
+        u32 i = 0;
 
-    void reload_video_async(DisplayState& state)
-    {
-        auto const load = [&]()
+        for (auto const& path : state.fb_sessions.GetMultiSelected())
         {
-            state.load_status = VLS::InProgress;
-            auto ok = reload_video(state);
-            if (ok)
+            for (; i < MAX_SESSIONS && state.sessions[i].status != SS::Empty; i++)
+            { }
+
+            if (i >= MAX_SESSIONS)
             {
-                state.load_status = VLS::Loaded;
-                state.play_status = VPS::Pause;
+                return;
             }
-            else
-            {
-                state.load_status = VLS::NotLoaded;
-                state.play_status = VPS::NotLoaded;
-            }            
-        };
-
-        std::thread th(load);
-        th.detach();
-    }
 
+            auto& session = state.sessions[i];
 
-    void play_video_async(DisplayState& state)
-    {
-        using VPS = VideoPlayStatus;
-
-        if (state.play_status != VPS::Pause)
-        {
-            return;
-        }
+            char temp_name[32] = { 0 };
+            stb::qsnprintf(temp_name, 32, "vdtemp_%u.mp4", i);
 
-        auto const play = [&]()
-        {
-            state.play_status = VPS::Play;
-            process_play_video(state);
-            state.play_status = VPS::Pause;
-        };
+            session.src_path = path;
+            session.temp_path = fs::path(OUT_VIDEO_DIR) / temp_name;
+            session.out_width = out_w;
+            session.out_height = out_h;
+            session.motion_on = state.motion_on;
+            session.status = SS::Loading;
 
-        std::thread th(play);
-        th.detach();
-    }
+            auto const load = [&session]()
+            {
+                TRACE_ZONE("load_session");
 
+                if (!load_session(session))
+                {
+                    session.status = SS::Fail;
+                    return;
+                }
 
-    void generate_video_async(DisplayState& state)
-    {
-        using VPS = VideoPlayStatus;
+                session.status = SS::Generate;
+                session_slice(session);
+            };
 
-        if (state.play_status != VPS::Pause)
-        {
-            return;
+            thread_pool::submit(load);
         }
-
-        auto const gen = [&]()
-        {
-            state.play_status = VPS::Generate;
-            process_generate_video(state);
-            state.play_status = VPS::Pause;
-        };
-
-        std::thread th(gen);
-        th.detach();
     }
 
 
@@ -602,12 +1998,27 @@ namespace internal
             "%6.4f"
         );
 
+        ImGui::Text("Mask filter");
+        int open_radius = (int)vms.gm.edge_motion.open_radius;
+        if (ImGui::SliderInt("Remove noise", &open_radius, 0, 3))
+        {
+            vms.gm.edge_motion.open_radius = (u32)open_radius;
+        }
+
+        int close_radius = (int)vms.gm.edge_motion.close_radius;
+        if (ImGui::SliderInt("Fill gaps", &close_radius, 0, 3))
+        {
+            vms.gm.edge_motion.close_radius = (u32)close_radius;
+        }
+
         if (ImGui::Button("Reset##motion_detection_settings"))
         {
             state.motion_on = true;
             state.show_motion = true;
             vms.gm.edge_motion.motion_sensitivity = 0.9f;
             vms.gm.edge_motion.locate_sensitivity = 0.98;
+            vms.gm.edge_motion.open_radius = 0;
+            vms.gm.edge_motion.close_radius = 0;
             vms.out_position_acc = 0.15f;
         }
     }
@@ -794,6 +2205,48 @@ namespace internal
     }
 
 
+    // begin or end of one axis, the range stays at least min_size
+    static void drag_limit_range(cstr label, u32& begin, u32& end, u32 min_size, u32 max)
+    {
+        int b = (int)begin;
+        int e = (int)end;
+
+        ImGui::DragIntRange2(label, &b, &e, 4, 0, (int)max, "Min: %d", "Max: %d");
+
+        if (b != (int)begin)
+        {
+            begin = (u32)num::clamp(b, 0, (int)(end - min_size));
+        }
+        else if (e != (int)end)
+        {
+            end = (u32)num::clamp(e, (int)(begin + min_size), (int)max);
+        }
+    }
+
+
+    // the limit region of an extra target, never smaller than its out size
+    static void target_region_settings(DisplayState& state, OutTarget& target)
+    {
+        auto& vms = state.vms;
+
+        auto src_w = vms.src_video.frame_width;
+        auto src_h = vms.src_video.frame_height;
+
+        auto size = target_out_size(target, src_w, src_h);
+
+        auto& region = target.out_limit_region;
+        if (!region_fits(region, size, src_w, src_h))
+        {
+            region = target_limit_region(target, vms, size);
+        }
+
+        ImGui::Text("%ux%u", size.x, size.y);
+
+        drag_limit_range("Limit X", region.x_begin, region.x_end, size.x, src_w);
+        drag_limit_range("Limit Y", region.y_begin, region.y_end, size.y, src_h);
+    }
+
+
     void out_video_settings(DisplayState& state)
     {
         ImGui::SeparatorText("Out Video");
@@ -904,16 +2357,262 @@ namespace internal
             state.vms.out_region = get_crop_rect(vms.out_position, w, h, vms.out_limit_region);
         }
 
+        ImGui::Checkbox("Write run report", &state.write_run_report);
+
+        ImGui::SeparatorText("Extra Targets");
+
+        for (u32 i = 0; i < N_OUT_TARGETS; i++)
+        {
+            auto& target = state.out_targets[i];
+
+            ImGui::PushID((int)i);
+
+            ImGui::Checkbox(target.label, &target.enabled);
+
+            if (target.enabled)
+            {
+                ImGui::SameLine();
+                ImGui::SliderFloat("Movement", &target.out_position_acc, 0.05f, 0.5f, "%6.4f");
+
+                target_region_settings(state, target);
+            }
+
+            ImGui::PopID();
+        }
+
+        ImGui::SeparatorText("Renditions");
+
+        for (u32 i = 0; i < N_RENDITIONS; i++)
+        {
+            auto& rend = state.renditions[i];
+
+            ImGui::PushID((int)(N_OUT_TARGETS + i));
+
+            ImGui::Checkbox(rend.label, &rend.enabled);
+            ImGui::SameLine();
+
+            if (rend.height < state.out_height)
+            {
+                ImGui::Text("%4.1f Mbps", rend.bit_rate / 1000000.0);
+            }
+            else
+            {
+                ImGui::TextDisabled("not below out height");
+            }
+
+            ImGui::PopID();
+        }
+
         if (combo_disabled) { ImGui::EndDisabled(); }
     }
 
 
+    static void stage_row(perf::StageTimes const& times, u32 stage, cstr label)
+    {
+        auto sum = perf::summarize(times, stage);
+
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::Text("%s", label);
+        ImGui::TableNextColumn();
+        ImGui::Text("%7.2f", sum.last_ms);
+        ImGui::TableNextColumn();
+        ImGui::Text("%7.2f", sum.p50_ms);
+        ImGui::TableNextColumn();
+        ImGui::Text("%7.2f", sum.p95_ms);
+        ImGui::TableNextColumn();
+        ImGui::Text("%7.2f", sum.max_ms);
+    }
+
+
+    void performance_stats(DisplayState& state)
+    {
+        using VS = vid::VideoStage;
+        using MS = motion::MotionStage;
+        using DS = DisplayStage;
+
+        auto& vt = state.video_times;
+        auto& mt = state.motion_times;
+        auto& dt = state.display_times;
+
+        ImGui::SeparatorText("Stages (ms)");
+
+        auto flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg;
+
+        if (ImGui::BeginTable("stage_table", 5, flags))
+        {
+            ImGui::TableSetupColumn("stage");
+            ImGui::TableSetupColumn("last");
+            ImGui::TableSetupColumn("p50");
+            ImGui::TableSetupColumn("p95");
+            ImGui::TableSetupColumn("max");
+            ImGui::TableHeadersRow();
+
+            stage_row(vt, (u32)VS::Decode,    "demux/decode");
+            stage_row(vt, (u32)VS::Capture,   "capture_frame");
+            stage_row(dt, (u32)DS::Motion,    "motion::update");
+            stage_row(mt, (u32)MS::Resize,    "  resize");
+            stage_row(mt, (u32)MS::Gradients, "  gradients");
+            stage_row(mt, (u32)MS::Motion,    "  motion");
+            stage_row(mt, (u32)MS::Centroid,  "  centroid");
+            stage_row(dt, (u32)DS::Crop,      "crop copy");
+            stage_row(dt, (u32)DS::Preview,   "preview resize");
+            stage_row(dt, (u32)DS::Ladder,    "rendition resize");
+            stage_row(vt, (u32)VS::Convert,   "colour convert");
+            stage_row(vt, (u32)VS::Encode,    "encode");
+            stage_row(vt, (u32)VS::Mux,       "mux");
+            stage_row(dt, (u32)DS::Frame,     "frame");
+
+            ImGui::EndTable();
+        }
+
+        auto frame = perf::summarize(dt, DS::Frame);
+        auto fps = frame.mean_ms > 0.0f ? 1000.0f / frame.mean_ms : 0.0f;
+
+        ImGui::Text("fps: %5.1f achieved / %5.1f source", fps, state.src_fps());
+
+        ImGui::SeparatorText("Queues");
+
+        auto n_behind = state.frames_processed.load() - state.frames_displayed.load();
+
+        ImGui::Text("vfx frames behind: %u", n_behind);
+
+        {
+            // same lock as the vfx thread, the reader is not closed while it is counted
+            std::lock_guard<std::mutex> lock(state.vfx_mutex);
+
+            if (state.load_status == VideoLoadStatus::Loaded)
+            {
+                auto& reader = frame_reader(state);
+                auto n_frames = reader.n_pool_frames;
+
+                ImGui::Text("frame pool: %u/%u in use", n_frames - vid::n_free_frames(reader), n_frames);
+            }
+        }
+
+        ImGui::Text("thread pool: %u queued tasks", thread_pool::n_queued());
+
+        // applied by each stage on its next record
+        if (ImGui::Button("Reset##performance_stats"))
+        {
+            perf::reset(vt);
+            perf::reset(mt);
+            perf::reset(dt);
+        }
+
+#ifdef TRACE_ZONES
+
+        ImGui::SeparatorText("Trace");
+
+        if (ImGui::Button("Save##performance_stats_trace"))
+        {
+            auto trace_path = fs::path(OUT_VIDEO_DIR) / "trace.json";
+            TRACE_WRITE(trace_path.string().c_str());
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Clear##performance_stats_trace"))
+        {
+            TRACE_CLEAR();
+        }
+
+#endif
+    }
+
+
+    static cstr session_status_str(SessionStatus status)
+    {
+        using SS = SessionStatus;
+
+        switch (status)
+        {
+        case SS::Empty: return "";
+        case SS::Loading: return "loading";
+        case SS::Generate: return "generating";
+        case SS::Done: return "done";
+        case SS::Fail: return "failed";
+        default: return "";
+        }
+    }
+
+
+    void session_list(DisplayState& state)
+    {
+        using SS = SessionStatus;
+
+        ImGui::SameLine();
+        if (ImGui::Button("Clear finished"))
+        {
+            for (auto& session : state.sessions)
+            {
+                auto status = session.status.load();
+                if (status == SS::Done || status == SS::Fail)
+                {
+                    destroy_session(session);
+                }
+            }
+        }
+
+        ImGui::Text("workers: %u  queued tasks: %u", thread_pool::n_workers(), thread_pool::n_queued());
+
+        auto flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg;
+
+        if (ImGui::BeginTable("session_table", 4, flags))
+        {
+            ImGui::TableSetupColumn("video");
+            ImGui::TableSetupColumn("out");
+            ImGui::TableSetupColumn("status");
+            ImGui::TableSetupColumn("frames");
+            ImGui::TableHeadersRow();
+
+            for (auto& session : state.sessions)
+            {
+                auto status = session.status.load();
+                if (status == SS::Empty)
+                {
+                    continue;
+                }
+
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::Text("%s", session.src_path.filename().string().c_str());
+                ImGui::TableNextColumn();
+                ImGui::Text("%ux%u", session.out_width, session.out_height);
+                ImGui::TableNextColumn();
+                ImGui::Text("%s", session_status_str(status));
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", (unsigned long long)session.frame_counts.encoded);
+            }
+
+            ImGui::EndTable();
+        }
+    }
+
+
+    void stop_proxy(DisplayState& state)
+    {
+        auto& proxy = state.proxy;
+
+        proxy.cancel = true;
+        if (proxy.thread.joinable())
+        {
+            proxy.thread.join();
+        }
+
+        vid::close_video(proxy.proxy_video);
+
+        proxy.status = ProxyStatus::None;
+        proxy.scale = 0;
+    }
+
+
     void start_vfx(DisplayState& state)
     {
         state.vfx_running = true;
 
         auto const run = [&]()
         {
+            TRACE_THREAD("vfx");
+
             Stopwatch sw;
             sw.start();
             while (state.vfx_running)
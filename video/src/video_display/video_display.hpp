@@ -4,8 +4,12 @@
 #include "../../../libs/imgui/imfilebrowser.hpp"
 #include "../../../libs/video/video.hpp"
 #include "../../../libs/video/motion.hpp"
+#include "../../../libs/thread_pool/thread_pool.hpp"
 
 #include <filesystem>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 namespace fs = std::filesystem;
 
@@ -35,6 +39,10 @@ namespace video_display
     constexpr u32 PROCESS_IMAGE_WIDTH = DISPLAY_FRAME_WIDTH / 2;
     constexpr u32 PROCESS_IMAGE_HEIGHT = DISPLAY_FRAME_HEIGHT / 2;
 
+    // gray pyramid levels of each decoded frame, level 1 is the display frame
+    constexpr u32 VFX_LEVEL = 1;
+    constexpr u32 PROCESS_LEVEL = 2;
+
     constexpr u32 OUT_SIZES[] = {
         DISPLAY_FRAME_HEIGHT,
         DISPLAY_FRAME_WIDTH,
@@ -46,12 +54,49 @@ namespace video_display
         WIDTH_4K
     };
 
+    // frames processed per task before yielding to other sessions
+    constexpr u32 SLICE_FRAMES = 8;
+
+    constexpr u32 MAX_SESSIONS = 8;
+
+    // additional crops rendered from the same decode as the main out video
+    constexpr u32 N_OUT_TARGETS = 3;
+
+    // smaller encodes of the main crop, e.g. for adaptive streaming
+    constexpr u32 N_RENDITIONS = 3;
+
+    // keyframe interval of the main out video and its renditions
+    constexpr f64 RENDITION_GOP_SECONDS = 2.0;
+
+    static_assert(1 + N_OUT_TARGETS + N_RENDITIONS <= vid::MAX_WRITERS);
+
     constexpr auto VIDEO_EXTENSION = ".mp4";
 
     constexpr auto SRC_VIDEO_DIR = "/home/adam/Videos/src";
     constexpr auto OUT_VIDEO_TEMP_PATH = "/home/adam/Repos/VideoDoctor/video/build/vdtemp.mp4";
     constexpr auto OUT_VIDEO_DIR = "/home/adam/Repos/VideoDoctor/video/build/";
 
+    // low res all keyframe copies of sources for play mode, named by source fingerprint
+    constexpr auto PROXY_DIR = "/home/adam/Repos/VideoDoctor/video/build/proxy/";
+
+    constexpr u32 PROXY_WIDTH = DISPLAY_FRAME_WIDTH;
+    constexpr u32 PROXY_HEIGHT = DISPLAY_FRAME_HEIGHT;
+    constexpr i64 PROXY_BIT_RATE = 4000000;
+
+    // keyframe strips of source videos, named by path and modified time
+    constexpr auto THUMB_DIR = "/home/adam/Repos/VideoDoctor/video/build/thumbs/";
+
+    constexpr u32 N_THUMBS = 8;
+    constexpr u32 THUMB_WIDTH = DISPLAY_FRAME_WIDTH / 4;
+    constexpr u32 THUMB_HEIGHT = DISPLAY_FRAME_HEIGHT / 4;
+    constexpr u32 MAX_THUMB_STRIPS = 64;
+
+    // strip drawn along the bottom of the video window while stepping
+    constexpr u32 TIMELINE_HEIGHT = THUMB_HEIGHT / 2;
+
+    // decoded frames at display resolution for stepping while paused
+    constexpr u64 FRAME_CACHE_BYTES = 128ull * 1024 * 1024;
+
 
     enum class VideoLoadStatus : u8
     {
@@ -71,6 +116,28 @@ namespace video_display
     };
 
 
+    enum class SessionStatus : u8
+    {
+        Empty = 0,
+        Loading,
+        Generate,
+        Done,
+        Fail
+    };
+
+
+    enum class DisplayStage : u32
+    {
+        Motion = 0, // motion::update
+        Crop,       // crop copy to out image
+        Preview,    // preview resize
+        Ladder,     // rendition resizes
+        Frame,      // time between processed frames
+
+        Count
+    };
+
+
     class VideoMotionState
     {
     public:
@@ -96,6 +163,138 @@ namespace video_display
     }
 
 
+    class OutTarget
+    {
+    public:
+        cstr label = "";
+        cstr file_tag = "";
+
+        u32 aspect_w = 1;
+        u32 aspect_h = 1;
+
+        bool enabled = false;
+
+        u32 out_width = 0;
+        u32 out_height = 0;
+
+        Point2Du32 out_position;
+        f32 out_position_acc = 0.15f;
+
+        // set in the out video settings, the main limit region when it does not fit the out size
+        Rect2Du32 out_limit_region;
+        Rect2Du32 out_region;
+
+        vid::VideoWriter dst_video;
+        fs::path temp_path;
+    };
+
+
+    // the main crop at a lower height and bit rate
+    class Rendition
+    {
+    public:
+        cstr label = "";
+
+        u32 height = 0;
+        i64 bit_rate = 0;
+
+        bool enabled = false;
+
+        u32 out_width = 0;
+        u32 out_height = 0;
+
+        vid::VideoWriter dst_video;
+        fs::path temp_path;
+
+        // from the next larger out video
+        img::ResizePlan resize_plan;
+    };
+
+
+    enum class ProxyStatus : u32
+    {
+        None = 0,
+        Building,
+        Ready,
+        Fail
+    };
+
+
+    // built on its own thread, source coordinates are proxy coordinates * scale
+    class ProxyVideo
+    {
+    public:
+        u32 scale = 0;
+
+        fs::path src_path;
+        fs::path proxy_path;
+
+        vid::VideoReader proxy_video;
+
+        std::thread thread;
+        std::atomic<bool> cancel = false;
+        std::atomic<ProxyStatus> status = ProxyStatus::None;
+
+        std::atomic<u32> frames_built = 0;
+    };
+
+
+    enum class ThumbStatus : u32
+    {
+        Empty = 0,
+        Building,
+        Ready,
+        Fail
+    };
+
+
+    class ThumbStrip
+    {
+    public:
+        fs::path src_path;
+
+        vid::VideoInfo info;
+
+        // N_THUMBS cells of THUMB_WIDTH x THUMB_HEIGHT
+        img::Image strip;
+
+        std::atomic<ThumbStatus> status = ThumbStatus::Empty;
+    };
+
+
+    // a background render with its own reader, motion state and writer
+    class VideoSession
+    {
+    public:
+
+        VideoMotionState vms;
+
+        vid::VideoWriter dst_video;
+
+        fs::path src_path;
+        fs::path temp_path;
+
+        u32 out_width = 0;
+        u32 out_height = 0;
+
+        bool motion_on = true;
+
+        vid::FrameCounts frame_counts;
+
+        std::atomic<SessionStatus> status = SessionStatus::Empty;
+    };
+
+
+    inline void destroy_session(VideoSession& session)
+    {
+        destroy_vms(session.vms);
+        vid::close_video(session.dst_video);
+
+        vid::reset(session.frame_counts);
+        session.status = SessionStatus::Empty;
+    }
+
+
     class DisplayState
     {
     public:
@@ -128,6 +327,7 @@ namespace video_display
         u32 out_width;
         u32 out_height;
         img::SubView preview_dst;
+        img::ResizePlan preview_plan;
 
         img::ImageView out_view() { return img::make_view(out_image); }
 
@@ -143,6 +343,51 @@ namespace video_display
         bool show_out_region;
 
         bool vfx_running;
+
+        // held by the vfx thread while it holds a frame, and by reload while it closes a reader
+        std::mutex vfx_mutex;
+
+        bool write_run_report;
+
+        // a play, generate, step or reload task is queued or running, only one drives the frame reader
+        std::atomic<bool> task_active;
+
+        perf::Stamp run_begin;
+        f64 run_cpu_ms;
+
+        OutTarget out_targets[N_OUT_TARGETS];
+
+        // largest first, each resized from the one before
+        Rendition renditions[N_RENDITIONS];
+
+        ProxyVideo proxy;
+
+        // play mode reads the proxy when it is ready, generate always reads the source
+        bool use_proxy;
+        bool play_proxy;
+
+        // slots are assigned on the ui thread, strips are built on the thread pool
+        ThumbStrip thumb_strips[MAX_THUMB_STRIPS];
+        fs::path thumb_preview_path;
+
+        // stepped frames are shown in the video window, play and generate continue from scrub_index
+        vid::FrameCache frame_cache;
+        u64 scrub_index;
+        bool scrub_seek;
+
+        VideoSession sessions[MAX_SESSIONS];
+        ImGui::FileBrowser fb_sessions{ ImGuiFileBrowserFlags_MultipleSelection };
+
+        perf::StageTimes video_times;
+        perf::StageTimes motion_times;
+        perf::StageTimes display_times;
+
+        perf::Stamp frame_time;
+
+        vid::FrameCounts frame_counts;
+
+        std::atomic<u32> frames_processed;
+        std::atomic<u32> frames_displayed;
     };
 }
 
@@ -182,7 +427,23 @@ namespace internal
 
     void out_video_settings(DisplayState& state);
 
+    void performance_stats(DisplayState& state);
+
     void start_vfx(DisplayState& state);
+
+    void stop_proxy(DisplayState& state);
+
+    void step_frame_async(DisplayState& state, i32 n_frames);
+
+    void scan_thumbs_async(DisplayState& state);
+
+    void update_thumb_preview(DisplayState& state);
+
+    void selected_video_info(DisplayState& state);
+
+    void add_sessions_async(DisplayState& state);
+
+    void session_list(DisplayState& state);
 }
 }
 
@@ -192,9 +453,40 @@ namespace video_display
     inline void destroy(DisplayState& state)
     { 
         state.vfx_running = false;
+        state.play_status = VideoPlayStatus::Pause;
+        
+        thread_pool::shutdown();
+
+        internal::stop_proxy(state);
+
+        vid::destroy_frame_cache(state.frame_cache);
+
+        for (auto& thumbs : state.thumb_strips)
+        {
+            img::destroy_image(thumbs.strip);
+        }
+
+        for (auto& session : state.sessions)
+        {
+            destroy_session(session);
+        }
+
         destroy_vms(state.vms);
         
         vid::close_video(state.dst_video); //!
+
+        for (auto& target : state.out_targets)
+        {
+            vid::close_video(target.dst_video);
+        }
+
+        for (auto& rend : state.renditions)
+        {
+            vid::close_video(rend.dst_video);
+            img::destroy_resize_plan(rend.resize_plan);
+        }
+
+        img::destroy_resize_plan(state.preview_plan);
         
         mb::destroy_buffer(state.display_buffer32);
         img::destroy_image(state.out_image);
@@ -239,8 +531,60 @@ namespace video_display
 
         state.vfx_running = false;
 
+        state.write_run_report = true;
+
+        state.task_active = false;
+
+        state.use_proxy = true;
+        state.play_proxy = false;
+
+        state.scrub_index = 0;
+        state.scrub_seek = false;
+
+        if (!vid::create_frame_cache(state.frame_cache, display_w, display_h, FRAME_CACHE_BYTES))
+        {
+            return false;
+        }
+
+        auto const set_target = [&](u32 i, cstr label, cstr file_tag, u32 aspect_w, u32 aspect_h)
+        {
+            auto& target = state.out_targets[i];
+            target.label = label;
+            target.file_tag = file_tag;
+            target.aspect_w = aspect_w;
+            target.aspect_h = aspect_h;
+        };
+
+        set_target(0, "9:16 vertical", "9x16", 9, 16);
+        set_target(1, "1:1 square", "1x1", 1, 1);
+        set_target(2, "4:5 portrait", "4x5", 4, 5);
+
+        auto const set_rendition = [&](u32 i, cstr label, u32 height, i64 bit_rate)
+        {
+            auto& rend = state.renditions[i];
+            rend.label = label;
+            rend.height = height;
+            rend.bit_rate = bit_rate;
+        };
+
+        set_rendition(0, "1080p", HEIGHT_1080P, 5000000);
+        set_rendition(1, "720p", HEIGHT_720P, 2800000);
+        set_rendition(2, "480p", 480, 1200000);
+
+        auto& fb_sessions = state.fb_sessions;
+        fb_sessions.SetTitle("Session Videos");
+        fb_sessions.SetTypeFilters({VIDEO_EXTENSION});
+        fb_sessions.SetDirectory(fs::path(SRC_VIDEO_DIR));
+
+        if (!thread_pool::init(0))
+        {
+            return false;
+        }
+
         internal::start_vfx(state);
 
+        internal::scan_thumbs_async(state);
+
         return true;
     }    
 }
@@ -262,9 +606,12 @@ namespace video_display
         auto open_disabled = state.play_status == VPS::Play;
         auto load_disabled = state.play_status == VPS::Play;
         auto play_pause_disabled = state.load_status != VLS::Loaded;
+        auto task_disabled = state.task_active.load();
 
         ImGui::Begin("Video");
 
+        internal::update_thumb_preview(state);
+
         ImGui::Image(texture, dims);
 
         if (open_disabled) { ImGui::BeginDisabled(); }
@@ -278,7 +625,7 @@ namespace video_display
         ImGui::SameLine();
         ImGui::Text("file: %s", state.src_video_filepath.string().c_str());
 
-        if (load_disabled) { ImGui::BeginDisabled(); }
+        if (load_disabled || task_disabled) { ImGui::BeginDisabled(); }
 
         if (state.load_status == VLS::NotLoaded)
         {
@@ -295,7 +642,7 @@ namespace video_display
             }
         }
 
-        if (load_disabled) { ImGui::EndDisabled(); }
+        if (load_disabled || task_disabled) { ImGui::EndDisabled(); }
 
         if (play_pause_disabled) { ImGui::BeginDisabled(); }
 
@@ -306,6 +653,8 @@ namespace video_display
         }
         else if (state.play_status == VPS::Pause)
         {
+            if (task_disabled) { ImGui::BeginDisabled(); }
+
             ImGui::SameLine();            
             if (ImGui::Button("Play"))
             {
@@ -320,6 +669,29 @@ namespace video_display
 
             ImGui::SameLine(); 
             ImGui::Checkbox("Audio", &state.dst_video.write_audio);
+
+            ImGui::SameLine();
+            if (ImGui::Button("<"))
+            {
+                internal::step_frame_async(state, -1);
+            }
+
+            ImGui::SameLine();
+            if (ImGui::Button(">"))
+            {
+                internal::step_frame_async(state, 1);
+            }
+
+            if (task_disabled) { ImGui::EndDisabled(); }
+
+            if (state.scrub_seek)
+            {
+                auto& cache = state.frame_cache;
+
+                ImGui::SameLine();
+                ImGui::Text("frame %llu (%u cached, %u/%u hit/miss)", (unsigned long long)state.scrub_index, 
+                    vid::n_cached_frames(cache), cache.n_hits.load(), cache.n_misses.load());
+            }
         }
         else if (state.play_status == VPS::Play || state.play_status == VPS::Generate)
         {
@@ -337,7 +709,35 @@ namespace video_display
         auto src_h = src_dims.y;
         auto src_fps = state.src_fps();        
 
-        ImGui::Text("%ux%u %3.1f fps", src_w, src_h, src_fps);
+        if (state.load_status == VLS::Loaded)
+        {
+            ImGui::Text("%ux%u %3.1f fps", src_w, src_h, src_fps);
+        }
+        else
+        {
+            internal::selected_video_info(state);
+        }
+
+        auto& proxy = state.proxy;
+
+        switch (proxy.status.load())
+        {
+        case ProxyStatus::Building:
+            ImGui::Text("proxy: building %u frames", proxy.frames_built.load());
+            break;
+
+        case ProxyStatus::Ready:
+            ImGui::Text("proxy: %ux%u", PROXY_WIDTH, PROXY_HEIGHT);
+            ImGui::SameLine();
+            ImGui::Checkbox("Play proxy", &state.use_proxy);
+            break;
+
+        case ProxyStatus::Fail:
+            ImGui::Text("proxy: failed");
+            break;
+
+        default: break;
+        }
        
         ImGui::End();
         
@@ -393,5 +793,37 @@ namespace video_display
     }
 
 
+    void video_performance_window(DisplayState& state)
+    {
+        ImGui::Begin("Performance");
+
+        internal::performance_stats(state);
+
+        ImGui::End();
+    }
+
+
+    void video_sessions_window(DisplayState& state)
+    {
+        ImGui::Begin("Sessions");
+
+        if (ImGui::Button("Add videos"))
+        {
+            state.fb_sessions.Open();
+        }
+
+        internal::session_list(state);
+
+        ImGui::End();
+
+        state.fb_sessions.Display();
+        if (state.fb_sessions.HasSelected())
+        {
+            internal::add_sessions_async(state);
+            state.fb_sessions.ClearSelected();
+        }
+    }
+
+
 
 }
\ No newline at end of file
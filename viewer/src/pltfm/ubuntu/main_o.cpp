@@ -3,5 +3,6 @@
 #include "../../../../libs/alloc_type/alloc_type.cpp"
 #include "../../../../libs/image/image.cpp"
 #include "../../../../libs/span/span.cpp"
+#include "../../../../libs/thread_pool/thread_pool.cpp"
 #include "../../../../libs/stb_libs/stb_libs.cpp"
 #include "../../../../libs/video/video.cpp"
\ No newline at end of file